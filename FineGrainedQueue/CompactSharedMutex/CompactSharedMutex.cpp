@@ -0,0 +1,201 @@
+#include "CompactSharedMutex.h"
+#include <cassert>
+#include <chrono>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+
+void CompactSharedMutex::lockSlow()
+{
+  for (size_t spin=0; ; ++spin){
+    uint32_t state = state_.load(std::memory_order_relaxed);
+    if (!(state & (WRITER | READERS))){
+      if (state_.compare_exchange_weak(state, state | WRITER,
+                                       std::memory_order_acquire,
+                                       std::memory_order_relaxed)){
+        return;
+      }
+      continue;
+    }
+    if (spin < SPIN_COUNT){
+      cpuRelax();
+      continue;
+    }
+    sleep(state);
+  }
+}
+
+
+
+void CompactSharedMutex::lockSharedSlow()
+{
+  for (size_t spin=0; ; ++spin){
+    if (try_lock_shared()){
+      return;
+    }
+    if (spin < SPIN_COUNT){
+      cpuRelax();
+      continue;
+    }
+    const uint32_t state = state_.load(std::memory_order_relaxed);
+    if (state & WRITER){
+      sleep(state);
+    }
+  }
+}
+
+
+
+void CompactSharedMutex::wakeAll()
+{
+  state_.notify_all();
+}
+
+
+
+void CompactSharedMutex::sleep(uint32_t state)
+{
+  //Бит WAITERS выставляется до засыпания: освобождение mutex увидит его
+  //и разбудит. Если состояние уже изменилось - захват повторяется
+  if (!(state & WAITERS) &&
+      !state_.compare_exchange_strong(state, state | WAITERS, std::memory_order_relaxed)){
+    return;
+  }
+  state_.wait(state | WAITERS, std::memory_order_relaxed);
+}
+
+
+
+//=============================================================================
+static void testOnethread();
+static void testWaiting();
+static void testMultithread();
+
+
+void compact_shared_mutex::test()
+{
+  testOnethread();
+  testWaiting();
+  testMultithread();
+}
+
+
+
+static void testOnethread()
+{
+  static_assert(sizeof(CompactSharedMutex) == 4);
+
+  CompactSharedMutex mutex;
+  mutex.lock();
+  assert(!mutex.try_lock());
+  assert(!mutex.try_lock_shared());
+  mutex.unlock();
+
+  //Несколько захватов на чтение одновременно
+  mutex.lock_shared();
+  assert(mutex.try_lock_shared());
+  assert(!mutex.try_lock());
+  mutex.unlock_shared();
+  assert(!mutex.try_lock());
+  mutex.unlock_shared();
+  assert(mutex.try_lock());
+  mutex.unlock();
+
+  //Совместимость с обёртками стандартной библиотеки
+  {
+    std::unique_lock<CompactSharedMutex> lock(mutex);
+    assert(!mutex.try_lock_shared());
+  }
+  {
+    std::shared_lock<CompactSharedMutex> lock(mutex);
+    assert(!mutex.try_lock());
+  }
+  CompactSharedMutex other;
+  std::lock(mutex, other);
+  mutex.unlock();
+  other.unlock();
+}
+
+
+
+static void testWaiting()
+{
+  //Поток засыпает на занятом mutex и просыпается при освобождении:
+  //удержание дольше активного ожидания
+  CompactSharedMutex mutex;
+  std::atomic<int> acquired(0);
+  mutex.lock();
+  std::thread writer([&](){
+    mutex.lock();
+    ++acquired;
+    mutex.unlock();
+  });
+  std::thread reader([&](){
+    mutex.lock_shared();
+    ++acquired;
+    mutex.unlock_shared();
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  assert(acquired == 0);
+  mutex.unlock();
+  writer.join();
+  reader.join();
+  assert(acquired == 2);
+
+  //Монопольный захват ждёт освобождения последнего читателя
+  acquired = 0;
+  mutex.lock_shared();
+  mutex.lock_shared();
+  std::thread waiting([&](){
+    mutex.lock();
+    ++acquired;
+    mutex.unlock();
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  mutex.unlock_shared();
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  assert(acquired == 0);
+  mutex.unlock_shared();
+  waiting.join();
+  assert(acquired == 1);
+}
+
+
+
+static void testMultithread()
+{
+  //Писатели меняют пару значений монопольно, читатели проверяют,
+  //что не видят промежуточного состояния
+  CompactSharedMutex mutex;
+  long first = 0;
+  long second = 0;
+  const int COUNT = 20000;
+  std::atomic<bool> done(false);
+  std::vector<std::thread> threads;
+  for (int i=0; i<2; ++i){
+    threads.emplace_back([&](){
+      for (int j=0; j<COUNT; ++j){
+        std::lock_guard<CompactSharedMutex> lock(mutex);
+        ++first;
+        ++second;
+      }
+    });
+  }
+  for (int i=0; i<2; ++i){
+    threads.emplace_back([&](){
+      while (!done){
+        std::shared_lock<CompactSharedMutex> lock(mutex);
+        assert(first == second);
+      }
+    });
+  }
+  threads[0].join();
+  threads[1].join();
+  done = true;
+  threads[2].join();
+  threads[3].join();
+  assert(first == 2*COUNT);
+  assert(second == 2*COUNT);
+}
@@ -0,0 +1,144 @@
+/**
+\file CompactSharedMutex.h
+\brief Класс - mutex с захватом на чтение в одном 32-битном слове
+
+- Замена std::shared_mutex (56 байт в glibc) для mutex элемента списка:
+  4 байта на элемент вместо 56
+- Слово состояния: бит монопольного захвата, бит "есть спящие потоки"
+  и количество захватов на чтение
+- Захват без ожидания - один compare_exchange. При занятом mutex поток
+  сначала ждёт активно (захваты элементов короткие), затем засыпает
+  на слове состояния (std::atomic::wait - futex в Linux)
+- Как и std::shared_mutex в glibc, предпочтение отдаётся читателям:
+  захват на чтение не ждёт потоков, ожидающих монопольного захвата
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+
+//Пауза активного ожидания: не занимает ресурсы соседнего
+//аппаратного потока ядра
+inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+
+
+class CompactSharedMutex{
+  public:
+    CompactSharedMutex() = default;
+    CompactSharedMutex(const CompactSharedMutex& other) = delete;
+    CompactSharedMutex& operator=(const CompactSharedMutex& other) = delete;
+
+    void lock();
+    bool try_lock();
+    void unlock();
+
+    void lock_shared();
+    bool try_lock_shared();
+    void unlock_shared();
+
+  private:
+    static constexpr uint32_t WRITER = 1u << 31;      //Захвачен монопольно
+    static constexpr uint32_t WAITERS = 1u << 30;     //Есть спящие потоки
+    static constexpr uint32_t READERS = WAITERS - 1;  //Маска количества читателей
+    //Сколько раз проверить состояние, прежде чем заснуть
+    static constexpr size_t SPIN_COUNT = 64;
+
+    void lockSlow();
+    void lockSharedSlow();
+    void wakeAll();
+
+    /**
+    Заснуть, пока состояние равно state (с выставленным битом WAITERS)
+    \param[in] state Состояние, при котором захват невозможен
+    */
+    void sleep(uint32_t state);
+
+    std::atomic<uint32_t> state_{0};
+};
+
+
+
+inline bool CompactSharedMutex::try_lock()
+{
+  //Бит WAITERS сохраняется: его сбросит освобождение mutex
+  uint32_t state = state_.load(std::memory_order_relaxed) & WAITERS;
+  return state_.compare_exchange_strong(state, state | WRITER,
+                                        std::memory_order_acquire,
+                                        std::memory_order_relaxed);
+}
+
+
+
+inline void CompactSharedMutex::lock()
+{
+  if (!try_lock()){
+    lockSlow();
+  }
+}
+
+
+
+inline void CompactSharedMutex::unlock()
+{
+  //Под монопольным захватом читателей нет: остаётся только бит WAITERS
+  if (state_.exchange(0, std::memory_order_release) & WAITERS){
+    wakeAll();
+  }
+}
+
+
+
+inline bool CompactSharedMutex::try_lock_shared()
+{
+  uint32_t state = state_.load(std::memory_order_relaxed);
+  while (!(state & WRITER)){
+    if (state_.compare_exchange_weak(state, state + 1,
+                                     std::memory_order_acquire,
+                                     std::memory_order_relaxed)){
+      return true;
+    }
+  }
+  return false;
+}
+
+
+
+inline void CompactSharedMutex::lock_shared()
+{
+  if (!try_lock_shared()){
+    lockSharedSlow();
+  }
+}
+
+
+
+inline void CompactSharedMutex::unlock_shared()
+{
+  const uint32_t state = state_.fetch_sub(1, std::memory_order_release) - 1;
+  //Последний читатель будит потоки, ждущие монопольного захвата
+  if (state == WAITERS){
+    uint32_t expected = WAITERS;
+    //При неудаче mutex уже захвачен снова - разбудит его освобождение
+    if (state_.compare_exchange_strong(expected, 0, std::memory_order_relaxed)){
+      wakeAll();
+    }
+  }
+}
+
+
+
+namespace compact_shared_mutex{
+  /**
+  Протестировать компактный mutex
+  */
+  void test();
+}
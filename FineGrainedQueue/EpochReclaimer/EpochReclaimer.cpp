@@ -0,0 +1,439 @@
+#include "EpochReclaimer.h"
+#include <cassert>
+#include <chrono>
+#include <thread>
+#include <utility>
+
+
+thread_local EpochReclaimer::ThreadHandle EpochReclaimer::handle_;
+
+
+
+EpochReclaimer::Guard::Guard()
+{
+  EpochReclaimer::instance().enter();
+}
+
+
+
+EpochReclaimer::Guard::~Guard()
+{
+  EpochReclaimer::instance().leave();
+}
+
+
+
+EpochReclaimer& EpochReclaimer::instance()
+{
+  //Объект не разрушается: объекты удаляются и после выхода из main()
+  static EpochReclaimer* reclaimer = new EpochReclaimer();
+  return *reclaimer;
+}
+
+
+
+void EpochReclaimer::retire(void* object, Deleter deleter)
+{
+  ThreadRecord* record = threadRecord();
+  const uint64_t epoch = epoch_.load();
+  //В ячейке корзины - эпоха не новее epoch-3, её объекты уже можно удалить
+  Bag& bag = record->bags[epoch % BAG_COUNT];
+  if (bag.epoch != epoch){
+    record->freed.store(record->freed.load(std::memory_order_relaxed) + freeBag(bag),
+                        std::memory_order_relaxed);
+    bag.epoch = epoch;
+  }
+  bag.objects.push_back(Retired{object, deleter});
+  record->retired.store(record->retired.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_relaxed);
+
+  if (++record->retiredSinceCollect >= COLLECT_PERIOD){
+    collect();
+  }
+}
+
+
+
+void EpochReclaimer::defer(std::function<void()> task)
+{
+  const uint64_t epoch = epoch_.load();
+  std::lock_guard<std::mutex> lock(mutexDeferred_);
+  deferred_.push_back(Deferred{epoch, std::move(task)});
+  if (!workerStarted_){
+    //Поток не присоединяется: объект существует до завершения программы
+    std::thread(&EpochReclaimer::runDeferred, this).detach();
+    workerStarted_ = true;
+  }
+  deferredReady_.notify_one();
+}
+
+
+
+size_t EpochReclaimer::collect()
+{
+  ThreadRecord* record = threadRecord();
+  record->retiredSinceCollect = 0;
+  const uint64_t epoch = tryAdvance();
+
+  size_t freed = 0;
+  for (Bag& bag : record->bags){
+    if (!bag.objects.empty() && bag.epoch + 2 <= epoch){
+      freed += freeBag(bag);
+    }
+  }
+  record->freed.store(record->freed.load(std::memory_order_relaxed) + freed,
+                      std::memory_order_relaxed);
+
+  //Корзины завершившихся потоков освобождает тот, кто первым захватит mutex
+  std::unique_lock<std::mutex> lock(mutexOrphans_, std::try_to_lock);
+  if (lock){
+    size_t orphansFreed = 0;
+    for (size_t i=0; i<orphans_.size(); ){
+      if (orphans_[i].epoch + 2 <= epoch){
+        orphansFreed += freeBag(orphans_[i]);
+        std::swap(orphans_[i], orphans_.back());
+        orphans_.pop_back();
+      }
+      else{
+        ++i;
+      }
+    }
+    orphansFreed_.fetch_add(orphansFreed, std::memory_order_relaxed);
+    freed += orphansFreed;
+  }
+  return freed;
+}
+
+
+
+EpochReclaimer::Stats EpochReclaimer::getStats() const
+{
+  Stats stats{epoch_.load(std::memory_order_relaxed), 0,
+              orphansFreed_.load(std::memory_order_relaxed)};
+  for (ThreadRecord* record = records_.load(); record; record = record->next){
+    stats.retired += record->retired.load(std::memory_order_relaxed);
+    stats.freed += record->freed.load(std::memory_order_relaxed);
+  }
+  return stats;
+}
+
+
+
+EpochReclaimer::ThreadHandle::~ThreadHandle()
+{
+  if (!record){
+    return;
+  }
+  //Поток завершается - его корзины удалит другой поток, когда
+  //эпоха позволит: пул памяти этого потока уже может быть разрушен
+  EpochReclaimer& reclaimer = EpochReclaimer::instance();
+  {
+    std::lock_guard<std::mutex> lock(reclaimer.mutexOrphans_);
+    for (Bag& bag : record->bags){
+      if (!bag.objects.empty()){
+        reclaimer.orphans_.push_back(std::move(bag));
+        bag.objects.clear();
+      }
+    }
+  }
+  record->retiredSinceCollect = 0;
+  record->nesting = 0;
+  record->epoch.store(QUIESCENT);
+  record->inUse.store(false, std::memory_order_release);
+}
+
+
+
+EpochReclaimer::ThreadRecord* EpochReclaimer::threadRecord()
+{
+  ThreadHandle& handle = handle_;
+  if (handle.record){
+    return handle.record;
+  }
+  //Занять запись завершившегося потока
+  for (ThreadRecord* record = records_.load(); record; record = record->next){
+    bool inUse = false;
+    if (!record->inUse.load(std::memory_order_relaxed) &&
+        record->inUse.compare_exchange_strong(inUse, true, std::memory_order_acquire)){
+      handle.record = record;
+      return record;
+    }
+  }
+  //Добавить новую запись в начало списка
+  ThreadRecord* record = new ThreadRecord();
+  record->next = records_.load();
+  while (!records_.compare_exchange_weak(record->next, record)){
+  }
+  handle.record = record;
+  return record;
+}
+
+
+
+void EpochReclaimer::enter()
+{
+  ThreadRecord* record = threadRecord();
+  if (record->nesting++ == 0){
+    //Объявление эпохи должно стать видимым до чтения объектов -
+    //все операции с эпохами последовательно согласованы (seq_cst)
+    record->epoch.store(epoch_.load());
+  }
+}
+
+
+
+void EpochReclaimer::leave()
+{
+  ThreadRecord* record = handle_.record;
+  if (--record->nesting == 0){
+    record->epoch.store(QUIESCENT);
+  }
+}
+
+
+
+uint64_t EpochReclaimer::tryAdvance()
+{
+  uint64_t epoch = epoch_.load();
+  for (ThreadRecord* record = records_.load(); record; record = record->next){
+    const uint64_t recordEpoch = record->epoch.load();
+    //Поток внутри Guard ещё не видел текущую эпоху
+    if (recordEpoch != QUIESCENT && recordEpoch != epoch){
+      return epoch;
+    }
+  }
+  //При неудаче epoch получает значение, установленное другим потоком
+  if (epoch_.compare_exchange_strong(epoch, epoch + 1)){
+    return epoch + 1;
+  }
+  return epoch;
+}
+
+
+
+size_t EpochReclaimer::freeBag(Bag& bag)
+{
+  const size_t count = bag.objects.size();
+  for (const Retired& retired : bag.objects){
+    retired.deleter(retired.object);
+  }
+  bag.objects.clear();
+  return count;
+}
+
+
+
+
+void EpochReclaimer::runDeferred()
+{
+  //Фоновый поток не бывает внутри Guard и не мешает увеличению эпохи
+  for (;;){
+    std::vector<Deferred> tasks;
+    {
+      std::unique_lock<std::mutex> lock(mutexDeferred_);
+      deferredReady_.wait(lock, [this](){ return !deferred_.empty(); });
+      tasks.swap(deferred_);
+    }
+    uint64_t target = 0;
+    for (const Deferred& deferred : tasks){
+      target = deferred.epoch + 2 > target ? deferred.epoch + 2 : target;
+    }
+    //Потоки внутри Guard выходят из него за время одной операции
+    while (tryAdvance() < target){
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+    for (Deferred& deferred : tasks){
+      deferred.task();
+    }
+  }
+}
+
+
+
+//=============================================================================
+static void testRetire();
+static void testActiveReader();
+static void testThreadExit();
+static void testDefer();
+static void testMultithread();
+
+
+void epoch_reclaimer::test()
+{
+  testRetire();
+  testActiveReader();
+  testThreadExit();
+  testDefer();
+  testMultithread();
+}
+
+
+
+//Объект теста: удаление портит значение, чтение удалённого объекта
+//заметит assert (и AddressSanitizer)
+struct TestObject{
+  static constexpr int ALIVE = 42;
+  int value = ALIVE;
+};
+
+
+
+static std::atomic<size_t> deleted(0);
+
+
+
+static void deleteTestObject(void* object)
+{
+  TestObject* testObject = static_cast<TestObject*>(object);
+  testObject->value = 0;
+  delete testObject;
+  ++deleted;
+}
+
+
+
+//Несколько попыток: каждая увеличивает эпоху не больше чем на 1
+static void collectAll()
+{
+  for (size_t i=0; i<2*EpochReclaimer::COLLECT_PERIOD; ++i){
+    EpochReclaimer::instance().collect();
+  }
+}
+
+
+
+static void testRetire()
+{
+  EpochReclaimer& reclaimer = EpochReclaimer::instance();
+  deleted = 0;
+  {
+    //Пока поток внутри Guard, переданные объекты не удаляются
+    EpochReclaimer::Guard guard;
+    EpochReclaimer::Guard nested;
+    for (size_t i=0; i<10*EpochReclaimer::COLLECT_PERIOD; ++i){
+      reclaimer.retire(new TestObject(), deleteTestObject);
+    }
+    collectAll();
+    assert(deleted == 0);
+  }
+  //Вне Guard эпоха увеличивается - объекты удаляются
+  collectAll();
+  assert(deleted == 10*EpochReclaimer::COLLECT_PERIOD);
+
+  const EpochReclaimer::Stats stats = reclaimer.getStats();
+  assert(stats.retired >= deleted);
+  assert(stats.freed >= deleted);
+}
+
+
+
+static void testActiveReader()
+{
+  EpochReclaimer& reclaimer = EpochReclaimer::instance();
+  deleted = 0;
+  std::atomic<bool> entered(false);
+  std::atomic<bool> release(false);
+
+  //Другой поток внутри Guard задерживает удаление
+  std::thread reader([&](){
+    EpochReclaimer::Guard guard;
+    entered = true;
+    while (!release){
+      std::this_thread::yield();
+    }
+  });
+  while (!entered){
+    std::this_thread::yield();
+  }
+  reclaimer.retire(new TestObject(), deleteTestObject);
+  collectAll();
+  assert(deleted == 0);
+
+  release = true;
+  reader.join();
+  collectAll();
+  assert(deleted == 1);
+}
+
+
+
+static void testThreadExit()
+{
+  //Объекты завершившегося потока удаляет другой поток
+  deleted = 0;
+  std::thread retirer([](){
+    EpochReclaimer::instance().retire(new TestObject(), deleteTestObject);
+  });
+  retirer.join();
+  collectAll();
+  assert(deleted == 1);
+}
+
+
+
+static void testDefer()
+{
+  std::atomic<bool> entered(false);
+  std::atomic<bool> release(false);
+  std::atomic<bool> done(false);
+
+  //Задача не выполняется, пока не завершится Guard, начатый до defer()
+  std::thread reader([&](){
+    EpochReclaimer::Guard guard;
+    entered = true;
+    while (!release){
+      std::this_thread::yield();
+    }
+  });
+  while (!entered){
+    std::this_thread::yield();
+  }
+  const std::thread::id caller = std::this_thread::get_id();
+  EpochReclaimer::instance().defer([&done, caller](){
+    //Задача выполняется в фоновом потоке
+    assert(std::this_thread::get_id() != caller);
+    done = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  assert(!done);
+
+  release = true;
+  reader.join();
+  while (!done){
+    std::this_thread::yield();
+  }
+}
+
+
+
+static void testMultithread()
+{
+  //Писатель заменяет объект и передаёт старый в retire(),
+  //читатели внутри Guard читают текущий объект
+  deleted = 0;
+  const size_t REPLACES = 20000;
+  std::atomic<TestObject*> current(new TestObject());
+  std::atomic<bool> done(false);
+
+  std::vector<std::thread> readers;
+  for (size_t i=0; i<3; ++i){
+    readers.emplace_back([&](){
+      while (!done){
+        EpochReclaimer::Guard guard;
+        TestObject* object = current.load();
+        assert(object->value == TestObject::ALIVE);
+      }
+    });
+  }
+  for (size_t i=0; i<REPLACES; ++i){
+    TestObject* old = current.exchange(new TestObject());
+    EpochReclaimer::instance().retire(old, deleteTestObject);
+  }
+  done = true;
+  for (auto& reader : readers){
+    reader.join();
+  }
+  collectAll();
+  assert(deleted == REPLACES);
+  deleteTestObject(current.load());
+}
@@ -0,0 +1,186 @@
+/**
+\file EpochReclaimer.h
+\brief Класс - отложенное освобождение памяти по эпохам (epoch-based reclamation)
+
+- Поток, читающий объекты без блокировок, находится внутри Guard: на время
+  Guard поток объявляет эпоху, в которой начал чтение
+- Объект, исключённый из структуры данных, не удаляется сразу, а передаётся
+  в retire() и попадает в корзину текущей эпохи потока
+- Глобальная эпоха увеличивается, когда все потоки внутри Guard объявили
+  текущую эпоху. Корзина эпохи e освобождается, когда глобальная эпоха
+  достигла e+2: ни один поток уже не может держать указатель на её объекты
+- Запись потока - в lock-free списке записей; записи завершившихся
+  потоков переиспользуются, корзины завершившихся потоков освобождают
+  другие потоки
+- defer() выполняет задачу в фоновом потоке после того, как завершатся
+  все Guard, начатые до вызова: длинную цепочку объектов можно удалить,
+  не задерживая вызывающий поток
+- Объект существует до завершения программы, как и пул NodePool
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+
+class EpochReclaimer{
+  public:
+    //Функция удаления объекта
+    using Deleter = void (*)(void*);
+
+    //Сколько объектов передано на удаление и сколько уже удалено
+    struct Stats{
+      uint64_t epoch;   //Глобальная эпоха
+      size_t retired;   //Передано в retire()
+      size_t freed;     //Удалено
+    };
+
+    //Поток читает объекты без блокировок, пока существует Guard.
+    //Guard может быть вложенным
+    class Guard{
+      public:
+        Guard();
+        ~Guard();
+        Guard(const Guard& other) = delete;
+        Guard& operator=(const Guard& other) = delete;
+    };
+
+    //Сколько объектов поток передаёт в retire() между попытками
+    //увеличить эпоху и освободить корзины
+    static constexpr size_t COLLECT_PERIOD = 64;
+
+    EpochReclaimer(const EpochReclaimer& other) = delete;
+    EpochReclaimer& operator=(const EpochReclaimer& other) = delete;
+
+    /**
+    \return Единственный объект
+    */
+    static EpochReclaimer& instance();
+
+    /**
+    Удалить объект, когда его не сможет читать ни один поток.
+    Объект должен быть уже недостижим для новых читателей
+    \param[in] object Объект
+    \param[in] deleter Функция удаления объекта
+    */
+    void retire(void* object, Deleter deleter);
+
+    /**
+    Выполнить задачу в фоновом потоке, когда завершатся все Guard,
+    начатые до вызова. Фоновый поток запускается при первом вызове
+    \param[in] task Задача
+    */
+    void defer(std::function<void()> task);
+
+    /**
+    Попытаться увеличить эпоху и освободить корзины текущего потока
+    и завершившихся потоков
+    \return Количество удалённых объектов
+    */
+    size_t collect();
+
+    /**
+    \return Статистика удаления объектов
+    */
+    Stats getStats() const;
+
+  private:
+    //Эпоха потока вне Guard
+    static constexpr uint64_t QUIESCENT = UINT64_MAX;
+    //Корзин столько, сколько эпох может быть не освобождено: e-1, e, e+1
+    static constexpr size_t BAG_COUNT = 3;
+
+    struct Retired{
+      void* object;
+      Deleter deleter;
+    };
+
+    //Объекты, переданные на удаление в одной эпохе
+    struct Bag{
+      uint64_t epoch = 0;
+      std::vector<Retired> objects;
+    };
+
+    //Запись потока. Записи не удаляются, next не меняется после публикации
+    struct ThreadRecord{
+      std::atomic<uint64_t> epoch{QUIESCENT};  //Эпоха, объявленная в Guard
+      std::atomic<bool> inUse{true};           //Запись занята потоком
+      std::atomic<size_t> retired{0};          //Статистика; меняет только владелец
+      std::atomic<size_t> freed{0};
+      ThreadRecord* next = nullptr;
+      //Поля ниже использует только поток-владелец
+      size_t nesting = 0;                      //Глубина вложенности Guard
+      size_t retiredSinceCollect = 0;
+      Bag bags[BAG_COUNT];
+    };
+
+    //Задача defer() и эпоха, в которой она передана
+    struct Deferred{
+      uint64_t epoch;
+      std::function<void()> task;
+    };
+
+    //Запись текущего потока; при завершении потока запись освобождается
+    struct ThreadHandle{
+      ~ThreadHandle();
+      ThreadRecord* record = nullptr;
+    };
+
+    EpochReclaimer() = default;
+
+    /**
+    \return Запись текущего потока
+    */
+    ThreadRecord* threadRecord();
+
+    void enter();
+    void leave();
+
+    /**
+    Увеличить глобальную эпоху, если все потоки внутри Guard объявили её
+    \return Глобальная эпоха после попытки
+    */
+    uint64_t tryAdvance();
+
+    /**
+    Удалить объекты корзины
+    \return Количество удалённых объектов
+    */
+    size_t freeBag(Bag& bag);
+
+    /**
+    Цикл фонового потока: дождаться задач defer() и нужной эпохи, выполнить задачи
+    */
+    void runDeferred();
+
+    std::atomic<uint64_t> epoch_{0};               //Глобальная эпоха
+    std::atomic<ThreadRecord*> records_{nullptr};  //Записи потоков
+
+    //Корзины завершившихся потоков
+    std::mutex mutexOrphans_;
+    std::vector<Bag> orphans_;
+    std::atomic<size_t> orphansFreed_{0};
+
+    //Задачи фонового потока
+    std::mutex mutexDeferred_;
+    std::condition_variable deferredReady_;
+    std::vector<Deferred> deferred_;
+    bool workerStarted_ = false;
+
+    static thread_local ThreadHandle handle_;
+};
+
+
+
+namespace epoch_reclaimer{
+  /**
+  Протестировать отложенное освобождение памяти
+  */
+  void test();
+}
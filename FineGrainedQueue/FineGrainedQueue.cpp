@@ -1,189 +1,22 @@
 #include "FineGrainedQueue.h"
+#include <algorithm>
 #include <cassert>
+#include <climits>
 #include <thread>
 #include <iostream>
+#include <list>
+#include <ranges>
+#include <string>
+#include <vector>
 
-#include "Exceptions/ListIsEmpty_Exception.h"
 
-
-FineGrainedQueue::FineGrainedQueue(): size_(0), head_(nullptr), tail_(nullptr)
-{
-}
-
-
-
-FineGrainedQueue::FineGrainedQueue(std::initializer_list<int> values):
-  FineGrainedQueue()
-{
-  for (const auto value : values){
-    pushBack(value);
-  }
-}
-
-
-
-FineGrainedQueue::~FineGrainedQueue()
-{
-}
-
-
-
-void FineGrainedQueue::pushFront(int value)
-{
-  //Создать новый элемент
-  std::shared_ptr<Node> nodeNew = std::make_shared<Node>(value);
-
-  //Захватить одновременно mutex начала и конца списка
-  std::lock(mutexHead_, mutexTail_);
-
-  //Список пуст
-  if (!head_){
-    head_ = nodeNew;
-    tail_ = nodeNew;
-    mutexHead_.unlock();
-    mutexTail_.unlock();
-  }
-
-  //Список не пуст
-  else{
-    //Добавляем в начало списка - поэтому tail_ не нужен
-    mutexTail_.unlock();
-    //Новый элемент указывает на первый элемент
-    nodeNew->next = head_;
-    //Новый элемент становится первым
-    head_ = nodeNew;
-    mutexHead_.unlock();
-  }
-  ++size_;
-}
-
-
-
-void FineGrainedQueue::pushBack(int value)
-{
-  //Создать новый элемент
-  std::shared_ptr<Node> nodeNew = std::make_shared<Node>(value);
-
-  //Захватить одновременно mutex начала и конца списка
-  std::lock(mutexHead_, mutexTail_);
-
-  //Список пуст
-  if (!head_){
-    head_ = nodeNew;
-    tail_ = nodeNew;
-    mutexHead_.unlock();
-    mutexTail_.unlock();
-  }
-
-  //Список не пуст
-  else{
-    //Добавляем в конец списка - поэтому head_ не нужен
-    mutexHead_.unlock();
-    //Последний элемент указывает на новый элемент
-    tail_->next = nodeNew;
-    //Новый элемент становится последним
-    tail_ = nodeNew;
-    mutexTail_.unlock();
-  }
-  ++size_;
-}
-
-
-
-void FineGrainedQueue::insertIntoMiddle(int value, size_t pos)
-{
-  if (pos == 0){
-    pushFront(value);
-  }
-  else if (pos >= size_){
-    pushBack(value);
-  }
-  else{
-    std::shared_ptr<Node> nodeNew = std::make_shared<Node>(value);
-
-    //Двигаясь вперёд по списку захватываем mutex элемента и освобождаем
-    //mutex предыдущего элемента - ищем элемент, предыдущий элементу
-    //с заданной позицией в списке
-    size_t currentPos = 0;
-    mutexHead_.lock();
-    std::shared_ptr<Node> iter = head_;
-    std::shared_ptr<Node> iterPrev = nullptr;
-    iter->mutex.lock(); //Захватить mutex первого элемента
-    mutexHead_.unlock();
-
-    while(iter->next){
-      if (currentPos == pos-1){
-        break;
-      }
-      iterPrev = iter;
-      iter = iter->next;
-      iter->mutex.lock();
-      iterPrev->mutex.unlock();
-      ++currentPos;
-    }
-    //iter указывает на pos-1 элемент, его mutex захвачен
-    //mutex pos-1-1 освобождён
-    nodeNew->next = iter->next;
-    iter->next = nodeNew;
-    iter->mutex.unlock();
-    ++size_;
-  }
-}
-
-
-
-size_t FineGrainedQueue::getSize() const
-{
-  return size_;
-}
-
-
-
-int FineGrainedQueue::getValue(size_t pos) const
-{
-  //Обработка ошибок
-  if (isEmpty()){
-    throw ListIsEmpty_Exception();
-  }
-  if (pos > size_-1){
-    const std::string errorMessage = "Error: pos (" +
-      std::to_string(pos) + ") is out_of_range";
-		throw std::out_of_range(errorMessage.c_str());
-  }
-  //Найти элемент pos
-  size_t currentPos = 0;
-  mutexHead_.lock_shared();
-  std::shared_ptr<Node> iter = head_;
-  std::shared_ptr<Node> iterPrev = nullptr;
-  iter->mutex.lock_shared(); //Залочить mutex первого элемента
-  mutexHead_.unlock_shared();
-
-  while(iter->next){
-    if (currentPos == pos){
-      break;
-    }
-    iterPrev = iter;
-    iter = iter->next;
-    iter->mutex.lock_shared();
-    iterPrev->mutex.unlock_shared();
-    ++currentPos;
-  }
-  //iter указывает на pos элемент, его mutex захвачен
-  //mutex pos-1 освобождён
-  const int resultValue = iter->value;
-  iter->mutex.unlock_shared();
-  return resultValue;
-}
-
-
-
-bool FineGrainedQueue::isEmpty() const
-{
-  if (size_ == 0){
-    return true;
-  }
-  return false;
-}
+//Проверка компиляции всех методов
+template class FineGrainedQueue<int>;
+template class FineGrainedQueue<int, PoolAllocator<int>, LockStats>;
+template class FineGrainedQueue<int, PoolAllocator<int>, NoLockStats, SharedMutexLocking>;
+template class FineGrainedQueue<int, PoolAllocator<int>, NoLockStats, SpinLocking>;
+template class FineGrainedQueue<int, PoolAllocator<int>, NoLockStats, NullLocking<>>;
+template class FineGrainedQueue<int, PoolAllocator<int>, LockStats, NullLocking<>>;
 
 
 //=============================================================================
@@ -193,6 +26,27 @@ static void testPushBack();
 static void testInsertIntoMiddle();
 static void testGetValue();
 static void testIsEmpty();
+static void testReserve();
+static void testPopFront();
+static void testPopBack();
+static void testRemove();
+static void testEmplace();
+static void testMoveOnly();
+static void testVisitValue();
+static void testPeek();
+static void testOptimisticTraversal();
+static void testPositionalIndex();
+static void testBulk();
+static void testForEach();
+static void testParallel();
+static void testClear();
+static void testSplice();
+static void testStats();
+static void testLocking();
+static void testSizeMode();
+static void testPushMode();
+static void testLatencyStats();
+static void testCapacity();
 
 
 void fine_grained_queue::test()
@@ -203,6 +57,27 @@ void fine_grained_queue::test()
   testInsertIntoMiddle();
   testGetValue();
   testIsEmpty();
+  testReserve();
+  testPopFront();
+  testPopBack();
+  testRemove();
+  testEmplace();
+  testMoveOnly();
+  testVisitValue();
+  testPeek();
+  testOptimisticTraversal();
+  testPositionalIndex();
+  testBulk();
+  testForEach();
+  testParallel();
+  testClear();
+  testSplice();
+  testStats();
+  testLocking();
+  testSizeMode();
+  testPushMode();
+  testLatencyStats();
+  testCapacity();
 }
 
 
@@ -210,7 +85,7 @@ void fine_grained_queue::test()
 static void testCtor()
 {
   //Конструктор по-умолчанию
-  FineGrainedQueue testQueue_1;
+  FineGrainedQueue<int> testQueue_1;
   assert(testQueue_1.getSize() == 0);
   assert(testQueue_1.isEmpty() == true);
 
@@ -261,7 +136,7 @@ static void testInsertIntoMiddle()
 
 static void testGetValue()
 {
-  FineGrainedQueue testQueue;
+  FineGrainedQueue<int> testQueue;
 
   testQueue.pushFront(1); //1
   assert(testQueue.getValue(0) == 1);
@@ -283,7 +158,7 @@ static void testGetValue()
 
   //Тест выброс исключений
   // testQueue.getValue(11111); //pos is out_of_range
-  // FineGrainedQueue testQueue_1;
+  // FineGrainedQueue<int> testQueue_1;
   // testQueue_1.getValue(1); //list is empty
 }
 
@@ -291,9 +166,9 @@ static void testGetValue()
 
 static void testIsEmpty()
 {
-  FineGrainedQueue testQueue_1;
-  FineGrainedQueue testQueue_2;
-  FineGrainedQueue testQueue_3;
+  FineGrainedQueue<int> testQueue_1;
+  FineGrainedQueue<int> testQueue_2;
+  FineGrainedQueue<int> testQueue_3;
 
   assert(testQueue_1.isEmpty() == true);
   assert(testQueue_2.isEmpty() == true);
@@ -311,9 +186,65 @@ static void testIsEmpty()
 
 
 
+static void testReserve()
+{
+  //Список с заранее выделенной памятью ведёт себя как обычный
+  FineGrainedQueue testQueue(1000);
+  assert(testQueue.getSize() == 0);
+  assert(testQueue.isEmpty() == true);
+  for (int i=0; i<1000; ++i){
+    testQueue.pushBack(i);
+  }
+  assert(testQueue.getSize() == 1000);
+  assert(testQueue.getValue(0) == 0);
+  assert(testQueue.getValue(999) == 999);
+
+  testQueue.reserve(10);
+  testQueue.insertIntoMiddle(-1, 500);
+  assert(testQueue.getValue(500) == -1);
+  assert(testQueue.getSize() == 1001);
+}
+
+
+
+static void testPopFrontOnethread();
+static void testPopFrontMiltithread();
+
+static void testPopFront()
+{
+  testPopFrontOnethread();
+  testPopFrontMiltithread();
+}
+
+
+
+static void testPopBackOnethread();
+static void testPopBackMiltithread();
+
+static void testPopBack()
+{
+  testPopBackOnethread();
+  testPopBackMiltithread();
+}
+
+
+
+static void testRemoveOnethread();
+static void testRemoveIndexed();
+static void testRemoveMiltithread();
+
+static void testRemove()
+{
+  testRemoveOnethread();
+  testRemoveIndexed();
+  testRemoveMiltithread();
+}
+
+
+
 static void testPushFrontOnethread()
 {
-  FineGrainedQueue testQueue;
+  FineGrainedQueue<int> testQueue;
   for (size_t i=0; i<10; ++i){
     testQueue.pushFront(i);
     assert(testQueue.getValue(0) == static_cast<int>(i));
@@ -323,12 +254,12 @@ static void testPushFrontOnethread()
 
 
 
-static void PushFrontForMiltithread(FineGrainedQueue& queue, int value);
+static void PushFrontForMiltithread(FineGrainedQueue<int>& queue, int value);
 
 static void testPushFrontMiltithread()
 {
   for(size_t i=0; i<100; ++i){
-    FineGrainedQueue testQueue;
+    FineGrainedQueue<int> testQueue;
     const int VALUE_1 = 1;
     const int VALUE_2 = 2;
     const int VALUE_3 = 3;
@@ -374,7 +305,7 @@ static void testPushFrontMiltithread()
 
 static void testPushBackOnethread()
 {
-  FineGrainedQueue testQueue;
+  FineGrainedQueue<int> testQueue;
   for (size_t i=0; i<10; ++i){
     testQueue.pushBack(i);
     assert(testQueue.getValue(testQueue.getSize()-1) == static_cast<int>(i));
@@ -384,12 +315,12 @@ static void testPushBackOnethread()
 
 
 
-static void PushBackForMiltithread(FineGrainedQueue& queue, int value);
+static void PushBackForMiltithread(FineGrainedQueue<int>& queue, int value);
 
 static void testPushBackMiltithread()
 {
   for(size_t i=0; i<100; ++i){
-    FineGrainedQueue testQueue;
+    FineGrainedQueue<int> testQueue;
     const int VALUE_1 = 1;
     const int VALUE_2 = 2;
     const int VALUE_3 = 3;
@@ -432,7 +363,7 @@ static void testPushBackMiltithread()
 
   //Тест одновременно pushBack(), pushFront()
   for (size_t i=0; i<100; ++i){
-    FineGrainedQueue testQueue;
+    FineGrainedQueue<int> testQueue;
     const int VALUE_BACK = 11;
     const int VALUE_FRONT = 22;
     std::thread A(PushBackForMiltithread, std::ref(testQueue), VALUE_BACK);
@@ -454,7 +385,7 @@ static void testPushBackMiltithread()
 
 static void testInsertIntoMiddleOnethread()
 {
-  FineGrainedQueue testQueue;
+  FineGrainedQueue<int> testQueue;
   //Вставка в конец пустого списка
   testQueue.insertIntoMiddle(436, 99999); //436
   assert(testQueue.getValue(0) == 436);
@@ -489,7 +420,7 @@ static void testInsertIntoMiddleOnethread()
   assert(testQueue.getValue(4) == 2);
   assert(testQueue.getSize() == 5);
 
-  FineGrainedQueue testQueue_1;
+  FineGrainedQueue<int> testQueue_1;
   //Вставка в начало пустого списка
   testQueue_1.insertIntoMiddle(1,0);
   assert(testQueue_1.getValue(0) == 1);
@@ -498,7 +429,7 @@ static void testInsertIntoMiddleOnethread()
 
 
 
-static void PushInsertIntoMiddleMiltithread(FineGrainedQueue& queue,
+static void PushInsertIntoMiddleMiltithread(FineGrainedQueue<int>& queue,
                                             int value,
                                             size_t pos);
 
@@ -506,7 +437,7 @@ static void testInsertIntoMiddleMiltithread()
 {
   //Вставка в КОНЕЦ ПУСТОГО списка
   for (size_t i=0; i<100; ++i){
-    FineGrainedQueue testQueue;
+    FineGrainedQueue<int> testQueue;
     const int VALUE_1 = 1;
     const int VALUE_2 = 2;
     const int VALUE_3 = 3;
@@ -563,7 +494,7 @@ static void testInsertIntoMiddleMiltithread()
 
   //Вставка в НАЧАЛО НЕпустого списка
   for (size_t i=0; i<100; ++i){
-    FineGrainedQueue testQueue;
+    FineGrainedQueue<int> testQueue;
     const int VALUE_INI = 1;
     testQueue.pushBack(VALUE_INI);
 
@@ -595,7 +526,7 @@ static void testInsertIntoMiddleMiltithread()
 
   //Вставка в КОНЕЦ НЕпустого списка
   for (size_t i=0; i<100; ++i){
-    FineGrainedQueue testQueue;
+    FineGrainedQueue<int> testQueue;
     const int VALUE_INI = 1;
     testQueue.pushBack(VALUE_INI);
 
@@ -629,7 +560,7 @@ static void testInsertIntoMiddleMiltithread()
 
   //Вставка в СЕРЕДИНУ списка
   for (size_t i=0; i<100; ++i){
-    FineGrainedQueue testQueue;
+    FineGrainedQueue<int> testQueue;
     const int VALUE_INI_1 = 1;
     const int VALUE_INI_2 = 2;
     const int VALUE_INI_3 = 3;
@@ -669,7 +600,7 @@ static void testInsertIntoMiddleMiltithread()
 
   //Вставка в начало пустого списка
   for (size_t i=0; i<100; ++i){
-    FineGrainedQueue testQueue;
+    FineGrainedQueue<int> testQueue;
     const int VALUE_1 = 11;
     const int VALUE_2 = 21;
     const size_t POS = 0;
@@ -697,23 +628,2344 @@ static void testInsertIntoMiddleMiltithread()
 
 
 
-static void PushFrontForMiltithread(FineGrainedQueue& queue, int value)
+static void PushFrontForMiltithread(FineGrainedQueue<int>& queue, int value)
 {
   queue.pushFront(value);
 }
 
 
 
-static void PushBackForMiltithread(FineGrainedQueue& queue, int value)
+static void PushBackForMiltithread(FineGrainedQueue<int>& queue, int value)
 {
   queue.pushBack(value);
 }
 
 
 
-static void PushInsertIntoMiddleMiltithread(FineGrainedQueue& queue,
+static void PushInsertIntoMiddleMiltithread(FineGrainedQueue<int>& queue,
                                             int value,
                                             size_t pos)
 {
   queue.insertIntoMiddle(value, pos);
-}
\ No newline at end of file
+}
+
+
+
+static void testPopFrontOnethread()
+{
+  FineGrainedQueue testQueue = {1,2,3};
+  assert(testQueue.tryPopFront() == 1);
+  assert(testQueue.getSize() == 2);
+  assert(testQueue.getValue(0) == 2);
+  assert(testQueue.popFront() == 2);
+  assert(testQueue.popFrontFor(std::chrono::milliseconds(1)) == 3);
+  assert(testQueue.isEmpty() == true);
+  assert(testQueue.tryPopFront() == std::nullopt);
+
+  //Пустой список - ожидание завершается по таймауту
+  const auto start = std::chrono::steady_clock::now();
+  assert(testQueue.popFrontFor(std::chrono::milliseconds(20)) == std::nullopt);
+  assert(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(20));
+
+  //После опустошения список снова работает с обоих концов
+  testQueue.pushBack(4);  //4
+  testQueue.pushFront(5); //5 4
+  testQueue.pushBack(6);  //5 4 6
+  assert(testQueue.getSize() == 3);
+  assert(testQueue.tryPopFront() == 5);
+  assert(testQueue.tryPopFront() == 4);
+  testQueue.insertIntoMiddle(7, 1); //6 7
+  assert(testQueue.getValue(1) == 7);
+  assert(testQueue.tryPopFront() == 6);
+  assert(testQueue.tryPopFront() == 7);
+  assert(testQueue.isEmpty() == true);
+}
+
+
+
+static void testPopFrontMiltithread()
+{
+  //Ожидающий поток просыпается при добавлении элемента
+  for (size_t i=0; i<20; ++i){
+    FineGrainedQueue<int> testQueue;
+    int popped = 0;
+    std::thread consumer([&](){ popped = testQueue.popFront(); });
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+    testQueue.pushBack(42);
+    consumer.join();
+    assert(popped == 42);
+    assert(testQueue.isEmpty() == true);
+  }
+
+  //Производители в конце списка, потребители в начале:
+  //каждый элемент извлекается ровно один раз
+  const int COUNT = 20000;
+  FineGrainedQueue<int> testQueue;
+  std::atomic<long long> sum(0);
+  std::atomic<int> popped(0);
+  auto produce = [&](int first){
+    for (int i=first; i<COUNT; i+=2){
+      testQueue.pushBack(i);
+    }
+  };
+  auto consume = [&](){
+    while (popped < COUNT){
+      if (std::optional<int> value = testQueue.popFrontFor(std::chrono::milliseconds(1))){
+        sum += *value;
+        ++popped;
+      }
+    }
+  };
+  std::thread producer_1(produce, 0);
+  std::thread producer_2(produce, 1);
+  std::thread consumer_1(consume);
+  std::thread consumer_2(consume);
+  producer_1.join();
+  producer_2.join();
+  consumer_1.join();
+  consumer_2.join();
+  assert(popped == COUNT);
+  assert(sum == static_cast<long long>(COUNT) * (COUNT - 1) / 2);
+  assert(testQueue.isEmpty() == true);
+  assert(testQueue.tryPopFront() == std::nullopt);
+}
+
+
+
+static void testPopBackOnethread()
+{
+  FineGrainedQueue testQueue = {1,2,3};
+  assert(testQueue.tryPopBack() == 3);
+  assert(testQueue.getSize() == 2);
+  assert(testQueue.getValue(1) == 2);
+
+  //Конец списка обновлён - добавление в конец после извлечения
+  testQueue.pushBack(4); //1 2 4
+  assert(testQueue.getValue(2) == 4);
+  assert(testQueue.tryPopBack() == 4);
+  assert(testQueue.tryPopBack() == 2);
+  assert(testQueue.tryPopBack() == 1);
+  assert(testQueue.tryPopBack() == std::nullopt);
+  assert(testQueue.isEmpty() == true);
+
+  testQueue.pushFront(5);
+  assert(testQueue.tryPopBack() == 5);
+  assert(testQueue.tryPopFront() == std::nullopt);
+}
+
+
+
+static void testPopBackMiltithread()
+{
+  //Одновременное извлечение с обоих концов и добавление:
+  //сумма извлечённых и оставшихся равна сумме добавленных
+  for (size_t round=0; round<20; ++round){
+    const int COUNT = 500;
+    FineGrainedQueue<int> testQueue;
+    for (int i=0; i<COUNT; ++i){
+      testQueue.pushBack(i);
+    }
+    std::atomic<long long> sum(0);
+    std::thread A([&](){
+      for (int i=0; i<COUNT/4; ++i){
+        if (std::optional<int> value = testQueue.tryPopBack()){
+          sum += *value;
+        }
+      }
+    });
+    std::thread B([&](){
+      for (int i=0; i<COUNT/4; ++i){
+        if (std::optional<int> value = testQueue.tryPopFront()){
+          sum += *value;
+        }
+      }
+    });
+    std::thread C([&](){
+      for (int i=COUNT; i<2*COUNT; ++i){
+        testQueue.pushBack(i);
+        testQueue.insertIntoMiddle(-i, static_cast<size_t>(i % 7));
+      }
+    });
+    A.join();
+    B.join();
+    C.join();
+    while (std::optional<int> value = testQueue.tryPopBack()){
+      sum += *value;
+    }
+    assert(testQueue.isEmpty() == true);
+    assert(sum == static_cast<long long>(COUNT) * (COUNT - 1) / 2);
+  }
+}
+
+
+
+static void testRemoveOnethread()
+{
+  FineGrainedQueue testQueue = {0,1,2,3,4,5,6,7,8,9};
+
+  //Удаление из середины, из начала и из конца
+  assert(testQueue.erase(4) == 4);      //0 1 2 3 5 6 7 8 9
+  assert(testQueue.erase(0) == 0);      //1 2 3 5 6 7 8 9
+  assert(testQueue.erase(7) == 9);      //1 2 3 5 6 7 8
+  assert(testQueue.getSize() == 7);
+  assert(testQueue.getValue(3) == 5);
+  //Конец списка обновлён
+  testQueue.pushBack(10);               //1 2 3 5 6 7 8 10
+  assert(testQueue.getValue(7) == 10);
+  assert(testQueue.tryPopBack() == 10);
+
+  bool isThrown = false;
+  try{
+    testQueue.erase(7);
+  }
+  catch (const std::out_of_range&){
+    isThrown = true;
+  }
+  assert(isThrown);
+
+  assert(testQueue.removeFirst(6));     //1 2 3 5 7 8
+  assert(!testQueue.removeFirst(6));
+  assert(testQueue.removeFirst(8));     //1 2 3 5 7
+  testQueue.pushBack(11);
+  assert(testQueue.getValue(5) == 11);
+
+  //Нечётные: начало списка, середина и конец за один проход
+  assert(testQueue.removeIf([](int value){ return value % 2 == 1; }) == 5);
+  assert(testQueue.getSize() == 1);
+  assert(testQueue.getValue(0) == 2);
+  testQueue.pushFront(1);
+  testQueue.pushBack(3);
+  assert(testQueue.removeIf([](int){ return true; }) == 3);
+  assert(testQueue.isEmpty());
+  assert(testQueue.removeIf([](int){ return true; }) == 0);
+  testQueue.pushBack(12);
+  assert(testQueue.getValue(0) == 12);
+  assert(testQueue.tryPopBack() == 12);
+
+  isThrown = false;
+  try{
+    testQueue.erase(0);
+  }
+  catch (const ListIsEmpty_Exception&){
+    isThrown = true;
+  }
+  assert(isThrown);
+
+  //Исключение в условии не оставляет элементы захваченными
+  testQueue.pushBackBulk(std::vector<int>{1, 2, 3});
+  try{
+    testQueue.removeIf([](int value){
+      if (value == 2){
+        throw std::runtime_error("pred");
+      }
+      return value == 1;
+    });
+    assert(false);
+  }
+  catch (const std::runtime_error&){
+  }
+  assert(testQueue.getSize() == 2);
+  assert(testQueue.tryPopFront() == 2);
+  assert(testQueue.tryPopBack() == 3);
+
+  //Только перемещаемые значения
+  FineGrainedQueue<std::unique_ptr<int>> moveOnly;
+  moveOnly.pushBack(std::make_unique<int>(1));
+  moveOnly.pushBack(std::make_unique<int>(2));
+  assert(*moveOnly.erase(1) == 2);
+  assert(moveOnly.removeIf([](const std::unique_ptr<int>& value){ return *value == 1; }) == 1);
+}
+
+
+
+static void testRemoveIndexed()
+{
+  using Queue = FineGrainedQueue<int>;
+  Queue testQueue(Queue::IndexMode::SKIP_LIST);
+  for (int i=0; i<100; ++i){
+    testQueue.pushBack(i);
+  }
+  //Удаление по индексу и проходом - индекс согласован со списком
+  assert(testQueue.erase(50) == 50);
+  assert(testQueue.erase(98) == 99);
+  assert(testQueue.erase(0) == 0);
+  assert(testQueue.removeFirst(10));
+  assert(testQueue.removeIf([](int value){ return value % 3 == 0; }) == 32);
+  assert(testQueue.getSize() == 64);
+  int expected = 0;
+  size_t pos = 0;
+  testQueue.forEach([&](int value){
+    do{
+      ++expected;
+    } while (expected % 3 == 0 || expected == 10 || expected == 50);
+    assert(value == expected);
+    assert(testQueue.getValue(pos++) == value);
+  });
+  assert(expected == 98);
+  testQueue.pushBack(100);
+  assert(testQueue.getValue(64) == 100);
+}
+
+
+
+static void testRemoveMiltithread()
+{
+  //Удаление из середины одновременно с добавлением в оба конца, извлечением
+  //из начала и обходами: элемент удаляется ровно один раз, сумма удалённых,
+  //извлечённых и оставшихся равна сумме добавленных
+  using Queue = FineGrainedQueue<int>;
+  for (const auto mode : {Queue::TraversalMode::LOCK_COUPLING, Queue::TraversalMode::OPTIMISTIC}){
+    const int COUNT = 4000;
+    Queue testQueue;
+    testQueue.setTraversalMode(mode);
+    std::atomic<long long> sum(0);
+    std::atomic<bool> done(false);
+    std::vector<std::thread> threads;
+    threads.emplace_back([&](){
+      for (int i=1; i<=COUNT; ++i){
+        testQueue.pushBack(i);
+        testQueue.pushFront(-i);
+        testQueue.insertIntoMiddle(COUNT + i, static_cast<size_t>(i % 11));
+      }
+    });
+    threads.emplace_back([&](){
+      for (int i=0; i<COUNT; ++i){
+        if (std::optional<int> value = testQueue.tryPopFront()){
+          sum += *value;
+        }
+      }
+    });
+    threads.emplace_back([&](){
+      for (int i=0; i<COUNT; ++i){
+        try{
+          sum += testQueue.erase(static_cast<size_t>(i % 13));
+        }
+        catch (const std::out_of_range&){
+        }
+        catch (const ListIsEmpty_Exception&){
+        }
+        if (i % 100 == 0){
+          testQueue.removeIf([&sum](int value){
+            if (value % 5 == 0){
+              sum += value;
+              return true;
+            }
+            return false;
+          });
+        }
+      }
+    });
+    threads.emplace_back([&](){
+      while (!done){
+        testQueue.forEach([](int){}, Queue::ScanMode::WEAK);
+        testQueue.removeFirst(COUNT);
+      }
+    });
+    for (size_t i=0; i<3; ++i){
+      threads[i].join();
+    }
+    done = true;
+    threads[3].join();
+
+    //removeFirst(COUNT) мог удалить элемент COUNT
+    long long remaining = 0;
+    assert(testQueue.forEach([&remaining](int value){ remaining += value; }) ==
+           testQueue.getSize());
+    const long long pushed = static_cast<long long>(COUNT) * (COUNT + 1) / 2 +
+                             static_cast<long long>(COUNT) * COUNT;
+    const long long total = sum + remaining;
+    assert(total == pushed || total == pushed - COUNT);
+    //Конец списка верен после удалений из конца
+    testQueue.pushBack(0);
+    assert(testQueue.getValue(testQueue.getSize() - 1) == 0);
+  }
+}
+
+
+
+static void testEmplace()
+{
+  struct Message{
+    Message(int i, std::string t): id(i), text(std::move(t)){}
+    int id;
+    std::string text;
+  };
+  FineGrainedQueue<Message> testQueue;
+  testQueue.emplaceBack(2, "two");        //2
+  testQueue.emplaceFront(1, "one");       //1 2
+  testQueue.emplaceBack(4, "four");       //1 2 4
+  testQueue.emplaceAt(2, 3, "three");     //1 2 3 4
+  testQueue.emplaceAt(99999, 5, "five");  //1 2 3 4 5
+  assert(testQueue.getSize() == 5);
+  for (int i=0; i<5; ++i){
+    assert(testQueue.getValue(i).id == i+1);
+  }
+  assert(testQueue.getValue(2).text == "three");
+
+  //Список со стандартным аллокатором
+  FineGrainedQueue<std::string, std::allocator<std::string>> testQueue_1(100);
+  testQueue_1.pushBack("b");
+  testQueue_1.pushFront("a");
+  testQueue_1.insertIntoMiddle("c", 5);
+  assert(testQueue_1.getValue(0) == "a");
+  assert(testQueue_1.getValue(1) == "b");
+  assert(testQueue_1.getValue(2) == "c");
+}
+
+
+
+static void testMoveOnly()
+{
+  FineGrainedQueue<std::unique_ptr<int>> testQueue;
+  testQueue.pushBack(std::make_unique<int>(2));     //2
+  testQueue.emplaceFront(new int(1));               //1 2
+  testQueue.insertIntoMiddle(std::make_unique<int>(3), 2); //1 2 3
+  assert(testQueue.getSize() == 3);
+  assert(testQueue.visitValue(1, [](const std::unique_ptr<int>& value){
+    return *value;
+  }) == 2);
+
+  //Значение перемещается из списка при извлечении
+  std::optional<std::unique_ptr<int>> value = testQueue.tryPopFront();
+  assert(value && **value == 1);
+  value = testQueue.tryPopBack();
+  assert(value && **value == 3);
+  std::unique_ptr<int> last = testQueue.popFront();
+  assert(*last == 2);
+  assert(testQueue.isEmpty() == true);
+
+  //Разные потоки передают владение через список
+  FineGrainedQueue<std::unique_ptr<int>> channel;
+  const int COUNT = 1000;
+  std::thread producer([&](){
+    for (int i=0; i<COUNT; ++i){
+      channel.pushBack(std::make_unique<int>(i));
+    }
+  });
+  long long sum = 0;
+  for (int i=0; i<COUNT; ++i){
+    sum += *channel.popFront();
+  }
+  producer.join();
+  assert(sum == static_cast<long long>(COUNT) * (COUNT - 1) / 2);
+}
+
+
+
+static int payloadCopies = 0;
+
+static void testVisitValue()
+{
+  //Тип, считающий свои копирования
+  struct Payload{
+    explicit Payload(int v): value(v){}
+    Payload(const Payload& other): value(other.value){ ++payloadCopies; }
+    Payload(Payload&& other) noexcept: value(other.value){}
+    int value;
+  };
+  FineGrainedQueue<Payload> testQueue;
+  for (int i=0; i<10; ++i){
+    testQueue.emplaceBack(i);
+  }
+  //Добавление на месте и чтение посетителем не копируют значения
+  int sum = 0;
+  for (size_t i=0; i<testQueue.getSize(); ++i){
+    sum += testQueue.visitValue(i, [](const Payload& payload){
+      return payload.value;
+    });
+  }
+  assert(sum == 45);
+  assert(payloadCopies == 0);
+
+  //Извлечение перемещает значение
+  std::optional<Payload> value = testQueue.tryPopFront();
+  assert(value && value->value == 0);
+  assert(payloadCopies == 0);
+
+  //getValue возвращает копию
+  assert(testQueue.getValue(0).value == 1);
+  assert(payloadCopies == 1);
+
+  //Исключение в посетителе не оставляет элемент захваченным
+  try{
+    testQueue.visitValue(0, [](const Payload&){ throw std::runtime_error("visitor"); });
+    assert(false);
+  }
+  catch (const std::runtime_error&){
+  }
+  testQueue.pushFront(Payload(-1));
+  assert(testQueue.tryPopFront()->value == -1);
+}
+
+
+
+static void testPeekOnethread();
+static void testPeekMiltithread();
+
+static void testPeek()
+{
+  testPeekOnethread();
+  testPeekMiltithread();
+}
+
+
+
+static void testPeekOnethread()
+{
+  //Пустой список
+  FineGrainedQueue<int> testQueue;
+  assert(!testQueue.tryPeekFront());
+  assert(!testQueue.tryPeekBack());
+  bool isThrown = false;
+  try{
+    testQueue.peekBack();
+  }
+  catch (const ListIsEmpty_Exception&){
+    isThrown = true;
+  }
+  assert(isThrown);
+
+  //Первый и последний элементы после добавлений и извлечений
+  testQueue.pushBack(2);
+  assert(testQueue.peekFront() == 2 && testQueue.peekBack() == 2);
+  testQueue.pushFront(1);
+  testQueue.pushBack(3);
+  testQueue.insertIntoMiddle(5, 1);
+  assert(testQueue.peekFront() == 1);
+  assert(*testQueue.tryPeekBack() == 3);
+  testQueue.tryPopBack();
+  assert(testQueue.peekBack() == 2);
+  testQueue.tryPopFront();
+  assert(testQueue.peekFront() == 5);
+  testQueue.clear();
+  assert(!testQueue.tryPeekFront());
+
+  //Не тривиально копируемый тип читается под mutex элемента
+  FineGrainedQueue<std::string> stringQueue = {"a", "b", "c"};
+  assert(stringQueue.peekFront() == "a");
+  assert(stringQueue.peekBack() == "c");
+  assert(stringQueue.getSize() == 3);
+}
+
+
+
+static void testPeekMiltithread()
+{
+  //Производитель добавляет возрастающие значения, потребитель извлекает;
+  //читатели видят неубывающие первый и последний элементы
+  auto check = [](auto makeValue, auto readValue){
+    using Value = decltype(makeValue(0));
+    FineGrainedQueue<Value> testQueue;
+    const int COUNT = 20000;
+    std::atomic<bool> done(false);
+    std::vector<std::thread> threads;
+    threads.emplace_back([&](){
+      for (int i=0; i<COUNT; ++i){
+        testQueue.pushBack(makeValue(i));
+      }
+    });
+    threads.emplace_back([&](){
+      for (int i=0; i<COUNT; ){
+        if (testQueue.tryPopFront()){
+          ++i;
+        }
+      }
+    });
+    for (int i=0; i<2; ++i){
+      threads.emplace_back([&](){
+        int lastFront = -1;
+        int lastBack = -1;
+        while (!done){
+          if (std::optional<Value> value = testQueue.tryPeekFront()){
+            assert(readValue(*value) >= lastFront);
+            lastFront = readValue(*value);
+          }
+          if (std::optional<Value> value = testQueue.tryPeekBack()){
+            assert(readValue(*value) >= lastBack);
+            lastBack = readValue(*value);
+          }
+        }
+      });
+    }
+    threads[0].join();
+    threads[1].join();
+    done = true;
+    threads[2].join();
+    threads[3].join();
+    assert(!testQueue.tryPeekFront() && !testQueue.tryPeekBack());
+  };
+  check([](int i){ return i; }, [](int value){ return value; });
+  check([](int i){ return std::to_string(i); },
+        [](const std::string& value){ return std::stoi(value); });
+}
+
+
+static void testOptimisticTraversalOnethread();
+static void testOptimisticTraversalMiltithread();
+
+static void testOptimisticTraversal()
+{
+  testOptimisticTraversalOnethread();
+  testOptimisticTraversalMiltithread();
+}
+
+
+
+static void testOptimisticTraversalOnethread()
+{
+  FineGrainedQueue<int> testQueue;
+  assert(testQueue.getTraversalMode() ==
+         FineGrainedQueue<int>::TraversalMode::LOCK_COUPLING);
+  testQueue.setTraversalMode(FineGrainedQueue<int>::TraversalMode::OPTIMISTIC);
+  assert(testQueue.getTraversalMode() ==
+         FineGrainedQueue<int>::TraversalMode::OPTIMISTIC);
+
+  //Результат тот же, что и при захвате по цепочке
+  testQueue.insertIntoMiddle(3, 0);   //3
+  testQueue.insertIntoMiddle(1, 0);   //1 3
+  testQueue.insertIntoMiddle(2, 1);   //1 2 3
+  testQueue.insertIntoMiddle(5, 100); //1 2 3 5
+  testQueue.insertIntoMiddle(4, 3);   //1 2 3 4 5
+  assert(testQueue.getSize() == 5);
+  for (size_t i=0; i<5; ++i){
+    assert(testQueue.getValue(i) == static_cast<int>(i+1));
+  }
+  assert(testQueue.visitValue(4, [](const int& value){ return value * 10; }) == 50);
+
+  //Извлечённые элементы не находятся
+  assert(testQueue.tryPopBack() == 5);
+  assert(testQueue.tryPopFront() == 1);
+  assert(testQueue.getValue(0) == 2);
+  assert(testQueue.getValue(2) == 4);
+  bool isThrown = false;
+  try{
+    testQueue.getValue(3);
+  }
+  catch (const std::out_of_range&){
+    isThrown = true;
+  }
+  assert(isThrown);
+  //После вставки в конец tail_ указывает на новый элемент
+  testQueue.insertIntoMiddle(6, 3);
+  testQueue.pushBack(7);
+  assert(testQueue.getValue(3) == 6);
+  assert(testQueue.getValue(4) == 7);
+}
+
+
+
+static void testOptimisticTraversalMiltithread()
+{
+  //Вставки и чтения в середине идут одновременно с извлечением
+  //с обоих концов - ни один элемент не теряется
+  const int COUNT = 2000;
+  for (size_t round=0; round<5; ++round){
+    FineGrainedQueue<int> testQueue;
+    testQueue.setTraversalMode(FineGrainedQueue<int>::TraversalMode::OPTIMISTIC);
+    for (int i=0; i<COUNT; ++i){
+      testQueue.pushBack(-1);
+    }
+    std::atomic<long> popped(0);
+    std::atomic<bool> done(false);
+
+    std::thread inserter([&](){
+      for (int i=0; i<COUNT; ++i){
+        testQueue.insertIntoMiddle(i, static_cast<size_t>(i) % 64);
+      }
+      done = true;
+    });
+    std::thread reader([&](){
+      while (!done){
+        const size_t size = testQueue.getSize();
+        try{
+          testQueue.getValue(size / 2);
+        }
+        catch (const std::out_of_range&){
+        }
+        catch (const ListIsEmpty_Exception&){
+        }
+      }
+    });
+    std::thread popperFront([&](){
+      for (int i=0; i<COUNT/2; ++i){
+        if (testQueue.tryPopFront()){
+          ++popped;
+        }
+      }
+    });
+    std::thread popperBack([&](){
+      for (int i=0; i<COUNT/2; ++i){
+        if (testQueue.tryPopBack()){
+          ++popped;
+        }
+      }
+    });
+    inserter.join();
+    reader.join();
+    popperFront.join();
+    popperBack.join();
+
+    assert(testQueue.getSize() + popped == 2*COUNT);
+    size_t count = 0;
+    while (testQueue.tryPopFront()){
+      ++count;
+    }
+    assert(count + popped == 2*COUNT);
+  }
+}
+
+
+
+static void testPositionalIndexOnethread();
+static void testPositionalIndexMiltithread();
+
+static void testPositionalIndex()
+{
+  testPositionalIndexOnethread();
+  testPositionalIndexMiltithread();
+}
+
+
+
+static void testPositionalIndexOnethread()
+{
+  using Queue = FineGrainedQueue<int>;
+  Queue testQueue(Queue::IndexMode::SKIP_LIST);
+  assert(testQueue.getIndexMode() == Queue::IndexMode::SKIP_LIST);
+  assert(Queue().getIndexMode() == Queue::IndexMode::NONE);
+
+  //Результат тот же, что и без индекса
+  for (int i=0; i<1000; ++i){
+    testQueue.pushBack(2*i);
+  }
+  for (int i=0; i<1000; ++i){
+    testQueue.insertIntoMiddle(2*i+1, 2*i+1);
+  }
+  testQueue.pushFront(-1);
+  testQueue.insertIntoMiddle(2000, 99999);
+  assert(testQueue.getSize() == 2002);
+  for (size_t i=0; i<2002; ++i){
+    assert(testQueue.getValue(i) == static_cast<int>(i)-1);
+  }
+  assert(testQueue.visitValue(1, [](const int& value){ return value + 1; }) == 1);
+
+  //Извлечение с обоих концов обновляет индекс
+  assert(testQueue.tryPopFront() == -1);
+  assert(testQueue.tryPopBack() == 2000);
+  assert(testQueue.tryPopBack() == 1999);
+  assert(testQueue.getValue(0) == 0);
+  assert(testQueue.getValue(1998) == 1998);
+  bool isThrown = false;
+  try{
+    testQueue.getValue(1999);
+  }
+  catch (const std::out_of_range&){
+    isThrown = true;
+  }
+  assert(isThrown);
+
+  while (testQueue.tryPopBack()){
+  }
+  isThrown = false;
+  try{
+    testQueue.getValue(0);
+  }
+  catch (const ListIsEmpty_Exception&){
+    isThrown = true;
+  }
+  assert(isThrown);
+  testQueue.insertIntoMiddle(5, 3);
+  assert(testQueue.getValue(0) == 5);
+}
+
+
+
+static void testPositionalIndexMiltithread()
+{
+  //Чтения по позиции идут одновременно с добавлением и извлечением
+  //с обоих концов и вставкой в середину
+  using Queue = FineGrainedQueue<int>;
+  const int COUNT = 2000;
+  for (size_t round=0; round<5; ++round){
+    Queue testQueue(Queue::IndexMode::SKIP_LIST);
+    std::atomic<long> popped(0);
+    std::atomic<bool> done(false);
+
+    std::thread pusherBack([&](){
+      for (int i=0; i<COUNT; ++i){
+        testQueue.pushBack(i);
+      }
+    });
+    std::thread pusherFront([&](){
+      for (int i=0; i<COUNT; ++i){
+        testQueue.pushFront(-i);
+      }
+    });
+    std::thread inserter([&](){
+      for (int i=0; i<COUNT; ++i){
+        testQueue.insertIntoMiddle(i, testQueue.getSize() / 2);
+      }
+      done = true;
+    });
+    std::thread reader([&](){
+      while (!done){
+        try{
+          testQueue.getValue(testQueue.getSize() / 3);
+        }
+        catch (const std::out_of_range&){
+        }
+        catch (const ListIsEmpty_Exception&){
+        }
+      }
+    });
+    std::thread popper([&](){
+      for (int i=0; i<COUNT; ++i){
+        if ((i % 2 ? testQueue.tryPopBack() : testQueue.tryPopFront())){
+          ++popped;
+        }
+      }
+    });
+    pusherBack.join();
+    pusherFront.join();
+    inserter.join();
+    reader.join();
+    popper.join();
+
+    assert(testQueue.getSize() + popped == 3*COUNT);
+    //Индекс совпадает со списком
+    const size_t size = testQueue.getSize();
+    std::vector<int> values;
+    for (size_t i=0; i<size; ++i){
+      values.push_back(testQueue.getValue(i));
+    }
+    for (size_t i=0; i<size; ++i){
+      assert(testQueue.tryPopFront() == values[i]);
+    }
+    assert(testQueue.isEmpty());
+  }
+}
+
+
+
+static void testBulkOnethread();
+static void testBulkMiltithread();
+
+static void testBulk()
+{
+  testBulkOnethread();
+  testBulkMiltithread();
+}
+
+
+
+static void testBulkOnethread()
+{
+  using Queue = FineGrainedQueue<int>;
+  for (const auto indexMode : {Queue::IndexMode::NONE, Queue::IndexMode::SKIP_LIST}){
+    Queue testQueue(indexMode);
+    //Пустой диапазон ничего не меняет
+    testQueue.pushBackBulk(std::vector<int>());
+    testQueue.insertBulkAt(0, std::vector<int>());
+    assert(testQueue.isEmpty());
+
+    //Вставка в пустой список, в конец, в начало и в середину
+    testQueue.pushBackBulk(std::vector<int>{4, 5});               //4 5
+    const std::list<int> values = {8, 9};
+    testQueue.pushBackBulk(values.begin(), values.end());         //4 5 8 9
+    testQueue.pushFrontBulk(std::vector<int>{0, 1, 2});           //0 1 2 4 5 8 9
+    testQueue.insertBulkAt(3, std::vector<int>{3});               //0 1 2 3 4 5 8 9
+    testQueue.insertBulkAt(6, std::vector<int>{6, 7});            //0 ... 9
+    testQueue.insertBulkAt(99999, std::vector<int>{10, 11});      //0 ... 11
+    assert(testQueue.getSize() == 12);
+    for (size_t i=0; i<12; ++i){
+      assert(testQueue.getValue(i) == static_cast<int>(i));
+    }
+    //Цепочка вставлена целиком - конец списка указывает на её последний элемент
+    testQueue.pushBack(12);
+    assert(testQueue.tryPopBack() == 12);
+    assert(testQueue.tryPopBack() == 11);
+    for (int i=0; i<11; ++i){
+      assert(testQueue.tryPopFront() == i);
+    }
+    assert(testQueue.isEmpty());
+  }
+
+  //Только перемещаемые значения
+  FineGrainedQueue<std::unique_ptr<int>> uniqueQueue;
+  std::vector<std::unique_ptr<int>> pointers;
+  pointers.push_back(std::make_unique<int>(1));
+  pointers.push_back(std::make_unique<int>(2));
+  uniqueQueue.pushBackBulk(std::make_move_iterator(pointers.begin()),
+                           std::make_move_iterator(pointers.end()));
+  assert(*uniqueQueue.popFront() == 1);
+  assert(*uniqueQueue.popFront() == 2);
+}
+
+
+
+static void testBulkMiltithread()
+{
+  //Пакеты добавляются одновременно с обоих концов - внутри
+  //пакета порядок элементов не нарушается
+  const int BATCHES = 200;
+  const int BATCH_SIZE = 50;
+  FineGrainedQueue<int> testQueue;
+  std::thread front([&](){
+    std::vector<int> batch(BATCH_SIZE);
+    for (int i=0; i<BATCHES; ++i){
+      for (int j=0; j<BATCH_SIZE; ++j){
+        batch[j] = -(i*BATCH_SIZE + j) - 1;
+      }
+      testQueue.pushFrontBulk(batch);
+    }
+  });
+  std::thread back([&](){
+    std::vector<int> batch(BATCH_SIZE);
+    for (int i=0; i<BATCHES; ++i){
+      for (int j=0; j<BATCH_SIZE; ++j){
+        batch[j] = i*BATCH_SIZE + j;
+      }
+      testQueue.pushBackBulk(batch);
+    }
+  });
+  front.join();
+  back.join();
+  assert(testQueue.getSize() == 2*BATCHES*BATCH_SIZE);
+  std::vector<int> values;
+  while (std::optional<int> value = testQueue.tryPopFront()){
+    values.push_back(*value);
+  }
+  assert(values.size() == 2*BATCHES*BATCH_SIZE);
+  for (size_t i=0; i<values.size(); i+=BATCH_SIZE){
+    for (size_t j=1; j<BATCH_SIZE; ++j){
+      assert(values[i+j] == values[i+j-1] + (values[i] < 0 ? -1 : 1));
+    }
+  }
+
+  //Пакет будит всех ожидающих в popFront()
+  std::atomic<int> sum(0);
+  std::vector<std::thread> consumers;
+  for (int i=0; i<4; ++i){
+    consumers.emplace_back([&](){
+      sum += testQueue.popFront();
+    });
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  testQueue.pushBackBulk(std::vector<int>{1, 2, 3, 4});
+  for (auto& consumer : consumers){
+    consumer.join();
+  }
+  assert(sum == 10);
+}
+
+
+
+static void testForEachOnethread();
+static void testForEachMiltithread();
+
+static void testForEach()
+{
+  testForEachOnethread();
+  testForEachMiltithread();
+}
+
+
+
+static void testForEachOnethread()
+{
+  using Queue = FineGrainedQueue<int>;
+  for (const auto indexMode : {Queue::IndexMode::NONE, Queue::IndexMode::SKIP_LIST}){
+    for (const auto mode : {Queue::ScanMode::LOCK_COUPLING, Queue::ScanMode::WEAK}){
+      Queue testQueue(indexMode);
+      //Пустой список
+      assert(testQueue.forEach([](const int&){ assert(false); }, mode) == 0);
+
+      testQueue.pushBackBulk(std::vector<int>{0, 1, 2, 3, 4, 5, 6, 7, 8, 9});
+      //Все элементы по порядку
+      std::vector<int> values;
+      assert(testQueue.forEach([&values](const int& value){ values.push_back(value); },
+                               mode) == 10);
+      assert(values == std::vector<int>({0, 1, 2, 3, 4, 5, 6, 7, 8, 9}));
+
+      //Диапазон позиций, в том числе выходящий за конец списка
+      values.clear();
+      assert(testQueue.forEachRange(3, 6, [&values](const int& value){
+        values.push_back(value);
+      }, mode) == 3);
+      assert(values == std::vector<int>({3, 4, 5}));
+      assert(testQueue.forEachRange(8, 100, [](const int&){}, mode) == 2);
+      assert(testQueue.forEachRange(10, 100, [](const int&){}, mode) == 0);
+      assert(testQueue.forEachRange(5, 5, [](const int&){}, mode) == 0);
+
+      //false из посетителя прекращает обход
+      int sum = 0;
+      assert(testQueue.forEach([&sum](const int& value){
+        sum += value;
+        return value < 4;
+      }, mode) == 5);
+      assert(sum == 10);
+    }
+  }
+}
+
+
+
+static void testForEachMiltithread()
+{
+  //Добавление в конец и извлечение из начала во время обхода:
+  //значения добавляются по возрастанию, поэтому обход видит возрастающую
+  //последовательность; при захвате по цепочке - без пропусков
+  using Queue = FineGrainedQueue<int>;
+  for (const auto mode : {Queue::ScanMode::LOCK_COUPLING, Queue::ScanMode::WEAK}){
+    Queue testQueue;
+    for (int i=0; i<1000; ++i){
+      testQueue.pushBack(i);
+    }
+    std::atomic<bool> done(false);
+    std::thread producer([&](){
+      for (int i=1000; i<20000; ++i){
+        testQueue.pushBack(i);
+        testQueue.tryPopFront();
+      }
+      done = true;
+    });
+    size_t scans = 0;
+    while (!done || scans == 0){
+      int previous = -1;
+      testQueue.forEach([&previous, mode](const int& value){
+        if (previous >= 0){
+          if (mode == Queue::ScanMode::LOCK_COUPLING){
+            assert(value == previous + 1);
+          }
+          else{
+            assert(value > previous);
+          }
+        }
+        previous = value;
+      }, mode);
+      ++scans;
+    }
+    producer.join();
+    assert(testQueue.getSize() == 1000);
+  }
+}
+
+
+
+//Значение, считающее живые экземпляры: после удаления списка
+//(в том числе в фоновом потоке) экземпляров не остаётся
+struct Counted{
+  static inline std::atomic<long> alive = 0;
+  explicit Counted(int value): value(value){ ++alive; }
+  Counted(const Counted& other): value(other.value){ ++alive; }
+  Counted(Counted&& other): value(other.value){ ++alive; }
+  ~Counted(){ --alive; }
+  int value;
+};
+
+
+
+static void waitAllDestroyed()
+{
+  //Длинные цепочки удаляет фоновый поток, извлечённые элементы
+  //(с перемещёнными значениями) ждут продвижения эпохи
+  while (Counted::alive != 0){
+    EpochReclaimer::instance().collect();
+    std::this_thread::yield();
+  }
+}
+
+
+
+static void testParallelOnethread();
+static void testParallelMiltithread();
+
+static void testParallel()
+{
+  testParallelOnethread();
+  testParallelMiltithread();
+}
+
+
+
+static void testParallelOnethread()
+{
+  using Queue = FineGrainedQueue<int>;
+  for (const auto indexMode : {Queue::IndexMode::NONE, Queue::IndexMode::SKIP_LIST}){
+    //Пустой список - результат init
+    Queue testQueue(indexMode);
+    assert(testQueue.parallelReduce(7, std::plus<int>(), std::plus<int>()) == 7);
+    assert(testQueue.countIf([](int){ return true; }) == 0);
+
+    //Длинный список делится на несколько участков, короткий - один участок
+    for (const int count : {10, 100000}){
+      testQueue.clear();
+      testQueue.pushBackBulk(std::views::iota(0, count));
+      const long long sum = testQueue.parallelReduce(0LL,
+        [](long long result, int value){ return result + value; },
+        std::plus<long long>());
+      assert(sum == static_cast<long long>(count) * (count - 1) / 2);
+      const int minimum = testQueue.parallelReduce(INT_MAX,
+        [](int result, int value){ return std::min(result, value); },
+        [](int left, int right){ return std::min(left, right); });
+      assert(minimum == 0);
+      assert(testQueue.countIf([](int value){ return value % 3 == 0; }) ==
+             static_cast<size_t>((count + 2) / 3));
+      std::atomic<long long> visitedSum(0);
+      assert(testQueue.parallelForEach([&visitedSum](int value){ visitedSum += value; }) ==
+             static_cast<size_t>(count));
+      assert(visitedSum == sum);
+
+      //Участки объединяются в порядке списка: отбор в вектор сохраняет порядок
+      const std::vector<int> selected = testQueue.parallelReduce(std::vector<int>(),
+        [](std::vector<int> result, int value){
+          if (value % 1000 == 0){
+            result.push_back(value);
+          }
+          return result;
+        },
+        [](std::vector<int> left, std::vector<int> right){
+          left.insert(left.end(), right.begin(), right.end());
+          return left;
+        });
+      assert(selected.size() == static_cast<size_t>((count + 999) / 1000));
+      assert(std::is_sorted(selected.begin(), selected.end()));
+    }
+  }
+
+  //Исключение в accumulate передаётся вызывающему, блокировки освобождены
+  Queue testQueue;
+  testQueue.pushBackBulk(std::views::iota(0, 100000));
+  bool isThrown = false;
+  try{
+    testQueue.countIf([](int value){
+      if (value == 50000){
+        throw std::runtime_error("pred");
+      }
+      return true;
+    });
+  }
+  catch (const std::runtime_error&){
+    isThrown = true;
+  }
+  assert(isThrown);
+  assert(testQueue.erase(50000) == 50000);
+  assert(testQueue.removeIf([](int){ return true; }) == 99999);
+}
+
+
+
+static void testParallelMiltithread()
+{
+  //Обход одновременно с извлечением из начала, добавлением в конец и
+  //удалением в середине, в том числе первых элементов участков. Элемент
+  //учитывается не более одного раза; элементы, которые не менялись,
+  //учитываются всегда
+  using Queue = FineGrainedQueue<int>;
+  for (const auto indexMode : {Queue::IndexMode::NONE, Queue::IndexMode::SKIP_LIST}){
+    const int COUNT = 100000;
+    const int POPPED = 1000;
+    Queue testQueue(indexMode);
+    testQueue.pushBackBulk(std::views::iota(0, COUNT));
+    std::atomic<bool> done(false);
+    std::vector<std::thread> threads;
+    threads.emplace_back([&](){
+      for (int i=0; i<POPPED; ++i){
+        testQueue.tryPopFront();
+        testQueue.pushBack(COUNT + i);
+      }
+    });
+    threads.emplace_back([&](){
+      testQueue.removeIf([](int value){ return value % 5000 == 0; });
+    });
+    threads.emplace_back([&](){
+      std::vector<std::atomic<int>> seen(COUNT + POPPED);
+      while (!done){
+        for (auto& count : seen){
+          count = 0;
+        }
+        testQueue.parallelForEach([&seen](int value){ ++seen[value]; });
+        for (int value=0; value<COUNT+POPPED; ++value){
+          assert(seen[value] <= 1);
+          //Извлечено POPPED первых элементов; 0 мог быть удалён до этого
+          if (value > POPPED && value < COUNT && value % 5000 != 0){
+            assert(seen[value] == 1);
+          }
+        }
+      }
+    });
+    threads[0].join();
+    threads[1].join();
+    done = true;
+    threads[2].join();
+    assert(testQueue.countIf([](int){ return true; }) == testQueue.getSize());
+  }
+}
+
+
+
+static void testClearOnethread();
+static void testClearMiltithread();
+static void testClearRemove();
+
+static void testClear()
+{
+  testClearOnethread();
+  testClearMiltithread();
+  testClearRemove();
+}
+
+
+
+static void testClearOnethread()
+{
+  using Queue = FineGrainedQueue<int>;
+  for (const auto indexMode : {Queue::IndexMode::NONE, Queue::IndexMode::SKIP_LIST}){
+    Queue testQueue(indexMode);
+    //Пустой список
+    testQueue.clear();
+    assert(testQueue.isEmpty());
+
+    testQueue.pushBackBulk(std::vector<int>{0, 1, 2, 3, 4, 5, 6, 7, 8, 9});
+    testQueue.clear();
+    assert(testQueue.getSize() == 0);
+    assert(testQueue.isEmpty());
+    assert(!testQueue.tryPopFront());
+    assert(!testQueue.tryPopBack());
+    assert(testQueue.forEach([](const int&){}) == 0);
+    bool isThrown = false;
+    try{
+      testQueue.getValue(0);
+    }
+    catch (const ListIsEmpty_Exception&){
+      isThrown = true;
+    }
+    assert(isThrown);
+
+    //После очистки список снова работает
+    testQueue.pushBack(2);
+    testQueue.pushFront(0);
+    testQueue.insertIntoMiddle(1, 1);
+    assert(testQueue.getSize() == 3);
+    assert(testQueue.getValue(0) == 0);
+    assert(testQueue.getValue(1) == 1);
+    assert(testQueue.getValue(2) == 2);
+    assert(*testQueue.tryPopBack() == 2);
+  }
+
+  //Длинный список: очистка и разрушение без рекурсии
+  {
+    const int COUNT = 1000000;
+    FineGrainedQueue<Counted> testQueue;
+    auto values = std::views::iota(0, COUNT) |
+                  std::views::transform([](int i){ return Counted(i); });
+    testQueue.pushBackBulk(values);
+    assert(testQueue.getSize() == COUNT);
+    testQueue.clear();
+    assert(testQueue.isEmpty());
+    testQueue.pushBackBulk(values);
+    assert(testQueue.getValue(COUNT-1).value == COUNT-1);
+  }
+  waitAllDestroyed();
+
+  //Деструктор разрушает значения длинного списка до возврата
+  {
+    FineGrainedQueue<Counted> testQueue;
+    testQueue.pushBackBulk(std::views::iota(0, 10000) |
+                           std::views::transform([](int i){ return Counted(i); }));
+  }
+  assert(Counted::alive == 0);
+}
+
+
+
+static void testClearRemove()
+{
+  //removeIf, продолжающий проход по цепочке, отсоединённой clear(),
+  //не уменьшает обнулённый размер: getSize() не превышает количества
+  //добавленных элементов и после прохода равен 0
+  const int COUNT = 100000;
+  for (int attempt=0; attempt<20; ++attempt){
+    FineGrainedQueue<int> testQueue;
+    testQueue.pushBackBulk(std::views::iota(0, COUNT));
+    std::atomic<bool> started(false);
+    std::atomic<bool> done(false);
+    std::thread remover([&testQueue, &started, &done](){
+      started = true;
+      testQueue.removeIf([](int value){ return value % 2 != 0; });
+      done = true;
+    });
+    while (!started){
+      std::this_thread::yield();
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(attempt * 50));
+    {
+      //Задача clear() ждёт завершения Guard: размер не уточняется,
+      //пока проверяется
+      EpochReclaimer::Guard guard;
+      testQueue.clear();
+      while (!done){
+        assert(testQueue.getSize() <= static_cast<size_t>(COUNT));
+        std::this_thread::yield();
+      }
+      remover.join();
+      assert(testQueue.getSize() == 0);
+    }
+  }
+}
+
+
+
+static void testClearMiltithread()
+{
+  //Добавление, вставка в середину, извлечение и обход одновременно
+  //с очисткой: после завершения фоновых задач размер совпадает
+  //с количеством элементов, все значения удалены
+  using Queue = FineGrainedQueue<Counted>;
+  for (const auto mode : {Queue::TraversalMode::LOCK_COUPLING,
+                          Queue::TraversalMode::OPTIMISTIC}){
+    {
+      Queue testQueue;
+      testQueue.setTraversalMode(mode);
+      std::atomic<bool> done(false);
+      std::vector<std::thread> threads;
+      threads.emplace_back([&](){
+        for (int i=0; i<20000; ++i){
+          testQueue.pushBack(Counted(i));
+        }
+      });
+      threads.emplace_back([&](){
+        for (int i=0; i<20000; ++i){
+          testQueue.insertIntoMiddle(Counted(i), static_cast<size_t>(i) % 50);
+        }
+      });
+      threads.emplace_back([&](){
+        for (int i=0; i<20000; ++i){
+          testQueue.tryPopFront();
+        }
+      });
+      threads.emplace_back([&](){
+        while (!done){
+          testQueue.forEach([](const Counted& value){ assert(value.value >= 0); },
+                            Queue::ScanMode::WEAK);
+        }
+      });
+      for (int i=0; i<200; ++i){
+        testQueue.clear();
+        std::this_thread::yield();
+      }
+      for (size_t i=0; i<3; ++i){
+        threads[i].join();
+      }
+      done = true;
+      threads[3].join();
+
+      //size_ уточняется фоновой задачей clear()
+      while (testQueue.getSize() != testQueue.forEach([](const Counted&){})){
+        std::this_thread::yield();
+      }
+    }
+    waitAllDestroyed();
+  }
+}
+
+
+
+static void testSpliceOnethread();
+static void testSpliceMiltithread();
+static void testSpliceMiddle();
+
+static void testSplice()
+{
+  testSpliceOnethread();
+  testSpliceMiltithread();
+  testSpliceMiddle();
+}
+
+
+
+static void testSpliceOnethread()
+{
+  using Queue = FineGrainedQueue<int>;
+  const auto values = [](const Queue& queue){
+    std::vector<int> result;
+    queue.forEach([&result](int value){ result.push_back(value); });
+    assert(result.size() == queue.getSize());
+    return result;
+  };
+  for (const auto indexMode : {Queue::IndexMode::NONE, Queue::IndexMode::SKIP_LIST}){
+    //Перемещение: индекс и способ прохода переходят вместе с элементами
+    Queue source(indexMode);
+    source.setTraversalMode(Queue::TraversalMode::OPTIMISTIC);
+    source.pushBackBulk(std::vector<int>{0, 1, 2, 3, 4});
+    Queue moved(std::move(source));
+    assert(source.isEmpty());
+    assert(moved.getIndexMode() == indexMode);
+    assert(moved.getTraversalMode() == Queue::TraversalMode::OPTIMISTIC);
+    assert((values(moved) == std::vector<int>{0, 1, 2, 3, 4}));
+    source.pushBack(5);
+    assert(source.getValue(0) == 5);
+
+    //Присваивание: прежние элементы удаляются, индекс списка сохраняется
+    for (const auto otherMode : {Queue::IndexMode::NONE, Queue::IndexMode::SKIP_LIST}){
+      Queue assigned(indexMode);
+      assigned.pushBackBulk(std::vector<int>{7, 8});
+      Queue other(otherMode);
+      other.pushBackBulk(std::vector<int>{1, 2, 3});
+      assigned = std::move(other);
+      assert(other.isEmpty());
+      assert(assigned.getIndexMode() == indexMode);
+      assert((values(assigned) == std::vector<int>{1, 2, 3}));
+      assert(assigned.getValue(2) == 3);
+      assigned.insertIntoMiddle(9, 1);
+      assert(assigned.erase(1) == 9);
+      other.pushBack(4);
+      assert(other.getSize() == 1);
+    }
+
+    //Разделение в начале, середине, конце и за концом списка
+    Queue testQueue(indexMode);
+    testQueue.pushBackBulk(std::views::iota(0, 10));
+    Queue tail = testQueue.splitAt(6);
+    assert(tail.getIndexMode() == indexMode);
+    assert((values(testQueue) == std::vector<int>{0, 1, 2, 3, 4, 5}));
+    assert((values(tail) == std::vector<int>{6, 7, 8, 9}));
+    assert(testQueue.splitAt(6).isEmpty());
+    assert(testQueue.splitAt(100).isEmpty());
+    //Обе части - рабочие списки: конец списка перенесён
+    testQueue.pushBack(60);
+    tail.pushFront(50);
+    assert(*testQueue.tryPopBack() == 60);
+    assert(*tail.tryPopBack() == 9);
+    assert(tail.getValue(0) == 50);
+    Queue all = testQueue.splitAt(0);
+    assert(testQueue.isEmpty());
+    assert(all.getSize() == 6);
+    testQueue.pushBack(1);
+    assert(testQueue.getValue(0) == 1);
+    assert(*testQueue.tryPopFront() == 1);
+
+    //Соединение: с пустым, пустого с непустым, с другим индексом
+    all.appendAll(std::move(tail));
+    assert(tail.isEmpty());
+    assert((values(all) == std::vector<int>{0, 1, 2, 3, 4, 5, 50, 6, 7, 8}));
+    all.appendAll(std::move(tail));
+    testQueue.appendAll(std::move(all));
+    assert(all.isEmpty());
+    assert(testQueue.getValue(9) == 8);
+    Queue other(indexMode == Queue::IndexMode::NONE ? Queue::IndexMode::SKIP_LIST :
+                                                      Queue::IndexMode::NONE);
+    other.pushBackBulk(std::vector<int>{11, 12});
+    testQueue.appendAll(std::move(other));
+    assert(testQueue.getSize() == 12);
+    assert(testQueue.getValue(11) == 12);
+    assert(testQueue.erase(10) == 11);
+    assert(*testQueue.tryPopBack() == 12);
+    testQueue.appendAll(std::move(testQueue));
+    assert(testQueue.getSize() == 10);
+  }
+}
+
+
+
+static void testSpliceMiltithread()
+{
+  //Два списка; один поток переносит элементы между ними splitAt и
+  //appendAll, остальные добавляют в конец, извлекают из начала и читают.
+  //Ни один элемент не теряется и не повторяется, размеры верны
+  using Queue = FineGrainedQueue<int>;
+  for (const auto indexMode : {Queue::IndexMode::NONE, Queue::IndexMode::SKIP_LIST}){
+    const int COUNT = 20000;
+    Queue first(indexMode);
+    Queue second(indexMode);
+    std::atomic<bool> done(false);
+    std::vector<std::vector<int>> popped(2);
+    std::vector<std::thread> threads;
+    for (int i=0; i<2; ++i){
+      threads.emplace_back([&, i](){
+        Queue& queue = i ? second : first;
+        for (int j=0; j<COUNT; ++j){
+          queue.pushBack(i*COUNT + j);
+        }
+      });
+      threads.emplace_back([&, i](){
+        Queue& queue = i ? second : first;
+        for (int j=0; j<COUNT/2; ++j){
+          if (std::optional<int> value = queue.tryPopFront()){
+            popped[i].push_back(*value);
+          }
+        }
+      });
+    }
+    threads.emplace_back([&](){
+      while (!done){
+        first.forEach([](int value){ assert(value >= 0); });
+        second.forEach([](int value){ assert(value >= 0); }, Queue::ScanMode::WEAK);
+      }
+    });
+    for (int i=0; !done; ++i){
+      Queue& from = i % 2 ? first : second;
+      Queue& to = i % 2 ? second : first;
+      to.appendAll(from.splitAt(from.getSize() / 2));
+      done = i >= 2000;
+    }
+    for (auto& thread : threads){
+      thread.join();
+    }
+
+    std::vector<int> all;
+    for (Queue* queue : {&first, &second}){
+      assert(queue->getSize() == queue->forEach([&all](int value){ all.push_back(value); }));
+    }
+    for (const auto& values : popped){
+      all.insert(all.end(), values.begin(), values.end());
+    }
+    std::sort(all.begin(), all.end());
+    assert(all.size() == 2*COUNT);
+    for (int i=0; i<2*COUNT; ++i){
+      assert(all[i] == i);
+    }
+  }
+}
+
+
+
+static void testSpliceMiddle()
+{
+  //Один поток переносит элементы между двумя списками splitAt и appendAll,
+  //остальные вставляют и удаляют в середине обоих списков и читают по
+  //позиции. Каждый элемент либо удалён, либо остался ровно в одном
+  //списке; размеры списков совпадают с количеством их элементов
+  using Queue = FineGrainedQueue<int>;
+  for (const auto indexMode : {Queue::IndexMode::NONE, Queue::IndexMode::SKIP_LIST}){
+    const int COUNT = 10000;
+    const int INITIAL = 1000;
+    Queue first(indexMode);
+    Queue second(indexMode);
+    first.pushBackBulk(std::views::iota(0, INITIAL));
+    second.pushBackBulk(std::views::iota(INITIAL, 2*INITIAL));
+    std::atomic<bool> done(false);
+    std::vector<std::vector<int>> erased(2);
+    std::vector<std::thread> threads;
+    for (int i=0; i<2; ++i){
+      threads.emplace_back([&, i](){
+        Queue& queue = i ? second : first;
+        for (int j=0; j<COUNT; ++j){
+          queue.insertIntoMiddle(2*INITIAL + i*COUNT + j, static_cast<size_t>(j % 300 + 1));
+        }
+      });
+      threads.emplace_back([&, i](){
+        Queue& queue = i ? first : second;
+        for (int j=0; j<COUNT/2; ++j){
+          try{
+            erased[i].push_back(queue.erase(static_cast<size_t>(j % 200 + 1)));
+          }
+          catch (const std::out_of_range&){
+          }
+          catch (const ListIsEmpty_Exception&){
+          }
+          if (j % 500 == 0){
+            queue.removeIf([&erased, i](int value){
+              if (value % 97 == 0){
+                erased[i].push_back(value);
+                return true;
+              }
+              return false;
+            });
+          }
+        }
+      });
+    }
+    threads.emplace_back([&](){
+      while (!done){
+        try{
+          assert(first.getValue(first.getSize() / 2) >= 0);
+        }
+        catch (const std::out_of_range&){
+        }
+        catch (const ListIsEmpty_Exception&){
+        }
+      }
+    });
+    //Позиции разделения - там же, где вставки и удаления
+    for (int i=0; i<20000; ++i){
+      Queue& from = i % 2 ? first : second;
+      Queue& to = i % 2 ? second : first;
+      to.appendAll(from.splitAt(static_cast<size_t>(i % 250 + 1)));
+    }
+    done = true;
+    for (auto& thread : threads){
+      thread.join();
+    }
+
+    std::vector<int> all;
+    for (Queue* queue : {&first, &second}){
+      assert(queue->getSize() == queue->forEach([&all](int value){ all.push_back(value); }));
+    }
+    for (const auto& values : erased){
+      all.insert(all.end(), values.begin(), values.end());
+    }
+    std::sort(all.begin(), all.end());
+    assert(all.size() == static_cast<size_t>(2*INITIAL + 2*COUNT));
+    for (int i=0; i<2*INITIAL + 2*COUNT; ++i){
+      assert(all[i] == i);
+    }
+  }
+}
+
+
+
+static void testStatsOnethread();
+static void testStatsMiltithread();
+
+static void testStats()
+{
+  testStatsOnethread();
+  testStatsMiltithread();
+}
+
+
+
+static void testStatsOnethread()
+{
+  //По умолчанию статистика не собирается
+  FineGrainedQueue<int> plainQueue = {1, 2, 3};
+  plainQueue.getValue(2);
+  assert(plainQueue.getStats()[LockKind::HEAD].acquisitions == 0);
+  assert(plainQueue.getStats().traversals == 0);
+
+  using Queue = FineGrainedQueue<int, PoolAllocator<int>, LockStats>;
+  Queue testQueue;
+  testQueue.pushBackBulk(std::vector<int>{0, 1, 2, 3, 4, 5, 6, 7, 8, 9});
+  testQueue.resetStats();
+
+  testQueue.pushFront(-1);
+  LockStatsSnapshot stats = testQueue.getStats();
+  assert(stats[LockKind::HEAD].acquisitions == 1);
+  assert(stats[LockKind::TAIL].acquisitions == 0);
+  assert(stats[LockKind::NODE].acquisitions == 0);
+
+  //Проход по цепочке до элемента 5 - 5 шагов, 6 элементов захвачено
+  testQueue.resetStats();
+  assert(testQueue.getValue(5) == 4);
+  stats = testQueue.getStats();
+  assert(stats.traversals == 1);
+  assert(stats.averageTraversal() == 5.0);
+  assert(stats[LockKind::NODE].acquisitions == 6);
+  assert(stats[LockKind::NODE].contended == 0);
+
+  //Вставка в середину проходит до элемента pos-1
+  testQueue.resetStats();
+  testQueue.insertIntoMiddle(100, 3);
+  stats = testQueue.getStats();
+  assert(stats.traversals == 1);
+  assert(stats.traversalSteps == 2);
+  assert(stats[LockKind::NODE].holdNs > 0);
+
+  //Оптимистичный проход захватывает только найденный элемент
+  testQueue.setTraversalMode(Queue::TraversalMode::OPTIMISTIC);
+  testQueue.resetStats();
+  assert(testQueue.getValue(8) == 6);
+  stats = testQueue.getStats();
+  assert(stats.traversalSteps == 8);
+  assert(stats[LockKind::NODE].acquisitions == 1);
+
+  //Извлечение из конца захватывает оба конца списка
+  testQueue.resetStats();
+  assert(testQueue.tryPopBack() == 9);
+  stats = testQueue.getStats();
+  assert(stats[LockKind::HEAD].acquisitions == 1);
+  assert(stats[LockKind::TAIL].acquisitions == 1);
+  assert(stats.traversalSteps == testQueue.getSize() - 1);
+}
+
+
+
+static void testStatsMiltithread()
+{
+  //Производители в конец и потребители из начала: все захваты учтены,
+  //ожидание учитывается только для захватов с ожиданием
+  using Queue = FineGrainedQueue<int, PoolAllocator<int>, LockStats>;
+  Queue testQueue;
+  const int COUNT = 20000;
+  std::vector<std::thread> threads;
+  for (size_t i=0; i<2; ++i){
+    threads.emplace_back([&testQueue](){
+      for (int value=0; value<COUNT; ++value){
+        testQueue.pushBack(value);
+      }
+    });
+    threads.emplace_back([&testQueue](){
+      for (int value=0; value<COUNT; ++value){
+        testQueue.tryPopFront();
+      }
+    });
+  }
+  for (auto& thread : threads){
+    thread.join();
+  }
+  const LockStatsSnapshot stats = testQueue.getStats();
+  assert(stats[LockKind::TAIL].acquisitions >= 2*COUNT);
+  assert(stats[LockKind::HEAD].acquisitions >= 2*COUNT);
+  for (const auto kind : {LockKind::HEAD, LockKind::TAIL, LockKind::NODE}){
+    assert(stats[kind].contended <= stats[kind].acquisitions);
+    assert((stats[kind].contended == 0) == (stats[kind].waitNs == 0) ||
+           stats[kind].contended != 0);
+  }
+}
+
+
+
+template<typename Queue>
+static void testLockingOnethread();
+template<typename Queue>
+static void testLockingMultithread();
+static void testLockingConversion();
+
+static void testLocking()
+{
+  using Allocator = PoolAllocator<int>;
+  testLockingOnethread<FineGrainedQueue<int, Allocator, NoLockStats, SharedMutexLocking>>();
+  testLockingOnethread<FineGrainedQueue<int, Allocator, NoLockStats, SpinLocking>>();
+  testLockingOnethread<FineGrainedQueue<int, Allocator, NoLockStats, NullLocking<>>>();
+  testLockingOnethread<FineGrainedQueue<int, Allocator, LockStats, NullLocking<>>>();
+  testLockingMultithread<FineGrainedQueue<int, Allocator, NoLockStats, SharedMutexLocking>>();
+  testLockingMultithread<FineGrainedQueue<int, Allocator, NoLockStats, SpinLocking>>();
+  testLockingConversion();
+}
+
+
+
+template<typename Queue>
+static void testLockingOnethread()
+{
+  Queue testQueue;
+  testQueue.pushBackBulk(std::vector<int>{1, 2, 3, 4, 5});
+  testQueue.pushFront(0);
+  testQueue.insertIntoMiddle(100, 3);
+  assert(testQueue.getSize() == 7);
+  assert(testQueue.getValue(3) == 100);
+  assert(testQueue.getValue(6) == 5);
+
+  testQueue.setTraversalMode(Queue::TraversalMode::OPTIMISTIC);
+  assert(testQueue.getValue(4) == 3);
+  int sum = 0;
+  assert(testQueue.forEach([&sum](int value){ sum += value; }) == 7);
+  assert(sum == 115);
+
+  assert(testQueue.tryPopFront() == 0);
+  assert(testQueue.tryPopBack() == 5);
+  testQueue.clear();
+  assert(testQueue.isEmpty());
+}
+
+
+
+template<typename Queue>
+static void testLockingMultithread()
+{
+  //Производители в конец и середину, потребители из начала
+  Queue testQueue;
+  const int COUNT = 5000;
+  std::atomic<int> popped(0);
+  std::vector<std::thread> threads;
+  for (size_t i=0; i<2; ++i){
+    threads.emplace_back([&testQueue](){
+      for (int value=0; value<COUNT; ++value){
+        testQueue.pushBack(value);
+        testQueue.insertIntoMiddle(value, value % 7);
+      }
+    });
+    threads.emplace_back([&testQueue, &popped](){
+      for (int value=0; value<COUNT; ++value){
+        if (testQueue.tryPopFront()){
+          ++popped;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads){
+    thread.join();
+  }
+  assert(testQueue.getSize() == 4*COUNT - static_cast<size_t>(popped));
+  assert(testQueue.forEach([](int){}) == testQueue.getSize());
+}
+
+
+
+static void testLockingConversion()
+{
+  using Allocator = PoolAllocator<int>;
+  using NullQueue = FineGrainedQueue<int, Allocator, NoLockStats, NullLocking<>>;
+  using Queue = FineGrainedQueue<int, Allocator>;
+  static_assert(std::is_same_v<NullQueue::Node, Queue::Node>);
+
+  //Список заполняется в одном потоке без блокировок
+  NullQueue building(NullQueue::IndexMode::SKIP_LIST);
+  for (int value=0; value<1000; ++value){
+    building.pushBack(value);
+  }
+  building.setTraversalMode(NullQueue::TraversalMode::OPTIMISTIC);
+  const int* first = building.visitValue(0, [](const int& value){ return &value; });
+  const int* last = building.visitValue(999, [](const int& value){ return &value; });
+
+  //Перевод в политику по умолчанию: элементы те же, режимы сохранены
+  Queue testQueue(std::move(building));
+  assert(building.isEmpty());
+  assert(testQueue.getSize() == 1000);
+  assert(testQueue.getIndexMode() == Queue::IndexMode::SKIP_LIST);
+  assert(testQueue.getTraversalMode() == Queue::TraversalMode::OPTIMISTIC);
+  assert(testQueue.visitValue(0, [](const int& value){ return &value; }) == first);
+  assert(testQueue.visitValue(999, [](const int& value){ return &value; }) == last);
+
+  //Список работает в нескольких потоках
+  std::vector<std::thread> threads;
+  for (int i=0; i<2; ++i){
+    threads.emplace_back([&testQueue, i](){
+      for (int value=0; value<1000; ++value){
+        testQueue.pushBack(value);
+        assert(testQueue.getValue(500 + i) >= 0);
+      }
+    });
+  }
+  threads.emplace_back([&testQueue](){
+    for (int value=0; value<500; ++value){
+      testQueue.tryPopFront();
+    }
+  });
+  for (auto& thread : threads){
+    thread.join();
+  }
+  assert(testQueue.getSize() == 2500);
+
+  //Обратный перевод для однопоточного этапа
+  NullQueue back(std::move(testQueue));
+  assert(testQueue.isEmpty());
+  assert(back.getSize() == 2500);
+  assert(back.getValue(0) == 500);
+  assert(back.tryPopBack() == 999);
+
+  //Перевод списка со статистикой: mutex элемента - обёртка LockStats
+  FineGrainedQueue<int, Allocator, LockStats, NullLocking<>> countedBuilding = {1, 2, 3};
+  FineGrainedQueue<int, Allocator, LockStats> counted(std::move(countedBuilding));
+  counted.resetStats();
+  assert(counted.getValue(2) == 3);
+  assert(counted.getStats()[LockKind::NODE].acquisitions == 3);
+}
+
+
+
+static void testSizeModeOnethread();
+static void testSizeModeMultithread();
+
+static void testSizeMode()
+{
+  testSizeModeOnethread();
+  testSizeModeMultithread();
+}
+
+
+
+static void testSizeModeOnethread()
+{
+  using Queue = FineGrainedQueue<int>;
+  //Начало, конец списка и размер - в разных кэш-линиях
+  static_assert(alignof(Queue) == 64);
+
+  Queue exactQueue;
+  assert(exactQueue.getSizeMode() == Queue::SizeMode::EXACT);
+
+  Queue testQueue(Queue::SizeMode::SHARDED);
+  assert(testQueue.getSizeMode() == Queue::SizeMode::SHARDED);
+  assert(testQueue.getIndexMode() == Queue::IndexMode::NONE);
+  assert(testQueue.isEmpty());
+  testQueue.pushBackBulk(std::vector<int>{1, 2, 3});
+  testQueue.pushFront(0);
+  testQueue.insertIntoMiddle(100, 2);
+  assert(testQueue.getSize() == 5);
+  assert(testQueue.getValue(4) == 3);
+  assert(testQueue.tryPopFront() == 0);
+  assert(testQueue.tryPopBack() == 3);
+  assert(testQueue.getSize() == 3);
+  testQueue.clear();
+  assert(testQueue.isEmpty());
+
+  //Индекс и распределённый счётчик вместе; счётчик сохраняется при
+  //переводе в другую политику блокировок
+  using NullQueue = FineGrainedQueue<int, PoolAllocator<int>, NoLockStats, NullLocking<>>;
+  NullQueue building(NullQueue::IndexMode::SKIP_LIST, NullQueue::SizeMode::SHARDED);
+  building.pushBackBulk(std::vector<int>{1, 2, 3});
+  Queue converted(std::move(building));
+  assert(converted.getSizeMode() == Queue::SizeMode::SHARDED);
+  assert(converted.getSize() == 3);
+  assert(building.getSize() == 0);
+}
+
+
+
+static void testSizeModeMultithread()
+{
+  //Элементы добавляются и извлекаются в разных потоках: размер не
+  //выходит за границы и точен после завершения потоков
+  using Queue = FineGrainedQueue<int>;
+  for (const auto mode : {Queue::SizeMode::EXACT, Queue::SizeMode::SHARDED}){
+    Queue testQueue(mode);
+    const int COUNT = 20000;
+    std::atomic<int> popped(0);
+    std::atomic<bool> done(false);
+    std::vector<std::thread> threads;
+    for (int i=0; i<2; ++i){
+      threads.emplace_back([&testQueue](){
+        for (int value=0; value<COUNT; ++value){
+          testQueue.pushBack(value);
+        }
+      });
+      threads.emplace_back([&testQueue, &popped](){
+        for (int value=0; value<COUNT; ++value){
+          if (testQueue.tryPopFront()){
+            ++popped;
+          }
+        }
+      });
+    }
+    std::thread checker([&testQueue, &done](){
+      while (!done){
+        assert(testQueue.getSize() <= 2*COUNT);
+      }
+    });
+    for (auto& thread : threads){
+      thread.join();
+    }
+    done = true;
+    checker.join();
+    assert(testQueue.getSize() == 2*COUNT - static_cast<size_t>(popped));
+    assert(testQueue.forEach([](int){}) == testQueue.getSize());
+  }
+}
+
+
+
+static void testPushModeOnethread();
+static void testPushModeMiltithread();
+
+static void testPushMode()
+{
+  testPushModeOnethread();
+  testPushModeMiltithread();
+}
+
+
+
+static void testPushModeOnethread()
+{
+  using Queue = FineGrainedQueue<int>;
+  Queue testQueue;
+  assert(testQueue.getPushMode() == Queue::PushMode::DIRECT);
+  testQueue.setPushMode(Queue::PushMode::COMBINING);
+  assert(testQueue.getPushMode() == Queue::PushMode::COMBINING);
+
+  //Без других потоков пакет - одно добавление, порядок как в DIRECT
+  testQueue.pushBack(2);
+  testQueue.pushFront(1);
+  testQueue.emplaceBack(3);
+  testQueue.emplaceFront(0);
+  testQueue.insertIntoMiddle(5, 2);
+  assert(testQueue.getSize() == 5);
+  const int expected[] = {0, 1, 5, 2, 3};
+  for (size_t i=0; i<5; ++i){
+    assert(testQueue.getValue(i) == expected[i]);
+  }
+
+  //Способ добавления переходит к перемещённому и отделённому списку
+  Queue moved(std::move(testQueue));
+  assert(moved.getPushMode() == Queue::PushMode::COMBINING);
+  Queue suffix = moved.splitAt(2);
+  assert(suffix.getPushMode() == Queue::PushMode::COMBINING);
+  suffix.pushBack(4);
+  assert(suffix.getSize() == 4 && suffix.getValue(3) == 4);
+
+  //С индексом добавления пакета попадают в индекс
+  Queue indexed(Queue::IndexMode::SKIP_LIST);
+  indexed.setPushMode(Queue::PushMode::COMBINING);
+  for (int i=0; i<100; ++i){
+    indexed.pushBack(i);
+  }
+  assert(indexed.getValue(99) == 99);
+  assert(*indexed.tryPopBack() == 99);
+
+  //Обратно в DIRECT - комбинатор остаётся, но не используется
+  moved.setPushMode(Queue::PushMode::DIRECT);
+  moved.pushBack(7);
+  assert(moved.getValue(moved.getSize()-1) == 7);
+}
+
+
+
+static void testPushModeMiltithread()
+{
+  //Производители добавляют в начало и в конец, потребители извлекают:
+  //каждое значение добавлено ровно один раз, порядок добавлений
+  //одного производителя в конец сохраняется
+  using Queue = FineGrainedQueue<int>;
+  for (const Queue::IndexMode indexMode : {Queue::IndexMode::NONE, Queue::IndexMode::SKIP_LIST}){
+    Queue testQueue(indexMode);
+    testQueue.setPushMode(Queue::PushMode::COMBINING);
+    const int PRODUCERS = 8;
+    const int COUNT = 2000;
+    std::atomic<int> popped(0);
+    std::vector<std::thread> threads;
+    for (int t=0; t<PRODUCERS; ++t){
+      threads.emplace_back([&testQueue, t](){
+        for (int i=0; i<COUNT; ++i){
+          const int value = t * COUNT + i;
+          if (t % 4 == 3){
+            testQueue.pushFront(value);
+          }
+          else{
+            testQueue.pushBack(value);
+          }
+        }
+      });
+    }
+    threads.emplace_back([&testQueue, &popped](){
+      for (int i=0; i<COUNT; ++i){
+        if (testQueue.tryPopFront()){
+          ++popped;
+        }
+      }
+    });
+    for (auto& thread : threads){
+      thread.join();
+    }
+    assert(testQueue.getSize() == static_cast<size_t>(PRODUCERS * COUNT - popped));
+
+    std::vector<int> last(PRODUCERS, -1);
+    size_t count = 0;
+    testQueue.forEach([&last, &count](int value){
+      const int producer = value / COUNT;
+      if (producer % 4 != 3){
+        assert(value > last[producer]);
+        last[producer] = value;
+      }
+      ++count;
+    });
+    assert(count == testQueue.getSize());
+  }
+}
+
+
+
+static void testLatencyStatsOnethread();
+static void testLatencyStatsMiltithread();
+
+static void testLatencyStats()
+{
+  testLatencyStatsOnethread();
+  testLatencyStatsMiltithread();
+}
+
+
+
+static void testLatencyStatsOnethread()
+{
+  //Без включения задержки не записываются
+  FineGrainedQueue<int> testQueue;
+  testQueue.pushBack(1);
+  assert(testQueue.getLatencyStats()[OperationKind::PUSH_BACK].getCount() == 0);
+
+  testQueue.setLatencyStats(true);
+  testQueue.pushBack(2);
+  testQueue.emplaceBack(3);
+  testQueue.pushFront(0);
+  testQueue.insertIntoMiddle(5, 2);
+  testQueue.getValue(1);
+  testQueue.visitValue(3, [](int){});
+  testQueue.erase(2);
+  testQueue.tryPopFront();
+  testQueue.tryPopBack();
+  testQueue.pushBackBulk(std::vector<int>{7, 8});   //Пакетное добавление - свой вид
+  LatencySnapshot snapshot = testQueue.getLatencyStats();
+  assert(snapshot[OperationKind::PUSH_BACK].getCount() == 2);
+  assert(snapshot[OperationKind::PUSH_BACK_BULK].getCount() == 1);
+  assert(snapshot[OperationKind::PUSH_FRONT].getCount() == 1);
+  assert(snapshot[OperationKind::INSERT].getCount() == 1);
+  assert(snapshot[OperationKind::GET_VALUE].getCount() == 2);
+  assert(snapshot[OperationKind::ERASE].getCount() == 1);
+  assert(snapshot[OperationKind::POP_FRONT].getCount() == 1);
+  assert(snapshot[OperationKind::POP_BACK].getCount() == 1);
+  //Самая долгая вставка - единственная: позиция 2, длина после вставки 5
+  const SlowestOperation& slowest = snapshot.slowest[static_cast<size_t>(OperationKind::INSERT)];
+  assert(slowest.ns == snapshot[OperationKind::INSERT].getMax());
+  assert(slowest.position == 2 && slowest.length == 5);
+
+  //popFront() без ожидания - одно извлечение из начала; исключение
+  //тоже завершает операцию
+  testQueue.popFront();
+  try{
+    testQueue.getValue(100);
+  }
+  catch (const std::out_of_range&){
+  }
+  snapshot = testQueue.getLatencyStats();
+  assert(snapshot[OperationKind::POP_FRONT].getCount() == 2);
+  assert(snapshot[OperationKind::GET_VALUE].getCount() == 3);
+
+  //Остальные операции над элементами - по одной записи на вызов,
+  //операции, вызывающие другие (peekFront, forEach, countIf), не
+  //записываются дважды
+  testQueue.pushFrontBulk(std::vector<int>{-2, -1});
+  testQueue.insertBulkAt(2, std::vector<int>{4, 5, 6});
+  testQueue.peekFront();
+  testQueue.tryPeekBack();
+  testQueue.forEach([](int){});
+  testQueue.forEachRange(1, 3, [](int){});
+  testQueue.countIf([](int value){ return value > 0; });
+  testQueue.removeFirst(4);
+  testQueue.removeIf([](int value){ return value < 0; });
+  FineGrainedQueue<int> suffix = testQueue.splitAt(2);
+  testQueue.appendAll(std::move(suffix));
+  testQueue.clear();
+  snapshot = testQueue.getLatencyStats();
+  for (const OperationKind kind : {OperationKind::PUSH_FRONT_BULK, OperationKind::INSERT_BULK,
+                                   OperationKind::PEEK_FRONT, OperationKind::PEEK_BACK,
+                                   OperationKind::PARALLEL, OperationKind::REMOVE_FIRST,
+                                   OperationKind::REMOVE_IF, OperationKind::SPLIT_AT,
+                                   OperationKind::APPEND_ALL, OperationKind::CLEAR}){
+    assert(snapshot[kind].getCount() == 1);
+  }
+  assert(snapshot[OperationKind::FOR_EACH].getCount() == 2);
+  assert(snapshot.slowest[static_cast<size_t>(OperationKind::INSERT_BULK)].position == 2);
+  assert(snapshot[OperationKind::GET_VALUE].getCount() == 3);
+  //Отделённый список пишет в свои гистограммы
+  assert(suffix.getLatencyStats()[OperationKind::APPEND_ALL].getCount() == 0);
+
+  //Обнуление и выключение
+  testQueue.resetLatencyStats();
+  assert(testQueue.getLatencyStats()[OperationKind::PUSH_BACK].getCount() == 0);
+  testQueue.setLatencyStats(false);
+  testQueue.pushBack(9);
+  assert(testQueue.getLatencyStats()[OperationKind::PUSH_BACK].getCount() == 0);
+}
+
+
+
+static void testLatencyStatsMiltithread()
+{
+  //Задержки всех потоков попадают в снимок; снимок во время операций
+  FineGrainedQueue<int> testQueue(FineGrainedQueue<int>::IndexMode::SKIP_LIST);
+  testQueue.setLatencyStats(true);
+  const int THREADS = 4;
+  const int COUNT = 2000;
+  std::atomic<bool> done(false);
+  std::vector<std::thread> threads;
+  for (int t=0; t<THREADS; ++t){
+    threads.emplace_back([&testQueue](){
+      for (int i=0; i<COUNT; ++i){
+        testQueue.pushBack(i);
+        testQueue.insertIntoMiddle(i, static_cast<size_t>(i) / 2);
+        testQueue.getValue(static_cast<size_t>(i));
+      }
+    });
+  }
+  std::thread reader([&testQueue, &done](){
+    while (!done){
+      const LatencySnapshot snapshot = testQueue.getLatencyStats();
+      assert(snapshot[OperationKind::PUSH_BACK].getCount() <= THREADS * COUNT);
+      testQueue.resetLatencyStats();
+    }
+  });
+  for (auto& thread : threads){
+    thread.join();
+  }
+  done = true;
+  reader.join();
+
+  testQueue.resetLatencyStats();
+  for (int i=0; i<COUNT; ++i){
+    testQueue.tryPopBack();
+  }
+  const LatencySnapshot snapshot = testQueue.getLatencyStats();
+  assert(snapshot[OperationKind::POP_BACK].getCount() == COUNT);
+  assert(snapshot[OperationKind::POP_BACK].percentile(0.5) <=
+         snapshot[OperationKind::POP_BACK].percentile(0.999));
+  assert(snapshot[OperationKind::PUSH_BACK].getCount() == 0);
+}
+
+
+
+static void testCapacityOnethread();
+static void testCapacityMiltithread();
+static void testCapacityClear();
+
+static void testCapacity()
+{
+  testCapacityOnethread();
+  testCapacityMiltithread();
+  testCapacityClear();
+}
+
+
+
+static void testCapacityOnethread()
+{
+  using Queue = FineGrainedQueue<std::unique_ptr<int>>;
+  for (const auto indexMode : {Queue::IndexMode::NONE, Queue::IndexMode::SKIP_LIST}){
+    //По-умолчанию ёмкость не ограничена
+    Queue testQueue(indexMode);
+    assert(testQueue.getCapacity() == 0);
+    assert(testQueue.tryPushBack(std::make_unique<int>(0)));
+    testQueue.setCapacity(3);
+    assert(testQueue.getCapacity() == 3);
+    testQueue.pushBack(std::make_unique<int>(1));
+    testQueue.emplaceBack(new int(2));
+    assert(testQueue.getSize() == 3);
+
+    //Список заполнен - значение не перемещается
+    std::unique_ptr<int> value = std::make_unique<int>(3);
+    assert(!testQueue.tryPushBack(std::move(value)));
+    assert(value && *value == 3);
+    assert(!testQueue.pushBackFor(std::move(value), std::chrono::milliseconds(20)));
+    assert(value && *value == 3);
+    assert(testQueue.getSize() == 3);
+
+    //Добавление в начало не ждёт места
+    testQueue.pushFront(std::make_unique<int>(-1));
+    assert(testQueue.getSize() == 4);
+
+    //Извлечение освобождает место
+    assert(*testQueue.popFront() == -1);
+    assert(*testQueue.popFront() == 0);
+    assert(testQueue.tryPushBack(std::move(value)));
+    assert(!value);
+    assert(testQueue.getSize() == 3);
+    testQueue.visitValue(2, [](const std::unique_ptr<int>& last){ assert(*last == 3); });
+
+    //Увеличение ёмкости и снятие ограничения
+    testQueue.setCapacity(4);
+    assert(testQueue.pushBackFor(std::make_unique<int>(4), std::chrono::milliseconds(1)));
+    assert(!testQueue.tryPushBack(std::make_unique<int>(5)));
+    testQueue.setCapacity(0);
+    assert(testQueue.tryPushBack(std::make_unique<int>(5)));
+    assert(testQueue.getSize() == 5);
+  }
+
+  //Ёмкость переносится в часть, отделённую splitAt
+  FineGrainedQueue<int> testQueue = {1, 2, 3};
+  testQueue.setCapacity(3);
+  FineGrainedQueue<int> suffix = testQueue.splitAt(1);
+  assert(suffix.getCapacity() == 3);
+  assert(testQueue.tryPushBack(4));
+  assert(suffix.tryPushBack(5));
+  assert(!suffix.tryPushBack(6));
+}
+
+
+
+static void testCapacityMiltithread()
+{
+  //Производители ждут места, потребители освобождают его;
+  //размер не превышает ёмкости, все значения доставляются
+  using Queue = FineGrainedQueue<int>;
+  for (const auto indexMode : {Queue::IndexMode::NONE, Queue::IndexMode::SKIP_LIST}){
+    Queue testQueue(indexMode);
+    const size_t CAPACITY = 8;
+    testQueue.setCapacity(CAPACITY);
+    const int PRODUCERS = 4;
+    const int CONSUMERS = 2;
+    const int COUNT = 2000;
+    std::atomic<long> sum(0);
+    std::atomic<int> consumed(0);
+    std::atomic<int> timeouts(0);
+    std::vector<std::thread> threads;
+    for (int t=0; t<PRODUCERS; ++t){
+      threads.emplace_back([&testQueue, &timeouts, t](){
+        for (int i=0; i<COUNT; ++i){
+          const int value = t * COUNT + i;
+          //Половина производителей - с таймаутом, повтор до успеха
+          if (t % 2){
+            while (!testQueue.pushBackFor(value, std::chrono::microseconds(100))){
+              ++timeouts;
+            }
+          }
+          else{
+            testQueue.pushBack(value);
+          }
+          assert(testQueue.getSize() <= CAPACITY);
+        }
+      });
+    }
+    for (int t=0; t<CONSUMERS; ++t){
+      threads.emplace_back([&testQueue, &sum, &consumed](){
+        while (consumed < PRODUCERS * COUNT){
+          if (std::optional<int> value = testQueue.popFrontFor(std::chrono::milliseconds(1))){
+            sum += *value;
+            ++consumed;
+          }
+        }
+      });
+    }
+    for (auto& thread : threads){
+      thread.join();
+    }
+    assert(testQueue.isEmpty());
+    const long total = PRODUCERS * COUNT;
+    assert(sum == total * (total - 1) / 2);
+  }
+}
+
+
+
+static void testCapacityClear()
+{
+  //Вставка в середину, попавшая в цепочку, отсоединённую clear(),
+  //учитывается в размере до фоновой задачи clear(). Задача уменьшает
+  //размер и будит производителя, ждущего места в pushBack()
+  const int COUNT = 100000;
+  bool raced = false;
+  for (int attempt=0; attempt<200 && !raced; ++attempt){
+    FineGrainedQueue<int> testQueue;
+    testQueue.pushBackBulk(std::views::iota(0, COUNT));
+    testQueue.setCapacity(1);
+    std::atomic<bool> started(false);
+    std::thread inserter([&testQueue, &started](){
+      started = true;
+      try{
+        testQueue.insertIntoMiddle(-1, COUNT-1);
+      }
+      catch (const std::out_of_range&){
+      }
+    });
+    while (!started){
+      std::this_thread::yield();
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(attempt * 20));
+
+    std::atomic<bool> pushed(false);
+    std::thread producer;
+    {
+      //Задача clear() ждёт завершения Guard: производитель успевает уснуть
+      EpochReclaimer::Guard guard;
+      testQueue.clear();
+      inserter.join();
+      //Список пуст, а размер учитывает вставку в отсоединённую цепочку
+      raced = testQueue.getSize() == 1 && !testQueue.tryPeekFront();
+      if (raced){
+        producer = std::thread([&testQueue, &pushed](){
+          testQueue.pushBack(1);
+          pushed = true;
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        assert(!pushed);
+      }
+    }
+    if (raced){
+      const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+      while (!pushed && std::chrono::steady_clock::now() < deadline){
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      assert(pushed);
+      producer.join();
+      assert(testQueue.getSize() == 1);
+    }
+  }
+}
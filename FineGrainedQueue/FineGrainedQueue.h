@@ -1,42 +1,217 @@
 /**
 \file FineGrainedQueue.h
-\brief Класс - потокобезопасный односвязный список с мелкогранулярными блокировками
+\brief Шаблон класса - потокобезопасный односвязный список с мелкогранулярными блокировками
 
 Методы:
 - добавить элемент в начало списка
 - добавить элемент в конец списка
 - добавить элемент в заданную позицию списка
+- сконструировать элемент на месте в начале / конце / заданной позиции списка
+- добавить диапазон элементов в начало / конец / заданную позицию списка
+  за один захват mutex
+- ограничить ёмкость списка: добавление в конец без ожидания (tryPushBack),
+  с ожиданием места (pushBack) и с таймаутом (pushBackFor)
 - получить количество элементов в списке
 - получить значение элемента в заданной позиции списка
+- прочитать первый / последний элемент без блокировок списка (peekFront / peekBack)
+- прочитать элемент в заданной позиции списка без копирования (посетителем)
+- обойти все элементы / элементы диапазона позиций за один проход (посетителем)
+- свернуть / обойти / подсчитать элементы в несколько потоков: список
+  делится на участки, участки обходятся в потоках ThreadPool
 - получить признак - пуст ли список
+- извлечь элемент из начала списка (без ожидания, с ожиданием, с таймаутом)
+- извлечь элемент из конца списка
+- удалить элемент в заданной позиции / первый элемент с заданным значением /
+  все элементы, удовлетворяющие условию (за один проход)
+- удалить все элементы: цепочка отсоединяется за O(1), удаляется в фоновом потоке
+- выбрать способ прохода по списку: захват mutex по цепочке или
+  оптимистичный проход без блокировок с проверкой найденного элемента
+- выбрать способ добавления в начало / конец: каждый поток захватывает
+  mutex сам или flat combining - добавления многих потоков выполняет
+  пакетом один поток (FlatCombiner)
+- при создании списка включить позиционный индекс (skip list) -
+  доступ и вставка по позиции за O(log n)
+- получить статистику блокировок (если выбрана политика LockStats)
+- включить гистограммы задержек операций (LatencyStats): перцентили
+  задержек каждого вида операций над элементами, самая долгая
+  операция с позицией и длиной списка
+- перевести список другой политики блокировок в эту без копирования элементов
+- переместить список; перенести все элементы другого списка в конец за O(1);
+  отделить элементы начиная с заданной позиции в новый список
+
+Значения хранятся внутри элементов списка и при извлечении перемещаются -
+тип T может быть только перемещаемым (например std::unique_ptr).
+Элементы списка размещаются аллокатором Allocator (по умолчанию - пул блоков
+NodePool: память выделяется у системы крупными кусками, освобождённые
+элементы переиспользуются). Сбор статистики блокировок задаёт третий
+параметр шаблона: NoLockStats (по умолчанию, без затрат) или LockStats.
+Четвёртый параметр - политика блокировок (LockPolicy.h): какие mutex
+захватываются, в том числе NullLocking<> - без блокировок для
+однопоточных этапов работы со списком.
+Элементы связаны обычными указателями: проход по списку не меняет
+счётчиков ссылок. Исключённый из списка элемент удаляется не сразу,
+а через EpochReclaimer - когда его уже не может читать ни один поток,
+проходящий по списку без блокировок
 */
 
 #pragma once
 
 #include <shared_mutex>
 #include <mutex>
+#include <condition_variable>
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
 #include <memory>
 #include <initializer_list>
+#include <iterator>
+#include <ranges>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "NodePool/PoolAllocator.h"
+#include "SkipListIndex/SkipListIndex.h"
+#include "FlatCombiner/FlatCombiner.h"
+#include "EpochReclaimer/EpochReclaimer.h"
+#include "ThreadPool/ThreadPool.h"
+#include "LockStats/LockStats.h"
+#include "LatencyStats/LatencyStats.h"
+#include "SizeCounter/SizeCounter.h"
+#include "Exceptions/ListIsEmpty_Exception.h"
+
+
+//Элемент списка FineGrainedQueue. Тип зависит только от T и mutex элемента
+//(NodeStorage политики блокировок): списки разных политик с одинаковым
+//NodeStorage передают друг другу элементы без копирования.
+//next читается без блокировок при оптимистичном проходе - поэтому атомарный;
+//removed выставляется под mutex элемента при исключении элемента из списка,
+//next исключённого элемента по-прежнему ведёт дальше по списку и больше
+//не меняется. removed атомарный: параллельный обход проверяет границы
+//участков без блокировок
+template<typename T, typename NodeLock>
+struct ListNode{
+  template<typename... Args>
+  explicit ListNode(std::in_place_t, Args&&... args):
+    value(std::forward<Args>(args)...), next(nullptr), removed(false){}
+  T value;
+  std::atomic<ListNode*> next;
+  NodeLock mutex;
+  std::atomic<bool> removed;
+};
+
 
 
+template<typename T = int, typename Allocator = PoolAllocator<T>,
+         typename Stats = NoLockStats, typename Locking = CompactLocking>
 class FineGrainedQueue{
+  private:
+    //mutex элемента, хранящийся в элементе
+    using NodeStorage =
+      typename Stats::template Mutex<LockKind::NODE, typename Locking::NodeStorage>;
+
   public:
-    //Элемент списка
-    struct Node{
-      explicit Node(int v): value(v), next(nullptr){}
-      int value;
-      std::shared_ptr<Node> next;
-      std::shared_mutex mutex;
+    using Node = ListNode<T, NodeStorage>;
+
+    //Способ прохода по списку в insertIntoMiddle / emplaceAt / getValue / visitValue
+    enum class TraversalMode{
+      LOCK_COUPLING,  //Захват mutex каждого элемента по цепочке
+      OPTIMISTIC      //Проход без блокировок, захват и проверка только найденного
+                      //элемента; при неудачной проверке - LOCK_COUPLING
+    };
+
+    //Способ обхода списка в forEach / forEachRange
+    enum class ScanMode{
+      LOCK_COUPLING,  //mutex элементов захватываются на чтение по цепочке:
+                      //обгонять обход и менять список перед ним нельзя
+      WEAK            //mutex элемента захватывается только на время вызова
+                      //посетителя: обход не задерживает изменения списка,
+                      //но может пропустить элементы, добавленные во время обхода
+    };
+
+    //Способ добавления в начало / конец списка в pushFront / pushBack /
+    //emplaceFront / emplaceBack
+    enum class PushMode{
+      DIRECT,     //Каждый поток захватывает mutex начала / конца списка сам
+      COMBINING   //Flat combining: поток публикует элемент в своём слоте,
+                  //поток, захвативший комбинатор, собирает элементы всех
+                  //слотов в цепочки и добавляет каждую за один захват mutex
+    };
+
+    //Позиционный индекс - задаётся при создании списка
+    enum class IndexMode{
+      NONE,       //Позиция ищется проходом по списку (см. TraversalMode)
+      SKIP_LIST   //Индексируемый skip list поверх элементов списка: getValue,
+                  //visitValue и вставка в середину за O(log n). Изменения списка
+                  //выполняются по одному под mutex индекса, чтения - параллельно
     };
 
+    //Счётчик размера - задаётся при создании списка (см. SizeCounter):
+    //EXACT - один счётчик, меняется под mutex изменяемого места списка;
+    //SHARDED - счётчик на группу потоков, getSize() приблизителен
+    using SizeMode = SizeCounter::Mode;
+
     FineGrainedQueue();
-		FineGrainedQueue(std::initializer_list<int> values);
+		FineGrainedQueue(std::initializer_list<T> values);
+
+    /**
+    Создать пустой список с заранее выделенной памятью под элементы
+    \param[in] reservedNodes Количество элементов
+    */
+    explicit FineGrainedQueue(size_t reservedNodes);
+
+    /**
+    Создать пустой список с позиционным индексом
+    \param[in] indexMode Позиционный индекс
+    \param[in] sizeMode Счётчик размера
+    */
+    explicit FineGrainedQueue(IndexMode indexMode, SizeMode sizeMode = SizeMode::EXACT);
+
+    /**
+    Создать пустой список с заданным счётчиком размера
+    \param[in] sizeMode Счётчик размера
+    */
+    explicit FineGrainedQueue(SizeMode sizeMode);
+
+    /**
+    Перевести список другой политики блокировок в эту политику
+    без копирования элементов: элементы, индекс и режимы прохода
+    забираются у other за O(1), other остаётся пустым. Например, список
+    заполняется в одном потоке с NullLocking<> и переводится в CompactLocking.
+    Другие потоки не должны обращаться к other во время перевода
+    \param[in] other Список; NodeStorage политик должен совпадать
+    */
+    template<typename OtherStats, typename OtherLocking>
+      requires (!std::is_same_v<FineGrainedQueue<T, Allocator, OtherStats, OtherLocking>,
+                                FineGrainedQueue<T, Allocator, Stats, Locking>>)
+    explicit FineGrainedQueue(FineGrainedQueue<T, Allocator, OtherStats, OtherLocking>&& other);
+
+    /**
+    Переместить список: элементы, индекс и режимы забираются у other
+    за O(1), other остаётся пустым. Другие потоки не должны обращаться
+    к other во время перемещения
+    \param[in] other Список
+    */
+    FineGrainedQueue(FineGrainedQueue&& other);
 
     FineGrainedQueue(const FineGrainedQueue& other) = delete;
-    FineGrainedQueue(const FineGrainedQueue&& other) = delete;
     FineGrainedQueue& operator=(const FineGrainedQueue& other) = delete;
-    FineGrainedQueue& operator=(FineGrainedQueue&& other) = delete;
+
+    /**
+    Заменить элементы списка элементами other. Прежние элементы удаляются,
+    как в clear(). Индекс и счётчик размера списка не меняются: если индекс
+    есть только у этого списка, он строится за O(n), иначе элементы
+    забираются за O(1). Другие потоки не должны обращаться к обоим
+    спискам во время перемещения
+    \param[in] other Список; после вызова пуст
+    \return Этот список
+    */
+    FineGrainedQueue& operator=(FineGrainedQueue&& other);
 
     ~FineGrainedQueue();
 
@@ -44,13 +219,34 @@ class FineGrainedQueue{
     Вставить элемент в начало списка
     \param[in] value Значение элемента
     */
-    void pushFront(int value);
+    void pushFront(const T& value);
+    void pushFront(T&& value);
+
+    /**
+    Вставить элемент в конец списка. Если задана ёмкость и список
+    заполнен - ждать, пока потребители освободят место
+    \param[in] value Значение элемента
+    */
+    void pushBack(const T& value);
+    void pushBack(T&& value);
+
+    /**
+    Вставить элемент в конец списка без ожидания места
+    \param[in] value Значение элемента
+    \return false - список заполнен (см. setCapacity), value не перемещено
+    */
+    bool tryPushBack(const T& value);
+    bool tryPushBack(T&& value);
 
     /**
-    Вставить элемент в конец списка
+    Вставить элемент в конец списка. Если список заполнен - ждать
+    места не дольше timeout
     \param[in] value Значение элемента
+    \param[in] timeout Максимальное время ожидания
+    \return false - время истекло, value не перемещено
     */
-    void pushBack(int value);
+    bool pushBackFor(const T& value, std::chrono::nanoseconds timeout);
+    bool pushBackFor(T&& value, std::chrono::nanoseconds timeout);
 
     /**
     Вставить элемент в заданную позицию
@@ -58,31 +254,3017 @@ class FineGrainedQueue{
     \param[in] value Значение элемента
     \param[in] pos Позиция в списке куда поместить
     */
-    void insertIntoMiddle(int value, size_t pos);
+    void insertIntoMiddle(const T& value, size_t pos);
+    void insertIntoMiddle(T&& value, size_t pos);
+
+    /**
+    Сконструировать элемент на месте в начале списка
+    \param[in] args Аргументы конструктора T
+    */
+    template<typename... Args>
+    void emplaceFront(Args&&... args);
+
+    /**
+    Сконструировать элемент на месте в конце списка; если список
+    заполнен - ждать места (см. pushBack)
+    \param[in] args Аргументы конструктора T
+    */
+    template<typename... Args>
+    void emplaceBack(Args&&... args);
+
+    /**
+    Сконструировать элемент на месте в заданной позиции
+    Если позиция больше длины списка - вставить в конец
+    \param[in] pos Позиция в списке куда поместить
+    \param[in] args Аргументы конструктора T
+    */
+    template<typename... Args>
+    void emplaceAt(size_t pos, Args&&... args);
+
+    /**
+    Вставить элементы со значениями из диапазона в начало списка
+    одной операцией: элементы связываются в цепочку заранее, без
+    блокировок, и вставляются за один захват mutex. Порядок
+    элементов диапазона сохраняется
+    \param[in] first Начало диапазона
+    \param[in] last Конец диапазона
+    */
+    template<std::input_iterator Iterator, std::sentinel_for<Iterator> Sentinel>
+    void pushFrontBulk(Iterator first, Sentinel last);
+
+    /**
+    \param[in] values Диапазон значений
+    */
+    template<std::ranges::input_range Range>
+    void pushFrontBulk(Range&& values);
+
+    /**
+    Вставить элементы со значениями из диапазона в конец списка
+    одной операцией (см. pushFrontBulk)
+    \param[in] first Начало диапазона
+    \param[in] last Конец диапазона
+    */
+    template<std::input_iterator Iterator, std::sentinel_for<Iterator> Sentinel>
+    void pushBackBulk(Iterator first, Sentinel last);
+
+    /**
+    \param[in] values Диапазон значений
+    */
+    template<std::ranges::input_range Range>
+    void pushBackBulk(Range&& values);
+
+    /**
+    Вставить элементы со значениями из диапазона в заданную позицию
+    одной операцией (см. pushFrontBulk): первый элемент диапазона
+    окажется в позиции pos. Если позиция больше длины списка - вставить в конец
+    \param[in] pos Позиция в списке куда поместить
+    \param[in] first Начало диапазона
+    \param[in] last Конец диапазона
+    */
+    template<std::input_iterator Iterator, std::sentinel_for<Iterator> Sentinel>
+    void insertBulkAt(size_t pos, Iterator first, Sentinel last);
+
+    /**
+    \param[in] pos Позиция в списке куда поместить
+    \param[in] values Диапазон значений
+    */
+    template<std::ranges::input_range Range>
+    void insertBulkAt(size_t pos, Range&& values);
+
+    /**
+    Извлечь элемент из начала списка без ожидания
+    \return Значение элемента или std::nullopt, если список пуст
+    */
+    std::optional<T> tryPopFront();
+
+    /**
+    Извлечь элемент из начала списка.
+    Если список пуст - ждать, пока в него добавят элемент
+    \return Значение элемента
+    */
+    T popFront();
+
+    /**
+    Извлечь элемент из начала списка.
+    Если список пуст - ждать добавления элемента не дольше timeout
+    \param[in] timeout Максимальное время ожидания
+    \return Значение элемента или std::nullopt, если время истекло
+    */
+    std::optional<T> popFrontFor(std::chrono::nanoseconds timeout);
+
+    /**
+    Извлечь элемент из конца списка без ожидания.
+    Список односвязный - предпоследний элемент ищется проходом от начала,
+    mutex конца списка удерживается на время прохода
+    \return Значение элемента или std::nullopt, если список пуст
+    */
+    std::optional<T> tryPopBack();
+
+    /**
+    Удалить элемент в заданной позиции. Позиция ищется проходом с захватом
+    mutex по цепочке (с индексом - по индексу); mutex начала списка
+    захватывается только для pos == 0, mutex конца - только если
+    удаляется последний элемент
+    \param[in] pos Позиция в списке
+    \return Значение удалённого элемента
+    */
+    T erase(size_t pos);
+
+    /**
+    Удалить первый элемент со значением value
+    \param[in] value Значение
+    \return true - если элемент найден и удалён
+    */
+    bool removeFirst(const T& value);
+
+    /**
+    Удалить все элементы, для которых pred(value) == true, за один проход
+    с захватом mutex по цепочке. pred вызывается под монопольно захваченным
+    mutex элемента, для элементов в начале списка - и под mutex начала
+    списка. Если проход пришлось начать заново (последний элемент удалялся
+    одновременно с изменением конца списка), pred может быть вызван для
+    элемента повторно. Элементы, добавленные во время прохода, могут
+    быть не проверены. Исключение в pred прерывает проход: удалённые до
+    него элементы остаются удалёнными
+    \param[in] pred Условие удаления: bool(const T&)
+    \return Количество удалённых элементов
+    */
+    template<typename Predicate>
+    size_t removeIf(Predicate pred);
 
     /**
-    \return Количество элементов списка
+    Удалить все элементы. Цепочка элементов отсоединяется от списка за O(1)
+    под mutex начала и конца списка, а удаляется в фоновом потоке
+    (см. EpochReclaimer::defer) - деструкторы T вызываются в нём же.
+    Вставка в середину, начатая до clear() и завершающаяся одновременно
+    с ним, может попасть в отсоединённую цепочку: getSize() учитывает
+    такие элементы, пока фоновый поток не удалит цепочку; затем он будит
+    производителей, ждущих места (см. setCapacity). Исключения (erase,
+    removeFirst, removeIf), продолжающие проход по отсоединённой цепочке,
+    размер не меняют
+    */
+    void clear();
+
+    /**
+    Перенести все элементы other в конец списка без копирования. Цепочка
+    элементов other отсоединяется под его mutex начала и конца списка,
+    присоединяется - под mutex конца списка и последнего элемента; mutex
+    обоих списков одновременно не захватываются. Без индекса - O(1); если
+    индекс есть только у этого списка, элементы добавляются в него
+    за O(log n) каждый, если у обоих - индексы соединяются за O(log n).
+    Добавление, извлечение и peek в обоих списках выполняются одновременно
+    с переносом; вставка, удаление в середине other и проходы по нему
+    ждут отсоединения цепочки (mutex структуры other захватывается монопольно)
+    \param[in] other Список; после вызова пуст
+    */
+    void appendAll(FineGrainedQueue&& other);
+
+    /**
+    Отделить элементы начиная с позиции pos в новый список без копирования.
+    Элемент pos-1 ищется под mutex начала списка проходом без блокировок -
+    O(pos), с индексом - по индексу за O(log n); цепочка разрезается под
+    mutex этого элемента и mutex конца списка. Извлечение из начала ждёт
+    разделения, добавление и извлечение из конца - только разреза.
+    Вставка, удаление в середине и проходы по списку (getValue, forEach,
+    parallel*) ждут разделения: mutex структуры захватывается монопольно
+    \param[in] pos Позиция первого отделяемого элемента; если pos не меньше
+    размера списка, новый список пуст
+    \return Список с отделёнными элементами; индекс, счётчик размера
+    и способ прохода - как у этого списка
+    */
+    FineGrainedQueue splitAt(size_t pos);
+
+    /**
+    \return Количество элементов списка. С SizeMode::SHARDED при
+    одновременных изменениях - приблизительно
     */
     size_t getSize() const;
 
     /**
     \param[in] pos Позиция в списке
-    \return Значение элемента
+    \return Копия значения элемента
+    */
+    T getValue(size_t pos) const;
+
+    /**
+    Прочитать элемент без копирования: visitor вызывается
+    под разделяемой блокировкой элемента
+    \param[in] pos Позиция в списке
+    \param[in] visitor Функция, принимающая const T&
+    \return Результат visitor
+    */
+    template<typename Visitor>
+    std::invoke_result_t<Visitor, const T&> visitValue(size_t pos,
+                                                       Visitor&& visitor) const;
+
+    /**
+    Прочитать первый / последний элемент без mutex начала и конца списка:
+    head_ / tail_ читаются атомарно, элемент не удаляется до конца чтения
+    (EpochReclaimer::Guard). Значение тривиально копируемого T копируется
+    без блокировок: оно не меняется, пока элемент не удалён (извлечение
+    копирует его). Для остальных T захватывается на чтение mutex элемента.
+    Не мешает добавлению в конец и извлечению из начала
+    \return Значение элемента, бывшего первым / последним в момент чтения
+    head_ / tail_; nullopt, если список пуст
+    */
+    std::optional<T> tryPeekFront() const;
+    std::optional<T> tryPeekBack() const;
+
+    /**
+    Прочитать первый / последний элемент (см. tryPeekFront / tryPeekBack)
+    \return Значение элемента. Если список пуст - исключение ListIsEmpty_Exception
+    */
+    T peekFront() const;
+    T peekBack() const;
+
+    /**
+    Обойти все элементы от начала к концу за один проход.
+    visitor вызывается под разделяемой блокировкой элемента и не должен
+    изменять список. Если visitor возвращает bool, false прекращает обход
+    \param[in] visitor Функция, принимающая const T&
+    \param[in] mode Способ обхода
+    \return Количество элементов, переданных visitor
+    */
+    template<typename Visitor>
+    size_t forEach(Visitor&& visitor, ScanMode mode = ScanMode::LOCK_COUPLING) const;
+
+    /**
+    Обойти элементы в позициях [begin, end) за один проход (см. forEach).
+    Позиции за концом списка пропускаются
+    \param[in] begin Позиция первого элемента
+    \param[in] end Позиция за последним элементом
+    \param[in] visitor Функция, принимающая const T&
+    \param[in] mode Способ обхода
+    \return Количество элементов, переданных visitor
+    */
+    template<typename Visitor>
+    size_t forEachRange(size_t begin, size_t end, Visitor&& visitor,
+                        ScanMode mode = ScanMode::LOCK_COUPLING) const;
+
+    /**
+    Свернуть значения всех элементов в несколько потоков (ThreadPool).
+    Первые элементы участков находятся одним проходом без блокировок
+    (с индексом - по индексу), затем участки обходятся одновременно, как
+    в forEach с ScanMode::WEAK: элементы, исключённые во время обхода,
+    пропускаются, добавленные могут быть не учтены, каждый элемент
+    учитывается не более одного раза. Короткий список обходится
+    в вызывающем потоке
+    \param[in] init Начальное значение результата каждого участка
+    (0 для суммы, наибольшее значение для минимума)
+    \param[in] accumulate Добавить значение к результату участка:
+    R(R, const T&); вызывается под разделяемой блокировкой элемента
+    \param[in] combine Объединить результаты двух соседних участков: R(R, R)
+    \return Результат; init, если список пуст
+    */
+    template<typename R, typename Accumulate, typename Combine>
+    R parallelReduce(R init, Accumulate accumulate, Combine combine) const;
+
+    /**
+    Обойти все элементы в несколько потоков (см. parallelReduce).
+    visitor вызывается одновременно из разных потоков, порядок не задан
+    \param[in] visitor Функция, принимающая const T&
+    \return Количество элементов, переданных visitor
     */
-    int getValue(size_t pos) const;
+    template<typename Visitor>
+    size_t parallelForEach(Visitor visitor) const;
+
+    /**
+    Подсчитать элементы в несколько потоков (см. parallelReduce)
+    \param[in] pred Условие: bool(const T&); вызывается одновременно
+    из разных потоков
+    \return Количество элементов, для которых pred(value) == true
+    */
+    template<typename Predicate>
+    size_t countIf(Predicate pred) const;
 
     /**
     \return Признак пуст ли список
     */
     bool isEmpty() const;
 
+    /**
+    Заранее выделить память под count элементов, чтобы последующие
+    добавления не обращались к системному аллокатору.
+    Работает с аллокаторами, у которых есть метод reserve(count)
+    \param[in] count Количество элементов
+    */
+    void reserve(size_t count);
+
+    /**
+    Ограничить количество элементов списка. Ёмкость соблюдают добавления
+    в конец: pushBack / emplaceBack ждут места, tryPushBack / pushBackFor
+    возвращают false. Добавления в начало и в середину, пакетные
+    добавления и appendAll() не ждут и могут превысить ёмкость.
+    Пока список далёк от заполнения, проверка - одно чтение размера
+    \param[in] capacity Наибольшее количество элементов; 0 - без ограничения
+    */
+    void setCapacity(size_t capacity);
+
+    /**
+    \return Ёмкость списка; 0 - без ограничения
+    */
+    size_t getCapacity() const;
+
+    /**
+    Выбрать способ прохода по списку
+    \param[in] mode Способ прохода
+    */
+    void setTraversalMode(TraversalMode mode);
+
+    /**
+    \return Способ прохода по списку
+    */
+    TraversalMode getTraversalMode() const;
+
+    /**
+    Выбрать способ добавления в начало / конец списка. COMBINING выгоден,
+    когда много потоков одновременно добавляют в один конец списка.
+    Слоты комбинатора создаются при первом включении COMBINING и
+    существуют до разрушения списка. Добавления в конец списка с
+    ограниченной ёмкостью (setCapacity) выполняются напрямую
+    \param[in] mode Способ добавления
+    */
+    void setPushMode(PushMode mode);
+
+    /**
+    \return Способ добавления в начало / конец списка
+    */
+    PushMode getPushMode() const;
+
+    /**
+    \return Позиционный индекс списка
+    */
+    IndexMode getIndexMode() const;
+
+    /**
+    \return Счётчик размера списка
+    */
+    SizeMode getSizeMode() const;
+
+    /**
+    Снимок статистики блокировок: захваты, ожидание и удержание mutex
+    начала списка, конца списка, элементов и индекса, длина проходов
+    по списку. С NoLockStats - нули
+    \return Статистика
+    */
+    LockStatsSnapshot getStats() const;
+
+    /**
+    Обнулить статистику блокировок
+    */
+    void resetStats();
+
+    /**
+    Включить / выключить гистограммы задержек операций над элементами
+    (виды - OperationKind): добавления, вставки и пакетные добавления,
+    чтения по позиции, peek, обходы, извлечения (popFront / popFrontFor -
+    без ожидания), удаления, clear, appendAll, splitAt. Выключенные
+    гистограммы стоят одного чтения флага на операцию. Гистограммы создаются при первом включении и существуют
+    до разрушения списка; при выключении накопленное сохраняется
+    \param[in] enabled Признак записи задержек
+    */
+    void setLatencyStats(bool enabled);
+
+    /**
+    Снимок гистограмм задержек, сложенных по всем потокам, и самых долгих
+    операций (задержка, позиция, длина списка). Без включения - пустой
+    \return Гистограммы задержек
+    */
+    LatencySnapshot getLatencyStats() const;
+
+    /**
+    Удалить накопленные задержки
+    */
+    void resetLatencyStats();
+
   private:
-    std::atomic<size_t> size_;    //Размер списка
-    std::shared_ptr<Node> head_;  //Указатель на первый элемент
-    std::shared_ptr<Node> tail_;  //Указатель на последний элемент
-    mutable std::shared_mutex mutexHead_;
-    mutable std::shared_mutex mutexTail_;
-};
+    template<typename, typename, typename, typename>
+    friend class FineGrainedQueue;
+
+    template<LockKind Kind>
+    using ListMutex =
+      typename Stats::template Mutex<Kind, typename Locking::template Mutex<Kind>>;
+    using HeadMutex = ListMutex<LockKind::HEAD>;
+    using TailMutex = ListMutex<LockKind::TAIL>;
+    using NodeMutex = ListMutex<LockKind::NODE>;
+    using IndexMutex = ListMutex<LockKind::INDEX>;
+    using StructureMutex = ListMutex<LockKind::STRUCTURE>;
+
+    //Ёмкость списка без ограничения
+    static constexpr size_t UNBOUNDED = SIZE_MAX;
+    //Количество попыток оптимистичного прохода до перехода к захвату по цепочке
+    static constexpr int OPTIMISTIC_ATTEMPTS = 2;
+    //Наименьший участок параллельного обхода и участков на исполнителя
+    //ThreadPool: участки поменьше выравнивают нагрузку потоков
+    static constexpr size_t PARALLEL_MIN_SEGMENT = 16384;
+    static constexpr size_t PARALLEL_SEGMENTS_PER_THREAD = 4;
+
+    using NodeAllocator =
+      typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+
+    /**
+    \param[in] args Аргументы конструктора T
+    \return Новый элемент, размещённый аллокатором
+    */
+    template<typename... Args>
+    static Node* createNode(Args&&... args);
+
+    /**
+    Удалить элемент и вернуть его память аллокатору
+    \param[in] node Элемент (Node*)
+    */
+    static void destroyNode(void* node) noexcept;
+
+    /**
+    Удалить цепочку элементов, связанных next
+    \param[in] first Первый элемент цепочки
+    \return Количество удалённых элементов
+    */
+    static size_t destroyChain(Node* first) noexcept;
+
+    /**
+    Удалить исключённый из списка элемент, когда его не сможет
+    читать ни один поток (см. EpochReclaimer)
+    \param[in] node Элемент
+    */
+    static void retireNode(Node* node);
+
+    /**
+    Забрать элементы, индекс и способ прохода у пустого other. Другие
+    потоки не обращаются к обоим спискам, элементов у списка нет.
+    Индекс строится, если он есть только у этого списка
+    \param[in] other Список той же или другой политики блокировок
+    */
+    template<typename OtherQueue>
+    void adopt(OtherQueue& other);
+
+    /**
+    \param[in] node Элемент
+    \return mutex элемента в этой политике. Если политика не захватывает
+    mutex элементов (NullLocking), хранящийся в элементе mutex не
+    используется - возвращается общий для потока mutex NodeMutex
+    */
+    static NodeMutex& lockOf(Node* node);
+
+    //Цепочка связанных элементов, ещё не видимая другим потокам.
+    //Одиночный элемент - цепочка из одного элемента
+    struct Chain{
+      Chain() = default;
+      Chain(Node* node): first(node), last(node), count(1){}
+      Node* first = nullptr;
+      Node* last = nullptr;
+      size_t count = 0;
+    };
+
+    //Замер задержки публичной операции - от создания до разрушения;
+    //с выключенными гистограммами - одно чтение флага
+    class LatencyScope{
+      public:
+        /**
+        \param[in] queue Список
+        \param[in] kind Вид операции
+        \param[in] position Позиция операции
+        */
+        LatencyScope(const FineGrainedQueue& queue, OperationKind kind, size_t position = 0);
+        ~LatencyScope();
+        LatencyScope(const LatencyScope& other) = delete;
+        LatencyScope& operator=(const LatencyScope& other) = delete;
+
+      private:
+        const FineGrainedQueue& queue_;
+        LatencyStats* stats_;   //nullptr - задержка не записывается
+        OperationKind kind_;
+        size_t position_;
+        uint64_t start_;
+    };
+
+    //Добавление, опубликованное в слоте комбинатора
+    struct PushRequest{
+      Node* node;
+      bool front;   //В начало списка; иначе - в конец
+    };
+
+    /**
+    Добавить элемент в начало / конец списка способом pushMode_
+    \param[in] node Элемент
+    \param[in] front В начало списка; иначе - в конец
+    */
+    void pushNode(Node* node, bool front);
+
+    /**
+    Выполнить пакет добавлений комбинатора: элементы связываются в цепочки
+    начала и конца списка, каждая вставляется за один захват mutex
+    \param[in] batch Пакет добавлений
+    */
+    void combinePushes(const std::vector<PushRequest>& batch);
+
+    /**
+    Связать элементы со значениями из диапазона [first, last) в цепочку
+    \param[in] first Начало диапазона
+    \param[in] last Конец диапазона
+    \return Цепочка; пустая, если диапазон пуст
+    */
+    template<typename Iterator, typename Sentinel>
+    static Chain createChain(Iterator first, Sentinel last);
+
+    /**
+    Вставить готовую цепочку в начало / конец / заданную позицию списка:
+    с mutex индекса, если он есть, и пробуждением ожидающих в popFront()
+    \param[in] chain Цепочка элементов
+    \param[in] pos Позиция в списке
+    */
+    void spliceFront(Chain chain);
+    void spliceAt(Chain chain, size_t pos);
+
+    /**
+    Вставить готовую цепочку в конец списка: с mutex индекса, если он есть,
+    и пробуждением ожидающих в popFront()
+    \param[in] chain Цепочка элементов
+    \param[in] capacity Ёмкость: цепочка не вставляется, если размер
+    превысил бы её; UNBOUNDED - без проверки
+    \return false - цепочка не вставлена, элементы остаются у вызывающего
+    */
+    bool spliceBack(Chain chain, size_t capacity = UNBOUNDED);
+
+    /**
+    Вставить готовую цепочку в начало / конец / заданную позицию списка
+    \param[in] chain Цепочка элементов
+    \param[in] pos Позиция в списке
+    \param[in] capacity Ёмкость (см. spliceBack); проверяется под mutex
+    конца списка
+    \return false - цепочка не вставлена
+    */
+    void pushFrontChain(Chain chain);
+    bool pushBackChain(Chain chain, size_t capacity = UNBOUNDED);
+    void insertChain(Chain chain, size_t pos);
+
+    /**
+    Вставить готовую цепочку в заданную позицию списка с индексом.
+    Позиция ищется по индексу, вызывается под mutex индекса
+    \param[in] chain Цепочка элементов
+    \param[in] pos Позиция в списке
+    */
+    void insertChainIndexed(Chain chain, size_t pos);
+
+    /**
+    Добавить элементы цепочки в индекс начиная с позиции pos
+    \param[in] chain Цепочка элементов
+    \param[in] pos Позиция в списке
+    */
+    void indexChain(const Chain& chain, size_t pos);
+
+    /**
+    Исключить первый / последний элемент из списка
+    \return Элемент или nullptr, если список пуст
+    */
+    Node* popFrontNode();
+    Node* popBackNode();
+
+    //Цепочка элементов списка. clear() заменяет её новой и отмечает
+    //отсоединённой: исключения по цепочке, начатые до clear(), больше
+    //не меняют size_ (он уже обнулён), а считаются в removed - их учтёт
+    //задача clear()
+    struct ChainState{
+      bool detached = false;            //Меняется под mutexChain_ монопольно
+      std::atomic<size_t> removed{0};   //Исключено из отсоединённой цепочки
+    };
+
+    /**
+    Исключить из списка первый элемент. mutex начала списка и mutex
+    элемента захвачены; mutex элемента освобождается, mutex начала - нет
+    \param[in] first Первый элемент
+    */
+    void unlinkFirst(Node* first);
+
+    /**
+    Исключить из списка элемент node, следующий за prev. mutex prev и node
+    захвачены монопольно; mutex node освобождается, mutex prev - нет.
+    Если node последний, нужен mutexTail_: захватывать его под mutex
+    элементов можно только без ожидания (см. popFrontNode). Если он занят,
+    mutex элементов освобождаются, захватываются заново после mutexTail_,
+    и пока они были свободны, prev мог измениться
+    \param[in] prev Предыдущий элемент
+    \param[in] node Исключаемый элемент
+    \param[in] chain Цепочка, в которой начат проход (см. ChainState)
+    \return false - prev исключён или больше не ведёт к node: node не
+    исключён, его mutex освобождён
+    */
+    bool unlinkNext(Node* prev, Node* node, ChainState* chain);
+
+    //Решение об элементе при проходе removeNodes
+    enum class Removal{
+      KEEP,     //Оставить элемент
+      REMOVE,   //Исключить элемент и продолжить проход
+      LAST      //Исключить элемент и закончить проход
+    };
+
+    /**
+    Исключить элементы из списка за один проход с захватом mutex по цепочке
+    \param[in] decide Решение об элементе: Removal(const T& value, size_t pos),
+    pos - позиция элемента в списке; вызывается под mutex элемента
+    \param[in] removed Вызывается для каждого исключённого элемента (Node*)
+    \return Количество исключённых элементов
+    */
+    template<typename Decide, typename Removed>
+    size_t removeNodes(Decide decide, Removed removed);
+
+    /**
+    Захватить mutex индекса для изменения списка
+    \return Блокировка; пустая, если индекса нет
+    */
+    std::unique_lock<IndexMutex> lockIndex();
+
+    /**
+    Вставить цепочку после элемента pos-1, найденного без блокировок
+    \param[in] chain Цепочка элементов
+    \param[in] pos Позиция в списке
+    \return Признак успеха; false - проверка не прошла, цепочка не вставлена
+    */
+    bool insertChainOptimistic(Chain& chain, size_t pos);
+
+    /**
+    Найти элемент pos
+    \param[in] pos Позиция в списке
+    \return Элемент, его mutex захвачен на чтение
+    */
+    Node* findShared(size_t pos) const;
+
+    /**
+    Найти элемент pos, захватывая mutex по цепочке
+    \param[in] pos Позиция в списке
+    \return Элемент, его mutex захвачен на чтение
+    */
+    Node* findSharedCoupled(size_t pos) const;
+
+    /**
+    Пройти до элемента pos без блокировок. Элемент мог быть
+    исключён из списка во время прохода - нужна проверка removed.
+    Вызывается внутри EpochReclaimer::Guard
+    \param[in] pos Позиция в списке
+    \return Элемент или nullptr, если список короче
+    */
+    Node* walkOptimistic(size_t pos) const;
+
+    /**
+    Найти элемент pos по индексу
+    \param[in] pos Позиция в списке
+    \return Элемент, его mutex захвачен на чтение
+    */
+    Node* findSharedIndexed(size_t pos) const;
+
+    /**
+    Найти первый элемент обхода forEachRange
+    \param[in] pos Позиция в списке
+    \param[in] mode Способ обхода
+    \return Элемент, его mutex захвачен на чтение; nullptr, если список короче
+    */
+    Node* findScanStart(size_t pos, ScanMode mode) const;
+
+    /**
+    Прочитать значение элемента, на который указывает end, без mutex списка
+    \param[in] end head_ или tail_
+    \return Значение; nullopt, если end пуст
+    */
+    std::optional<T> peekEnd(const std::atomic<Node*>& end) const;
+
+    /**
+    Найти первые элементы участков параллельного обхода. Проход без
+    блокировок, вызывается внутри EpochReclaimer::Guard
+    \param[in] maxSegments Наибольшее количество участков
+    \return Первые элементы участков в порядке списка; пусто, если список пуст
+    */
+    std::vector<Node*> findSegments(size_t maxSegments) const;
+
+    /**
+    Обойти участок от node до end (не включая), захватывая mutex элемента
+    на чтение на время вызова visitor. Если end исключён из списка, участок
+    продолжается до элемента, к которому ведёт его next: с него начинает
+    обход и следующий участок
+    \param[in] node Первый элемент участка
+    \param[in] end Первый элемент следующего участка; nullptr - до конца списка
+    \param[in] visitor Функция, принимающая const T&
+    \return Количество элементов, переданных visitor
+    */
+    template<typename Visitor>
+    static size_t scanSegment(Node* node, Node* end, Visitor& visitor);
+
+    /**
+    Передать значение посетителю обхода
+    \param[in] visitor Посетитель
+    \param[in] value Значение элемента
+    \return Признак продолжения обхода
+    */
+    template<typename Visitor>
+    static bool visitNext(Visitor& visitor, const T& value);
+
+    /**
+    Разбудить потоки, ожидающие в popFront(), если такие есть
+    \param[in] count Количество добавленных элементов
+    */
+    void notifyWaiters(size_t count = 1);
+
+    /**
+    \param[in] count Количество добавляемых элементов
+    \param[in] capacity Ёмкость
+    \return Признак - поместятся ли count элементов
+    */
+    bool hasRoom(size_t count, size_t capacity) const;
+
+    /**
+    Вставить значение в конец списка с ограниченной ёмкостью
+    \param[in] value Значение элемента
+    \param[in] deadline Момент окончания ожидания места; nullopt - ждать
+    без ограничения
+    \return false - место не освободилось к deadline, value не перемещено
+    */
+    template<typename Value>
+    bool pushBackUntil(Value&& value,
+                       const std::optional<std::chrono::steady_clock::time_point>& deadline);
+
+    /**
+    Вставить созданный элемент в конец списка, ожидая места
+    \param[in] node Элемент
+    \param[in] deadline Момент окончания ожидания; nullopt - без ограничения
+    \return false - время истекло, элемент остаётся у вызывающего
+    */
+    bool pushBackBounded(Node* node,
+                         const std::optional<std::chrono::steady_clock::time_point>& deadline);
+
+    /**
+    Дождаться, пока размер списка станет меньше ёмкости
+    \param[in] deadline Момент окончания ожидания; nullopt - без ограничения
+    \return false - время истекло
+    */
+    bool waitForSpace(const std::optional<std::chrono::steady_clock::time_point>& deadline);
+
+    /**
+    Разбудить производителей, ожидающих места, если такие есть: будится
+    не больше производителей, чем освободилось мест
+    \param[in] count Количество извлечённых элементов
+    */
+    void notifySpace(size_t count = 1);
+
+    [[noreturn]] static void throwOutOfRange(size_t pos);
+
+    //Начало списка, конец списка и размер - в разных кэш-линиях:
+    //извлекающие из начала и добавляющие в конец не делят кэш-линию.
+    //head_ и tail_ меняются под своими mutex, атомарные - потому что
+    //peekFront() / peekBack() читают их без блокировок
+    alignas(64) std::atomic<Node*> head_;  //Указатель на первый элемент
+    mutable HeadMutex mutexHead_;
+    alignas(64) std::atomic<Node*> tail_;  //Указатель на последний элемент
+    mutable TailMutex mutexTail_;
+    SizeCounter size_;        //Размер списка
+
+    alignas(64) std::atomic<TraversalMode> traversalMode_;
+    std::atomic<PushMode> pushMode_;
+    std::atomic<size_t> capacity_;  //UNBOUNDED - без ограничения
+    //Комбинатор добавлений; создаётся при первом включении COMBINING
+    std::atomic<FlatCombiner<PushRequest>*> combiner_;
+
+    //Позиционный индекс. mutex индекса захватывается первым после
+    //mutex структуры: изменения списка - монопольно, поиск по индексу - на чтение
+    const IndexMode indexMode_;
+    SkipListIndex<Node*> index_;
+    mutable IndexMutex mutexIndex_;
+    //Проходы по цепочке (вставка и удаление в середине, чтение по позиции,
+    //обходы) захватывают mutex структуры на чтение, splitAt() и appendAll()
+    //(у other) - монопольно: проход не попадает в отделённую цепочку
+    mutable StructureMutex mutexStructure_;
+
+    //Ожидание непустого списка в popFront() и места в pushBack()
+    std::mutex mutexWait_;
+    std::condition_variable notEmpty_;
+    std::atomic<size_t> waiters_;   //Количество ожидающих потоков
+    std::condition_variable notFull_;
+    std::atomic<size_t> spaceWaiters_;  //Количество ожидающих места производителей
+
+    //Фоновое удаление цепочек, отсоединённых clear(): задача уточняет
+    //size_, деструктор дожидается её завершения
+    std::mutex mutexClear_;
+    std::condition_variable cleared_;
+    size_t pendingClears_;
+    //Текущая цепочка; заменяется clear() под mutex начала и конца списка.
+    //Исключение по цепочке меняет size_ под mutexChain_ на чтение,
+    //clear() отмечает цепочку отсоединённой и обнуляет size_ - монопольно
+    ChainState* chain_;
+    CompactSharedMutex mutexChain_;
+
+    mutable Stats stats_;   //Статистика блокировок
+
+    //Гистограммы задержек; создаются при первом включении
+    std::atomic<bool> latencyEnabled_;
+    std::atomic<LatencyStats*> latency_;
+};
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+FineGrainedQueue<T, Allocator, Stats, Locking>::FineGrainedQueue():
+  FineGrainedQueue(IndexMode::NONE)
+{
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+FineGrainedQueue<T, Allocator, Stats, Locking>::FineGrainedQueue(std::initializer_list<T> values):
+  FineGrainedQueue()
+{
+  pushBackBulk(values);
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+FineGrainedQueue<T, Allocator, Stats, Locking>::FineGrainedQueue(size_t reservedNodes):
+  FineGrainedQueue()
+{
+  reserve(reservedNodes);
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+FineGrainedQueue<T, Allocator, Stats, Locking>::FineGrainedQueue(IndexMode indexMode,
+                                                                 SizeMode sizeMode):
+  head_(nullptr), tail_(nullptr), size_(sizeMode),
+  traversalMode_(TraversalMode::LOCK_COUPLING), pushMode_(PushMode::DIRECT),
+  capacity_(UNBOUNDED), combiner_(nullptr), indexMode_(indexMode), waiters_(0),
+  spaceWaiters_(0), pendingClears_(0), chain_(new ChainState()),
+  latencyEnabled_(false), latency_(nullptr)
+{
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+FineGrainedQueue<T, Allocator, Stats, Locking>::FineGrainedQueue(SizeMode sizeMode):
+  FineGrainedQueue(IndexMode::NONE, sizeMode)
+{
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+template<typename OtherStats, typename OtherLocking>
+  requires (!std::is_same_v<FineGrainedQueue<T, Allocator, OtherStats, OtherLocking>,
+                            FineGrainedQueue<T, Allocator, Stats, Locking>>)
+FineGrainedQueue<T, Allocator, Stats, Locking>::FineGrainedQueue(
+  FineGrainedQueue<T, Allocator, OtherStats, OtherLocking>&& other):
+  FineGrainedQueue(static_cast<IndexMode>(other.indexMode_), other.size_.getMode())
+{
+  adopt(other);
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+FineGrainedQueue<T, Allocator, Stats, Locking>::FineGrainedQueue(FineGrainedQueue&& other):
+  FineGrainedQueue(other.indexMode_, other.size_.getMode())
+{
+  adopt(other);
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+FineGrainedQueue<T, Allocator, Stats, Locking>&
+FineGrainedQueue<T, Allocator, Stats, Locking>::operator=(FineGrainedQueue&& other)
+{
+  if (this != &other){
+    clear();
+    adopt(other);
+  }
+  return *this;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+template<typename OtherQueue>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::adopt(OtherQueue& other)
+{
+  static_assert(std::is_same_v<Node, typename OtherQueue::Node>,
+                "lock policies must store the same node mutex");
+  //Фоновые задачи clear() уточняют size_ списка other
+  {
+    std::unique_lock<std::mutex> lock(other.mutexClear_);
+    other.cleared_.wait(lock, [&other](){ return other.pendingClears_ == 0; });
+  }
+  head_.store(other.head_.exchange(nullptr), std::memory_order_release);
+  tail_.store(other.tail_.exchange(nullptr), std::memory_order_release);
+  const size_t count = other.size_.reset();
+  size_.add(count);
+  if (indexMode_ == static_cast<IndexMode>(other.indexMode_)){
+    index_.swap(other.index_);
+  }
+  else{
+    other.index_.clear();
+    if (indexMode_ != IndexMode::NONE && head_){
+      Chain chain(head_);
+      chain.last = tail_;
+      chain.count = count;
+      indexChain(chain, 0);
+    }
+  }
+  traversalMode_ = static_cast<TraversalMode>(other.traversalMode_.load());
+  setPushMode(static_cast<PushMode>(other.pushMode_.load()));
+  setLatencyStats(other.latencyEnabled_);
+  capacity_ = other.capacity_.load();
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+FineGrainedQueue<T, Allocator, Stats, Locking>::~FineGrainedQueue()
+{
+  //Дождаться фоновых задач clear(): они меняют size_
+  {
+    std::unique_lock<std::mutex> lock(mutexClear_);
+    cleared_.wait(lock, [this](){ return pendingClears_ == 0; });
+  }
+  delete combiner_.load();
+  delete latency_.load();
+  delete chain_;
+  //Других потоков нет - элементы удаляются сразу: к возврату из
+  //деструктора значения T уже разрушены
+  destroyChain(head_);
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::pushFront(const T& value)
+{
+  emplaceFront(value);
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::pushFront(T&& value)
+{
+  emplaceFront(std::move(value));
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::pushBack(const T& value)
+{
+  emplaceBack(value);
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::pushBack(T&& value)
+{
+  emplaceBack(std::move(value));
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+bool FineGrainedQueue<T, Allocator, Stats, Locking>::tryPushBack(const T& value)
+{
+  return pushBackUntil(value, std::chrono::steady_clock::time_point::min());
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+bool FineGrainedQueue<T, Allocator, Stats, Locking>::tryPushBack(T&& value)
+{
+  return pushBackUntil(std::move(value), std::chrono::steady_clock::time_point::min());
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+bool FineGrainedQueue<T, Allocator, Stats, Locking>::pushBackFor(const T& value,
+                                                                 std::chrono::nanoseconds timeout)
+{
+  return pushBackUntil(value, std::chrono::steady_clock::now() + timeout);
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+bool FineGrainedQueue<T, Allocator, Stats, Locking>::pushBackFor(T&& value,
+                                                                 std::chrono::nanoseconds timeout)
+{
+  return pushBackUntil(std::move(value), std::chrono::steady_clock::now() + timeout);
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::insertIntoMiddle(const T& value, size_t pos)
+{
+  emplaceAt(pos, value);
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::insertIntoMiddle(T&& value, size_t pos)
+{
+  emplaceAt(pos, std::move(value));
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+template<typename... Args>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::emplaceFront(Args&&... args)
+{
+  LatencyScope latencyScope(*this, OperationKind::PUSH_FRONT);
+  //Создать новый элемент
+  pushNode(createNode(std::forward<Args>(args)...), true);
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+template<typename... Args>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::emplaceBack(Args&&... args)
+{
+  LatencyScope latencyScope(*this, OperationKind::PUSH_BACK);
+  //Создать новый элемент
+  Node* node = createNode(std::forward<Args>(args)...);
+  if (capacity_.load(std::memory_order_relaxed) == UNBOUNDED){
+    pushNode(node, false);
+    return;
+  }
+  //Ожидание места без ограничения времени: элемент будет вставлен
+  pushBackBounded(node, std::nullopt);
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+template<typename... Args>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::emplaceAt(size_t pos, Args&&... args)
+{
+  LatencyScope latencyScope(*this, OperationKind::INSERT, pos);
+  //Создать новый элемент
+  spliceAt(createNode(std::forward<Args>(args)...), pos);
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+template<std::input_iterator Iterator, std::sentinel_for<Iterator> Sentinel>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::pushFrontBulk(Iterator first, Sentinel last)
+{
+  LatencyScope latencyScope(*this, OperationKind::PUSH_FRONT_BULK);
+  spliceFront(createChain(first, last));
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+template<std::ranges::input_range Range>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::pushFrontBulk(Range&& values)
+{
+  pushFrontBulk(std::ranges::begin(values), std::ranges::end(values));
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+template<std::input_iterator Iterator, std::sentinel_for<Iterator> Sentinel>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::pushBackBulk(Iterator first, Sentinel last)
+{
+  LatencyScope latencyScope(*this, OperationKind::PUSH_BACK_BULK);
+  spliceBack(createChain(first, last));
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+template<std::ranges::input_range Range>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::pushBackBulk(Range&& values)
+{
+  pushBackBulk(std::ranges::begin(values), std::ranges::end(values));
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+template<std::input_iterator Iterator, std::sentinel_for<Iterator> Sentinel>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::insertBulkAt(size_t pos, Iterator first, Sentinel last)
+{
+  LatencyScope latencyScope(*this, OperationKind::INSERT_BULK, pos);
+  spliceAt(createChain(first, last), pos);
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+template<std::ranges::input_range Range>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::insertBulkAt(size_t pos, Range&& values)
+{
+  insertBulkAt(pos, std::ranges::begin(values), std::ranges::end(values));
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+std::optional<T> FineGrainedQueue<T, Allocator, Stats, Locking>::tryPopFront()
+{
+  LatencyScope latencyScope(*this, OperationKind::POP_FRONT);
+  typename Stats::Scope statsScope(stats_);
+  std::unique_lock<IndexMutex> indexLock = lockIndex();
+  Node* first = popFrontNode();
+  //Список пуст
+  if (!first){
+    return std::nullopt;
+  }
+  if (indexLock){
+    index_.erase(0);
+    indexLock.unlock();
+  }
+  notifySpace();
+  //Элемент уже недостижим из списка - значение забирается без блокировок
+  std::optional<T> value(std::move(first->value));
+  retireNode(first);
+  return value;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+typename FineGrainedQueue<T, Allocator, Stats, Locking>::Node*
+FineGrainedQueue<T, Allocator, Stats, Locking>::popFrontNode()
+{
+  mutexHead_.lock();
+  Node* first = head_;
+  //Список пуст
+  if (!first){
+    mutexHead_.unlock();
+    return nullptr;
+  }
+  //Захватить mutex первого элемента - дождаться проходящих через него
+  lockOf(first).lock();
+  unlinkFirst(first);
+  mutexHead_.unlock();
+  return first;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::unlinkFirst(Node* first)
+{
+  //Единственный элемент списка одновременно последний - нужен mutexTail_.
+  //Захватывать mutexTail_ под mutex элемента нельзя: pushBack держит
+  //mutexTail_ и ждёт mutex последнего элемента
+  bool tailLocked = false;
+  Node* next = first->next.load();
+  if (!next){
+    lockOf(first).unlock();
+    mutexTail_.lock();
+    tailLocked = true;
+    lockOf(first).lock();
+    next = first->next.load();
+  }
+
+  head_.store(next, std::memory_order_release);
+  if (!head_){
+    tail_.store(nullptr, std::memory_order_release);
+  }
+  first->removed = true;
+  //Размер меняется до освобождения mutex: getSize() не отстаёт от списка
+  size_.subtract(1);
+  lockOf(first).unlock();
+  if (tailLocked){
+    mutexTail_.unlock();
+  }
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+bool FineGrainedQueue<T, Allocator, Stats, Locking>::unlinkNext(Node* prev, Node* node,
+                                                                ChainState* chain)
+{
+  Node* next = node->next.load();
+  const bool tailLocked = !next;
+  if (tailLocked && !mutexTail_.try_lock()){
+    lockOf(node).unlock();
+    lockOf(prev).unlock();
+    mutexTail_.lock();
+    lockOf(prev).lock();
+    lockOf(node).lock();
+    //prev исключён или после него вставлен элемент
+    if (prev->removed || prev->next.load() != node){
+      lockOf(node).unlock();
+      mutexTail_.unlock();
+      return false;
+    }
+    next = node->next.load();
+  }
+
+  prev->next.store(next);
+  //node последний в списке. Если tail_ другой, node - в цепочке,
+  //отсоединённой clear(): конец списка не меняется
+  if (!next && tail_ == node){
+    tail_.store(prev, std::memory_order_release);
+  }
+  //next исключённого элемента по-прежнему ведёт дальше по списку
+  node->removed = true;
+  {
+    std::shared_lock<CompactSharedMutex> chainLock(mutexChain_);
+    if (chain->detached){
+      ++chain->removed;
+    }
+    else{
+      size_.subtract(1);
+    }
+  }
+  lockOf(node).unlock();
+  if (tailLocked){
+    mutexTail_.unlock();
+  }
+  return true;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+T FineGrainedQueue<T, Allocator, Stats, Locking>::popFront()
+{
+  for (;;){
+    if (std::optional<T> value = tryPopFront()){
+      return std::move(*value);
+    }
+    std::unique_lock<std::mutex> lock(mutexWait_);
+    ++waiters_;
+    notEmpty_.wait(lock, [this](){ return size_.load() != 0; });
+    --waiters_;
+  }
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+std::optional<T> FineGrainedQueue<T, Allocator, Stats, Locking>::popFrontFor(std::chrono::nanoseconds timeout)
+{
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  for (;;){
+    if (std::optional<T> value = tryPopFront()){
+      return value;
+    }
+    std::unique_lock<std::mutex> lock(mutexWait_);
+    ++waiters_;
+    const bool notEmpty = notEmpty_.wait_until(lock, deadline,
+                                               [this](){ return size_.load() != 0; });
+    --waiters_;
+    if (!notEmpty){
+      return std::nullopt;
+    }
+  }
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+std::optional<T> FineGrainedQueue<T, Allocator, Stats, Locking>::tryPopBack()
+{
+  LatencyScope latencyScope(*this, OperationKind::POP_BACK);
+  typename Stats::Scope statsScope(stats_);
+  std::unique_lock<IndexMutex> indexLock = lockIndex();
+  Node* last = popBackNode();
+  //Список пуст
+  if (!last){
+    return std::nullopt;
+  }
+  if (indexLock){
+    index_.erase(index_.size()-1);
+    indexLock.unlock();
+  }
+  notifySpace();
+  std::optional<T> value(std::move(last->value));
+  retireNode(last);
+  return value;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+typename FineGrainedQueue<T, Allocator, Stats, Locking>::Node*
+FineGrainedQueue<T, Allocator, Stats, Locking>::popBackNode()
+{
+  //Захватить одновременно mutex начала и конца списка:
+  //предпоследний элемент ищется от начала списка
+  std::lock(mutexHead_, mutexTail_);
+  Node* last = tail_;
+  //Список пуст
+  if (!last){
+    mutexHead_.unlock();
+    mutexTail_.unlock();
+    return nullptr;
+  }
+
+  Node* iter = head_;
+  Node* iterPrev = nullptr;
+  lockOf(iter).lock();
+
+  //Единственный элемент
+  if (iter == last){
+    head_.store(nullptr, std::memory_order_release);
+    tail_.store(nullptr, std::memory_order_release);
+    last->removed = true;
+    size_.subtract(1);
+    lockOf(iter).unlock();
+    mutexHead_.unlock();
+    mutexTail_.unlock();
+    return last;
+  }
+  //Начало списка не затрагивается, mutexTail_ удерживается до конца -
+  //последний элемент не изменится
+  mutexHead_.unlock();
+
+  //С индексом предпоследний элемент известен сразу: изменения списка
+  //выполняются под mutex индекса, его удерживает вызывающий
+  if (indexMode_ != IndexMode::NONE){
+    lockOf(iter).unlock();
+    iter = index_.at(index_.size()-2);
+    lockOf(iter).lock();
+  }
+
+  //Найти предпоследний элемент, захватывая mutex по цепочке
+  size_t steps = 0;
+  for (Node* next = iter->next.load(); next != last;
+       next = iter->next.load()){
+    iterPrev = iter;
+    iter = next;
+    lockOf(iter).lock();
+    lockOf(iterPrev).unlock();
+    ++steps;
+  }
+  stats_.traversal(steps);
+  //Дождаться проходящих через последний элемент
+  lockOf(last).lock();
+  iter->next.store(nullptr);
+  tail_.store(iter, std::memory_order_release);
+  last->removed = true;
+  size_.subtract(1);
+  lockOf(last).unlock();
+  lockOf(iter).unlock();
+  mutexTail_.unlock();
+  return last;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+T FineGrainedQueue<T, Allocator, Stats, Locking>::erase(size_t pos)
+{
+  LatencyScope latencyScope(*this, OperationKind::ERASE, pos);
+  typename Stats::Scope statsScope(stats_);
+  //Обработка ошибок
+  if (isEmpty()){
+    throw ListIsEmpty_Exception();
+  }
+  if (pos > size_.load()-1){
+    throwOutOfRange(pos);
+  }
+
+  std::shared_lock<StructureMutex> structureLock(mutexStructure_);
+  Node* erased = nullptr;
+  //С индексом элемент pos-1 известен сразу: изменения списка выполняются
+  //под mutex индекса, цепочка элементов не меняется
+  if (std::unique_lock<IndexMutex> indexLock = lockIndex()){
+    if (pos >= index_.size()){
+      throwOutOfRange(pos);
+    }
+    if (pos > 0){
+      Node* prev = index_.at(pos-1);
+      lockOf(prev).lock();
+      erased = prev->next.load();
+      lockOf(erased).lock();
+      if (unlinkNext(prev, erased, chain_)){
+        index_.erase(pos);
+      }
+      else{
+        erased = nullptr;
+      }
+      lockOf(prev).unlock();
+    }
+  }
+  //Проход по цепочке до позиции pos; первый элемент исключается
+  //под mutex начала списка
+  if (!erased){
+    removeNodes([pos](const T&, size_t current){
+                  return current == pos ? Removal::LAST : Removal::KEEP;
+                },
+                [&erased](Node* node){ erased = node; });
+  }
+  //Список укоротился после проверки размера
+  if (!erased){
+    throwOutOfRange(pos);
+  }
+  notifySpace();
+  T value(std::move(erased->value));
+  retireNode(erased);
+  return value;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+bool FineGrainedQueue<T, Allocator, Stats, Locking>::removeFirst(const T& value)
+{
+  LatencyScope latencyScope(*this, OperationKind::REMOVE_FIRST);
+  typename Stats::Scope statsScope(stats_);
+  std::shared_lock<StructureMutex> structureLock(mutexStructure_);
+  const bool removed = removeNodes([&value](const T& current, size_t){
+                                     return current == value ? Removal::LAST : Removal::KEEP;
+                                   },
+                                   [](Node* node){ retireNode(node); }) != 0;
+  if (removed){
+    notifySpace();
+  }
+  return removed;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+template<typename Predicate>
+size_t FineGrainedQueue<T, Allocator, Stats, Locking>::removeIf(Predicate pred)
+{
+  LatencyScope latencyScope(*this, OperationKind::REMOVE_IF);
+  typename Stats::Scope statsScope(stats_);
+  std::shared_lock<StructureMutex> structureLock(mutexStructure_);
+  const size_t count = removeNodes([&pred](const T& value, size_t){
+                                     return pred(value) ? Removal::REMOVE : Removal::KEEP;
+                                   },
+                                   [](Node* node){ retireNode(node); });
+  notifySpace(count);
+  return count;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+template<typename Decide, typename Removed>
+size_t FineGrainedQueue<T, Allocator, Stats, Locking>::removeNodes(Decide decide, Removed removed)
+{
+  //Цепочку, отсоединённую clear() во время прохода, фоновая задача
+  //удалит после его завершения
+  EpochReclaimer::Guard guard;
+  std::unique_lock<IndexMutex> indexLock = lockIndex();
+  size_t count = 0;
+  for (;;){
+    //Начало списка: исключение меняет head_, mutexHead_ удерживается,
+    //пока первый элемент исключается
+    size_t pos = 0;
+    Node* prev = nullptr;
+    Removal decision = Removal::KEEP;
+    mutexHead_.lock();
+    //Проход идёт по цепочке, текущей при захвате mutex начала списка
+    ChainState* chain = chain_;
+    while (Node* first = head_){
+      lockOf(first).lock();
+      try{
+        decision = decide(std::as_const(first->value), pos);
+      }
+      catch (...){
+        lockOf(first).unlock();
+        mutexHead_.unlock();
+        throw;
+      }
+      if (decision == Removal::KEEP){
+        prev = first;
+        break;
+      }
+      unlinkFirst(first);
+      if (indexLock){
+        index_.erase(0);
+      }
+      removed(first);
+      ++count;
+      if (decision == Removal::LAST){
+        break;
+      }
+    }
+    mutexHead_.unlock();
+    if (!prev){
+      return count;
+    }
+
+    //Дальше - захват mutex по цепочке, как во вставке в середину:
+    //mutex prev удерживается, пока исключается следующий элемент
+    bool restart = false;
+    size_t steps = 0;
+    while (Node* node = prev->next.load()){
+      lockOf(node).lock();
+      ++steps;
+      try{
+        decision = decide(std::as_const(node->value), pos+1);
+      }
+      catch (...){
+        lockOf(node).unlock();
+        lockOf(prev).unlock();
+        throw;
+      }
+      if (decision == Removal::KEEP){
+        lockOf(prev).unlock();
+        prev = node;
+        ++pos;
+        continue;
+      }
+      if (!unlinkNext(prev, node, chain)){
+        restart = true;
+        break;
+      }
+      if (indexLock){
+        index_.erase(pos+1);
+      }
+      removed(node);
+      ++count;
+      if (decision == Removal::LAST){
+        break;
+      }
+    }
+    lockOf(prev).unlock();
+    stats_.traversal(steps);
+    if (!restart){
+      return count;
+    }
+  }
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::clear()
+{
+  LatencyScope latencyScope(*this, OperationKind::CLEAR);
+  typename Stats::Scope statsScope(stats_);
+  Node* first = nullptr;
+  size_t detached = 0;
+  ChainState* detachedChain = nullptr;
+  SkipListIndex<Node*>* detachedIndex = nullptr;
+  {
+    std::unique_lock<IndexMutex> indexLock = lockIndex();
+    if (indexLock){
+      detachedIndex = new SkipListIndex<Node*>();
+      detachedIndex->swap(index_);
+    }
+    std::lock(mutexHead_, mutexTail_);
+    first = head_;
+    head_.store(nullptr, std::memory_order_release);
+    tail_.store(nullptr, std::memory_order_release);
+    //Вставки в середину меняют size_ без mutex начала и конца списка.
+    //Пустой список не трогает size_: вставка в цепочку, отсоединённую
+    //прошлым clear(), ещё может увеличить его - учтёт задача того clear()
+    if (first){
+      detachedChain = chain_;
+      chain_ = new ChainState();
+      std::lock_guard<CompactSharedMutex> chainLock(mutexChain_);
+      detachedChain->detached = true;
+      detached = size_.reset();
+    }
+    mutexHead_.unlock();
+    mutexTail_.unlock();
+  }
+  //Список был пуст
+  if (!first){
+    delete detachedIndex;
+    return;
+  }
+  notifySpace(detached);
+
+  {
+    std::lock_guard<std::mutex> lock(mutexClear_);
+    ++pendingClears_;
+  }
+  //Задача выполнится, когда завершатся операции, начатые до отсоединения
+  //цепочки: незавершённые вставки в середину могли добавить в неё элементы
+  EpochReclaimer::instance().defer([this, first, detached, detachedChain, detachedIndex](){
+    delete detachedIndex;
+    const size_t count = destroyChain(first);
+    //Вставки в отсоединённую цепочку учтены в size_, исключения из неё -
+    //нет. Вставки больше не учитываются в размере - место освободилось
+    //и для ждущих в pushBack()
+    const size_t inserted = count + detachedChain->removed - detached;
+    delete detachedChain;
+    size_.subtract(inserted);
+    notifySpace(inserted);
+    std::lock_guard<std::mutex> lock(mutexClear_);
+    --pendingClears_;
+    cleared_.notify_all();
+  });
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::appendAll(FineGrainedQueue&& other)
+{
+  if (&other == this){
+    return;
+  }
+  LatencyScope latencyScope(*this, OperationKind::APPEND_ALL);
+  //Отсоединить цепочку other, как в clear(), но не удалять её.
+  //Индекс other уходит вместе с цепочкой. Проходы по other дожидаются
+  //отсоединения: иначе вставка или удаление в середине other изменили бы
+  //цепочку, уже присоединённую к этому списку
+  Chain chain;
+  SkipListIndex<Node*> detachedIndex;
+  {
+    typename Stats::Scope statsScope(other.stats_);
+    std::unique_lock<StructureMutex> structureLock(other.mutexStructure_);
+    std::unique_lock<IndexMutex> indexLock = other.lockIndex();
+    std::lock(other.mutexHead_, other.mutexTail_);
+    chain.first = other.head_.exchange(nullptr);
+    chain.last = other.tail_.exchange(nullptr);
+    if (chain.first){
+      chain.count = other.size_.reset();
+      if (indexLock){
+        detachedIndex.swap(other.index_);
+      }
+    }
+    other.mutexHead_.unlock();
+    other.mutexTail_.unlock();
+  }
+  //other был пуст
+  if (!chain.first){
+    return;
+  }
+  other.notifySpace(chain.count);
+
+  typename Stats::Scope statsScope(stats_);
+  const size_t count = chain.count;
+  {
+    std::unique_lock<IndexMutex> indexLock = lockIndex();
+    if (indexLock){
+      //Индекс other соединяется с индексом списка; если у other его
+      //не было - элементы цепочки добавляются в индекс по одному
+      if (detachedIndex.size() == count){
+        index_.append(detachedIndex);
+      }
+      else{
+        indexChain(chain, index_.size());
+      }
+    }
+    pushBackChain(std::move(chain));
+  }
+  notifyWaiters(count);
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+FineGrainedQueue<T, Allocator, Stats, Locking>
+FineGrainedQueue<T, Allocator, Stats, Locking>::splitAt(size_t pos)
+{
+  LatencyScope latencyScope(*this, OperationKind::SPLIT_AT, pos);
+  typename Stats::Scope statsScope(stats_);
+  FineGrainedQueue suffix(indexMode_, size_.getMode());
+  suffix.traversalMode_ = traversalMode_.load();
+  suffix.setPushMode(pushMode_);
+  suffix.setLatencyStats(latencyEnabled_);
+  suffix.capacity_ = capacity_.load();
+  //Вставка, удаление в середине и проходы по списку ждут разделения:
+  //mutex элементов им не защищают от переноса элемента в suffix
+  std::unique_lock<StructureMutex> structureLock(mutexStructure_);
+  std::unique_lock<IndexMutex> indexLock = lockIndex();
+  //Элементы, извлечённые из конца во время прохода, не удаляются до его конца
+  EpochReclaimer::Guard guard;
+  //mutex начала списка удерживается до конца разделения: извлечение
+  //из начала не меняет количество элементов перед pos
+  mutexHead_.lock();
+  //Проход без блокировок до элемента pos-1 (pos > 0)
+  auto findPrev = [this, pos, &indexLock](){
+    if (indexLock){
+      return pos-1 < index_.size() ? index_.at(pos-1) : nullptr;
+    }
+    Node* node = head_;
+    size_t steps = 1;
+    for (; node && steps<pos; ++steps){
+      node = node->next.load();
+    }
+    stats_.traversal(steps-1);
+    return node;
+  };
+  //Середину списка меняет только извлечение из конца: проход может
+  //дойти до уже исключённого элемента
+  Node* prev = pos > 0 ? findPrev() : nullptr;
+  //Элементов не больше pos - отделять нечего
+  if (pos > 0 && !prev){
+    mutexHead_.unlock();
+    return suffix;
+  }
+  //mutex конца списка - только на время разреза: добавление в конец
+  //не ждёт прохода
+  mutexTail_.lock();
+  if (prev){
+    lockOf(prev).lock();
+    //Элемент pos-1 извлечён из конца за время прохода - пройти заново:
+    //под mutex начала и конца списка цепочка не меняется
+    if (prev->removed){
+      lockOf(prev).unlock();
+      prev = findPrev();
+      if (prev){
+        lockOf(prev).lock();
+      }
+    }
+  }
+  Node* first = nullptr;
+  if (pos == 0){
+    first = head_.load();
+  }
+  else if (prev){
+    //Дождаться читающих next элемента pos-1
+    first = prev->next.load();
+    if (first){
+      prev->next.store(nullptr);
+    }
+    lockOf(prev).unlock();
+  }
+  //Отделять нечего
+  if (!first){
+    mutexHead_.unlock();
+    mutexTail_.unlock();
+    return suffix;
+  }
+
+  size_t count = 0;
+  if (prev){
+    count = size_.load() - pos;
+    size_.subtract(count);
+  }
+  else{
+    head_.store(nullptr, std::memory_order_release);
+    count = size_.reset();
+  }
+  suffix.head_.store(first, std::memory_order_release);
+  suffix.tail_.store(tail_.exchange(prev), std::memory_order_release);
+  suffix.size_.add(count);
+  mutexHead_.unlock();
+  mutexTail_.unlock();
+  if (indexLock){
+    index_.split(pos, suffix.index_);
+    indexLock.unlock();
+  }
+  notifySpace(count);
+  return suffix;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+size_t FineGrainedQueue<T, Allocator, Stats, Locking>::getSize() const
+{
+  return size_.load();
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+T FineGrainedQueue<T, Allocator, Stats, Locking>::getValue(size_t pos) const
+{
+  return visitValue(pos, [](const T& value){ return value; });
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+template<typename Visitor>
+std::invoke_result_t<Visitor, const T&>
+FineGrainedQueue<T, Allocator, Stats, Locking>::visitValue(size_t pos, Visitor&& visitor) const
+{
+  LatencyScope latencyScope(*this, OperationKind::GET_VALUE, pos);
+  typename Stats::Scope statsScope(stats_);
+  std::shared_lock<StructureMutex> structureLock(mutexStructure_);
+  //Элемент, найденный без блокировок, не будет удалён до конца чтения
+  EpochReclaimer::Guard guard;
+  Node* node = findShared(pos);
+  //Снять блокировку элемента и при исключении в visitor
+  std::shared_lock<NodeMutex> lock(lockOf(node), std::adopt_lock);
+  return std::forward<Visitor>(visitor)(std::as_const(node->value));
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+template<typename Visitor>
+size_t FineGrainedQueue<T, Allocator, Stats, Locking>::forEach(Visitor&& visitor, ScanMode mode) const
+{
+  return forEachRange(0, SIZE_MAX, std::forward<Visitor>(visitor), mode);
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+template<typename Visitor>
+size_t FineGrainedQueue<T, Allocator, Stats, Locking>::forEachRange(size_t begin, size_t end,
+                                                    Visitor&& visitor,
+                                                    ScanMode mode) const
+{
+  LatencyScope latencyScope(*this, OperationKind::FOR_EACH, begin);
+  typename Stats::Scope statsScope(stats_);
+  if (begin >= end){
+    return 0;
+  }
+  std::shared_lock<StructureMutex> structureLock(mutexStructure_);
+  //В WEAK элемент может быть исключён между освобождением его mutex
+  //и захватом mutex следующего - удаление откладывается до конца обхода
+  EpochReclaimer::Guard guard;
+  size_t visited = 0;
+  size_t pos = begin;
+  Node* node = findScanStart(begin, mode);
+  while (node){
+    Node* next = nullptr;
+    {
+      //Снять блокировку элемента и при исключении в visitor
+      std::shared_lock<NodeMutex> lock(lockOf(node), std::adopt_lock);
+      //Элемент исключён из списка до захвата его mutex (только в WEAK) -
+      //его next по-прежнему ведёт дальше по списку
+      if (node->removed){
+        next = node->next.load();
+      }
+      else{
+        ++visited;
+        if (visitNext(visitor, node->value) && ++pos < end){
+          next = node->next.load();
+          //Захватить следующий элемент до освобождения текущего
+          if (next && mode == ScanMode::LOCK_COUPLING){
+            lockOf(next).lock_shared();
+          }
+        }
+      }
+    }
+    if (next && mode == ScanMode::WEAK){
+      lockOf(next).lock_shared();
+    }
+    node = next;
+  }
+  return visited;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+std::optional<T> FineGrainedQueue<T, Allocator, Stats, Locking>::tryPeekFront() const
+{
+  LatencyScope latencyScope(*this, OperationKind::PEEK_FRONT);
+  return peekEnd(head_);
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+std::optional<T> FineGrainedQueue<T, Allocator, Stats, Locking>::tryPeekBack() const
+{
+  LatencyScope latencyScope(*this, OperationKind::PEEK_BACK);
+  return peekEnd(tail_);
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+T FineGrainedQueue<T, Allocator, Stats, Locking>::peekFront() const
+{
+  std::optional<T> value = tryPeekFront();
+  if (!value){
+    throw ListIsEmpty_Exception();
+  }
+  return std::move(*value);
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+T FineGrainedQueue<T, Allocator, Stats, Locking>::peekBack() const
+{
+  std::optional<T> value = tryPeekBack();
+  if (!value){
+    throw ListIsEmpty_Exception();
+  }
+  return std::move(*value);
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+template<typename R, typename Accumulate, typename Combine>
+R FineGrainedQueue<T, Allocator, Stats, Locking>::parallelReduce(R init, Accumulate accumulate,
+                                                                 Combine combine) const
+{
+  LatencyScope latencyScope(*this, OperationKind::PARALLEL);
+  typename Stats::Scope statsScope(stats_);
+  //Участки обходят потоки ThreadPool под mutex структуры вызывающего
+  std::shared_lock<StructureMutex> structureLock(mutexStructure_);
+  //Guard вызывающего потока действует до конца обхода всех участков:
+  //границы участков и элементы, исключённые во время обхода, не удаляются
+  EpochReclaimer::Guard guard;
+  ThreadPool& pool = ThreadPool::instance();
+  const std::vector<Node*> starts =
+    findSegments(pool.getConcurrency() * PARALLEL_SEGMENTS_PER_THREAD);
+  if (starts.empty()){
+    return init;
+  }
+
+  std::vector<std::optional<R>> results(starts.size());
+  pool.run(starts.size(), [&](size_t segment){
+    typename Stats::Scope workerScope(stats_);
+    R result = init;
+    auto visitor = [&result, &accumulate](const T& value){
+      result = accumulate(std::move(result), value);
+    };
+    scanSegment(starts[segment], segment+1 < starts.size() ? starts[segment+1] : nullptr,
+                visitor);
+    results[segment].emplace(std::move(result));
+  });
+  R result = std::move(*results[0]);
+  for (size_t segment=1; segment<results.size(); ++segment){
+    result = combine(std::move(result), std::move(*results[segment]));
+  }
+  return result;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+template<typename Visitor>
+size_t FineGrainedQueue<T, Allocator, Stats, Locking>::parallelForEach(Visitor visitor) const
+{
+  return parallelReduce(size_t(0),
+                        [&visitor](size_t count, const T& value){
+                          visitor(value);
+                          return count + 1;
+                        },
+                        std::plus<size_t>());
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+template<typename Predicate>
+size_t FineGrainedQueue<T, Allocator, Stats, Locking>::countIf(Predicate pred) const
+{
+  return parallelReduce(size_t(0),
+                        [&pred](size_t count, const T& value){
+                          return pred(value) ? count + 1 : count;
+                        },
+                        std::plus<size_t>());
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+bool FineGrainedQueue<T, Allocator, Stats, Locking>::isEmpty() const
+{
+  if (size_.load() == 0){
+    return true;
+  }
+  return false;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::reserve(size_t count)
+{
+  NodeAllocator allocator;
+  if constexpr (requires{ allocator.reserve(count); }){
+    allocator.reserve(count);
+  }
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+typename FineGrainedQueue<T, Allocator, Stats, Locking>::IndexMode
+FineGrainedQueue<T, Allocator, Stats, Locking>::getIndexMode() const
+{
+  return indexMode_;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+typename FineGrainedQueue<T, Allocator, Stats, Locking>::SizeMode
+FineGrainedQueue<T, Allocator, Stats, Locking>::getSizeMode() const
+{
+  return size_.getMode();
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+LockStatsSnapshot FineGrainedQueue<T, Allocator, Stats, Locking>::getStats() const
+{
+  return stats_.snapshot();
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::resetStats()
+{
+  stats_.reset();
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::setLatencyStats(bool enabled)
+{
+  if (enabled && !latency_.load()){
+    //Гистограммы создаются один раз: проигравший гонку удаляет свои
+    auto latency = std::make_unique<LatencyStats>();
+    LatencyStats* expected = nullptr;
+    if (latency_.compare_exchange_strong(expected, latency.get())){
+      latency.release();
+    }
+  }
+  latencyEnabled_ = enabled;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+LatencySnapshot FineGrainedQueue<T, Allocator, Stats, Locking>::getLatencyStats() const
+{
+  if (const LatencyStats* latency = latency_.load()){
+    return latency->snapshot();
+  }
+  return LatencySnapshot();
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::resetLatencyStats()
+{
+  if (LatencyStats* latency = latency_.load()){
+    latency->reset();
+  }
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::setCapacity(size_t capacity)
+{
+  capacity_ = capacity ? capacity : UNBOUNDED;
+  //Ёмкость могла увеличиться - ожидающие места проверят её заново
+  if (spaceWaiters_ != 0){
+    std::lock_guard<std::mutex> lock(mutexWait_);
+    notFull_.notify_all();
+  }
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+size_t FineGrainedQueue<T, Allocator, Stats, Locking>::getCapacity() const
+{
+  const size_t capacity = capacity_;
+  return capacity == UNBOUNDED ? 0 : capacity;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+FineGrainedQueue<T, Allocator, Stats, Locking>::LatencyScope::LatencyScope(
+  const FineGrainedQueue& queue, OperationKind kind, size_t position):
+  queue_(queue),
+  //Гистограммы созданы до выставления флага
+  stats_(queue.latencyEnabled_.load(std::memory_order_acquire) ?
+         queue.latency_.load(std::memory_order_relaxed) : nullptr),
+  kind_(kind), position_(position),
+  start_(stats_ ? LatencyStats::now() : 0)
+{
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+FineGrainedQueue<T, Allocator, Stats, Locking>::LatencyScope::~LatencyScope()
+{
+  if (stats_){
+    stats_->record(kind_, LatencyStats::now() - start_, position_,
+                   [this](){ return queue_.size_.load(); });
+  }
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+std::unique_lock<typename FineGrainedQueue<T, Allocator, Stats, Locking>::IndexMutex>
+FineGrainedQueue<T, Allocator, Stats, Locking>::lockIndex()
+{
+  if (indexMode_ == IndexMode::NONE){
+    return std::unique_lock<IndexMutex>();
+  }
+  return std::unique_lock<IndexMutex>(mutexIndex_);
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::setTraversalMode(TraversalMode mode)
+{
+  traversalMode_ = mode;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+typename FineGrainedQueue<T, Allocator, Stats, Locking>::TraversalMode
+FineGrainedQueue<T, Allocator, Stats, Locking>::getTraversalMode() const
+{
+  return traversalMode_;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::setPushMode(PushMode mode)
+{
+  if (mode == PushMode::COMBINING && !combiner_.load()){
+    //Комбинатор создаётся один раз: проигравший гонку удаляет свой
+    auto combiner = std::make_unique<FlatCombiner<PushRequest>>();
+    FlatCombiner<PushRequest>* expected = nullptr;
+    if (combiner_.compare_exchange_strong(expected, combiner.get())){
+      combiner.release();
+    }
+  }
+  pushMode_ = mode;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+typename FineGrainedQueue<T, Allocator, Stats, Locking>::PushMode
+FineGrainedQueue<T, Allocator, Stats, Locking>::getPushMode() const
+{
+  return pushMode_;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::pushNode(Node* node, bool front)
+{
+  if (pushMode_ == PushMode::DIRECT){
+    if (front){
+      spliceFront(node);
+    }
+    else{
+      spliceBack(node);
+    }
+    return;
+  }
+  combiner_.load()->execute(PushRequest{node, front},
+                            [this](const std::vector<PushRequest>& batch){
+                              combinePushes(batch);
+                            });
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::combinePushes(
+  const std::vector<PushRequest>& batch)
+{
+  //Элементы пакета ещё не видны другим потокам - связываются без блокировок
+  Chain chains[2];
+  for (const PushRequest& request : batch){
+    Chain& chain = chains[request.front ? 0 : 1];
+    if (chain.last){
+      chain.last->next.store(request.node, std::memory_order_relaxed);
+    }
+    else{
+      chain.first = request.node;
+    }
+    chain.last = request.node;
+    ++chain.count;
+  }
+  spliceFront(chains[0]);
+  spliceBack(chains[1]);
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::spliceFront(Chain chain)
+{
+  typename Stats::Scope statsScope(stats_);
+  if (!chain.count){
+    return;
+  }
+  const size_t count = chain.count;
+  {
+    std::unique_lock<IndexMutex> indexLock = lockIndex();
+    if (indexLock){
+      indexChain(chain, 0);
+    }
+    pushFrontChain(std::move(chain));
+  }
+  notifyWaiters(count);
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+bool FineGrainedQueue<T, Allocator, Stats, Locking>::spliceBack(Chain chain, size_t capacity)
+{
+  typename Stats::Scope statsScope(stats_);
+  if (!chain.count){
+    return true;
+  }
+  const size_t count = chain.count;
+  {
+    std::unique_lock<IndexMutex> indexLock = lockIndex();
+    if (indexLock){
+      //Список меняется только под mutex индекса: ёмкость проверяется
+      //до добавления цепочки в индекс
+      if (!hasRoom(count, capacity)){
+        return false;
+      }
+      indexChain(chain, index_.size());
+    }
+    if (!pushBackChain(std::move(chain), capacity)){
+      return false;
+    }
+  }
+  notifyWaiters(count);
+  return true;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::spliceAt(Chain chain, size_t pos)
+{
+  typename Stats::Scope statsScope(stats_);
+  if (!chain.count){
+    return;
+  }
+  const size_t count = chain.count;
+  std::shared_lock<StructureMutex> structureLock(mutexStructure_);
+  //С индексом позиция сравнивается с размером под mutex индекса
+  if (indexMode_ != IndexMode::NONE){
+    {
+      std::unique_lock<IndexMutex> indexLock = lockIndex();
+      insertChainIndexed(std::move(chain), pos);
+    }
+    notifyWaiters(count);
+  }
+  else if (pos == 0){
+    spliceFront(std::move(chain));
+  }
+  else if (pos >= size_.load()){
+    spliceBack(std::move(chain));
+  }
+  else{
+    insertChain(std::move(chain), pos);
+    notifyWaiters(count);
+  }
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+template<typename... Args>
+typename FineGrainedQueue<T, Allocator, Stats, Locking>::Node*
+FineGrainedQueue<T, Allocator, Stats, Locking>::createNode(Args&&... args)
+{
+  using Traits = std::allocator_traits<NodeAllocator>;
+  NodeAllocator allocator;
+  Node* node = Traits::allocate(allocator, 1);
+  try{
+    Traits::construct(allocator, node, std::in_place, std::forward<Args>(args)...);
+  }
+  catch (...){
+    Traits::deallocate(allocator, node, 1);
+    throw;
+  }
+  return node;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::destroyNode(void* node) noexcept
+{
+  using Traits = std::allocator_traits<NodeAllocator>;
+  NodeAllocator allocator;
+  Traits::destroy(allocator, static_cast<Node*>(node));
+  Traits::deallocate(allocator, static_cast<Node*>(node), 1);
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+size_t FineGrainedQueue<T, Allocator, Stats, Locking>::destroyChain(Node* first) noexcept
+{
+  size_t count = 0;
+  while (first){
+    Node* next = first->next.load(std::memory_order_relaxed);
+    destroyNode(first);
+    first = next;
+    ++count;
+  }
+  return count;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::retireNode(Node* node)
+{
+  EpochReclaimer::instance().retire(node, destroyNode);
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+typename FineGrainedQueue<T, Allocator, Stats, Locking>::NodeMutex&
+FineGrainedQueue<T, Allocator, Stats, Locking>::lockOf(Node* node)
+{
+  if constexpr (std::is_same_v<NodeMutex, NodeStorage>){
+    return node->mutex;
+  }
+  else{
+    thread_local NodeMutex unused;
+    return unused;
+  }
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+template<typename Iterator, typename Sentinel>
+typename FineGrainedQueue<T, Allocator, Stats, Locking>::Chain
+FineGrainedQueue<T, Allocator, Stats, Locking>::createChain(Iterator first, Sentinel last)
+{
+  //Цепочка не видна другим потокам - связывается без блокировок
+  Chain chain;
+  try{
+    for (; first != last; ++first){
+      Node* node = createNode(*first);
+      if (chain.last){
+        chain.last->next.store(node, std::memory_order_relaxed);
+      }
+      else{
+        chain.first = node;
+      }
+      chain.last = node;
+      ++chain.count;
+    }
+  }
+  catch (...){
+    //Удалить уже созданные элементы цепочки
+    destroyChain(chain.first);
+    throw;
+  }
+  return chain;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::pushFrontChain(Chain chain)
+{
+  mutexHead_.lock();
+
+  //Список не пуст - конец списка не затрагивается, mutex tail_ не нужен
+  if (head_){
+    size_.add(chain.count);
+    //Новый элемент указывает на первый элемент
+    chain.last->next.store(head_);
+    //Новый элемент становится первым
+    head_.store(chain.first, std::memory_order_release);
+    mutexHead_.unlock();
+    return;
+  }
+  mutexHead_.unlock();
+
+  //Список пуст - захватить одновременно mutex начала и конца списка
+  std::lock(mutexHead_, mutexTail_);
+  size_.add(chain.count);
+  if (!head_){
+    head_.store(chain.first, std::memory_order_release);
+    tail_.store(chain.last, std::memory_order_release);
+  }
+  //Элемент добавлен другим потоком, пока mutex были свободны
+  else{
+    chain.last->next.store(head_);
+    head_.store(chain.first, std::memory_order_release);
+  }
+  mutexHead_.unlock();
+  mutexTail_.unlock();
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+bool FineGrainedQueue<T, Allocator, Stats, Locking>::pushBackChain(Chain chain, size_t capacity)
+{
+  mutexTail_.lock();
+
+  //Список пуст - захватить одновременно mutex начала и конца списка
+  if (!tail_){
+    mutexTail_.unlock();
+    std::lock(mutexHead_, mutexTail_);
+    if (!tail_){
+      const bool room = hasRoom(chain.count, capacity);
+      if (room){
+        size_.add(chain.count);
+        head_.store(chain.first, std::memory_order_release);
+        tail_.store(chain.last, std::memory_order_release);
+      }
+      mutexHead_.unlock();
+      mutexTail_.unlock();
+      return room;
+    }
+    //Элемент добавлен другим потоком, пока mutex были свободны
+    mutexHead_.unlock();
+  }
+
+  //Добавления в конец выполняются по одному под mutexTail_ - между
+  //проверкой ёмкости и добавлением размер может только уменьшиться
+  if (!hasRoom(chain.count, capacity)){
+    mutexTail_.unlock();
+    return false;
+  }
+
+  //Список не пуст - начало списка не затрагивается, mutex head_ не нужен.
+  //next последнего элемента меняют и вставка в середину, и popFront -
+  //захватить mutex последнего элемента
+  Node* last = tail_;
+  lockOf(last).lock();
+  size_.add(chain.count);
+  //Последний элемент указывает на новый элемент
+  last->next.store(chain.first);
+  //Новый элемент становится последним
+  tail_.store(chain.last, std::memory_order_release);
+  lockOf(last).unlock();
+  mutexTail_.unlock();
+  return true;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::insertChain(Chain chain, size_t pos)
+{
+  //Оптимистичный проход читает элементы без блокировок
+  EpochReclaimer::Guard guard;
+  if (traversalMode_ == TraversalMode::OPTIMISTIC){
+    for (int attempt=0; attempt<OPTIMISTIC_ATTEMPTS; ++attempt){
+      if (insertChainOptimistic(chain, pos)){
+        return;
+      }
+    }
+  }
+
+  //Двигаясь вперёд по списку захватываем mutex элемента и освобождаем
+  //mutex предыдущего элемента - ищем элемент, предыдущий элементу
+  //с заданной позицией в списке
+  size_t currentPos = 0;
+  mutexHead_.lock();
+  Node* iter = head_;
+  Node* iterPrev = nullptr;
+  //Список опустел после проверки размера
+  if (!iter){
+    mutexHead_.unlock();
+    pushBackChain(std::move(chain));
+    return;
+  }
+  lockOf(iter).lock(); //Захватить mutex первого элемента
+  mutexHead_.unlock();
+
+  Node* next = iter->next.load();
+  while(next){
+    if (currentPos == pos-1){
+      break;
+    }
+    iterPrev = iter;
+    iter = next;
+    lockOf(iter).lock();
+    lockOf(iterPrev).unlock();
+    next = iter->next.load();
+    ++currentPos;
+  }
+  stats_.traversal(currentPos);
+  //Список укоротился после проверки размера - iter последний элемент,
+  //вставка после него меняет tail_ и выполняется через mutexTail_
+  if (!next){
+    lockOf(iter).unlock();
+    pushBackChain(std::move(chain));
+    return;
+  }
+  //iter указывает на pos-1 элемент, его mutex захвачен
+  //mutex pos-1-1 освобождён
+  size_.add(chain.count);
+  chain.last->next.store(next);
+  iter->next.store(chain.first);
+  lockOf(iter).unlock();
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::insertChainIndexed(Chain chain, size_t pos)
+{
+  const size_t size = index_.size();
+  if (pos == 0){
+    indexChain(chain, 0);
+    pushFrontChain(std::move(chain));
+    return;
+  }
+  if (pos >= size){
+    indexChain(chain, size);
+    pushBackChain(std::move(chain));
+    return;
+  }
+  indexChain(chain, pos);
+  //Элемент pos-1 не последний - tail_ не меняется.
+  //Захватить его mutex - дождаться читающих его next
+  Node* iter = index_.at(pos-1);
+  lockOf(iter).lock();
+  size_.add(chain.count);
+  chain.last->next.store(iter->next.load());
+  iter->next.store(chain.first);
+  lockOf(iter).unlock();
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::indexChain(const Chain& chain, size_t pos)
+{
+  Node* node = chain.first;
+  for (size_t i=0; i<chain.count; ++i){
+    index_.insert(pos + i, node);
+    node = node->next.load();
+  }
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+bool FineGrainedQueue<T, Allocator, Stats, Locking>::insertChainOptimistic(Chain& chain, size_t pos)
+{
+  Node* iter = walkOptimistic(pos-1);
+  //Список короче pos - вставка в конец
+  if (!iter){
+    pushBackChain(std::move(chain));
+    return true;
+  }
+  //Захватить только найденный элемент и проверить, что он всё ещё в списке
+  lockOf(iter).lock();
+  if (iter->removed){
+    lockOf(iter).unlock();
+    return false;
+  }
+  Node* next = iter->next.load();
+  //iter последний элемент - вставка после него меняет tail_
+  if (!next){
+    lockOf(iter).unlock();
+    pushBackChain(std::move(chain));
+    return true;
+  }
+  size_.add(chain.count);
+  chain.last->next.store(next);
+  iter->next.store(chain.first);
+  lockOf(iter).unlock();
+  return true;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+typename FineGrainedQueue<T, Allocator, Stats, Locking>::Node*
+FineGrainedQueue<T, Allocator, Stats, Locking>::findShared(size_t pos) const
+{
+  //Обработка ошибок
+  if (isEmpty()){
+    throw ListIsEmpty_Exception();
+  }
+  if (pos > size_.load()-1){
+    throwOutOfRange(pos);
+  }
+  if (indexMode_ != IndexMode::NONE){
+    return findSharedIndexed(pos);
+  }
+  if (traversalMode_ == TraversalMode::OPTIMISTIC){
+    for (int attempt=0; attempt<OPTIMISTIC_ATTEMPTS; ++attempt){
+      Node* iter = walkOptimistic(pos);
+      //Список укоротился - ошибку сообщит проход по цепочке
+      if (!iter){
+        break;
+      }
+      //Захватить только найденный элемент и проверить, что он всё ещё в списке
+      lockOf(iter).lock_shared();
+      if (!iter->removed){
+        return iter;
+      }
+      lockOf(iter).unlock_shared();
+    }
+  }
+  return findSharedCoupled(pos);
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+typename FineGrainedQueue<T, Allocator, Stats, Locking>::Node*
+FineGrainedQueue<T, Allocator, Stats, Locking>::findSharedCoupled(size_t pos) const
+{
+  //Найти элемент pos
+  size_t currentPos = 0;
+  mutexHead_.lock_shared();
+  Node* iter = head_;
+  Node* iterPrev = nullptr;
+  //Список опустел после проверки размера
+  if (!iter){
+    mutexHead_.unlock_shared();
+    throw ListIsEmpty_Exception();
+  }
+  lockOf(iter).lock_shared(); //Залочить mutex первого элемента
+  mutexHead_.unlock_shared();
+
+  for (Node* next = iter->next.load(); next;
+       next = iter->next.load()){
+    if (currentPos == pos){
+      break;
+    }
+    iterPrev = iter;
+    iter = next;
+    lockOf(iter).lock_shared();
+    lockOf(iterPrev).unlock_shared();
+    ++currentPos;
+  }
+  stats_.traversal(currentPos);
+  //Список укоротился после проверки размера
+  if (currentPos != pos){
+    lockOf(iter).unlock_shared();
+    throwOutOfRange(pos);
+  }
+  //iter указывает на pos элемент, его mutex захвачен
+  //mutex pos-1 освобождён
+  return iter;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+typename FineGrainedQueue<T, Allocator, Stats, Locking>::Node*
+FineGrainedQueue<T, Allocator, Stats, Locking>::walkOptimistic(size_t pos) const
+{
+  //mutex начала списка нужен только для чтения head_,
+  //дальше - без блокировок по атомарным next
+  mutexHead_.lock_shared();
+  Node* iter = head_;
+  mutexHead_.unlock_shared();
+
+  size_t currentPos = 0;
+  for (; iter && currentPos<pos; ++currentPos){
+    iter = iter->next.load();
+  }
+  stats_.traversal(currentPos);
+  return iter;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+typename FineGrainedQueue<T, Allocator, Stats, Locking>::Node*
+FineGrainedQueue<T, Allocator, Stats, Locking>::findSharedIndexed(size_t pos) const
+{
+  std::shared_lock<IndexMutex> indexLock(mutexIndex_);
+  //Список укоротился после проверки размера
+  if (pos >= index_.size()){
+    indexLock.unlock();
+    if (isEmpty()){
+      throw ListIsEmpty_Exception();
+    }
+    throwOutOfRange(pos);
+  }
+  //Элемент не исключат из списка, пока его mutex захвачен на чтение:
+  //извлечение захватывает mutex элемента монопольно
+  Node* node = index_.at(pos);
+  lockOf(node).lock_shared();
+  return node;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+typename FineGrainedQueue<T, Allocator, Stats, Locking>::Node*
+FineGrainedQueue<T, Allocator, Stats, Locking>::findScanStart(size_t pos, ScanMode mode) const
+{
+  //Начало списка
+  if (pos == 0){
+    std::shared_lock<HeadMutex> headLock(mutexHead_);
+    Node* first = head_;
+    if (first){
+      lockOf(first).lock_shared();
+    }
+    return first;
+  }
+  if (indexMode_ != IndexMode::NONE){
+    std::shared_lock<IndexMutex> indexLock(mutexIndex_);
+    if (pos >= index_.size()){
+      return nullptr;
+    }
+    Node* node = index_.at(pos);
+    lockOf(node).lock_shared();
+    return node;
+  }
+  if (mode == ScanMode::WEAK){
+    Node* node = walkOptimistic(pos);
+    if (node){
+      lockOf(node).lock_shared();
+    }
+    return node;
+  }
+  //Проход по цепочке до элемента pos
+  mutexHead_.lock_shared();
+  Node* iter = head_;
+  if (!iter){
+    mutexHead_.unlock_shared();
+    return nullptr;
+  }
+  lockOf(iter).lock_shared();
+  mutexHead_.unlock_shared();
+  for (size_t currentPos=0; currentPos<pos; ++currentPos){
+    Node* next = iter->next.load();
+    if (next){
+      lockOf(next).lock_shared();
+    }
+    lockOf(iter).unlock_shared();
+    iter = next;
+    if (!iter){
+      return nullptr;
+    }
+  }
+  stats_.traversal(pos);
+  return iter;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+std::optional<T>
+FineGrainedQueue<T, Allocator, Stats, Locking>::peekEnd(const std::atomic<Node*>& end) const
+{
+  //Элемент, исключённый после чтения end, и цепочка, отсоединённая
+  //clear(), удаляются после завершения Guard
+  EpochReclaimer::Guard guard;
+  for (;;){
+    Node* node = end.load(std::memory_order_acquire);
+    if (!node){
+      return std::nullopt;
+    }
+    if constexpr (std::is_trivially_copyable_v<T>){
+      return std::optional<T>(node->value);
+    }
+    else{
+      //Значение перемещается из элемента после того, как он помечен
+      //removed под монопольным mutex
+      std::shared_lock<NodeMutex> lock(lockOf(node));
+      if (!node->removed){
+        return std::optional<T>(node->value);
+      }
+    }
+    //Элемент исключён после чтения end - end уже указывает на другой
+  }
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+std::vector<typename FineGrainedQueue<T, Allocator, Stats, Locking>::Node*>
+FineGrainedQueue<T, Allocator, Stats, Locking>::findSegments(size_t maxSegments) const
+{
+  //Участков столько, чтобы каждый был не короче PARALLEL_MIN_SEGMENT
+  const size_t size = size_.load();
+  const size_t segmentCount =
+    std::max<size_t>(1, std::min(maxSegments, size / PARALLEL_MIN_SEGMENT));
+  const size_t step = std::max<size_t>(1, size / segmentCount);
+  std::vector<Node*> starts;
+  starts.reserve(segmentCount);
+
+  if (indexMode_ != IndexMode::NONE){
+    std::shared_lock<IndexMutex> indexLock(mutexIndex_);
+    for (size_t pos=0; pos<index_.size() && starts.size()<segmentCount; pos+=step){
+      starts.push_back(index_.at(pos));
+    }
+    return starts;
+  }
+
+  //Проход по атомарным next без блокировок, как в walkOptimistic
+  mutexHead_.lock_shared();
+  Node* node = head_;
+  mutexHead_.unlock_shared();
+  size_t pos = 0;
+  for (; node; node = node->next.load(), ++pos){
+    if (pos % step == 0){
+      starts.push_back(node);
+      if (starts.size() == segmentCount){
+        break;
+      }
+    }
+  }
+  stats_.traversal(pos);
+  return starts;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+template<typename Visitor>
+size_t FineGrainedQueue<T, Allocator, Stats, Locking>::scanSegment(Node* node, Node* end,
+                                                                   Visitor& visitor)
+{
+  size_t visited = 0;
+  while (node){
+    //next исключённого элемента больше не меняется: следующий участок,
+    //начатый с end, придёт к тому же элементу
+    while (end && end->removed){
+      end = end->next.load();
+    }
+    if (node == end){
+      break;
+    }
+    Node* next = nullptr;
+    {
+      std::shared_lock<NodeMutex> lock(lockOf(node));
+      if (!node->removed){
+        visitor(std::as_const(node->value));
+        ++visited;
+      }
+      next = node->next.load();
+    }
+    node = next;
+  }
+  return visited;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+template<typename Visitor>
+bool FineGrainedQueue<T, Allocator, Stats, Locking>::visitNext(Visitor& visitor, const T& value)
+{
+  if constexpr (std::is_same_v<std::invoke_result_t<Visitor&, const T&>, bool>){
+    return visitor(value);
+  }
+  else{
+    visitor(value);
+    return true;
+  }
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::notifyWaiters(size_t count)
+{
+  //Размер увеличен до проверки waiters_, а ожидающий поток увеличивает
+  //waiters_ до проверки размера - хотя бы один из них увидит другого
+  if (waiters_ != 0){
+    //Ожидающий поток между проверкой условия и засыпанием держит mutexWait_
+    mutexWait_.lock();
+    mutexWait_.unlock();
+    if (count == 1){
+      notEmpty_.notify_one();
+    }
+    else{
+      notEmpty_.notify_all();
+    }
+  }
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+bool FineGrainedQueue<T, Allocator, Stats, Locking>::hasRoom(size_t count, size_t capacity) const
+{
+  return capacity == UNBOUNDED || size_.load() + count <= capacity;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+template<typename Value>
+bool FineGrainedQueue<T, Allocator, Stats, Locking>::pushBackUntil(
+  Value&& value, const std::optional<std::chrono::steady_clock::time_point>& deadline)
+{
+  LatencyScope latencyScope(*this, OperationKind::PUSH_BACK);
+  if (capacity_.load(std::memory_order_relaxed) == UNBOUNDED){
+    pushNode(createNode(std::forward<Value>(value)), false);
+    return true;
+  }
+  //Значение переносится в элемент, только когда место уже было
+  if (!waitForSpace(deadline)){
+    return false;
+  }
+  Node* node = createNode(std::forward<Value>(value));
+  if (pushBackBounded(node, deadline)){
+    return true;
+  }
+  //Место заняли другие производители, а время истекло - вернуть значение
+  if constexpr (!std::is_const_v<std::remove_reference_t<Value>>){
+    value = std::move(node->value);
+  }
+  destroyNode(node);
+  return false;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+bool FineGrainedQueue<T, Allocator, Stats, Locking>::pushBackBounded(
+  Node* node, const std::optional<std::chrono::steady_clock::time_point>& deadline)
+{
+  for (;;){
+    if (spliceBack(node, capacity_)){
+      return true;
+    }
+    if (!waitForSpace(deadline)){
+      return false;
+    }
+  }
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+bool FineGrainedQueue<T, Allocator, Stats, Locking>::waitForSpace(
+  const std::optional<std::chrono::steady_clock::time_point>& deadline)
+{
+  auto hasSpace = [this](){ return size_.load() < capacity_; };
+  //Список не заполнен - без mutex
+  if (hasSpace()){
+    return true;
+  }
+  if (deadline && *deadline <= std::chrono::steady_clock::now()){
+    return false;
+  }
+  std::unique_lock<std::mutex> lock(mutexWait_);
+  ++spaceWaiters_;
+  bool space = true;
+  if (deadline){
+    space = notFull_.wait_until(lock, *deadline, hasSpace);
+  }
+  else{
+    notFull_.wait(lock, hasSpace);
+  }
+  --spaceWaiters_;
+  return space;
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::notifySpace(size_t count)
+{
+  //Размер уменьшен до проверки spaceWaiters_, а ожидающий производитель
+  //увеличивает spaceWaiters_ до проверки размера (см. notifyWaiters).
+  //Пока список не заполнен, ожидающих нет - одно чтение счётчика
+  const size_t waiting = spaceWaiters_;
+  if (waiting == 0 || count == 0){
+    return;
+  }
+  mutexWait_.lock();
+  mutexWait_.unlock();
+  //Будится столько производителей, сколько освободилось мест: остальные
+  //всё равно не нашли бы места
+  if (count >= waiting){
+    notFull_.notify_all();
+  }
+  else{
+    for (size_t i=0; i<count; ++i){
+      notFull_.notify_one();
+    }
+  }
+}
+
+
+
+template<typename T, typename Allocator, typename Stats, typename Locking>
+void FineGrainedQueue<T, Allocator, Stats, Locking>::throwOutOfRange(size_t pos)
+{
+  const std::string errorMessage = "Error: pos (" +
+    std::to_string(pos) + ") is out_of_range";
+  throw std::out_of_range(errorMessage.c_str());
+}
 
 
 
@@ -91,4 +3273,4 @@ namespace fine_grained_queue{
   Протестировать публичные методы класса
   */
   void test();
-}
\ No newline at end of file
+}
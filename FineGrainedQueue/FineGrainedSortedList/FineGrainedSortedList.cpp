@@ -0,0 +1,146 @@
+#include "FineGrainedSortedList.h"
+#include <cassert>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+//Проверка компиляции всех методов
+template class FineGrainedSortedList<int>;
+template class FineGrainedSortedList<int, std::less<int>, PoolAllocator<int>, SpinLocking>;
+template class FineGrainedSortedList<int, std::less<int>, PoolAllocator<int>, NullLocking<>>;
+
+
+//=============================================================================
+static void testOnethread();
+static void testCompare();
+static void testMultithread();
+
+
+void fine_grained_sorted_list::test()
+{
+  testOnethread();
+  testCompare();
+  testMultithread();
+}
+
+
+
+static void testOnethread()
+{
+  FineGrainedSortedList<int> testList;
+  assert(testList.isEmpty());
+  assert(!testList.contains(1));
+  assert(!testList.remove(1));
+
+  //Вставка в начало, конец и середину
+  for (const int value : {5, 1, 9, 3, 7}){
+    assert(testList.insert(value));
+  }
+  //Равное значение не вставляется
+  assert(!testList.insert(5));
+  assert(!testList.emplace(1));
+  assert(testList.getSize() == 5);
+
+  std::vector<int> values;
+  assert(testList.forEach([&values](int value){ values.push_back(value); }) == 5);
+  assert((values == std::vector<int>{1, 3, 5, 7, 9}));
+  assert(testList.contains(7));
+  assert(!testList.contains(6));
+
+  //Удаление первого, среднего и последнего значения
+  assert(testList.remove(1));
+  assert(testList.remove(5));
+  assert(testList.remove(9));
+  assert(!testList.remove(5));
+  assert(!testList.contains(5));
+  assert(testList.getSize() == 2);
+  assert(testList.insert(8));
+  assert(testList.insert(0));
+
+  //Посетитель останавливает обход
+  values.clear();
+  assert(testList.forEach([&values](int value){
+    values.push_back(value);
+    return value < 3;
+  }) == 2);
+  assert((values == std::vector<int>{0, 3}));
+}
+
+
+
+static void testCompare()
+{
+  //Порядок задаёт Compare; значения - строки
+  FineGrainedSortedList<std::string, std::greater<std::string>> testList;
+  assert(testList.insert("b"));
+  assert(testList.insert(std::string("a")));
+  assert(testList.emplace(2, 'c'));
+  assert(!testList.insert("cc"));
+  std::string joined;
+  testList.forEach([&joined](const std::string& value){ joined += value + ","; });
+  assert(joined == "cc,b,a,");
+  assert(testList.remove("b"));
+  assert(testList.contains("a"));
+  assert(!testList.contains("b"));
+}
+
+
+
+static void testMultithread()
+{
+  //Вставляющие потоки пересекаются по значениям, удаляющий удаляет
+  //чётные, читатели проверяют порядок. В конце - все нечётные
+  //и те чётные, вставка которых была после удаления
+  const int COUNT = 4000;
+  FineGrainedSortedList<int> testList;
+  std::atomic<bool> done(false);
+  std::atomic<int> inserted(0);
+  std::atomic<int> removed(0);
+  std::vector<std::thread> threads;
+  for (int i=0; i<3; ++i){
+    threads.emplace_back([&testList, &inserted, i](){
+      for (int j=0; j<COUNT; ++j){
+        const int value = (j * 7 + i * 1000) % COUNT;
+        if (testList.insert(value)){
+          ++inserted;
+        }
+      }
+    });
+  }
+  threads.emplace_back([&testList, &removed](){
+    for (int round=0; round<3; ++round){
+      for (int value=0; value<COUNT; value+=2){
+        if (testList.remove(value)){
+          ++removed;
+        }
+      }
+    }
+  });
+  std::thread reader([&testList, &done](){
+    while (!done){
+      int last = -1;
+      testList.forEach([&last](int value){
+        assert(value > last);
+        last = value;
+      });
+      testList.contains(COUNT / 2);
+    }
+  });
+  for (auto& thread : threads){
+    thread.join();
+  }
+  done = true;
+  reader.join();
+
+  //Каждое значение вставлено хотя бы один раз
+  assert(inserted - removed == static_cast<int>(testList.getSize()));
+  for (int value=1; value<COUNT; value+=2){
+    assert(testList.contains(value));
+  }
+  int last = -1;
+  assert(testList.forEach([&last](int value){
+    assert(value > last);
+    last = value;
+  }) == testList.getSize());
+}
@@ -0,0 +1,459 @@
+/**
+\file FineGrainedSortedList.h
+\brief Шаблон класса - потокобезопасное упорядоченное множество на односвязном
+списке с мелкогранулярными блокировками
+
+Методы:
+- вставить значение на его место по порядку (если равного ещё нет)
+- сконструировать значение и вставить на его место
+- проверить, есть ли значение в множестве
+- удалить значение
+- обойти значения по возрастанию (посетителем)
+- получить количество значений
+- получить признак - пусто ли множество
+
+Элементы - ListNode, как у FineGrainedQueue. Поиск места - один проход без
+блокировок (элементы защищены EpochReclaimer, значения после вставки не
+меняются). Затем захватывается только mutex предыдущего элемента (для
+удаления - и самого элемента) и проверяется, что за время прохода ни один
+из них не исключён из списка и они по-прежнему соседние; при неудачной
+проверке проход повторяется (lazy list). Исключённый элемент помечается
+removed, его next по-прежнему ведёт дальше по списку - проходящие через
+него потоки не теряют продолжение списка.
+Вставка - один проход по списку; проверка наличия блокирует только
+найденный элемент и не мешает другим читателям
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <type_traits>
+#include <utility>
+
+#include "FineGrainedQueue.h"
+
+
+template<typename T = int, typename Compare = std::less<T>,
+         typename Allocator = PoolAllocator<T>, typename Locking = CompactLocking>
+class FineGrainedSortedList{
+  public:
+    using Node = ListNode<T, typename Locking::NodeStorage>;
+
+    explicit FineGrainedSortedList(const Compare& compare = Compare());
+
+    FineGrainedSortedList(const FineGrainedSortedList& other) = delete;
+    FineGrainedSortedList& operator=(const FineGrainedSortedList& other) = delete;
+
+    ~FineGrainedSortedList();
+
+    /**
+    Вставить значение на его место по порядку
+    \param[in] value Значение
+    \return false - если равное значение уже есть; value не вставлено
+    */
+    bool insert(const T& value);
+    bool insert(T&& value);
+
+    /**
+    Сконструировать значение и вставить на его место по порядку
+    \param[in] args Аргументы конструктора T
+    \return false - если равное значение уже есть; созданное значение удалено
+    */
+    template<typename... Args>
+    bool emplace(Args&&... args);
+
+    /**
+    \param[in] value Значение
+    \return true - если значение есть в множестве
+    */
+    bool contains(const T& value) const;
+
+    /**
+    Удалить значение
+    \param[in] value Значение
+    \return true - если значение было в множестве и удалено
+    */
+    bool remove(const T& value);
+
+    /**
+    Обойти значения по возрастанию. mutex элемента захватывается на чтение
+    только на время вызова посетителя: значения, вставленные или удалённые
+    во время обхода, могут быть пропущены
+    \param[in] visitor Посетитель: void(const T&) или bool(const T&),
+    false - остановить обход
+    \return Количество посещённых значений
+    */
+    template<typename Visitor>
+    size_t forEach(Visitor&& visitor) const;
+
+    /**
+    \return Количество значений
+    */
+    size_t getSize() const;
+
+    /**
+    \return true - если множество пусто
+    */
+    bool isEmpty() const;
+
+  private:
+    using HeadMutex = typename Locking::template Mutex<LockKind::HEAD>;
+    using NodeMutex = typename Locking::template Mutex<LockKind::NODE>;
+    using NodeAllocator =
+      typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+
+    //Соседние элементы: значение должно стоять между ними.
+    //pred == nullptr - место в начале списка
+    struct Window{
+      Node* pred;
+      Node* curr;
+    };
+
+    template<typename... Args>
+    static Node* createNode(Args&&... args);
+    static void destroyNode(void* node) noexcept;
+
+    /**
+    \param[in] node Элемент
+    \return mutex элемента в политике Locking (см. FineGrainedQueue::lockOf)
+    */
+    static NodeMutex& lockOf(Node* node);
+
+    /**
+    Найти место значения проходом без блокировок.
+    Вызывается внутри EpochReclaimer::Guard
+    \param[in] value Значение
+    \return curr - первый элемент не меньше value или nullptr
+    */
+    Window find(const T& value) const;
+
+    /**
+    Захватить mutex предыдущего элемента окна (mutex начала списка,
+    если pred == nullptr) и проверить, что окно не изменилось
+    \param[in] window Окно
+    \return true - pred в списке и ведёт к curr; false - mutex освобождён
+    */
+    bool lockWindow(const Window& window) const;
+
+    /**
+    Освободить mutex, захваченный lockWindow
+    \param[in] window Окно
+    */
+    void unlockWindow(const Window& window) const;
+
+    /**
+    Вставить созданный элемент на его место
+    \param[in] node Элемент
+    \return false - равное значение уже есть; элемент удалён
+    */
+    bool insertNode(Node* node);
+
+    /**
+    \return true - если значения равны
+    */
+    bool equal(const T& lhs, const T& rhs) const;
+
+    Compare compare_;
+    Node* head_;    //Указатель на первый элемент
+    mutable HeadMutex mutexHead_;
+    alignas(64) SizeCounter size_;
+};
+
+
+
+template<typename T, typename Compare, typename Allocator, typename Locking>
+FineGrainedSortedList<T, Compare, Allocator, Locking>::FineGrainedSortedList(const Compare& compare):
+  compare_(compare), head_(nullptr)
+{
+}
+
+
+
+template<typename T, typename Compare, typename Allocator, typename Locking>
+FineGrainedSortedList<T, Compare, Allocator, Locking>::~FineGrainedSortedList()
+{
+  Node* node = head_;
+  while (node){
+    Node* next = node->next.load(std::memory_order_relaxed);
+    destroyNode(node);
+    node = next;
+  }
+}
+
+
+
+template<typename T, typename Compare, typename Allocator, typename Locking>
+bool FineGrainedSortedList<T, Compare, Allocator, Locking>::insert(const T& value)
+{
+  return emplace(value);
+}
+
+
+
+template<typename T, typename Compare, typename Allocator, typename Locking>
+bool FineGrainedSortedList<T, Compare, Allocator, Locking>::insert(T&& value)
+{
+  return emplace(std::move(value));
+}
+
+
+
+template<typename T, typename Compare, typename Allocator, typename Locking>
+template<typename... Args>
+bool FineGrainedSortedList<T, Compare, Allocator, Locking>::emplace(Args&&... args)
+{
+  return insertNode(createNode(std::forward<Args>(args)...));
+}
+
+
+
+template<typename T, typename Compare, typename Allocator, typename Locking>
+bool FineGrainedSortedList<T, Compare, Allocator, Locking>::contains(const T& value) const
+{
+  EpochReclaimer::Guard guard;
+  const Window window = find(value);
+  if (!window.curr || !equal(window.curr->value, value)){
+    return false;
+  }
+  //Элемент найден без блокировок - проверить, что он не исключён
+  std::shared_lock<NodeMutex> lock(lockOf(window.curr));
+  return !window.curr->removed;
+}
+
+
+
+template<typename T, typename Compare, typename Allocator, typename Locking>
+bool FineGrainedSortedList<T, Compare, Allocator, Locking>::remove(const T& value)
+{
+  EpochReclaimer::Guard guard;
+  for (;;){
+    const Window window = find(value);
+    if (!window.curr || !equal(window.curr->value, value)){
+      return false;
+    }
+    if (!lockWindow(window)){
+      continue;
+    }
+    Node* curr = window.curr;
+    lockOf(curr).lock();
+    //curr исключён другим потоком между проходом и захватом
+    if (curr->removed){
+      lockOf(curr).unlock();
+      unlockWindow(window);
+      return false;
+    }
+    Node* next = curr->next.load();
+    if (window.pred){
+      window.pred->next.store(next);
+    }
+    else{
+      head_ = next;
+    }
+    //next исключённого элемента по-прежнему ведёт дальше по списку
+    curr->removed = true;
+    size_.subtract(1);
+    lockOf(curr).unlock();
+    unlockWindow(window);
+    //Значение не перемещается: его ещё могут сравнивать проходящие потоки
+    EpochReclaimer::instance().retire(curr, destroyNode);
+    return true;
+  }
+}
+
+
+
+template<typename T, typename Compare, typename Allocator, typename Locking>
+template<typename Visitor>
+size_t FineGrainedSortedList<T, Compare, Allocator, Locking>::forEach(Visitor&& visitor) const
+{
+  EpochReclaimer::Guard guard;
+  size_t visited = 0;
+  mutexHead_.lock_shared();
+  Node* node = head_;
+  mutexHead_.unlock_shared();
+  while (node){
+    std::shared_lock<NodeMutex> lock(lockOf(node));
+    if (!node->removed){
+      ++visited;
+      if constexpr (std::is_same_v<std::invoke_result_t<Visitor&, const T&>, bool>){
+        if (!visitor(std::as_const(node->value))){
+          break;
+        }
+      }
+      else{
+        visitor(std::as_const(node->value));
+      }
+    }
+    node = node->next.load();
+  }
+  return visited;
+}
+
+
+
+template<typename T, typename Compare, typename Allocator, typename Locking>
+size_t FineGrainedSortedList<T, Compare, Allocator, Locking>::getSize() const
+{
+  return size_.load();
+}
+
+
+
+template<typename T, typename Compare, typename Allocator, typename Locking>
+bool FineGrainedSortedList<T, Compare, Allocator, Locking>::isEmpty() const
+{
+  return size_.load() == 0;
+}
+
+
+
+template<typename T, typename Compare, typename Allocator, typename Locking>
+template<typename... Args>
+typename FineGrainedSortedList<T, Compare, Allocator, Locking>::Node*
+FineGrainedSortedList<T, Compare, Allocator, Locking>::createNode(Args&&... args)
+{
+  using Traits = std::allocator_traits<NodeAllocator>;
+  NodeAllocator allocator;
+  Node* node = Traits::allocate(allocator, 1);
+  try{
+    Traits::construct(allocator, node, std::in_place, std::forward<Args>(args)...);
+  }
+  catch (...){
+    Traits::deallocate(allocator, node, 1);
+    throw;
+  }
+  return node;
+}
+
+
+
+template<typename T, typename Compare, typename Allocator, typename Locking>
+void FineGrainedSortedList<T, Compare, Allocator, Locking>::destroyNode(void* node) noexcept
+{
+  using Traits = std::allocator_traits<NodeAllocator>;
+  NodeAllocator allocator;
+  Traits::destroy(allocator, static_cast<Node*>(node));
+  Traits::deallocate(allocator, static_cast<Node*>(node), 1);
+}
+
+
+
+template<typename T, typename Compare, typename Allocator, typename Locking>
+typename FineGrainedSortedList<T, Compare, Allocator, Locking>::NodeMutex&
+FineGrainedSortedList<T, Compare, Allocator, Locking>::lockOf(Node* node)
+{
+  if constexpr (std::is_same_v<NodeMutex, typename Locking::NodeStorage>){
+    return node->mutex;
+  }
+  else{
+    thread_local NodeMutex unused;
+    return unused;
+  }
+}
+
+
+
+template<typename T, typename Compare, typename Allocator, typename Locking>
+typename FineGrainedSortedList<T, Compare, Allocator, Locking>::Window
+FineGrainedSortedList<T, Compare, Allocator, Locking>::find(const T& value) const
+{
+  //mutex начала списка нужен только для чтения head_,
+  //дальше - без блокировок по атомарным next
+  mutexHead_.lock_shared();
+  Node* curr = head_;
+  mutexHead_.unlock_shared();
+
+  Node* pred = nullptr;
+  while (curr && compare_(curr->value, value)){
+    pred = curr;
+    curr = curr->next.load();
+  }
+  return Window{pred, curr};
+}
+
+
+
+template<typename T, typename Compare, typename Allocator, typename Locking>
+bool FineGrainedSortedList<T, Compare, Allocator, Locking>::lockWindow(const Window& window) const
+{
+  if (!window.pred){
+    mutexHead_.lock();
+    if (head_ == window.curr){
+      return true;
+    }
+    mutexHead_.unlock();
+    return false;
+  }
+  lockOf(window.pred).lock();
+  if (!window.pred->removed && window.pred->next.load() == window.curr){
+    return true;
+  }
+  lockOf(window.pred).unlock();
+  return false;
+}
+
+
+
+template<typename T, typename Compare, typename Allocator, typename Locking>
+void FineGrainedSortedList<T, Compare, Allocator, Locking>::unlockWindow(const Window& window) const
+{
+  if (window.pred){
+    lockOf(window.pred).unlock();
+  }
+  else{
+    mutexHead_.unlock();
+  }
+}
+
+
+
+template<typename T, typename Compare, typename Allocator, typename Locking>
+bool FineGrainedSortedList<T, Compare, Allocator, Locking>::insertNode(Node* node)
+{
+  EpochReclaimer::Guard guard;
+  for (;;){
+    const Window window = find(node->value);
+    if (!lockWindow(window)){
+      continue;
+    }
+    //curr не может быть исключён, пока захвачен mutex pred: исключение
+    //меняет next предыдущего элемента под его mutex
+    if (window.curr && equal(window.curr->value, node->value)){
+      unlockWindow(window);
+      destroyNode(node);
+      return false;
+    }
+    node->next.store(window.curr);
+    if (window.pred){
+      window.pred->next.store(node);
+    }
+    else{
+      head_ = node;
+    }
+    size_.add(1);
+    unlockWindow(window);
+    return true;
+  }
+}
+
+
+
+template<typename T, typename Compare, typename Allocator, typename Locking>
+bool FineGrainedSortedList<T, Compare, Allocator, Locking>::equal(const T& lhs, const T& rhs) const
+{
+  return !compare_(lhs, rhs) && !compare_(rhs, lhs);
+}
+
+
+
+namespace fine_grained_sorted_list{
+  /**
+  Протестировать упорядоченное множество
+  */
+  void test();
+}
@@ -0,0 +1,155 @@
+#include "FlatCombiner.h"
+#include <cassert>
+#include <chrono>
+#include <ctime>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+
+//Проверка компиляции всех методов
+template class FlatCombiner<int>;
+
+
+
+//=============================================================================
+static void testOnethread();
+static void testMultithread();
+static void testException();
+static void testWait();
+
+
+void flat_combiner::test()
+{
+  testOnethread();
+  testMultithread();
+  testException();
+  testWait();
+}
+
+
+
+static void testOnethread()
+{
+  FlatCombiner<int> combiner(4);
+  assert(combiner.getSlotCount() == 4);
+  assert(FlatCombiner<int>().getSlotCount() >= 1);
+
+  //Без других потоков пакет - только собственный запрос
+  std::vector<int> applied;
+  for (int i=0; i<10; ++i){
+    combiner.execute(i, [&applied](const std::vector<int>& batch){
+      assert(batch.size() == 1);
+      applied.insert(applied.end(), batch.begin(), batch.end());
+    });
+  }
+  assert(applied.size() == 10);
+  for (int i=0; i<10; ++i){
+    assert(applied[i] == i);
+  }
+}
+
+
+
+static void testMultithread()
+{
+  //Каждый запрос выполняется ровно один раз, пакеты - по одному за раз,
+  //в том числе когда потоков больше, чем слотов
+  for (const size_t slotCount : {1, 2, 16}){
+    FlatCombiner<int> combiner(slotCount);
+    const int THREADS = 8;
+    const int COUNT = 5000;
+    std::vector<int> calls(THREADS * COUNT, 0);   //Меняется только в combine
+    std::atomic<bool> combining(false);
+    std::vector<std::thread> threads;
+    for (int t=0; t<THREADS; ++t){
+      threads.emplace_back([&, t](){
+        for (int i=0; i<COUNT; ++i){
+          const int request = t * COUNT + i;
+          combiner.execute(request, [&](const std::vector<int>& batch){
+            assert(!combining.exchange(true));
+            assert(!batch.empty() && batch.size() <= slotCount + 1);
+            for (const int value : batch){
+              ++calls[value];
+            }
+            combining = false;
+          });
+          //Запрос выполнен к возврату из execute
+          assert(calls[request] == 1);
+        }
+      });
+    }
+    for (auto& thread : threads){
+      thread.join();
+    }
+    for (const int call : calls){
+      assert(call == 1);
+    }
+  }
+}
+
+
+
+static void testException()
+{
+  //Исключение передаётся вызывающему, комбинатор продолжает работать
+  FlatCombiner<int> combiner(2);
+  bool isThrown = false;
+  try{
+    combiner.execute(1, [](const std::vector<int>&){
+      throw std::runtime_error("combine");
+    });
+  }
+  catch (const std::runtime_error&){
+    isThrown = true;
+  }
+  assert(isThrown);
+  int sum = 0;
+  combiner.execute(2, [&sum](const std::vector<int>& batch){
+    for (const int value : batch){
+      sum += value;
+    }
+  });
+  assert(sum == 2);
+}
+
+
+
+static void testWait()
+{
+  //Пока комбинатор выполняет долгий пакет, ждущие потоки спят,
+  //а не расходуют процессор, и просыпаются после пакета
+  FlatCombiner<int> combiner(4);
+  const int THREADS = 4;
+  const auto DURATION = std::chrono::milliseconds(300);
+  std::atomic<bool> started(false);
+  std::atomic<int> executed(0);
+  std::thread combining([&](){
+    combiner.execute(-1, [&](const std::vector<int>&){
+      started = true;
+      std::this_thread::sleep_for(DURATION);
+    });
+  });
+  while (!started){
+    std::this_thread::yield();
+  }
+  const std::clock_t cpuStart = std::clock();
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int t=0; t<THREADS; ++t){
+    threads.emplace_back([&, t](){
+      combiner.execute(t, [&](const std::vector<int>& batch){
+        executed += static_cast<int>(batch.size());
+      });
+    });
+  }
+  for (auto& thread : threads){
+    thread.join();
+  }
+  combining.join();
+  const double cpu = static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+  const double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  assert(executed == THREADS);
+  //Активное ожидание заняло бы процессор на всё время пакета
+  assert(cpu < wall / 2);
+}
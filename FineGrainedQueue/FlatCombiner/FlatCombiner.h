@@ -0,0 +1,235 @@
+/**
+\file FlatCombiner.h
+\brief Шаблон класса - flat combining: запросы многих потоков выполняет
+пакетом один поток
+
+- Поток публикует запрос в своём слоте и ждёт; тот, кто захватил
+  блокировку комбинатора, собирает запросы из всех слотов и выполняет
+  их одним вызовом combine: вместо очереди потоков на блокировку
+  структуры - один захват на пакет
+- Запись запроса размещается на стеке публикующего потока, слот хранит
+  указатель на неё: слот освобождается при сборе, а о выполнении поток
+  узнаёт по флагу своей записи - повторное занятие слота не путается
+  с выполнением
+- Слот выбирается по номеру потока; если он занят потоком с тем же
+  номером, поток не ждёт слота - пытается стать комбинатором и выполнить
+  свой запрос сам
+- Ждущий поток сначала недолго проверяет флаг активно, затем засыпает
+  (std::atomic::wait) на номере пакета комбинатора: запись на стеке
+  после done может быть уже разрушена, поэтому будят не по ней, а по
+  номеру, который меняется при каждом освобождении блокировки комбинатора
+- Исключение из combine получают все потоки пакета
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "CompactSharedMutex/CompactSharedMutex.h"
+#include "ThreadNumber/ThreadNumber.h"
+
+
+template<typename Request>
+class FlatCombiner{
+  public:
+    /**
+    \param[in] slotCount Количество слотов; 0 - по количеству ядер
+    */
+    explicit FlatCombiner(size_t slotCount = 0);
+
+    FlatCombiner(const FlatCombiner& other) = delete;
+    FlatCombiner& operator=(const FlatCombiner& other) = delete;
+
+    /**
+    Выполнить запрос: опубликовать его и дождаться, пока его выполнит
+    комбинатор, или стать комбинатором самому.
+    Возвращается, когда запрос выполнен
+    \param[in] request Запрос
+    \param[in] combine Функция, принимающая const std::vector<Request>& -
+    пакет запросов. Вызывается одним потоком за раз
+    */
+    template<typename Combine>
+    void execute(Request request, Combine&& combine);
+
+    /**
+    \return Количество слотов
+    */
+    size_t getSlotCount() const;
+
+  private:
+    //Сколько раз проверить флаг выполнения, прежде чем заснуть
+    static constexpr size_t SPIN_COUNT = 64;
+
+    //Опубликованный запрос - на стеке ожидающего потока
+    struct Record{
+      explicit Record(Request request): request(std::move(request)){}
+      Request request;
+      std::exception_ptr error;       //Пишется до done
+      std::atomic<bool> done{false};  //Запрос выполнен комбинатором
+    };
+
+    struct alignas(64) Slot{
+      std::atomic<Record*> record{nullptr};
+    };
+
+    /**
+    Собрать запросы из слотов, выполнить их пакетом и отметить выполненными.
+    Вызывается под блокировкой комбинатора
+    \param[in] own Запрос вызывающего потока, не попавший в слот; nullptr - нет
+    \param[in] combine Функция выполнения пакета
+    */
+    template<typename Combine>
+    void combineAll(Record* own, Combine& combine);
+
+    /**
+    Освободить блокировку комбинатора и разбудить ждущих: их запросы
+    выполнены или они могут стать комбинатором
+    */
+    void release();
+
+    /**
+    \return Слот текущего потока
+    */
+    Slot& local();
+
+    const size_t slotCount_;
+    std::unique_ptr<Slot[]> slots_;
+    alignas(64) std::atomic<bool> combining_{false};  //Блокировка комбинатора
+    //Номер освобождения блокировки комбинатора; на нём спят ждущие
+    std::atomic<uint32_t> generation_{0};
+    //Пакет текущего комбинатора; память переиспользуется между пакетами
+    std::vector<Record*> records_;
+    std::vector<Request> batch_;
+};
+
+
+
+template<typename Request>
+FlatCombiner<Request>::FlatCombiner(size_t slotCount):
+  slotCount_(slotCount ? slotCount : std::max(1u, std::thread::hardware_concurrency())),
+  slots_(std::make_unique<Slot[]>(slotCount_))
+{
+  records_.reserve(slotCount_ + 1);
+  batch_.reserve(slotCount_ + 1);
+}
+
+
+
+template<typename Request>
+template<typename Combine>
+void FlatCombiner<Request>::execute(Request request, Combine&& combine)
+{
+  Record record(std::move(request));
+  Slot& slot = local();
+  Record* expected = nullptr;
+  const bool published = slot.record.compare_exchange_strong(expected, &record);
+
+  for (size_t spin=0;; ++spin){
+    //Номер читается до проверок: освобождение блокировки после них
+    //меняет номер, и wait() не заснёт
+    const uint32_t generation = generation_.load(std::memory_order_acquire);
+    if (record.done.load(std::memory_order_acquire)){
+      break;
+    }
+    if (!combining_.load(std::memory_order_relaxed) &&
+        !combining_.exchange(true, std::memory_order_acquire)){
+      //Предыдущий комбинатор мог выполнить запрос между проверкой флага
+      //и захватом блокировки - пустой пакет не выполняется
+      if (!record.done.load(std::memory_order_acquire)){
+        //Собственный запрос выполняется в этом же пакете: он ещё в слоте
+        //или не был опубликован
+        combineAll(published ? nullptr : &record, combine);
+      }
+      release();
+      break;
+    }
+    if (spin < SPIN_COUNT){
+      cpuRelax();
+    }
+    else{
+      generation_.wait(generation, std::memory_order_acquire);
+    }
+  }
+  if (record.error){
+    std::rethrow_exception(record.error);
+  }
+}
+
+
+
+template<typename Request>
+template<typename Combine>
+void FlatCombiner<Request>::combineAll(Record* own, Combine& combine)
+{
+  records_.clear();
+  batch_.clear();
+  if (own){
+    records_.push_back(own);
+  }
+  for (size_t i=0; i<slotCount_; ++i){
+    if (!slots_[i].record.load(std::memory_order_relaxed)){
+      continue;
+    }
+    if (Record* record = slots_[i].record.exchange(nullptr, std::memory_order_acquire)){
+      records_.push_back(record);
+    }
+  }
+  for (Record* record : records_){
+    batch_.push_back(std::move(record->request));
+  }
+
+  std::exception_ptr error;
+  try{
+    combine(static_cast<const std::vector<Request>&>(batch_));
+  }
+  catch (...){
+    error = std::current_exception();
+  }
+  //После done запись может быть уже разрушена ждавшим потоком
+  for (Record* record : records_){
+    record->error = error;
+    record->done.store(true, std::memory_order_release);
+  }
+}
+
+
+
+template<typename Request>
+void FlatCombiner<Request>::release()
+{
+  combining_.store(false, std::memory_order_release);
+  generation_.fetch_add(1, std::memory_order_release);
+  generation_.notify_all();
+}
+
+
+
+template<typename Request>
+typename FlatCombiner<Request>::Slot& FlatCombiner<Request>::local()
+{
+  return slots_[threadNumber() % slotCount_];
+}
+
+
+
+template<typename Request>
+size_t FlatCombiner<Request>::getSlotCount() const
+{
+  return slotCount_;
+}
+
+
+
+namespace flat_combiner{
+  /**
+  Протестировать flat combining
+  */
+  void test();
+}
@@ -0,0 +1,251 @@
+#include "LatencyStats.h"
+#include <algorithm>
+#include <cassert>
+#include <thread>
+
+
+LatencyHistogram::LatencyHistogram():
+  buckets_(BUCKET_COUNT, 0)
+{
+}
+
+
+
+void LatencyHistogram::record(uint64_t ns, uint64_t count)
+{
+  buckets_[bucketOf(ns)] += count;
+  count_ += count;
+  sum_ += ns * count;
+  max_ = std::max(max_, ns);
+}
+
+
+
+void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+  for (size_t i=0; i<BUCKET_COUNT; ++i){
+    buckets_[i] += other.buckets_[i];
+  }
+  count_ += other.count_;
+  sum_ += other.sum_;
+  max_ = std::max(max_, other.max_);
+}
+
+
+
+uint64_t LatencyHistogram::percentile(double q) const
+{
+  if (!count_){
+    return 0;
+  }
+  //Номер значения перцентиля среди упорядоченных значений, с 1
+  const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * count_ + 0.5));
+  uint64_t seen = 0;
+  for (size_t i=0; i<BUCKET_COUNT; ++i){
+    seen += buckets_[i];
+    if (seen >= rank){
+      return std::min(bucketMax(i), max_);
+    }
+  }
+  return max_;
+}
+
+
+
+void LatencyHistogram::reset()
+{
+  std::fill(buckets_.begin(), buckets_.end(), 0);
+  count_ = 0;
+  sum_ = 0;
+  max_ = 0;
+}
+
+
+
+LatencyStats::LatencyStats(size_t shardCount):
+  shardCount_(shardCount ? shardCount : std::max(1u, std::thread::hardware_concurrency())),
+  shards_(std::make_unique<Shard[]>(shardCount_))
+{
+}
+
+
+
+LatencySnapshot LatencyStats::snapshot() const
+{
+  //Сумма и наибольшее значение гистограммы берутся из счётчиков групп:
+  //по корзинам они были бы известны лишь с погрешностью корзины
+  LatencySnapshot snapshot;
+  for (size_t kind=0; kind<static_cast<size_t>(OperationKind::COUNT); ++kind){
+    LatencyHistogram& histogram = snapshot.operations[kind];
+    SlowestOperation& slowest = snapshot.slowest[kind];
+    for (size_t s=0; s<shardCount_; ++s){
+      const Shard& shard = shards_[s];
+      for (size_t bucket=0; bucket<LatencyHistogram::BUCKET_COUNT; ++bucket){
+        const uint64_t count = shard.buckets[kind][bucket].load(std::memory_order_relaxed);
+        histogram.buckets_[bucket] += count;
+        histogram.count_ += count;
+      }
+      histogram.sum_ += shard.sum[kind].load(std::memory_order_relaxed);
+      const uint64_t ns = shard.slowest[kind].ns.load(std::memory_order_relaxed);
+      if (ns > slowest.ns){
+        slowest.ns = ns;
+        slowest.position = shard.slowest[kind].position.load(std::memory_order_relaxed);
+        slowest.length = shard.slowest[kind].length.load(std::memory_order_relaxed);
+      }
+    }
+    histogram.max_ = slowest.ns;
+  }
+  return snapshot;
+}
+
+
+
+void LatencyStats::reset()
+{
+  for (size_t s=0; s<shardCount_; ++s){
+    Shard& shard = shards_[s];
+    for (size_t kind=0; kind<static_cast<size_t>(OperationKind::COUNT); ++kind){
+      for (auto& bucket : shard.buckets[kind]){
+        bucket.store(0, std::memory_order_relaxed);
+      }
+      shard.sum[kind].store(0, std::memory_order_relaxed);
+      shard.slowest[kind].ns.store(0, std::memory_order_relaxed);
+      shard.slowest[kind].position.store(0, std::memory_order_relaxed);
+      shard.slowest[kind].length.store(0, std::memory_order_relaxed);
+    }
+  }
+}
+
+
+
+//=============================================================================
+static void testBuckets();
+static void testHistogram();
+static void testStats();
+static void testMultithread();
+
+
+void latency_stats::test()
+{
+  testBuckets();
+  testHistogram();
+  testStats();
+  testMultithread();
+}
+
+
+
+static void testBuckets()
+{
+  //Малые значения - точно, дальше - погрешность не больше 1/32
+  for (uint64_t ns=0; ns<32; ++ns){
+    assert(LatencyHistogram::bucketOf(ns) == ns);
+    assert(LatencyHistogram::bucketMax(ns) == ns);
+  }
+  for (uint64_t ns=32; ns<(uint64_t(1) << 20); ns = ns + ns / 7 + 1){
+    const size_t bucket = LatencyHistogram::bucketOf(ns);
+    const uint64_t max = LatencyHistogram::bucketMax(bucket);
+    assert(max >= ns);
+    assert(max - ns <= ns / 32);
+    //Корзины упорядочены и не пересекаются
+    assert(LatencyHistogram::bucketOf(max) == bucket);
+    assert(LatencyHistogram::bucketOf(max + 1) == bucket + 1);
+  }
+  assert(LatencyHistogram::bucketOf(UINT64_MAX) == LatencyHistogram::BUCKET_COUNT - 1);
+}
+
+
+
+static void testHistogram()
+{
+  LatencyHistogram histogram;
+  assert(histogram.percentile(0.5) == 0);
+  assert(histogram.getMean() == 0.0);
+
+  //1 ... 1000 нс
+  for (uint64_t ns=1; ns<=1000; ++ns){
+    histogram.record(ns);
+  }
+  assert(histogram.getCount() == 1000);
+  assert(histogram.getMax() == 1000);
+  assert(histogram.getMean() == 500.5);
+  const uint64_t p50 = histogram.percentile(0.5);
+  assert(p50 >= 500 && p50 <= 500 + 500 / 32);
+  const uint64_t p99 = histogram.percentile(0.99);
+  assert(p99 >= 990 && p99 <= 990 + 990 / 32);
+  assert(histogram.percentile(1.0) == 1000);
+  assert(histogram.percentile(0.0) == 1);
+
+  //Сложение гистограмм - как запись всех значений в одну
+  LatencyHistogram other;
+  other.record(1000000, 10);
+  histogram.merge(other);
+  assert(histogram.getCount() == 1010);
+  assert(histogram.getMax() == 1000000);
+  assert(histogram.percentile(0.999) == 1000000);
+  assert(histogram.getBucket(LatencyHistogram::bucketOf(1000000)) == 10);
+
+  histogram.reset();
+  assert(histogram.getCount() == 0 && histogram.getMax() == 0);
+}
+
+
+
+static void testStats()
+{
+  LatencyStats stats(4);
+  assert(stats.getShardCount() == 4);
+  assert(LatencyStats().getShardCount() >= 1);
+
+  size_t lengthCalls = 0;
+  auto length = [&lengthCalls](){ ++lengthCalls; return size_t(42); };
+  stats.record(OperationKind::INSERT, 100, 7, length);
+  stats.record(OperationKind::INSERT, 5000, 9, length);
+  stats.record(OperationKind::INSERT, 200, 3, length);
+  stats.record(OperationKind::PUSH_BACK, 50, 0, length);
+  //Длина запрашивается только у новой самой долгой операции
+  assert(lengthCalls == 3);
+
+  const LatencySnapshot snapshot = stats.snapshot();
+  assert(snapshot[OperationKind::INSERT].getCount() == 3);
+  assert(snapshot[OperationKind::INSERT].getMax() == 5000);
+  assert(snapshot[OperationKind::INSERT].getMean() == 5300.0 / 3);
+  assert(snapshot[OperationKind::PUSH_BACK].getCount() == 1);
+  assert(snapshot[OperationKind::GET_VALUE].getCount() == 0);
+  const SlowestOperation& slowest = snapshot.slowest[static_cast<size_t>(OperationKind::INSERT)];
+  assert(slowest.ns == 5000 && slowest.position == 9 && slowest.length == 42);
+
+  stats.reset();
+  assert(stats.snapshot()[OperationKind::INSERT].getCount() == 0);
+  assert(stats.snapshot().slowest[static_cast<size_t>(OperationKind::INSERT)].ns == 0);
+}
+
+
+
+static void testMultithread()
+{
+  //Записи потоков разных и общих групп складываются без потерь
+  LatencyStats stats(2);
+  const int THREADS = 4;
+  const int COUNT = 10000;
+  std::vector<std::thread> threads;
+  for (int t=0; t<THREADS; ++t){
+    threads.emplace_back([&stats](){
+      for (int i=0; i<COUNT; ++i){
+        stats.record(OperationKind::GET_VALUE, static_cast<uint64_t>(i % 100), i,
+                     [](){ return size_t(0); });
+      }
+    });
+  }
+  //Снимок во время записи не нарушает записей
+  for (int i=0; i<10; ++i){
+    assert(stats.snapshot()[OperationKind::GET_VALUE].getCount() <= THREADS * COUNT);
+  }
+  for (auto& thread : threads){
+    thread.join();
+  }
+  const LatencySnapshot snapshot = stats.snapshot();
+  assert(snapshot[OperationKind::GET_VALUE].getCount() == THREADS * COUNT);
+  assert(snapshot[OperationKind::GET_VALUE].getMax() == 99);
+  assert(snapshot[OperationKind::GET_VALUE].percentile(0.5) == 49);
+}
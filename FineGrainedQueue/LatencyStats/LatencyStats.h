@@ -0,0 +1,337 @@
+/**
+\file LatencyStats.h
+\brief Гистограммы задержек операций контейнера
+
+- LatencyHistogram - гистограмма с логарифмическими корзинами (как HDR
+  Histogram): значения до 32 нс - каждое в своей корзине, дальше каждая
+  степень двойки делится на 32 корзины - относительная погрешность
+  перцентиля не больше 1/32. Гистограммы складываются (merge)
+- LatencyStats - гистограммы по видам операций, распределённые по группам
+  потоков, как SizeCounter::Mode::SHARDED: запись - relaxed-инкремент
+  корзины в кэш-линиях своей группы, snapshot() складывает группы
+- Для каждого вида операции запоминается самая долгая операция группы
+  потоков: задержка, позиция и длина контейнера - чтобы связать выбросы
+  p999 с длиной списка и позицией вставки. Длина запрашивается только
+  у новой самой долгой операции
+- Виды операций (OperationKind) покрывают все операции FineGrainedQueue
+  над элементами. Не измеряются getSize / isEmpty (одно чтение счётчика),
+  настройки списка, перемещение и перевод в другую политику блокировок
+- snapshot() и reset() при одновременных записях приблизительны
+*/
+
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "ThreadNumber/ThreadNumber.h"
+
+
+//Операции, задержки которых измеряются
+enum class OperationKind{
+  PUSH_FRONT,   //pushFront / emplaceFront
+  PUSH_BACK,    //pushBack / emplaceBack / tryPushBack / pushBackFor, с ожиданием места
+  INSERT,       //insertIntoMiddle / emplaceAt
+  GET_VALUE,    //getValue / visitValue
+  POP_FRONT,    //tryPopFront, в том числе из popFront / popFrontFor
+  POP_BACK,     //tryPopBack
+  ERASE,        //erase
+  REMOVE_FIRST, //removeFirst
+  REMOVE_IF,    //removeIf
+  PUSH_FRONT_BULK,  //pushFrontBulk
+  PUSH_BACK_BULK,   //pushBackBulk
+  INSERT_BULK,      //insertBulkAt
+  PEEK_FRONT,   //tryPeekFront / peekFront
+  PEEK_BACK,    //tryPeekBack / peekBack
+  FOR_EACH,     //forEach / forEachRange, позиция - начало обхода
+  PARALLEL,     //parallelReduce / parallelForEach / countIf
+  CLEAR,        //clear
+  APPEND_ALL,   //appendAll
+  SPLIT_AT,     //splitAt
+  COUNT
+};
+
+
+
+class LatencyHistogram{
+  public:
+    //Корзин на степень двойки: 2^SUB_BUCKET_BITS
+    static constexpr size_t SUB_BUCKET_BITS = 5;
+    //Значения от 2^(MAX_EXPONENT+1) нс (больше минуты) - в последней корзине
+    static constexpr size_t MAX_EXPONENT = 36;
+    static constexpr size_t BUCKET_COUNT = (MAX_EXPONENT - SUB_BUCKET_BITS + 2) << SUB_BUCKET_BITS;
+
+    LatencyHistogram();
+
+    /**
+    \param[in] ns Значение, нс
+    \return Номер корзины значения
+    */
+    static size_t bucketOf(uint64_t ns);
+
+    /**
+    \param[in] bucket Номер корзины
+    \return Наибольшее значение корзины, нс
+    */
+    static uint64_t bucketMax(size_t bucket);
+
+    /**
+    Учесть значения
+    \param[in] ns Значение, нс
+    \param[in] count Сколько раз учесть значение
+    */
+    void record(uint64_t ns, uint64_t count = 1);
+
+    /**
+    Прибавить значения другой гистограммы
+    \param[in] other Гистограмма
+    */
+    void merge(const LatencyHistogram& other);
+
+    /**
+    \param[in] q Доля от 0 до 1, например 0.999
+    \return Перцентиль, нс: наибольшее значение корзины, в которую попал
+    перцентиль, но не больше getMax(); 0 - гистограмма пуста
+    */
+    uint64_t percentile(double q) const;
+
+    /**
+    \return Количество значений
+    */
+    uint64_t getCount() const;
+
+    /**
+    \return Наибольшее значение, нс
+    */
+    uint64_t getMax() const;
+
+    /**
+    \return Среднее значение, нс
+    */
+    double getMean() const;
+
+    /**
+    \param[in] bucket Номер корзины
+    \return Количество значений в корзине
+    */
+    uint64_t getBucket(size_t bucket) const;
+
+    /**
+    Удалить все значения
+    */
+    void reset();
+
+  private:
+    //Снимок LatencyStats заполняет поля напрямую
+    friend class LatencyStats;
+
+    std::vector<uint64_t> buckets_;
+    uint64_t count_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t max_ = 0;
+};
+
+
+
+//Самая долгая операция одного вида
+struct SlowestOperation{
+  uint64_t ns = 0;        //Задержка, нс
+  size_t position = 0;    //Позиция операции (для операций по позиции)
+  size_t length = 0;      //Длина контейнера после операции
+};
+
+
+
+//Снимок задержек контейнера
+struct LatencySnapshot{
+  LatencyHistogram operations[static_cast<size_t>(OperationKind::COUNT)];
+  SlowestOperation slowest[static_cast<size_t>(OperationKind::COUNT)];
+
+  const LatencyHistogram& operator[](OperationKind kind) const
+  {
+    return operations[static_cast<size_t>(kind)];
+  }
+};
+
+
+
+class LatencyStats{
+  public:
+    /**
+    \param[in] shardCount Количество групп потоков; 0 - по количеству ядер
+    */
+    explicit LatencyStats(size_t shardCount = 0);
+
+    LatencyStats(const LatencyStats& other) = delete;
+    LatencyStats& operator=(const LatencyStats& other) = delete;
+
+    /**
+    \return Текущее время, нс
+    */
+    static uint64_t now();
+
+    /**
+    Учесть операцию
+    \param[in] kind Вид операции
+    \param[in] ns Задержка, нс
+    \param[in] position Позиция операции
+    \param[in] length Функция без параметров, возвращающая длину контейнера;
+    вызывается, только если операция - самая долгая в группе потоков
+    */
+    template<typename Length>
+    void record(OperationKind kind, uint64_t ns, size_t position, Length&& length);
+
+    /**
+    \return Гистограммы всех групп потоков, сложенные по видам операций
+    */
+    LatencySnapshot snapshot() const;
+
+    /**
+    Удалить все значения
+    */
+    void reset();
+
+    /**
+    \return Количество групп потоков
+    */
+    size_t getShardCount() const;
+
+  private:
+    struct Slowest{
+      std::atomic<uint64_t> ns{0};
+      std::atomic<size_t> position{0};
+      std::atomic<size_t> length{0};
+    };
+
+    //Гистограммы группы потоков - в своих кэш-линиях
+    struct alignas(64) Shard{
+      std::atomic<uint64_t> buckets[static_cast<size_t>(OperationKind::COUNT)]
+                                   [LatencyHistogram::BUCKET_COUNT] = {};
+      std::atomic<uint64_t> sum[static_cast<size_t>(OperationKind::COUNT)] = {};
+      Slowest slowest[static_cast<size_t>(OperationKind::COUNT)];
+    };
+
+    /**
+    \return Группа текущего потока
+    */
+    Shard& local();
+
+    const size_t shardCount_;
+    std::unique_ptr<Shard[]> shards_;
+};
+
+
+
+inline size_t LatencyHistogram::bucketOf(uint64_t ns)
+{
+  if (ns < (uint64_t(1) << SUB_BUCKET_BITS)){
+    return static_cast<size_t>(ns);
+  }
+  const size_t exponent = std::bit_width(ns) - 1;
+  if (exponent > MAX_EXPONENT){
+    return BUCKET_COUNT - 1;
+  }
+  const size_t shift = exponent - SUB_BUCKET_BITS;
+  return ((shift + 1) << SUB_BUCKET_BITS) +
+         static_cast<size_t>((ns >> shift) - (uint64_t(1) << SUB_BUCKET_BITS));
+}
+
+
+
+inline uint64_t LatencyHistogram::bucketMax(size_t bucket)
+{
+  if (bucket < (size_t(1) << SUB_BUCKET_BITS)){
+    return bucket;
+  }
+  const size_t shift = (bucket >> SUB_BUCKET_BITS) - 1;
+  const uint64_t mantissa = (bucket & ((size_t(1) << SUB_BUCKET_BITS) - 1)) +
+                            (uint64_t(1) << SUB_BUCKET_BITS);
+  return ((mantissa + 1) << shift) - 1;
+}
+
+
+
+inline uint64_t LatencyHistogram::getCount() const
+{
+  return count_;
+}
+
+
+
+inline uint64_t LatencyHistogram::getMax() const
+{
+  return max_;
+}
+
+
+
+inline double LatencyHistogram::getMean() const
+{
+  return count_ ? static_cast<double>(sum_) / count_ : 0.0;
+}
+
+
+
+inline uint64_t LatencyHistogram::getBucket(size_t bucket) const
+{
+  return buckets_[bucket];
+}
+
+
+
+inline uint64_t LatencyStats::now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+
+template<typename Length>
+void LatencyStats::record(OperationKind kind, uint64_t ns, size_t position, Length&& length)
+{
+  Shard& shard = local();
+  const size_t index = static_cast<size_t>(kind);
+  shard.buckets[index][LatencyHistogram::bucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+  shard.sum[index].fetch_add(ns, std::memory_order_relaxed);
+  //Задержка самой долгой операции только растёт; позицию и длину пишет
+  //поток, увеличивший задержку, - потоки одной группы могут записать их
+  //вперемешку, и снимок позиции и длины приблизителен
+  Slowest& slowest = shard.slowest[index];
+  uint64_t slowestNs = slowest.ns.load(std::memory_order_relaxed);
+  while (ns > slowestNs){
+    if (slowest.ns.compare_exchange_weak(slowestNs, ns, std::memory_order_relaxed)){
+      slowest.position.store(position, std::memory_order_relaxed);
+      slowest.length.store(length(), std::memory_order_relaxed);
+      break;
+    }
+  }
+}
+
+
+
+inline LatencyStats::Shard& LatencyStats::local()
+{
+  return shards_[threadNumber() % shardCount_];
+}
+
+
+
+inline size_t LatencyStats::getShardCount() const
+{
+  return shardCount_;
+}
+
+
+
+namespace latency_stats{
+  /**
+  Протестировать гистограммы задержек
+  */
+  void test();
+}
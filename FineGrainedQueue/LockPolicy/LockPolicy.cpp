@@ -0,0 +1,111 @@
+#include "LockPolicy.h"
+#include <cassert>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+void SpinSharedMutex::backoff(size_t spin)
+{
+  if (spin < SPIN_COUNT){
+    cpuRelax();
+  }
+  else{
+    std::this_thread::yield();
+  }
+}
+
+
+
+//=============================================================================
+static void testNullMutex();
+static void testSpinOnethread();
+static void testSpinMultithread();
+
+
+void lock_policy::test()
+{
+  testNullMutex();
+  testSpinOnethread();
+  testSpinMultithread();
+}
+
+
+
+static void testNullMutex()
+{
+  static_assert(std::is_empty_v<NullMutex>);
+  static_assert(std::is_same_v<NullLocking<>::NodeStorage, CompactLocking::NodeStorage>);
+  static_assert(std::is_same_v<NullLocking<SpinLocking>::NodeStorage, SpinSharedMutex>);
+
+  //Захват всегда успешен, в том числе повторный
+  NullMutex mutex;
+  std::unique_lock<NullMutex> lock(mutex);
+  assert(mutex.try_lock());
+  assert(mutex.try_lock_shared());
+}
+
+
+
+static void testSpinOnethread()
+{
+  static_assert(sizeof(SpinSharedMutex) == 4);
+
+  SpinSharedMutex mutex;
+  mutex.lock();
+  assert(!mutex.try_lock());
+  assert(!mutex.try_lock_shared());
+  mutex.unlock();
+
+  mutex.lock_shared();
+  assert(mutex.try_lock_shared());
+  assert(!mutex.try_lock());
+  mutex.unlock_shared();
+  assert(!mutex.try_lock());
+  mutex.unlock_shared();
+  assert(mutex.try_lock());
+  mutex.unlock();
+
+  SpinSharedMutex other;
+  std::lock(mutex, other);
+  mutex.unlock();
+  other.unlock();
+}
+
+
+
+static void testSpinMultithread()
+{
+  //Писатели меняют пару значений монопольно, читатели проверяют,
+  //что не видят промежуточного состояния
+  SpinSharedMutex mutex;
+  long first = 0;
+  long second = 0;
+  const int COUNT = 20000;
+  std::atomic<bool> done(false);
+  std::vector<std::thread> threads;
+  for (int i=0; i<2; ++i){
+    threads.emplace_back([&](){
+      for (int j=0; j<COUNT; ++j){
+        std::lock_guard<SpinSharedMutex> lock(mutex);
+        ++first;
+        ++second;
+      }
+    });
+  }
+  for (int i=0; i<2; ++i){
+    threads.emplace_back([&](){
+      while (!done){
+        std::shared_lock<SpinSharedMutex> lock(mutex);
+        assert(first == second);
+      }
+    });
+  }
+  threads[0].join();
+  threads[1].join();
+  done = true;
+  threads[2].join();
+  threads[3].join();
+  assert(first == 2*COUNT);
+  assert(second == 2*COUNT);
+}
@@ -0,0 +1,187 @@
+/**
+\file LockPolicy.h
+\brief Политики блокировок FineGrainedQueue
+
+- Политика задаёт тип mutex для каждого вида mutex списка (Mutex<Kind>)
+  и тип mutex, хранящегося в каждом элементе списка (NodeStorage)
+- CompactLocking (по умолчанию) - у элементов CompactSharedMutex (4 байта),
+  mutex начала, конца списка и индекса - std::shared_mutex
+- SharedMutexLocking - везде std::shared_mutex
+- SpinLocking - везде SpinSharedMutex: только активное ожидание,
+  для коротких захватов при потоках не больше, чем ядер
+- NullLocking<Concurrent> - без блокировок, для однопоточных этапов работы.
+  Элементы хранят mutex политики Concurrent, но не захватывают его:
+  список переводится в политику Concurrent и обратно без копирования
+  элементов (конструктор FineGrainedQueue из списка другой политики)
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <shared_mutex>
+#include <type_traits>
+
+#include "CompactSharedMutex/CompactSharedMutex.h"
+
+
+//Вид mutex списка
+enum class LockKind{
+  HEAD,   //mutex начала списка
+  TAIL,   //mutex конца списка
+  NODE,   //mutex элементов (все элементы вместе)
+  INDEX,  //mutex позиционного индекса
+  STRUCTURE,  //mutex структуры списка: разделение и перенос цепочек
+  COUNT
+};
+
+
+
+//mutex, который ничего не захватывает
+class NullMutex{
+  public:
+    void lock() {}
+    bool try_lock() { return true; }
+    void unlock() {}
+    void lock_shared() {}
+    bool try_lock_shared() { return true; }
+    void unlock_shared() {}
+};
+
+
+
+//mutex с захватом на чтение в одном 32-битном слове, только активное
+//ожидание: поток не засыпает, а уступает ядро (yield)
+class SpinSharedMutex{
+  public:
+    SpinSharedMutex() = default;
+    SpinSharedMutex(const SpinSharedMutex& other) = delete;
+    SpinSharedMutex& operator=(const SpinSharedMutex& other) = delete;
+
+    void lock();
+    bool try_lock();
+    void unlock();
+
+    void lock_shared();
+    bool try_lock_shared();
+    void unlock_shared();
+
+  private:
+    static constexpr uint32_t WRITER = 1u << 31;
+    //Сколько раз проверить состояние, прежде чем уступить ядро
+    static constexpr size_t SPIN_COUNT = 64;
+
+    /**
+    Подождать перед следующей попыткой захвата
+    \param[in] spin Номер попытки
+    */
+    static void backoff(size_t spin);
+
+    std::atomic<uint32_t> state_{0};
+};
+
+
+
+inline bool SpinSharedMutex::try_lock()
+{
+  uint32_t state = 0;
+  return state_.compare_exchange_strong(state, WRITER, std::memory_order_acquire,
+                                        std::memory_order_relaxed);
+}
+
+
+
+inline void SpinSharedMutex::lock()
+{
+  size_t spin = 0;
+  while (!try_lock()){
+    //Ждать освобождения без записи в слово состояния
+    do{
+      backoff(spin++);
+    } while (state_.load(std::memory_order_relaxed) != 0);
+  }
+}
+
+
+
+inline void SpinSharedMutex::unlock()
+{
+  state_.store(0, std::memory_order_release);
+}
+
+
+
+inline bool SpinSharedMutex::try_lock_shared()
+{
+  uint32_t state = state_.load(std::memory_order_relaxed);
+  while (!(state & WRITER)){
+    if (state_.compare_exchange_weak(state, state + 1, std::memory_order_acquire,
+                                     std::memory_order_relaxed)){
+      return true;
+    }
+  }
+  return false;
+}
+
+
+
+inline void SpinSharedMutex::lock_shared()
+{
+  size_t spin = 0;
+  while (!try_lock_shared()){
+    backoff(spin++);
+  }
+}
+
+
+
+inline void SpinSharedMutex::unlock_shared()
+{
+  state_.fetch_sub(1, std::memory_order_release);
+}
+
+
+
+//Элементы - CompactSharedMutex, остальные mutex - std::shared_mutex
+struct CompactLocking{
+  template<LockKind Kind>
+  using Mutex = std::conditional_t<Kind == LockKind::NODE,
+                                   CompactSharedMutex, std::shared_mutex>;
+  using NodeStorage = Mutex<LockKind::NODE>;
+};
+
+
+
+struct SharedMutexLocking{
+  template<LockKind Kind>
+  using Mutex = std::shared_mutex;
+  using NodeStorage = Mutex<LockKind::NODE>;
+};
+
+
+
+struct SpinLocking{
+  template<LockKind Kind>
+  using Mutex = SpinSharedMutex;
+  using NodeStorage = Mutex<LockKind::NODE>;
+};
+
+
+
+//Без блокировок; элементы хранят mutex политики Concurrent
+template<typename Concurrent = CompactLocking>
+struct NullLocking{
+  template<LockKind Kind>
+  using Mutex = NullMutex;
+  using NodeStorage = typename Concurrent::NodeStorage;
+};
+
+
+
+namespace lock_policy{
+  /**
+  Протестировать mutex политик блокировок
+  */
+  void test();
+}
@@ -0,0 +1,110 @@
+#include "LockStats.h"
+#include <cassert>
+#include <mutex>
+#include <thread>
+
+
+//=============================================================================
+static void testCounters();
+static void testContention();
+static void testOutsideScope();
+
+
+void lock_stats::test()
+{
+  testCounters();
+  testContention();
+  testOutsideScope();
+}
+
+
+
+static void testCounters()
+{
+  LockStats stats;
+  LockStats::Mutex<LockKind::HEAD> head;
+  LockStats::Mutex<LockKind::NODE> node;
+  {
+    LockStats::Scope scope(stats);
+    head.lock();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    head.unlock();
+    node.lock_shared();
+    node.unlock_shared();
+    assert(node.try_lock());
+    node.unlock();
+    stats.traversal(10);
+    stats.traversal(20);
+  }
+  const LockStatsSnapshot snapshot = stats.snapshot();
+  assert(snapshot[LockKind::HEAD].acquisitions == 1);
+  assert(snapshot[LockKind::HEAD].contended == 0);
+  //Удержание mutex начала списка - не меньше 1 мс
+  assert(snapshot[LockKind::HEAD].holdNs >= 1000000);
+  assert(snapshot[LockKind::NODE].acquisitions == 2);
+  assert(snapshot[LockKind::TAIL].acquisitions == 0);
+  assert(snapshot.traversals == 2);
+  assert(snapshot.averageTraversal() == 15.0);
+
+  stats.reset();
+  assert(stats.snapshot()[LockKind::HEAD].acquisitions == 0);
+  assert(stats.snapshot().traversals == 0);
+}
+
+
+
+static void testContention()
+{
+  //Второй поток ждёт mutex, удерживаемый первым
+  LockStats stats;
+  LockStats::Mutex<LockKind::TAIL> tail;
+  std::atomic<bool> locked(false);
+  std::thread holder([&](){
+    LockStats::Scope scope(stats);
+    std::lock_guard<LockStats::Mutex<LockKind::TAIL>> lock(tail);
+    locked = true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  });
+  while (!locked){
+    std::this_thread::yield();
+  }
+  {
+    LockStats::Scope scope(stats);
+    tail.lock_shared();
+    tail.unlock_shared();
+  }
+  holder.join();
+
+  const LockStatsSnapshot snapshot = stats.snapshot();
+  assert(snapshot[LockKind::TAIL].acquisitions == 2);
+  assert(snapshot[LockKind::TAIL].contended == 1);
+  assert(snapshot[LockKind::TAIL].waitNs > 0);
+  assert(snapshot[LockKind::TAIL].holdNs > 0);
+}
+
+
+
+static void testOutsideScope()
+{
+  //Вне Scope mutex работает, статистика не пишется
+  LockStats stats;
+  LockStats::Mutex<LockKind::INDEX> index;
+  index.lock();
+  index.unlock();
+  {
+    //Вложенный Scope восстанавливает внешний
+    LockStats other;
+    LockStats::Scope scope(stats);
+    {
+      LockStats::Scope nested(other);
+      index.lock();
+      index.unlock();
+    }
+    index.lock_shared();
+    index.unlock_shared();
+    assert(other.snapshot()[LockKind::INDEX].acquisitions == 1);
+  }
+  index.lock();
+  index.unlock();
+  assert(stats.snapshot()[LockKind::INDEX].acquisitions == 1);
+}
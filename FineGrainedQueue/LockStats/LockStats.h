@@ -0,0 +1,324 @@
+/**
+\file LockStats.h
+\brief Политики статистики блокировок FineGrainedQueue
+
+- NoLockStats (по умолчанию) - статистика не собирается: mutex списка -
+  mutex политики блокировок (LockPolicy.h), вызовы статистики пустые
+- LockStats - для каждого вида mutex (начало списка, конец списка,
+  элементы, индекс) считаются захваты, захваты с ожиданием, суммарное
+  время ожидания и время монопольного удержания; для проходов по
+  списку - количество проходов и пройденных элементов
+- mutex находит статистику своего списка через указатель потока,
+  который выставляет Scope на время операции списка
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "LockPolicy/LockPolicy.h"
+
+
+
+//Статистика одного вида mutex
+struct LockCounters{
+  uint64_t acquisitions = 0;  //Захватов (монопольных и на чтение)
+  uint64_t contended = 0;     //Захватов, которым пришлось ждать
+  uint64_t waitNs = 0;        //Суммарное время ожидания, нс
+  uint64_t holdNs = 0;        //Суммарное время монопольного удержания, нс
+};
+
+
+
+//Снимок статистики списка
+struct LockStatsSnapshot{
+  LockCounters locks[static_cast<size_t>(LockKind::COUNT)];
+  uint64_t traversals = 0;      //Проходов по списку до позиции
+  uint64_t traversalSteps = 0;  //Пройдено элементов за все проходы
+
+  const LockCounters& operator[](LockKind kind) const
+  {
+    return locks[static_cast<size_t>(kind)];
+  }
+
+  /**
+  \return Средняя длина прохода по списку
+  */
+  double averageTraversal() const
+  {
+    return traversals ? static_cast<double>(traversalSteps) / traversals : 0.0;
+  }
+};
+
+
+
+//Статистика не собирается
+class NoLockStats{
+  public:
+    //Base - mutex политики блокировок списка
+    template<LockKind Kind, typename Base = CompactLocking::Mutex<Kind>>
+    using Mutex = Base;
+
+    struct Scope{
+      explicit Scope(NoLockStats&){}
+    };
+
+    void traversal(size_t) {}
+    LockStatsSnapshot snapshot() const { return LockStatsSnapshot{}; }
+    void reset() {}
+};
+
+
+
+//Статистика собирается
+class LockStats{
+  public:
+    template<LockKind Kind, typename Base = CompactLocking::Mutex<Kind>>
+    class Mutex;
+
+    //На время существования Scope mutex'ы текущего потока
+    //записывают статистику в stats. Scope может быть вложенным
+    class Scope{
+      public:
+        explicit Scope(LockStats& stats): previous_(current_){ current_ = &stats; }
+        ~Scope(){ current_ = previous_; }
+        Scope(const Scope& other) = delete;
+        Scope& operator=(const Scope& other) = delete;
+      private:
+        LockStats* previous_;
+    };
+
+    LockStats() = default;
+    LockStats(const LockStats& other) = delete;
+    LockStats& operator=(const LockStats& other) = delete;
+
+    /**
+    Учесть проход по списку
+    \param[in] steps Количество пройденных элементов
+    */
+    void traversal(size_t steps);
+
+    /**
+    \return Снимок статистики
+    */
+    LockStatsSnapshot snapshot() const;
+
+    /**
+    Обнулить статистику
+    */
+    void reset();
+
+  private:
+    //Счётчики вида mutex - в своей кэш-линии
+    struct alignas(64) Counters{
+      std::atomic<uint64_t> acquisitions{0};
+      std::atomic<uint64_t> contended{0};
+      std::atomic<uint64_t> waitNs{0};
+      std::atomic<uint64_t> holdNs{0};
+    };
+
+    /**
+    \return Текущее время, нс
+    */
+    static uint64_t now();
+
+    void acquired(LockKind kind, bool contended, uint64_t waitNs);
+    void released(LockKind kind, uint64_t holdNs);
+
+    Counters counters_[static_cast<size_t>(LockKind::COUNT)];
+    alignas(64) std::atomic<uint64_t> traversals_{0};
+    std::atomic<uint64_t> traversalSteps_{0};
+
+    inline static thread_local LockStats* current_ = nullptr;
+};
+
+
+
+//mutex Base, записывающий статистику в LockStats текущей операции.
+//Вне Scope статистика не записывается
+template<LockKind Kind, typename Base>
+class LockStats::Mutex{
+  public:
+    void lock();
+    bool try_lock();
+    void unlock();
+    void lock_shared();
+    bool try_lock_shared();
+    void unlock_shared();
+
+  private:
+    Base mutex_;
+    uint64_t since_ = 0;  //Момент монопольного захвата; пишет и читает владелец
+};
+
+
+
+inline void LockStats::traversal(size_t steps)
+{
+  traversals_.fetch_add(1, std::memory_order_relaxed);
+  traversalSteps_.fetch_add(steps, std::memory_order_relaxed);
+}
+
+
+
+inline LockStatsSnapshot LockStats::snapshot() const
+{
+  LockStatsSnapshot snapshot;
+  for (size_t kind=0; kind<static_cast<size_t>(LockKind::COUNT); ++kind){
+    const Counters& counters = counters_[kind];
+    snapshot.locks[kind].acquisitions = counters.acquisitions.load(std::memory_order_relaxed);
+    snapshot.locks[kind].contended = counters.contended.load(std::memory_order_relaxed);
+    snapshot.locks[kind].waitNs = counters.waitNs.load(std::memory_order_relaxed);
+    snapshot.locks[kind].holdNs = counters.holdNs.load(std::memory_order_relaxed);
+  }
+  snapshot.traversals = traversals_.load(std::memory_order_relaxed);
+  snapshot.traversalSteps = traversalSteps_.load(std::memory_order_relaxed);
+  return snapshot;
+}
+
+
+
+inline void LockStats::reset()
+{
+  for (Counters& counters : counters_){
+    counters.acquisitions.store(0, std::memory_order_relaxed);
+    counters.contended.store(0, std::memory_order_relaxed);
+    counters.waitNs.store(0, std::memory_order_relaxed);
+    counters.holdNs.store(0, std::memory_order_relaxed);
+  }
+  traversals_.store(0, std::memory_order_relaxed);
+  traversalSteps_.store(0, std::memory_order_relaxed);
+}
+
+
+
+inline uint64_t LockStats::now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+
+inline void LockStats::acquired(LockKind kind, bool contended, uint64_t waitNs)
+{
+  Counters& counters = counters_[static_cast<size_t>(kind)];
+  counters.acquisitions.fetch_add(1, std::memory_order_relaxed);
+  if (contended){
+    counters.contended.fetch_add(1, std::memory_order_relaxed);
+    counters.waitNs.fetch_add(waitNs, std::memory_order_relaxed);
+  }
+}
+
+
+
+inline void LockStats::released(LockKind kind, uint64_t holdNs)
+{
+  counters_[static_cast<size_t>(kind)].holdNs.fetch_add(holdNs, std::memory_order_relaxed);
+}
+
+
+
+template<LockKind Kind, typename Base>
+void LockStats::Mutex<Kind, Base>::lock()
+{
+  LockStats* stats = current_;
+  if (!stats){
+    mutex_.lock();
+    since_ = 0;
+    return;
+  }
+  //Захват без ожидания не требует замера времени ожидания
+  if (mutex_.try_lock()){
+    stats->acquired(Kind, false, 0);
+  }
+  else{
+    const uint64_t start = now();
+    mutex_.lock();
+    stats->acquired(Kind, true, now() - start);
+  }
+  since_ = now();
+}
+
+
+
+template<LockKind Kind, typename Base>
+bool LockStats::Mutex<Kind, Base>::try_lock()
+{
+  if (!mutex_.try_lock()){
+    return false;
+  }
+  since_ = 0;
+  if (LockStats* stats = current_){
+    stats->acquired(Kind, false, 0);
+    since_ = now();
+  }
+  return true;
+}
+
+
+
+template<LockKind Kind, typename Base>
+void LockStats::Mutex<Kind, Base>::unlock()
+{
+  const uint64_t since = since_;
+  mutex_.unlock();
+  LockStats* stats = current_;
+  if (stats && since){
+    stats->released(Kind, now() - since);
+  }
+}
+
+
+
+template<LockKind Kind, typename Base>
+void LockStats::Mutex<Kind, Base>::lock_shared()
+{
+  LockStats* stats = current_;
+  if (!stats){
+    mutex_.lock_shared();
+    return;
+  }
+  if (mutex_.try_lock_shared()){
+    stats->acquired(Kind, false, 0);
+  }
+  else{
+    const uint64_t start = now();
+    mutex_.lock_shared();
+    stats->acquired(Kind, true, now() - start);
+  }
+}
+
+
+
+template<LockKind Kind, typename Base>
+bool LockStats::Mutex<Kind, Base>::try_lock_shared()
+{
+  if (!mutex_.try_lock_shared()){
+    return false;
+  }
+  if (LockStats* stats = current_){
+    stats->acquired(Kind, false, 0);
+  }
+  return true;
+}
+
+
+
+template<LockKind Kind, typename Base>
+void LockStats::Mutex<Kind, Base>::unlock_shared()
+{
+  mutex_.unlock_shared();
+}
+
+
+
+namespace lock_stats{
+  /**
+  Протестировать сбор статистики блокировок
+  */
+  void test();
+}
@@ -0,0 +1,148 @@
+#include "NodePool.h"
+#include <cassert>
+#include <cstring>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "PoolAllocator.h"
+
+
+//=============================================================================
+static void testAllocate();
+static void testReserve();
+static void testMultithread();
+static void testPoolAllocator();
+
+
+void node_pool::test()
+{
+  testAllocate();
+  testReserve();
+  testMultithread();
+  testPoolAllocator();
+}
+
+
+
+static void testAllocate()
+{
+  using Pool = NodePool<40, 8>;
+  Pool& pool = Pool::instance();
+  assert(&pool == &Pool::instance());
+
+  //Выданные блоки не пересекаются и выровнены
+  std::vector<char*> blocks;
+  for (size_t i=0; i<3*Pool::BLOCKS_PER_SLAB; ++i){
+    char* block = static_cast<char*>(pool.allocate());
+    assert(reinterpret_cast<uintptr_t>(block) % 8 == 0);
+    std::memset(block, 0xAB, 40);
+    blocks.push_back(block);
+  }
+  std::set<char*> unique(blocks.begin(), blocks.end());
+  assert(unique.size() == blocks.size());
+  const size_t slabs = pool.getStats().slabs;
+  assert(slabs >= 3);
+
+  //Освобождённые блоки переиспользуются - новых slab'ов не требуется
+  for (char* block : blocks){
+    pool.deallocate(block);
+  }
+  for (size_t i=0; i<blocks.size(); ++i){
+    blocks[i] = static_cast<char*>(pool.allocate());
+  }
+  assert(pool.getStats().slabs == slabs);
+  for (char* block : blocks){
+    pool.deallocate(block);
+  }
+}
+
+
+
+static void testReserve()
+{
+  using Pool = NodePool<72, 8>;
+  Pool& pool = Pool::instance();
+  pool.reserve(5000);
+  const auto stats = pool.getStats();
+  assert(stats.blocks >= 5000);
+
+  //Зарезервированного хватает - выделение не обращается к системе
+  std::vector<void*> blocks;
+  for (size_t i=0; i<5000; ++i){
+    blocks.push_back(pool.allocate());
+  }
+  assert(pool.getStats().slabs == stats.slabs);
+  for (void* block : blocks){
+    pool.deallocate(block);
+  }
+}
+
+
+
+static void testMultithread()
+{
+  using Pool = NodePool<48, 16>;
+  Pool& pool = Pool::instance();
+  const size_t COUNT = 20000;
+
+  //Блоки выделяются в одних потоках, освобождаются в других
+  for (size_t round=0; round<5; ++round){
+    std::vector<void*> blocks_1(COUNT);
+    std::vector<void*> blocks_2(COUNT);
+    std::thread A([&](){
+      for (auto& block : blocks_1){
+        block = pool.allocate();
+        std::memset(block, 1, 48);
+      }
+    });
+    std::thread B([&](){
+      for (auto& block : blocks_2){
+        block = pool.allocate();
+        std::memset(block, 2, 48);
+      }
+    });
+    A.join();
+    B.join();
+    for (size_t i=0; i<COUNT; ++i){
+      assert(static_cast<char*>(blocks_1[i])[47] == 1);
+      assert(static_cast<char*>(blocks_2[i])[47] == 2);
+    }
+    std::thread C([&](){
+      for (auto block : blocks_1){
+        pool.deallocate(block);
+      }
+    });
+    std::thread D([&](){
+      for (auto block : blocks_2){
+        pool.deallocate(block);
+      }
+    });
+    C.join();
+    D.join();
+  }
+  //Блоки завершившихся потоков вернулись в пул
+  assert(pool.getStats().blocks <= 2*COUNT + 4*Pool::BLOCKS_PER_SLAB);
+}
+
+
+
+static void testPoolAllocator()
+{
+  struct Item{
+    long a;
+    long b;
+  };
+  PoolAllocator<Item> allocator;
+  Item* item = allocator.allocate(1);
+  item->a = 1;
+  item->b = 2;
+  allocator.deallocate(item, 1);
+
+  //Массивы идут мимо пула
+  Item* items = allocator.allocate(10);
+  allocator.deallocate(items, 10);
+
+  PoolAllocator<int> other(allocator);
+  assert(other == allocator);
+}
@@ -0,0 +1,289 @@
+/**
+\file NodePool.h
+\brief Класс - пул блоков памяти фиксированного размера для элементов списка
+
+- Память запрашивается у системы крупными кусками (slab) по BLOCKS_PER_SLAB блоков
+- У каждого потока свой кэш свободных блоков - выделение и освобождение
+  блока в кэше не требуют синхронизации
+- Потоки обмениваются пакетами по BATCH_SIZE блоков через глобальный
+  lock-free стек (стек Трайбера с тегом против ABA)
+- Пул существует до завершения программы - память slab'ов системе не возвращается
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+
+template<size_t BlockSize, size_t BlockAlign>
+class NodePool{
+  public:
+    //Сколько памяти пул получил у системы
+    struct Stats{
+      size_t slabs;   //Количество выделенных slab'ов
+      size_t blocks;  //Общее количество блоков в них
+    };
+
+    static constexpr size_t BATCH_SIZE = 64;
+    static constexpr size_t BLOCKS_PER_SLAB = 16 * BATCH_SIZE;
+
+    NodePool(const NodePool& other) = delete;
+    NodePool& operator=(const NodePool& other) = delete;
+
+    /**
+    \return Пул для блоков размера BlockSize
+    */
+    static NodePool& instance();
+
+    /**
+    \return Свободный блок памяти размера BlockSize
+    */
+    void* allocate();
+
+    /**
+    Вернуть блок в пул (в кэш текущего потока)
+    \param[in] block Блок, полученный через allocate()
+    */
+    void deallocate(void* block) noexcept;
+
+    /**
+    Заранее выделить у системы память так, чтобы в пуле было
+    не меньше count свободных блоков
+    \param[in] count Количество блоков
+    */
+    void reserve(size_t count);
+
+    /**
+    \return Статистика выделения памяти у системы
+    */
+    Stats getStats() const;
+
+  private:
+    //Свободный блок. Первый блок пакета хранит размер пакета
+    //и указатель на следующий пакет глобального стека
+    struct FreeBlock{
+      FreeBlock* next;
+      std::atomic<FreeBlock*> nextBatch;
+      size_t count;
+    };
+
+    //Кэш свободных блоков потока
+    struct ThreadCache{
+      ~ThreadCache();
+      FreeBlock* head = nullptr;
+      size_t count = 0;
+    };
+
+    static constexpr size_t BLOCK_ALIGN = BlockAlign > alignof(FreeBlock) ?
+                                          BlockAlign : alignof(FreeBlock);
+    static constexpr size_t BLOCK_BYTES =
+      ((BlockSize > sizeof(FreeBlock) ? BlockSize : sizeof(FreeBlock)) +
+       BLOCK_ALIGN - 1) / BLOCK_ALIGN * BLOCK_ALIGN;
+
+    //Вершина стека хранится вместе с тегом в одном 64-битном слове:
+    //младшие 48 бит - адрес, старшие 16 бит - счётчик изменений
+    static constexpr unsigned TAG_SHIFT = 48;
+    static constexpr uint64_t POINTER_MASK = (uint64_t(1) << TAG_SHIFT) - 1;
+    static_assert(sizeof(void*) == sizeof(uint64_t),
+                  "NodePool requires 64-bit pointers");
+
+    NodePool() = default;
+
+    static FreeBlock* pointerOf(uint64_t top);
+    static uint64_t makeTop(FreeBlock* block, uint64_t previousTop);
+
+    void pushBatch(FreeBlock* batch) noexcept;
+    FreeBlock* popBatch() noexcept;
+    FreeBlock* allocateSlab();
+
+    std::atomic<uint64_t> top_{0};        //Вершина стека пакетов
+    std::atomic<size_t> freeBlocks_{0};   //Блоков в глобальном стеке
+    std::atomic<size_t> slabs_{0};        //Выделено slab'ов
+
+    inline static thread_local ThreadCache cache_;
+};
+
+
+
+template<size_t BlockSize, size_t BlockAlign>
+NodePool<BlockSize, BlockAlign>& NodePool<BlockSize, BlockAlign>::instance()
+{
+  //Пул не разрушается: блоки могут освобождаться из деструкторов
+  //статических объектов и кэшей потоков уже после выхода из main()
+  static NodePool* pool = new NodePool();
+  return *pool;
+}
+
+
+
+template<size_t BlockSize, size_t BlockAlign>
+void* NodePool<BlockSize, BlockAlign>::allocate()
+{
+  ThreadCache& cache = cache_;
+  if (!cache.head){
+    FreeBlock* batch = popBatch();
+    if (!batch){
+      batch = allocateSlab();
+    }
+    cache.head = batch;
+    cache.count = batch->count;
+  }
+  FreeBlock* block = cache.head;
+  cache.head = block->next;
+  --cache.count;
+  return block;
+}
+
+
+
+template<size_t BlockSize, size_t BlockAlign>
+void NodePool<BlockSize, BlockAlign>::deallocate(void* block) noexcept
+{
+  ThreadCache& cache = cache_;
+  FreeBlock* freeBlock = new(block) FreeBlock{cache.head, {nullptr}, 0};
+  cache.head = freeBlock;
+  ++cache.count;
+
+  //Излишки кэша отдать другим потокам одним пакетом
+  if (cache.count >= 2 * BATCH_SIZE){
+    FreeBlock* first = cache.head;
+    FreeBlock* last = first;
+    for (size_t i=1; i<BATCH_SIZE; ++i){
+      last = last->next;
+    }
+    cache.head = last->next;
+    cache.count -= BATCH_SIZE;
+    last->next = nullptr;
+    first->count = BATCH_SIZE;
+    pushBatch(first);
+  }
+}
+
+
+
+template<size_t BlockSize, size_t BlockAlign>
+void NodePool<BlockSize, BlockAlign>::reserve(size_t count)
+{
+  while (freeBlocks_.load(std::memory_order_relaxed) < count){
+    pushBatch(allocateSlab());
+  }
+}
+
+
+
+template<size_t BlockSize, size_t BlockAlign>
+typename NodePool<BlockSize, BlockAlign>::Stats
+NodePool<BlockSize, BlockAlign>::getStats() const
+{
+  const size_t slabs = slabs_.load(std::memory_order_relaxed);
+  return Stats{slabs, slabs * BLOCKS_PER_SLAB};
+}
+
+
+
+template<size_t BlockSize, size_t BlockAlign>
+NodePool<BlockSize, BlockAlign>::ThreadCache::~ThreadCache()
+{
+  //Поток завершается - вернуть все его блоки в глобальный стек
+  if (head){
+    head->count = count;
+    NodePool::instance().pushBatch(head);
+  }
+}
+
+
+
+template<size_t BlockSize, size_t BlockAlign>
+typename NodePool<BlockSize, BlockAlign>::FreeBlock*
+NodePool<BlockSize, BlockAlign>::pointerOf(uint64_t top)
+{
+  return reinterpret_cast<FreeBlock*>(top & POINTER_MASK);
+}
+
+
+
+template<size_t BlockSize, size_t BlockAlign>
+uint64_t NodePool<BlockSize, BlockAlign>::makeTop(FreeBlock* block,
+                                                  uint64_t previousTop)
+{
+  const uint64_t tag = (previousTop >> TAG_SHIFT) + 1;
+  return reinterpret_cast<uint64_t>(block) | (tag << TAG_SHIFT);
+}
+
+
+
+template<size_t BlockSize, size_t BlockAlign>
+void NodePool<BlockSize, BlockAlign>::pushBatch(FreeBlock* batch) noexcept
+{
+  const size_t count = batch->count;
+  uint64_t top = top_.load(std::memory_order_relaxed);
+  do{
+    batch->nextBatch.store(pointerOf(top), std::memory_order_relaxed);
+  } while (!top_.compare_exchange_weak(top, makeTop(batch, top),
+                                       std::memory_order_release,
+                                       std::memory_order_relaxed));
+  freeBlocks_.fetch_add(count, std::memory_order_relaxed);
+}
+
+
+
+template<size_t BlockSize, size_t BlockAlign>
+typename NodePool<BlockSize, BlockAlign>::FreeBlock*
+NodePool<BlockSize, BlockAlign>::popBatch() noexcept
+{
+  uint64_t top = top_.load(std::memory_order_acquire);
+  while (FreeBlock* batch = pointerOf(top)){
+    //Память slab'ов не освобождается - чтение nextBatch безопасно
+    //даже если пакет уже забран другим потоком, устаревшее значение
+    //отсечёт тег вершины
+    FreeBlock* next = batch->nextBatch.load(std::memory_order_relaxed);
+    if (top_.compare_exchange_weak(top, makeTop(next, top),
+                                   std::memory_order_acquire,
+                                   std::memory_order_acquire)){
+      freeBlocks_.fetch_sub(batch->count, std::memory_order_relaxed);
+      return batch;
+    }
+  }
+  return nullptr;
+}
+
+
+
+template<size_t BlockSize, size_t BlockAlign>
+typename NodePool<BlockSize, BlockAlign>::FreeBlock*
+NodePool<BlockSize, BlockAlign>::allocateSlab()
+{
+  char* slab = static_cast<char*>(::operator new(BLOCK_BYTES * BLOCKS_PER_SLAB,
+                                                 std::align_val_t(BLOCK_ALIGN)));
+  slabs_.fetch_add(1, std::memory_order_relaxed);
+
+  //Нарезать slab на пакеты соседних блоков: первый пакет вернуть
+  //вызывающему, остальные положить в глобальный стек
+  FreeBlock* first = nullptr;
+  for (size_t b=0; b<BLOCKS_PER_SLAB; b+=BATCH_SIZE){
+    FreeBlock* next = nullptr;
+    for (size_t i=BATCH_SIZE; i>0; --i){
+      next = new(slab + (b + i - 1) * BLOCK_BYTES) FreeBlock{next, {nullptr}, 0};
+    }
+    next->count = BATCH_SIZE;
+    if (!first){
+      first = next;
+    }
+    else{
+      pushBatch(next);
+    }
+  }
+  return first;
+}
+
+
+
+namespace node_pool{
+  /**
+  Протестировать пул блоков
+  */
+  void test();
+}
@@ -0,0 +1,60 @@
+/**
+\file PoolAllocator.h
+\brief Класс - аллокатор в стиле std::allocator поверх NodePool
+
+- Одиночные объекты берутся из пула блоков размера sizeof(T)
+- Массивы (n > 1) выделяются обычным operator new
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+
+#include "NodePool.h"
+
+
+template<typename T>
+class PoolAllocator{
+  public:
+    using value_type = T;
+    using Pool = NodePool<sizeof(T), alignof(T)>;
+
+    PoolAllocator() noexcept = default;
+
+    template<typename U>
+    PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n)
+    {
+      if (n == 1){
+        return static_cast<T*>(Pool::instance().allocate());
+      }
+      return static_cast<T*>(::operator new(n * sizeof(T),
+                                            std::align_val_t(alignof(T))));
+    }
+
+    void deallocate(T* p, size_t n) noexcept
+    {
+      if (n == 1){
+        Pool::instance().deallocate(p);
+        return;
+      }
+      ::operator delete(p, std::align_val_t(alignof(T)));
+    }
+
+    /**
+    Заранее выделить память под count объектов
+    \param[in] count Количество объектов
+    */
+    void reserve(size_t count)
+    {
+      Pool::instance().reserve(count);
+    }
+
+    template<typename U>
+    bool operator==(const PoolAllocator<U>&) const noexcept
+    {
+      return true;
+    }
+};
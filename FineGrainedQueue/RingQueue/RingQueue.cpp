@@ -0,0 +1,191 @@
+#include "RingQueue.h"
+#include <cassert>
+#include <chrono>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+//Проверка компиляции всех методов
+template class RingQueue<int>;
+
+
+//=============================================================================
+static void testOnethread();
+static void testWrapAround();
+static void testMoveOnly();
+static void testMultithread();
+static void testBlocking();
+
+
+void ring_queue::test()
+{
+  testOnethread();
+  testWrapAround();
+  testMoveOnly();
+  testMultithread();
+  testBlocking();
+}
+
+
+
+static void testOnethread()
+{
+  //Ёмкость округляется до степени двойки
+  RingQueue<int> testQueue(5);
+  assert(testQueue.getCapacity() == 8);
+  assert(RingQueue<int>(0).getCapacity() == 2);
+  assert(RingQueue<int>(16).getCapacity() == 16);
+
+  assert(testQueue.isEmpty());
+  assert(!testQueue.tryPopFront());
+  for (int i=0; i<8; ++i){
+    assert(testQueue.tryPushBack(i));
+  }
+  //Очередь заполнена
+  assert(!testQueue.tryPushBack(8));
+  assert(testQueue.getSize() == 8);
+
+  for (int i=0; i<8; ++i){
+    assert(testQueue.tryPopFront() == i);
+  }
+  assert(testQueue.isEmpty());
+  assert(!testQueue.tryPopFront());
+
+  testQueue.emplaceBack(42);
+  testQueue.pushBack(43);
+  assert(testQueue.popFront() == 42);
+  assert(testQueue.popFront() == 43);
+}
+
+
+
+static void testWrapAround()
+{
+  //Позиции проходят буфер много раз по кругу
+  RingQueue<std::string> testQueue(4);
+  int pushed = 0;
+  int popped = 0;
+  for (int round=0; round<1000; ++round){
+    while (testQueue.tryPushBack(std::to_string(pushed))){
+      ++pushed;
+    }
+    for (int i=0; i<3; ++i){
+      assert(testQueue.tryPopFront() == std::to_string(popped));
+      ++popped;
+    }
+    assert(testQueue.getSize() == static_cast<size_t>(pushed - popped));
+  }
+  assert(pushed == 4 + 3*999);
+  //Оставшееся значение удаляет деструктор
+  assert(testQueue.getSize() == 1);
+}
+
+
+
+static void testMoveOnly()
+{
+  RingQueue<std::unique_ptr<int>> testQueue(4);
+  testQueue.pushBack(std::make_unique<int>(1));
+  testQueue.emplaceBack(new int(2));
+  assert(*testQueue.popFront() == 1);
+  assert(*testQueue.popFront() == 2);
+  testQueue.pushBack(std::make_unique<int>(3));
+}
+
+
+
+static void testMultithread()
+{
+  //Производители и потребители с ожиданием: очередь много раз
+  //заполняется; каждый элемент извлечён ровно один раз, элементы
+  //одного производителя извлекаются одним потребителем по порядку
+  const int PRODUCERS = 3;
+  const int CONSUMERS = 3;
+  const int COUNT = 20000;
+  RingQueue<int> testQueue(64);
+  std::vector<std::thread> threads;
+  for (int producer=0; producer<PRODUCERS; ++producer){
+    threads.emplace_back([&testQueue, producer](){
+      for (int i=0; i<COUNT; ++i){
+        testQueue.pushBack(producer*COUNT + i);
+      }
+    });
+  }
+  std::vector<std::vector<int>> popped(CONSUMERS);
+  for (auto& values : popped){
+    threads.emplace_back([&testQueue, &values](){
+      for (int i=0; i<PRODUCERS*COUNT/CONSUMERS; ++i){
+        values.push_back(testQueue.popFront());
+      }
+    });
+  }
+  for (auto& thread : threads){
+    thread.join();
+  }
+  assert(testQueue.isEmpty());
+
+  std::vector<char> seen(PRODUCERS*COUNT, 0);
+  for (const auto& values : popped){
+    std::vector<int> last(PRODUCERS, -1);
+    for (const int value : values){
+      assert(!seen[value]);
+      seen[value] = 1;
+      assert(value > last[value / COUNT]);
+      last[value / COUNT] = value;
+    }
+  }
+}
+
+
+
+/**
+\return Процессорное время текущего потока, мс
+*/
+static double threadCpuMs()
+{
+  timespec time;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+  return time.tv_sec * 1000.0 + time.tv_nsec / 1000000.0;
+}
+
+
+
+static void testBlocking()
+{
+  //Ожидающие спят, а не крутятся: за 100 мс ожидания потоки
+  //почти не тратят процессорное время
+  const auto WAIT = std::chrono::milliseconds(100);
+  RingQueue<int> testQueue(2);
+
+  //Потребитель ждёт в пустой очереди
+  double consumerCpu = 0;
+  std::thread consumer([&testQueue, &consumerCpu](){
+    const double start = threadCpuMs();
+    assert(testQueue.popFront() == 1);
+    consumerCpu = threadCpuMs() - start;
+  });
+  std::this_thread::sleep_for(WAIT);
+  testQueue.pushBack(1);
+  consumer.join();
+  assert(consumerCpu < 20);
+
+  //Производитель ждёт в заполненной очереди
+  testQueue.pushBack(2);
+  testQueue.pushBack(3);
+  double producerCpu = 0;
+  std::thread producer([&testQueue, &producerCpu](){
+    const double start = threadCpuMs();
+    testQueue.pushBack(4);
+    producerCpu = threadCpuMs() - start;
+  });
+  std::this_thread::sleep_for(WAIT);
+  assert(testQueue.getSize() == 2);
+  assert(testQueue.popFront() == 2);
+  producer.join();
+  assert(producerCpu < 20);
+  assert(testQueue.popFront() == 3);
+  assert(testQueue.popFront() == 4);
+  assert(testQueue.isEmpty());
+}
@@ -0,0 +1,379 @@
+/**
+\file RingQueue.h
+\brief Шаблон класса - потокобезопасная ограниченная очередь на кольцевом буфере
+(много производителей, много потребителей)
+
+Методы:
+- добавить элемент в конец очереди: без ожидания / с ожиданием свободного места
+- сконструировать элемент в конце очереди
+- извлечь элемент из начала очереди: без ожидания / с ожиданием
+- получить количество элементов в очереди
+- получить признак - пуста ли очередь
+
+Ёмкость задаётся при создании и округляется вверх до степени двойки;
+память под все ячейки выделяется один раз. У каждой ячейки - номер
+(sequence): по нему производитель узнаёт, что ячейка свободна, а
+потребитель - что значение записано. Позиции начала и конца захватываются
+compare_exchange, mutex нет. Позиции и ячейки - в разных кэш-линиях
+
+Ожидание в pushBack() / popFront(): несколько попыток без блокировок,
+затем сон на номере нужной ячейки (std::atomic::wait) до его изменения.
+Запись номера будит только ждущих этой ячейки; пока никто не ждёт,
+notify не обращается к ядру
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include "CompactSharedMutex/CompactSharedMutex.h"
+
+
+template<typename T = int>
+class RingQueue{
+  //Значение переносится в ячейку после захвата позиции: исключение
+  //в этот момент оставило бы ячейку занятой навсегда
+  static_assert(std::is_nothrow_move_constructible_v<T>,
+                "RingQueue requires nothrow move constructible values");
+
+  public:
+    /**
+    \param[in] capacity Наибольшее количество элементов; округляется
+    вверх до степени двойки, не меньше 2
+    */
+    explicit RingQueue(size_t capacity);
+
+    RingQueue(const RingQueue& other) = delete;
+    RingQueue& operator=(const RingQueue& other) = delete;
+
+    ~RingQueue();
+
+    /**
+    Вставить элемент в конец очереди без ожидания
+    \param[in] value Значение элемента
+    \return false - если очередь заполнена
+    */
+    bool tryPushBack(const T& value);
+    bool tryPushBack(T&& value);
+
+    /**
+    Вставить элемент в конец очереди. Если очередь заполнена -
+    ждать, пока потребители освободят место
+    \param[in] value Значение элемента
+    */
+    void pushBack(const T& value);
+    void pushBack(T&& value);
+
+    /**
+    Сконструировать элемент и вставить в конец очереди с ожиданием
+    свободного места
+    \param[in] args Аргументы конструктора T
+    */
+    template<typename... Args>
+    void emplaceBack(Args&&... args);
+
+    /**
+    Извлечь элемент из начала очереди без ожидания
+    \return Значение элемента или std::nullopt, если очередь пуста
+    */
+    std::optional<T> tryPopFront();
+
+    /**
+    Извлечь элемент из начала очереди. Если очередь пуста - ждать
+    \return Значение элемента
+    */
+    T popFront();
+
+    /**
+    \return Количество элементов очереди. При одновременных
+    изменениях - приблизительно
+    */
+    size_t getSize() const;
+
+    /**
+    \return true - если очередь пуста
+    */
+    bool isEmpty() const;
+
+    /**
+    \return Ёмкость очереди
+    */
+    size_t getCapacity() const;
+
+  private:
+    //Сколько раз попытаться без блокировок, прежде чем уснуть на ячейке
+    static constexpr size_t SPIN_COUNT = 64;
+
+    struct Slot{
+      //pos - ячейка свободна для записи в позицию pos;
+      //pos+1 - в ячейке значение позиции pos
+      std::atomic<size_t> sequence;
+      alignas(T) unsigned char storage[sizeof(T)];
+
+      T* value(){ return std::launder(reinterpret_cast<T*>(storage)); }
+    };
+
+    /**
+    \return Наименьшая степень двойки, не меньшая value (не меньше 2)
+    */
+    static size_t roundUpCapacity(size_t value);
+
+    /**
+    Захватить позицию конца очереди
+    \param[out] slot Ячейка захваченной позиции
+    \param[out] pos Захваченная позиция
+    \return false - если очередь заполнена
+    */
+    bool claimBack(Slot*& slot, size_t& pos);
+
+    /**
+    Захватить позицию начала очереди
+    \param[out] slot Ячейка захваченной позиции
+    \param[out] pos Захваченная позиция
+    \return false - если очередь пуста
+    */
+    bool claimFront(Slot*& slot, size_t& pos);
+
+    const size_t mask_;
+    std::unique_ptr<Slot[]> slots_;
+
+    //Производители и потребители меняют разные кэш-линии
+    alignas(64) std::atomic<size_t> tail_{0};
+    alignas(64) std::atomic<size_t> head_{0};
+};
+
+
+
+template<typename T>
+RingQueue<T>::RingQueue(size_t capacity):
+  mask_(roundUpCapacity(capacity) - 1),
+  slots_(std::make_unique<Slot[]>(mask_ + 1))
+{
+  for (size_t i=0; i<=mask_; ++i){
+    slots_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+
+
+template<typename T>
+RingQueue<T>::~RingQueue()
+{
+  while (tryPopFront()){
+  }
+}
+
+
+
+template<typename T>
+bool RingQueue<T>::tryPushBack(const T& value)
+{
+  //Копия делается до захвата позиции: копирование может бросить исключение
+  return tryPushBack(T(value));
+}
+
+
+
+template<typename T>
+bool RingQueue<T>::tryPushBack(T&& value)
+{
+  Slot* slot;
+  size_t pos;
+  if (!claimBack(slot, pos)){
+    return false;
+  }
+  ::new (static_cast<void*>(slot->storage)) T(std::move(value));
+  slot->sequence.store(pos + 1, std::memory_order_release);
+  //Ячейку ждут потребители этой позиции
+  slot->sequence.notify_all();
+  return true;
+}
+
+
+
+template<typename T>
+void RingQueue<T>::pushBack(const T& value)
+{
+  pushBack(T(value));
+}
+
+
+
+template<typename T>
+void RingQueue<T>::pushBack(T&& value)
+{
+  //Значение перемещается только при успешной вставке
+  for (size_t spin=0; !tryPushBack(std::move(value)); ++spin){
+    if (spin < SPIN_COUNT){
+      cpuRelax();
+      continue;
+    }
+    //Ячейка конца очереди ещё хранит значение предыдущего круга -
+    //уснуть до её освобождения; иначе конец сдвинулся - повторить
+    const size_t pos = tail_.load(std::memory_order_relaxed);
+    Slot& slot = slots_[pos & mask_];
+    const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+    if (sequence < pos){
+      slot.sequence.wait(sequence, std::memory_order_acquire);
+    }
+  }
+}
+
+
+
+template<typename T>
+template<typename... Args>
+void RingQueue<T>::emplaceBack(Args&&... args)
+{
+  pushBack(T(std::forward<Args>(args)...));
+}
+
+
+
+template<typename T>
+std::optional<T> RingQueue<T>::tryPopFront()
+{
+  Slot* slot;
+  size_t pos;
+  if (!claimFront(slot, pos)){
+    return std::nullopt;
+  }
+  std::optional<T> value(std::move(*slot->value()));
+  slot->value()->~T();
+  //Ячейка свободна для записи в позицию следующего круга;
+  //её ждут производители этой позиции
+  slot->sequence.store(pos + mask_ + 1, std::memory_order_release);
+  slot->sequence.notify_all();
+  return value;
+}
+
+
+
+template<typename T>
+T RingQueue<T>::popFront()
+{
+  for (size_t spin=0; ; ++spin){
+    std::optional<T> value = tryPopFront();
+    if (value){
+      return std::move(*value);
+    }
+    if (spin < SPIN_COUNT){
+      cpuRelax();
+      continue;
+    }
+    //Значение позиции начала ещё не записано - уснуть до записи
+    const size_t pos = head_.load(std::memory_order_relaxed);
+    Slot& slot = slots_[pos & mask_];
+    const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+    if (sequence < pos + 1){
+      slot.sequence.wait(sequence, std::memory_order_acquire);
+    }
+  }
+}
+
+
+
+template<typename T>
+size_t RingQueue<T>::getSize() const
+{
+  //head_ читается первым: tail_ не меньше прочитанного head_
+  const size_t head = head_.load(std::memory_order_acquire);
+  const size_t tail = tail_.load(std::memory_order_acquire);
+  const size_t size = tail > head ? tail - head : 0;
+  return size > mask_ + 1 ? mask_ + 1 : size;
+}
+
+
+
+template<typename T>
+bool RingQueue<T>::isEmpty() const
+{
+  return getSize() == 0;
+}
+
+
+
+template<typename T>
+size_t RingQueue<T>::getCapacity() const
+{
+  return mask_ + 1;
+}
+
+
+
+template<typename T>
+size_t RingQueue<T>::roundUpCapacity(size_t value)
+{
+  size_t capacity = 2;
+  while (capacity < value){
+    capacity *= 2;
+  }
+  return capacity;
+}
+
+
+
+template<typename T>
+bool RingQueue<T>::claimBack(Slot*& slot, size_t& pos)
+{
+  pos = tail_.load(std::memory_order_relaxed);
+  for (;;){
+    slot = &slots_[pos & mask_];
+    const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+    const intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+    if (diff == 0){
+      //При неудаче pos получает позицию, захваченную другим производителем
+      if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+        return true;
+      }
+    }
+    else if (diff < 0){
+      //Ячейка ещё хранит значение предыдущего круга
+      return false;
+    }
+    else{
+      pos = tail_.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+
+
+template<typename T>
+bool RingQueue<T>::claimFront(Slot*& slot, size_t& pos)
+{
+  pos = head_.load(std::memory_order_relaxed);
+  for (;;){
+    slot = &slots_[pos & mask_];
+    const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+    const intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+    if (diff == 0){
+      if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+        return true;
+      }
+    }
+    else if (diff < 0){
+      //Значение этой позиции ещё не записано
+      return false;
+    }
+    else{
+      pos = head_.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+
+
+namespace ring_queue{
+  /**
+  Протестировать очередь на кольцевом буфере
+  */
+  void test();
+}
@@ -0,0 +1,138 @@
+#include "ShardedQueue.h"
+#include <cassert>
+#include <thread>
+#include <vector>
+
+
+//Проверка компиляции всех методов
+template class ShardedQueue<int>;
+
+
+//=============================================================================
+static void testOnethread();
+static void testStealing();
+static void testMultithread();
+
+
+void sharded_queue::test()
+{
+  testOnethread();
+  testStealing();
+  testMultithread();
+}
+
+
+
+static void testOnethread()
+{
+  ShardedQueue<int> testQueue(4);
+  assert(testQueue.getLaneCount() == 4);
+  assert(testQueue.isEmpty());
+  assert(!testQueue.tryPopFront());
+
+  //Один поток пишет в свою полосу - порядок FIFO
+  for (int i=0; i<10; ++i){
+    testQueue.pushBack(i);
+  }
+  testQueue.emplaceBack(10);
+  testQueue.pushBackBulk(std::vector<int>{11, 12});
+  assert(testQueue.getSize() == 13);
+  assert(testQueue.getLaneSize(testQueue.getThreadLane()) == 13);
+  for (int i=0; i<13; ++i){
+    assert(testQueue.tryPopFront() == i);
+  }
+  assert(testQueue.isEmpty());
+
+  bool isThrown = false;
+  try{
+    testQueue.getLaneSize(4);
+  }
+  catch (const std::out_of_range&){
+    isThrown = true;
+  }
+  assert(isThrown);
+
+  //По умолчанию - полоса на ядро
+  ShardedQueue<int> defaultQueue;
+  assert(defaultQueue.getLaneCount() >= 1);
+}
+
+
+
+static void testStealing()
+{
+  //Элементы, добавленные другим потоком, извлекаются из его полосы.
+  //Нумерация потоков общая с другими контейнерами: если производителю
+  //досталась полоса этого потока, его заменяет следующий поток
+  ShardedQueue<int> testQueue(64);
+  const size_t ownLane = testQueue.getThreadLane();
+  size_t producerLane = ownLane;
+  while (producerLane == ownLane){
+    std::thread producer([&](){
+      producerLane = testQueue.getThreadLane();
+      if (producerLane == ownLane){
+        return;
+      }
+      for (int i=0; i<100; ++i){
+        testQueue.pushBack(i);
+      }
+    });
+    producer.join();
+  }
+  assert(testQueue.getLaneSize(producerLane) == 100);
+  assert(testQueue.getLaneSize(testQueue.getThreadLane()) == 0);
+
+  //Своя полоса просматривается первой
+  testQueue.pushBack(-1);
+  assert(testQueue.tryPopFront() == -1);
+  for (int i=0; i<100; ++i){
+    assert(testQueue.tryPopFront() == i);
+  }
+  assert(!testQueue.tryPopFront());
+}
+
+
+
+static void testMultithread()
+{
+  //Производители и потребители: каждый элемент извлечён ровно один раз,
+  //элементы одного производителя извлекаются одним потребителем по порядку
+  const int PRODUCERS = 4;
+  const int COUNT = 20000;
+  ShardedQueue<int> testQueue(PRODUCERS);
+  std::vector<std::thread> threads;
+  for (int producer=0; producer<PRODUCERS; ++producer){
+    threads.emplace_back([&testQueue, producer](){
+      for (int i=0; i<COUNT; ++i){
+        testQueue.pushBack(producer*COUNT + i);
+      }
+    });
+  }
+  std::vector<std::vector<int>> popped(2);
+  std::atomic<int> total(0);
+  for (auto& values : popped){
+    threads.emplace_back([&testQueue, &values, &total](){
+      while (total < PRODUCERS*COUNT){
+        if (std::optional<int> value = testQueue.tryPopFront()){
+          values.push_back(*value);
+          ++total;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads){
+    thread.join();
+  }
+  assert(testQueue.isEmpty());
+
+  std::vector<char> seen(PRODUCERS*COUNT, 0);
+  for (const auto& values : popped){
+    std::vector<int> last(PRODUCERS, -1);
+    for (const int value : values){
+      assert(!seen[value]);
+      seen[value] = 1;
+      assert(value > last[value / COUNT]);
+      last[value / COUNT] = value;
+    }
+  }
+}
@@ -0,0 +1,249 @@
+/**
+\file ShardedQueue.h
+\brief Шаблон класса - потокобезопасная очередь из нескольких полос (lanes)
+
+Методы:
+- добавить элемент / диапазон элементов в конец своей полосы
+- сконструировать элемент на месте в конце своей полосы
+- извлечь элемент из начала своей полосы, а если она пуста -
+  из начала другой полосы (work stealing)
+- получить количество элементов в очереди / в полосе
+- получить признак - пуста ли очередь
+
+Полоса - отдельный список FineGrainedQueue со своими mutex начала и конца:
+производители разных полос не конкурируют за mutex конца одного списка.
+Поток закреплён за полосой (номер потока по модулю количества полос),
+поэтому порядок FIFO сохраняется внутри полосы - для элементов одного
+производителя. Общего порядка между полосами нет
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "FineGrainedQueue.h"
+#include "ThreadNumber/ThreadNumber.h"
+
+
+template<typename T = int, typename Allocator = PoolAllocator<T>>
+class ShardedQueue{
+  public:
+    //Полоса - список FineGrainedQueue
+    using Lane = FineGrainedQueue<T, Allocator>;
+
+    /**
+    \param[in] laneCount Количество полос; 0 - по количеству ядер
+    */
+    explicit ShardedQueue(size_t laneCount = 0);
+
+    ShardedQueue(const ShardedQueue& other) = delete;
+    ShardedQueue& operator=(const ShardedQueue& other) = delete;
+
+    /**
+    Вставить элемент в конец полосы текущего потока
+    \param[in] value Значение элемента
+    */
+    void pushBack(const T& value);
+    void pushBack(T&& value);
+
+    /**
+    Сконструировать элемент на месте в конце полосы текущего потока
+    \param[in] args Аргументы конструктора T
+    */
+    template<typename... Args>
+    void emplaceBack(Args&&... args);
+
+    /**
+    Вставить элементы диапазона в конец полосы текущего потока
+    за один захват mutex конца полосы
+    \param[in] values Диапазон значений
+    */
+    template<typename Range>
+    void pushBackBulk(Range&& values);
+
+    /**
+    Извлечь элемент из начала полосы текущего потока без ожидания.
+    Если полоса пуста - извлечь из начала следующих за ней полос по кругу
+    \return Значение элемента или std::nullopt, если пусты все полосы
+    */
+    std::optional<T> tryPopFront();
+
+    /**
+    \return Количество элементов во всех полосах. При одновременных
+    изменениях - приблизительно: полосы считаются по очереди
+    */
+    size_t getSize() const;
+
+    /**
+    \return true - если пусты все полосы
+    */
+    bool isEmpty() const;
+
+    /**
+    \return Количество полос
+    */
+    size_t getLaneCount() const;
+
+    /**
+    \param[in] lane Номер полосы
+    \return Количество элементов полосы
+    */
+    size_t getLaneSize(size_t lane) const;
+
+    /**
+    \return Номер полосы текущего потока
+    */
+    size_t getThreadLane() const;
+
+  private:
+    //Полосы не делят кэш-линии: mutex и размер полосы - только её потоков
+    struct alignas(64) Slot{
+      Lane lane;
+    };
+
+    Slot& localSlot();
+
+    std::unique_ptr<Slot[]> slots_;
+    size_t laneCount_;
+};
+
+
+
+template<typename T, typename Allocator>
+ShardedQueue<T, Allocator>::ShardedQueue(size_t laneCount):
+  laneCount_(laneCount ? laneCount
+                       : std::max<size_t>(std::thread::hardware_concurrency(), 1))
+{
+  slots_ = std::make_unique<Slot[]>(laneCount_);
+}
+
+
+
+template<typename T, typename Allocator>
+void ShardedQueue<T, Allocator>::pushBack(const T& value)
+{
+  localSlot().lane.pushBack(value);
+}
+
+
+
+template<typename T, typename Allocator>
+void ShardedQueue<T, Allocator>::pushBack(T&& value)
+{
+  localSlot().lane.pushBack(std::move(value));
+}
+
+
+
+template<typename T, typename Allocator>
+template<typename... Args>
+void ShardedQueue<T, Allocator>::emplaceBack(Args&&... args)
+{
+  localSlot().lane.emplaceBack(std::forward<Args>(args)...);
+}
+
+
+
+template<typename T, typename Allocator>
+template<typename Range>
+void ShardedQueue<T, Allocator>::pushBackBulk(Range&& values)
+{
+  localSlot().lane.pushBackBulk(std::forward<Range>(values));
+}
+
+
+
+template<typename T, typename Allocator>
+std::optional<T> ShardedQueue<T, Allocator>::tryPopFront()
+{
+  const size_t home = getThreadLane();
+  for (size_t i=0; i<laneCount_; ++i){
+    Lane& lane = slots_[(home + i) % laneCount_].lane;
+    //Пустую полосу пропустить без захвата её mutex
+    if (lane.isEmpty()){
+      continue;
+    }
+    std::optional<T> value = lane.tryPopFront();
+    if (value){
+      return value;
+    }
+  }
+  return std::nullopt;
+}
+
+
+
+template<typename T, typename Allocator>
+size_t ShardedQueue<T, Allocator>::getSize() const
+{
+  size_t size = 0;
+  for (size_t i=0; i<laneCount_; ++i){
+    size += slots_[i].lane.getSize();
+  }
+  return size;
+}
+
+
+
+template<typename T, typename Allocator>
+bool ShardedQueue<T, Allocator>::isEmpty() const
+{
+  for (size_t i=0; i<laneCount_; ++i){
+    if (!slots_[i].lane.isEmpty()){
+      return false;
+    }
+  }
+  return true;
+}
+
+
+
+template<typename T, typename Allocator>
+size_t ShardedQueue<T, Allocator>::getLaneCount() const
+{
+  return laneCount_;
+}
+
+
+
+template<typename T, typename Allocator>
+size_t ShardedQueue<T, Allocator>::getLaneSize(size_t lane) const
+{
+  if (lane >= laneCount_){
+    throw std::out_of_range("Lane " + std::to_string(lane) + " out of range");
+  }
+  return slots_[lane].lane.getSize();
+}
+
+
+
+template<typename T, typename Allocator>
+size_t ShardedQueue<T, Allocator>::getThreadLane() const
+{
+  return threadNumber() % laneCount_;
+}
+
+
+
+template<typename T, typename Allocator>
+typename ShardedQueue<T, Allocator>::Slot& ShardedQueue<T, Allocator>::localSlot()
+{
+  return slots_[getThreadLane()];
+}
+
+
+
+namespace sharded_queue{
+  /**
+  Протестировать очередь из нескольких полос
+  */
+  void test();
+}
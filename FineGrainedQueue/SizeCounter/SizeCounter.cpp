@@ -0,0 +1,124 @@
+#include "SizeCounter.h"
+#include <algorithm>
+#include <cassert>
+#include <thread>
+#include <vector>
+
+
+SizeCounter::SizeCounter(Mode mode, size_t shardCount):
+  mode_(mode),
+  shardCount_(mode == Mode::EXACT ? 1 :
+              shardCount ? shardCount : std::max(1u, std::thread::hardware_concurrency()))
+{
+  if (mode_ == Mode::SHARDED){
+    shards_ = std::make_unique<Shard[]>(shardCount_);
+  }
+}
+
+
+
+size_t SizeCounter::load() const
+{
+  if (!shards_){
+    return exact_.value.load();
+  }
+  size_t sum = 0;
+  for (size_t i=0; i<shardCount_; ++i){
+    sum += shards_[i].value.load();
+  }
+  //Извлечение учтено раньше добавления того же элемента
+  return static_cast<ptrdiff_t>(sum) < 0 ? 0 : sum;
+}
+
+
+
+size_t SizeCounter::reset()
+{
+  if (!shards_){
+    return exact_.value.exchange(0);
+  }
+  size_t sum = 0;
+  for (size_t i=0; i<shardCount_; ++i){
+    sum += shards_[i].value.exchange(0);
+  }
+  return sum;
+}
+
+
+
+//=============================================================================
+static void testExact();
+static void testSharded();
+static void testMultithread();
+
+
+void size_counter::test()
+{
+  testExact();
+  testSharded();
+  testMultithread();
+}
+
+
+
+static void testExact()
+{
+  SizeCounter counter;
+  assert(counter.getMode() == SizeCounter::Mode::EXACT);
+  assert(counter.getShardCount() == 1);
+  assert(counter.load() == 0);
+  counter.add(5);
+  counter.subtract(2);
+  assert(counter.load() == 3);
+  assert(counter.reset() == 3);
+  assert(counter.load() == 0);
+}
+
+
+
+static void testSharded()
+{
+  SizeCounter counter(SizeCounter::Mode::SHARDED, 4);
+  assert(counter.getMode() == SizeCounter::Mode::SHARDED);
+  assert(counter.getShardCount() == 4);
+  assert(SizeCounter(SizeCounter::Mode::SHARDED).getShardCount() >= 1);
+
+  //Извлечение в другом потоке, чем добавление: сумма верна
+  counter.add(10);
+  std::thread([&counter](){ counter.subtract(4); }).join();
+  assert(counter.load() == 6);
+
+  //Извлечение учтено раньше добавления - промежуточный размер 0
+  std::thread([&counter](){ counter.subtract(8); }).join();
+  assert(counter.load() == 0);
+  counter.add(5);
+  assert(counter.load() == 3);
+
+  //reset() возвращает сумму по модулю: отрицательные счётчики учтены
+  assert(counter.reset() == 3);
+  assert(counter.load() == 0);
+}
+
+
+
+static void testMultithread()
+{
+  //Потоки добавляют и удаляют поровну - в конце размер равен добавленному
+  for (const auto mode : {SizeCounter::Mode::EXACT, SizeCounter::Mode::SHARDED}){
+    SizeCounter counter(mode, 3);
+    const int COUNT = 20000;
+    std::vector<std::thread> threads;
+    for (int i=0; i<4; ++i){
+      threads.emplace_back([&counter](){
+        for (int j=0; j<COUNT; ++j){
+          counter.add(2);
+          counter.subtract(1);
+        }
+      });
+    }
+    for (auto& thread : threads){
+      thread.join();
+    }
+    assert(counter.load() == 4*COUNT);
+  }
+}
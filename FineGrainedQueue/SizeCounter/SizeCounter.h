@@ -0,0 +1,138 @@
+/**
+\file SizeCounter.h
+\brief Класс - счётчик размера контейнера: точный или распределённый по потокам
+
+- EXACT - один атомарный счётчик в отдельной кэш-линии. Контейнер меняет
+  его под той же блокировкой, под которой меняет свою структуру: значение
+  совпадает с количеством элементов после каждой завершённой операции
+- SHARDED - счётчик на группу потоков, каждый в своей кэш-линии: изменение
+  не делит кэш-линию с другими потоками группы, load() суммирует все
+  счётчики и при одновременных изменениях приблизителен
+- Значения счётчиков беззнаковые: элемент может быть добавлен одним
+  потоком, а извлечён другим - отдельный счётчик "уходит в минус"
+  по модулю 2^64, сумма остаётся верной
+- Изменения и чтение - seq_cst: контейнер сверяет размер с количеством
+  ожидающих потоков (пробуждение в FineGrainedQueue::popFront())
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+#include "ThreadNumber/ThreadNumber.h"
+
+
+class SizeCounter{
+  public:
+    enum class Mode{
+      EXACT,    //Один счётчик; getSize() точен
+      SHARDED   //Счётчик на группу потоков; getSize() приблизителен
+    };
+
+    /**
+    \param[in] mode Вид счётчика
+    \param[in] shardCount Количество счётчиков SHARDED; 0 - по количеству ядер
+    */
+    explicit SizeCounter(Mode mode = Mode::EXACT, size_t shardCount = 0);
+
+    SizeCounter(const SizeCounter& other) = delete;
+    SizeCounter& operator=(const SizeCounter& other) = delete;
+
+    /**
+    Увеличить размер
+    \param[in] count Количество добавленных элементов
+    */
+    void add(size_t count);
+
+    /**
+    Уменьшить размер
+    \param[in] count Количество удалённых элементов
+    */
+    void subtract(size_t count);
+
+    /**
+    \return Размер. SHARDED при одновременных изменениях - приблизительно;
+    промежуточная отрицательная сумма возвращается как 0
+    */
+    size_t load() const;
+
+    /**
+    Обнулить размер
+    \return Размер до обнуления: сумма значений, снятых со счётчиков
+    */
+    size_t reset();
+
+    /**
+    \return Вид счётчика
+    */
+    Mode getMode() const;
+
+    /**
+    \return Количество счётчиков: 1 для EXACT
+    */
+    size_t getShardCount() const;
+
+  private:
+    struct alignas(64) Shard{
+      std::atomic<size_t> value{0};
+    };
+
+    /**
+    \return Счётчик текущего потока
+    */
+    std::atomic<size_t>& local();
+
+    const Mode mode_;
+    const size_t shardCount_;
+    std::unique_ptr<Shard[]> shards_;   //Только SHARDED
+    Shard exact_;                       //Только EXACT
+};
+
+
+
+inline std::atomic<size_t>& SizeCounter::local()
+{
+  if (!shards_){
+    return exact_.value;
+  }
+  return shards_[threadNumber() % shardCount_].value;
+}
+
+
+
+inline void SizeCounter::add(size_t count)
+{
+  local().fetch_add(count);
+}
+
+
+
+inline void SizeCounter::subtract(size_t count)
+{
+  local().fetch_sub(count);
+}
+
+
+
+inline SizeCounter::Mode SizeCounter::getMode() const
+{
+  return mode_;
+}
+
+
+
+inline size_t SizeCounter::getShardCount() const
+{
+  return shardCount_;
+}
+
+
+
+namespace size_counter{
+  /**
+  Протестировать счётчик размера
+  */
+  void test();
+}
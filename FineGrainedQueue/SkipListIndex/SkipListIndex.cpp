@@ -0,0 +1,163 @@
+#include "SkipListIndex.h"
+#include <cassert>
+#include <memory>
+#include <vector>
+
+
+//=============================================================================
+static void testInsertAt();
+static void testErase();
+static void testSplitAppend();
+static void testRandomOperations();
+
+
+void skip_list_index::test()
+{
+  testInsertAt();
+  testErase();
+  testSplitAppend();
+  testRandomOperations();
+}
+
+
+
+static void testInsertAt()
+{
+  SkipListIndex<int> index;
+  assert(index.size() == 0);
+
+  //Вставка в конец, начало и середину
+  for (int i=0; i<1000; ++i){
+    index.insert(index.size(), i);
+  }
+  index.insert(0, -1);
+  index.insert(500, -2);
+  assert(index.size() == 1002);
+  assert(index.at(0) == -1);
+  assert(index.at(1) == 0);
+  assert(index.at(499) == 498);
+  assert(index.at(500) == -2);
+  assert(index.at(501) == 499);
+  assert(index.at(1001) == 999);
+}
+
+
+
+static void testErase()
+{
+  SkipListIndex<std::unique_ptr<int>> index;
+  for (int i=0; i<100; ++i){
+    index.insert(index.size(), std::make_unique<int>(i));
+  }
+  //Удаление из начала, конца и середины
+  index.erase(0);
+  index.erase(index.size()-1);
+  index.erase(49);
+  assert(index.size() == 97);
+  assert(*index.at(0) == 1);
+  assert(*index.at(48) == 49);
+  assert(*index.at(49) == 51);
+  assert(*index.at(96) == 98);
+
+  while (index.size()){
+    index.erase(0);
+  }
+  //После опустошения индекс снова работает
+  index.insert(0, std::make_unique<int>(7));
+  assert(*index.at(0) == 7);
+  index.clear();
+  assert(index.size() == 0);
+
+  //Обмен с другим индексом
+  SkipListIndex<std::unique_ptr<int>> other;
+  other.insert(0, std::make_unique<int>(1));
+  other.insert(1, std::make_unique<int>(2));
+  index.swap(other);
+  assert(index.size() == 2 && other.size() == 0);
+  assert(*index.at(1) == 2);
+  other.insert(0, std::make_unique<int>(3));
+  assert(*other.at(0) == 3);
+}
+
+
+
+static void testSplitAppend()
+{
+  //Разделение в каждой позиции и соединение обратно
+  const int COUNT = 300;
+  SkipListIndex<int> index;
+  for (int i=0; i<COUNT; ++i){
+    index.insert(index.size(), i);
+  }
+  for (size_t pos=0; pos<=COUNT; pos+=13){
+    SkipListIndex<int> suffix;
+    index.split(pos, suffix);
+    assert(index.size() == pos);
+    assert(suffix.size() == COUNT - pos);
+    if (pos > 0){
+      assert(index.at(pos-1) == static_cast<int>(pos-1));
+    }
+    if (pos < COUNT){
+      assert(suffix.at(0) == static_cast<int>(pos));
+      assert(suffix.at(suffix.size()-1) == COUNT-1);
+    }
+    //Обе части остаются рабочими индексами
+    index.insert(index.size(), -1);
+    index.erase(index.size()-1);
+    suffix.insert(0, -1);
+    suffix.erase(0);
+    index.append(suffix);
+    assert(suffix.size() == 0);
+    assert(index.size() == COUNT);
+  }
+  for (int i=0; i<COUNT; ++i){
+    assert(index.at(i) == i);
+  }
+
+  //Соединение с пустым индексом и пустого с непустым
+  SkipListIndex<int> empty;
+  index.append(empty);
+  empty.append(index);
+  assert(index.size() == 0 && empty.size() == COUNT);
+  assert(empty.at(COUNT-1) == COUNT-1);
+}
+
+
+
+static void testRandomOperations()
+{
+  //Сравнение с std::vector на случайной последовательности операций
+  SkipListIndex<int> index;
+  std::vector<int> reference;
+  uint64_t random = 12345;
+  auto next = [&random](){
+    random ^= random << 13;
+    random ^= random >> 7;
+    random ^= random << 17;
+    return random;
+  };
+  for (int i=0; i<20000; ++i){
+    const uint64_t operation = next() % 3;
+    //Иногда - разделение и соединение в случайной позиции
+    if (i % 1000 == 999){
+      const size_t pos = next() % (reference.size() + 1);
+      SkipListIndex<int> suffix;
+      index.split(pos, suffix);
+      index.append(suffix);
+    }
+    if (operation != 0 || reference.empty()){
+      const size_t pos = next() % (reference.size() + 1);
+      index.insert(pos, i);
+      reference.insert(reference.begin() + pos, i);
+    }
+    else{
+      const size_t pos = next() % reference.size();
+      index.erase(pos);
+      reference.erase(reference.begin() + pos);
+    }
+    assert(index.size() == reference.size());
+  }
+  for (size_t pos=0; pos<reference.size(); ++pos){
+    assert(index.at(pos) == reference[pos]);
+  }
+}
@@ -0,0 +1,394 @@
+/**
+\file SkipListIndex.h
+\brief Шаблон класса - индексируемый skip list: последовательность элементов
+с доступом, вставкой и удалением по позиции за O(log n)
+
+- Каждая ссылка уровня хранит span - сколько элементов нижнего уровня она
+  перепрыгивает; позиция элемента - сумма span'ов на пути к нему
+- Высота элемента случайна: уровень k получает каждый 4-й элемент уровня k-1
+- Элемент и его ссылки размещаются одним блоком памяти
+- Класс не потокобезопасен - синхронизацию обеспечивает владелец
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+
+template<typename Item>
+class SkipListIndex{
+  public:
+    static constexpr size_t MAX_LEVEL = 16;
+
+    SkipListIndex();
+
+    SkipListIndex(const SkipListIndex& other) = delete;
+    SkipListIndex& operator=(const SkipListIndex& other) = delete;
+
+    ~SkipListIndex();
+
+    /**
+    \return Количество элементов
+    */
+    size_t size() const;
+
+    /**
+    \param[in] pos Позиция, меньше size()
+    \return Элемент в позиции pos
+    */
+    const Item& at(size_t pos) const;
+
+    /**
+    Вставить элемент так, чтобы он оказался в позиции pos
+    \param[in] pos Позиция, не больше size()
+    \param[in] item Элемент
+    */
+    void insert(size_t pos, Item item);
+
+    /**
+    Удалить элемент в позиции pos
+    \param[in] pos Позиция, меньше size()
+    */
+    void erase(size_t pos);
+
+    /**
+    Удалить все элементы
+    */
+    void clear();
+
+    /**
+    Перенести элементы с позиции pos до конца в пустой индекс suffix за O(log n)
+    \param[in] pos Позиция, не больше size()
+    \param[out] suffix Пустой индекс
+    */
+    void split(size_t pos, SkipListIndex& suffix);
+
+    /**
+    Перенести все элементы other в конец индекса за O(log n)
+    \param[in] other Другой индекс; после вызова пуст
+    */
+    void append(SkipListIndex& other);
+
+    /**
+    Обменяться элементами с другим индексом за O(1)
+    \param[in] other Другой индекс
+    */
+    void swap(SkipListIndex& other) noexcept;
+
+  private:
+    struct SkipNode;
+
+    struct Link{
+      SkipNode* next;
+      size_t span;    //Сколько элементов нижнего уровня перепрыгивает ссылка
+    };
+
+    //Элемент; за ним в том же блоке памяти - level ссылок
+    struct SkipNode{
+      SkipNode(Item&& item, size_t level): item(std::move(item)), level(level){}
+      Link* links(){ return reinterpret_cast<Link*>(this + 1); }
+      const Link* links() const{ return reinterpret_cast<const Link*>(this + 1); }
+      Item item;
+      size_t level;
+    };
+    static_assert(sizeof(SkipNode) % alignof(Link) == 0);
+
+    /**
+    \return Случайная высота нового элемента
+    */
+    size_t randomLevel();
+
+    /**
+    Найти на каждом уровне последнюю ссылку перед позицией pos
+    \param[in] pos Позиция
+    \param[out] update Ссылки уровней
+    \param[out] rank Позиции начал ссылок (начало индекса - 0)
+    */
+    void findUpdate(size_t pos, Link* update[], size_t rank[]);
+
+    /**
+    Уменьшить количество уровней до самой высокой непустой ссылки начала
+    */
+    void trimLevels();
+
+    static SkipNode* createNode(Item&& item, size_t level);
+    static void destroyNode(SkipNode* node) noexcept;
+
+    Link head_[MAX_LEVEL];  //Ссылки начала; позиция начала - 0, элементов - с 1
+    size_t level_;          //Количество используемых уровней
+    size_t size_;
+    uint64_t random_;
+};
+
+
+
+template<typename Item>
+SkipListIndex<Item>::SkipListIndex():
+  level_(1), size_(0), random_(0x9E3779B97F4A7C15ull)
+{
+  for (auto& link : head_){
+    link = Link{nullptr, 0};
+  }
+}
+
+
+
+template<typename Item>
+SkipListIndex<Item>::~SkipListIndex()
+{
+  clear();
+}
+
+
+
+template<typename Item>
+size_t SkipListIndex<Item>::size() const
+{
+  return size_;
+}
+
+
+
+template<typename Item>
+const Item& SkipListIndex<Item>::at(size_t pos) const
+{
+  //Позиции считаются от начала (0), искомый элемент - pos+1
+  const size_t target = pos + 1;
+  size_t rank = 0;
+  const SkipNode* node = nullptr;
+  const Link* links = head_;
+  for (size_t level=level_; level-->0 && rank != target; ){
+    while (links[level].next && rank + links[level].span <= target){
+      rank += links[level].span;
+      node = links[level].next;
+      links = node->links();
+    }
+  }
+  return node->item;
+}
+
+
+
+template<typename Item>
+void SkipListIndex<Item>::findUpdate(size_t pos, Link* update[], size_t rank[])
+{
+  Link* links = head_;
+  size_t current = 0;
+  for (size_t level=level_; level-->0; ){
+    while (links[level].next && current + links[level].span <= pos){
+      current += links[level].span;
+      links = links[level].next->links();
+    }
+    update[level] = links;
+    rank[level] = current;
+  }
+}
+
+
+
+template<typename Item>
+void SkipListIndex<Item>::insert(size_t pos, Item item)
+{
+  //На каждом уровне - последняя ссылка перед позицией вставки и её ранг
+  Link* update[MAX_LEVEL] = {};
+  size_t rank[MAX_LEVEL] = {};
+  findUpdate(pos, update, rank);
+
+  const size_t levelNew = randomLevel();
+  if (levelNew > level_){
+    for (size_t level=level_; level<levelNew; ++level){
+      update[level] = head_;
+      rank[level] = 0;
+      head_[level].span = size_;
+    }
+    level_ = levelNew;
+  }
+
+  SkipNode* node = createNode(std::move(item), levelNew);
+  Link* nodeLinks = node->links();
+  for (size_t level=0; level<levelNew; ++level){
+    nodeLinks[level].next = update[level][level].next;
+    update[level][level].next = node;
+    //Ссылка делится новым элементом на две
+    nodeLinks[level].span = update[level][level].span - (rank[0] - rank[level]);
+    update[level][level].span = rank[0] - rank[level] + 1;
+  }
+  //Ссылки выше нового элемента перепрыгивают на один элемент больше
+  for (size_t level=levelNew; level<level_; ++level){
+    ++update[level][level].span;
+  }
+  ++size_;
+}
+
+
+
+template<typename Item>
+void SkipListIndex<Item>::erase(size_t pos)
+{
+  Link* update[MAX_LEVEL] = {};
+  size_t rank[MAX_LEVEL] = {};
+  findUpdate(pos, update, rank);
+
+  SkipNode* node = update[0][0].next;
+  Link* nodeLinks = node->links();
+  for (size_t level=0; level<level_; ++level){
+    if (update[level][level].next == node){
+      update[level][level].span += nodeLinks[level].span - 1;
+      update[level][level].next = nodeLinks[level].next;
+    }
+    else{
+      --update[level][level].span;
+    }
+  }
+  trimLevels();
+  --size_;
+  destroyNode(node);
+}
+
+
+
+template<typename Item>
+void SkipListIndex<Item>::clear()
+{
+  SkipNode* node = head_[0].next;
+  while (node){
+    SkipNode* next = node->links()[0].next;
+    destroyNode(node);
+    node = next;
+  }
+  for (auto& link : head_){
+    link = Link{nullptr, 0};
+  }
+  level_ = 1;
+  size_ = 0;
+}
+
+
+
+template<typename Item>
+void SkipListIndex<Item>::split(size_t pos, SkipListIndex& suffix)
+{
+  //Ссылки, проходящие через позицию pos, делятся: до неё остаются
+  //в этом индексе, после - становятся ссылками начала suffix.
+  //Ссылка без следующего элемента перепрыгивает все элементы до конца
+  Link* update[MAX_LEVEL] = {};
+  size_t rank[MAX_LEVEL] = {};
+  findUpdate(pos, update, rank);
+  for (size_t level=0; level<level_; ++level){
+    Link& link = update[level][level];
+    suffix.head_[level] = Link{link.next, link.span - (pos - rank[level])};
+    link = Link{nullptr, pos - rank[level]};
+  }
+  suffix.level_ = level_;
+  suffix.size_ = size_ - pos;
+  size_ = pos;
+  trimLevels();
+  suffix.trimLevels();
+}
+
+
+
+template<typename Item>
+void SkipListIndex<Item>::append(SkipListIndex& other)
+{
+  //Последние ссылки уровней продолжаются ссылками начала other
+  Link* update[MAX_LEVEL] = {};
+  size_t rank[MAX_LEVEL] = {};
+  findUpdate(size_, update, rank);
+  for (size_t level=level_; level<other.level_; ++level){
+    update[level] = head_;
+    rank[level] = 0;
+  }
+  const size_t levelNew = std::max(level_, other.level_);
+  for (size_t level=0; level<levelNew; ++level){
+    Link& link = update[level][level];
+    link.span = size_ - rank[level];
+    if (level < other.level_){
+      link.next = other.head_[level].next;
+      link.span += other.head_[level].span;
+    }
+    else{
+      link.span += other.size_;
+    }
+  }
+  level_ = levelNew;
+  size_ += other.size_;
+  for (auto& link : other.head_){
+    link = Link{nullptr, 0};
+  }
+  other.level_ = 1;
+  other.size_ = 0;
+}
+
+
+
+template<typename Item>
+void SkipListIndex<Item>::trimLevels()
+{
+  while (level_ > 1 && !head_[level_-1].next){
+    head_[level_-1].span = 0;
+    --level_;
+  }
+}
+
+
+
+template<typename Item>
+void SkipListIndex<Item>::swap(SkipListIndex& other) noexcept
+{
+  for (size_t level=0; level<MAX_LEVEL; ++level){
+    std::swap(head_[level], other.head_[level]);
+  }
+  std::swap(level_, other.level_);
+  std::swap(size_, other.size_);
+}
+
+
+
+template<typename Item>
+size_t SkipListIndex<Item>::randomLevel()
+{
+  random_ ^= random_ >> 12;
+  random_ ^= random_ << 25;
+  random_ ^= random_ >> 27;
+  uint64_t bits = random_ * 0x2545F4914F6CDD1Dull;
+  //Каждые два нулевых бита подряд - ещё один уровень (вероятность 1/4)
+  size_t level = 1;
+  while (level < MAX_LEVEL && (bits & 3) == 0){
+    ++level;
+    bits >>= 2;
+  }
+  return level;
+}
+
+
+
+template<typename Item>
+typename SkipListIndex<Item>::SkipNode*
+SkipListIndex<Item>::createNode(Item&& item, size_t level)
+{
+  void* memory = ::operator new(sizeof(SkipNode) + level * sizeof(Link));
+  return new (memory) SkipNode(std::move(item), level);
+}
+
+
+
+template<typename Item>
+void SkipListIndex<Item>::destroyNode(SkipNode* node) noexcept
+{
+  node->~SkipNode();
+  ::operator delete(node);
+}
+
+
+
+namespace skip_list_index{
+  /**
+  Протестировать индексируемый skip list
+  */
+  void test();
+}
@@ -0,0 +1,31 @@
+#include "ThreadNumber.h"
+#include <algorithm>
+#include <cassert>
+#include <thread>
+#include <vector>
+
+
+//=============================================================================
+void thread_number::test()
+{
+  //Номер потока не меняется
+  const size_t number = threadNumber();
+  assert(threadNumber() == number);
+
+  //Разные потоки получают разные номера
+  const int THREADS = 8;
+  std::vector<size_t> numbers(THREADS);
+  std::vector<std::thread> threads;
+  for (int t=0; t<THREADS; ++t){
+    threads.emplace_back([&numbers, t](){
+      numbers[t] = threadNumber();
+      assert(threadNumber() == numbers[t]);
+    });
+  }
+  for (auto& thread : threads){
+    thread.join();
+  }
+  numbers.push_back(number);
+  std::sort(numbers.begin(), numbers.end());
+  assert(std::adjacent_find(numbers.begin(), numbers.end()) == numbers.end());
+}
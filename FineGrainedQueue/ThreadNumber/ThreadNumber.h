@@ -0,0 +1,36 @@
+/**
+\file ThreadNumber.h
+\brief Номер текущего потока для распределения потоков по группам
+
+- Потоки нумеруются подряд при первом обращении; номер не меняется
+  до завершения потока
+- Номер не зависит от ядра: поток, перенесённый планировщиком на другое
+  ядро, остаётся в своей группе (полосе ShardedQueue, слоте FlatCombiner,
+  группе SizeCounter и LatencyStats)
+- Нумерация общая для всех контейнеров: поток получает один номер
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+
+/**
+\return Номер текущего потока
+*/
+inline size_t threadNumber()
+{
+  static std::atomic<size_t> threadCount(0);
+  thread_local const size_t number = threadCount.fetch_add(1, std::memory_order_relaxed);
+  return number;
+}
+
+
+
+namespace thread_number{
+  /**
+  Протестировать нумерацию потоков
+  */
+  void test();
+}
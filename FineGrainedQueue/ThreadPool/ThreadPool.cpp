@@ -0,0 +1,219 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+
+ThreadPool::ThreadPool(size_t workerCount)
+{
+  workers_.reserve(workerCount);
+  for (size_t i=0; i<workerCount; ++i){
+    workers_.emplace_back(&ThreadPool::runWorker, this);
+  }
+}
+
+
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutexJobs_);
+    stopping_ = true;
+  }
+  jobsReady_.notify_all();
+  for (auto& worker : workers_){
+    worker.join();
+  }
+}
+
+
+
+ThreadPool& ThreadPool::instance()
+{
+  //Объект не разрушается: потоки пула ждут задач до завершения программы
+  static ThreadPool* pool = new ThreadPool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+  return *pool;
+}
+
+
+
+void ThreadPool::run(size_t count, const Task& task)
+{
+  if (count == 0){
+    return;
+  }
+  auto job = std::make_shared<Job>();
+  job->task = &task;
+  job->count = count;
+  //Одну задачу пул не получает - её выполнит вызывающий поток
+  const bool shared = count > 1 && !workers_.empty();
+  if (shared){
+    {
+      std::lock_guard<std::mutex> lock(mutexJobs_);
+      jobs_.push_back(job);
+    }
+    for (size_t i=1; i<count && i<=workers_.size(); ++i){
+      jobsReady_.notify_one();
+    }
+  }
+
+  work(*job);
+  {
+    std::unique_lock<std::mutex> lock(job->mutexDone);
+    job->done.wait(lock, [&job](){ return job->finished.load() == job->count; });
+  }
+  //Задачи выданы и выполнены: потоки пула, ещё не убравшие run()
+  //из очереди, не обратятся к task
+  if (shared){
+    std::lock_guard<std::mutex> lock(mutexJobs_);
+    const auto iter = std::find(jobs_.begin(), jobs_.end(), job);
+    if (iter != jobs_.end()){
+      jobs_.erase(iter);
+    }
+  }
+  if (job->error){
+    std::rethrow_exception(job->error);
+  }
+}
+
+
+
+void ThreadPool::work(Job& job)
+{
+  for (size_t i = job.next.fetch_add(1); i < job.count; i = job.next.fetch_add(1)){
+    try{
+      (*job.task)(i);
+    }
+    catch (...){
+      std::lock_guard<std::mutex> lock(job.mutexDone);
+      if (!job.error){
+        job.error = std::current_exception();
+      }
+    }
+    if (job.finished.fetch_add(1) + 1 == job.count){
+      std::lock_guard<std::mutex> lock(job.mutexDone);
+      job.done.notify_all();
+    }
+  }
+}
+
+
+
+void ThreadPool::runWorker()
+{
+  for (;;){
+    std::shared_ptr<Job> job;
+    {
+      std::unique_lock<std::mutex> lock(mutexJobs_);
+      jobsReady_.wait(lock, [this](){ return stopping_ || !jobs_.empty(); });
+      if (stopping_){
+        return;
+      }
+      job = jobs_.front();
+      //Все задачи выданы - run() убирается из очереди
+      if (job->next.load() >= job->count){
+        jobs_.pop_front();
+        continue;
+      }
+    }
+    work(*job);
+  }
+}
+
+
+
+//=============================================================================
+static void testRun();
+static void testNested();
+static void testException();
+static void testConcurrentRun();
+
+
+void thread_pool::test()
+{
+  testRun();
+  testNested();
+  testException();
+  testConcurrentRun();
+}
+
+
+
+static void testRun()
+{
+  //Каждая задача выполняется ровно один раз, в том числе без потоков пула
+  for (const size_t workerCount : {0, 1, 3}){
+    ThreadPool pool(workerCount);
+    assert(pool.getConcurrency() == workerCount + 1);
+    const size_t COUNT = 1000;
+    std::vector<std::atomic<int>> calls(COUNT);
+    pool.run(COUNT, [&calls](size_t i){ ++calls[i]; });
+    for (const auto& call : calls){
+      assert(call == 1);
+    }
+    pool.run(0, [](size_t){ assert(false); });
+    pool.run(1, [&calls](size_t i){ ++calls[i]; });
+    assert(calls[0] == 2);
+  }
+  assert(ThreadPool::instance().getConcurrency() >= 1);
+}
+
+
+
+static void testNested()
+{
+  //run() из задачи не ждёт занятых потоков пула: задачи выполняет и он сам
+  ThreadPool pool(2);
+  std::atomic<int> sum(0);
+  pool.run(8, [&pool, &sum](size_t i){
+    pool.run(8, [&sum, i](size_t j){ sum += static_cast<int>(i * 8 + j); });
+  });
+  assert(sum == 63 * 64 / 2);
+}
+
+
+
+static void testException()
+{
+  //Исключение передаётся вызывающему, остальные задачи выполняются
+  ThreadPool pool(2);
+  std::atomic<int> calls(0);
+  bool isThrown = false;
+  try{
+    pool.run(100, [&calls](size_t i){
+      ++calls;
+      if (i == 50){
+        throw std::runtime_error("task");
+      }
+    });
+  }
+  catch (const std::runtime_error&){
+    isThrown = true;
+  }
+  assert(isThrown);
+  assert(calls == 100);
+  //Пул работает после исключения
+  pool.run(10, [&calls](size_t){ ++calls; });
+  assert(calls == 110);
+}
+
+
+
+static void testConcurrentRun()
+{
+  //Несколько потоков одновременно вызывают run() одного пула
+  ThreadPool pool(2);
+  std::atomic<long> sum(0);
+  std::vector<std::thread> threads;
+  for (int i=0; i<4; ++i){
+    threads.emplace_back([&pool, &sum](){
+      for (int j=0; j<200; ++j){
+        pool.run(10, [&sum](size_t k){ sum += static_cast<long>(k); });
+      }
+    });
+  }
+  for (auto& thread : threads){
+    thread.join();
+  }
+  assert(sum == 4 * 200 * 45);
+}
@@ -0,0 +1,114 @@
+/**
+\file ThreadPool.h
+\brief Класс - пул потоков для параллельных обходов контейнеров
+
+- run(count, task) выполняет задачи task(0) ... task(count-1) в потоках
+  пула и в вызывающем потоке и возвращается, когда выполнены все:
+  вызывающий поток не простаивает, вложенный run() из задачи не ждёт
+  занятых потоков пула
+- Номер следующей задачи выдаёт атомарный счётчик: потоки, быстрее
+  выполнившие свои задачи, берут следующие
+- Несколько run() из разных потоков выполняются одновременно: потоки
+  пула берут задачи из самого раннего незавершённого run()
+- Исключение в задаче не прерывает остальные задачи и передаётся
+  вызывающему run() (первое из исключений)
+- instance() - общий пул на ядро без одного (вызывающий поток - тоже
+  исполнитель); существует до завершения программы, как EpochReclaimer
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+class ThreadPool{
+  public:
+    //Задача: номер задачи в run()
+    using Task = std::function<void(size_t)>;
+
+    /**
+    \param[in] workerCount Количество потоков пула; 0 - задачи выполняет
+    только вызывающий поток
+    */
+    explicit ThreadPool(size_t workerCount);
+
+    ThreadPool(const ThreadPool& other) = delete;
+    ThreadPool& operator=(const ThreadPool& other) = delete;
+
+    /**
+    Дождаться завершения потоков пула. Вызовы run() должны быть завершены
+    */
+    ~ThreadPool();
+
+    /**
+    \return Общий пул: потоков на одно меньше, чем ядер
+    */
+    static ThreadPool& instance();
+
+    /**
+    Выполнить задачи task(0) ... task(count-1) в потоках пула и в вызывающем
+    потоке. Задачи выполняются одновременно и в любом порядке
+    \param[in] count Количество задач
+    \param[in] task Задача
+    */
+    void run(size_t count, const Task& task);
+
+    /**
+    \return Количество исполнителей: потоки пула и вызывающий поток
+    */
+    size_t getConcurrency() const;
+
+  private:
+    //Задачи одного run()
+    struct Job{
+      const Task* task;
+      size_t count;
+      std::atomic<size_t> next{0};      //Номер следующей невыданной задачи
+      std::atomic<size_t> finished{0};  //Количество выполненных задач
+      std::mutex mutexDone;
+      std::condition_variable done;
+      std::exception_ptr error;         //Под mutexDone
+    };
+
+    /**
+    Выполнять задачи job, пока они не закончатся
+    \param[in] job Задачи
+    */
+    static void work(Job& job);
+
+    /**
+    Цикл потока пула: дождаться задач и выполнять их
+    */
+    void runWorker();
+
+    std::vector<std::thread> workers_;
+    std::mutex mutexJobs_;
+    std::condition_variable jobsReady_;
+    std::deque<std::shared_ptr<Job>> jobs_;  //Незавершённые run()
+    bool stopping_ = false;
+};
+
+
+
+inline size_t ThreadPool::getConcurrency() const
+{
+  return workers_.size() + 1;
+}
+
+
+
+namespace thread_pool{
+  /**
+  Протестировать пул потоков
+  */
+  void test();
+}
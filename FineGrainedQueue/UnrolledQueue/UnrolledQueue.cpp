@@ -0,0 +1,218 @@
+#include "UnrolledQueue.h"
+#include <cassert>
+#include <deque>
+#include <thread>
+#include <vector>
+
+
+//Проверка компиляции всех методов
+template class UnrolledQueue<int>;
+
+
+//=============================================================================
+static void testOnethread();
+static void testRandomOperations();
+static void testMoveOnly();
+static void testMultithread();
+
+
+void unrolled_queue::test()
+{
+  testOnethread();
+  testRandomOperations();
+  testMoveOnly();
+  testMultithread();
+}
+
+
+
+static void testOnethread()
+{
+  UnrolledQueue<int> testQueue;
+  assert(testQueue.isEmpty());
+  assert(!testQueue.tryPopFront());
+  assert(!testQueue.tryPopBack());
+  bool isThrown = false;
+  try{
+    testQueue.getValue(0);
+  }
+  catch (const ListIsEmpty_Exception&){
+    isThrown = true;
+  }
+  assert(isThrown);
+
+  //Несколько блоков: 16 значений int в блоке
+  for (int i=0; i<100; ++i){
+    testQueue.pushBack(i);
+  }
+  testQueue.pushFront(-1);
+  testQueue.insertIntoMiddle(1000, 50);
+  testQueue.insertIntoMiddle(2000, 99999);
+  assert(testQueue.getSize() == 103);
+  assert(testQueue.getValue(0) == -1);
+  assert(testQueue.getValue(1) == 0);
+  assert(testQueue.getValue(49) == 48);
+  assert(testQueue.getValue(50) == 1000);
+  assert(testQueue.getValue(51) == 49);
+  assert(testQueue.getValue(102) == 2000);
+  assert(testQueue.visitValue(101, [](const int& value){ return value + 1; }) == 100);
+  isThrown = false;
+  try{
+    testQueue.getValue(103);
+  }
+  catch (const std::out_of_range&){
+    isThrown = true;
+  }
+  assert(isThrown);
+
+  //Обход за один проход, досрочное завершение
+  int expected = 0;
+  assert(testQueue.forEach([&expected](const int& value){
+    if (value < 100 && value >= 0){
+      assert(value == expected++);
+    }
+  }) == 103);
+  assert(testQueue.forEach([](const int& value){ return value != 10; }) == 12);
+
+  assert(testQueue.tryPopBack() == 2000);
+  assert(testQueue.tryPopFront() == -1);
+  while (testQueue.tryPopFront()){
+  }
+  assert(testQueue.isEmpty());
+  //После опустошения список снова работает
+  testQueue.pushBack(1);
+  testQueue.pushFront(0);
+  assert(testQueue.getValue(1) == 1);
+}
+
+
+
+static void testRandomOperations()
+{
+  //Сравнение с std::deque: деление и слияние блоков не нарушают порядок
+  UnrolledQueue<int, 4> testQueue;
+  std::deque<int> reference;
+  uint64_t random = 42;
+  auto next = [&random](){
+    random ^= random << 13;
+    random ^= random >> 7;
+    random ^= random << 17;
+    return random;
+  };
+  for (int i=0; i<20000; ++i){
+    switch (next() % 5){
+      case 0:
+        testQueue.pushFront(i);
+        reference.push_front(i);
+        break;
+      case 1:
+        testQueue.pushBack(i);
+        reference.push_back(i);
+        break;
+      case 2:{
+        const size_t pos = next() % (reference.size() + 1);
+        testQueue.insertIntoMiddle(i, pos);
+        reference.insert(reference.begin() + pos, i);
+        break;
+      }
+      case 3:{
+        std::optional<int> value = testQueue.tryPopFront();
+        assert(value.has_value() == !reference.empty());
+        if (value){
+          assert(*value == reference.front());
+          reference.pop_front();
+        }
+        break;
+      }
+      default:{
+        std::optional<int> value = testQueue.tryPopBack();
+        assert(value.has_value() == !reference.empty());
+        if (value){
+          assert(*value == reference.back());
+          reference.pop_back();
+        }
+        break;
+      }
+    }
+    assert(testQueue.getSize() == reference.size());
+  }
+  size_t pos = 0;
+  testQueue.forEach([&](const int& value){
+    assert(value == reference[pos++]);
+  });
+  assert(pos == reference.size());
+}
+
+
+
+static void testMoveOnly()
+{
+  UnrolledQueue<std::unique_ptr<int>> testQueue;
+  for (int i=0; i<10; ++i){
+    testQueue.emplaceBack(new int(i));
+  }
+  testQueue.emplaceAt(5, std::make_unique<int>(100));
+  assert(testQueue.visitValue(5, [](const std::unique_ptr<int>& value){
+    return *value;
+  }) == 100);
+  assert(*testQueue.tryPopFront().value() == 0);
+  assert(*testQueue.tryPopBack().value() == 9);
+}
+
+
+
+static void testMultithread()
+{
+  //Добавление и извлечение с обоих концов, вставка в середину и обход
+  //одновременно - ни одно значение не теряется
+  const int COUNT = 20000;
+  for (size_t round=0; round<3; ++round){
+    UnrolledQueue<int, 8> testQueue;
+    std::atomic<long> popped(0);
+    std::atomic<bool> done(false);
+
+    std::thread pusherBack([&](){
+      for (int i=0; i<COUNT; ++i){
+        testQueue.pushBack(i);
+      }
+    });
+    std::thread pusherFront([&](){
+      for (int i=0; i<COUNT; ++i){
+        testQueue.pushFront(i);
+      }
+    });
+    std::thread inserter([&](){
+      for (int i=0; i<COUNT; ++i){
+        testQueue.insertIntoMiddle(i, static_cast<size_t>(i) % 100);
+      }
+      done = true;
+    });
+    std::thread popper([&](){
+      for (int i=0; i<COUNT; ++i){
+        if ((i % 2 ? testQueue.tryPopBack() : testQueue.tryPopFront())){
+          ++popped;
+        }
+      }
+    });
+    std::thread reader([&](){
+      while (!done){
+        testQueue.forEach([](const int& value){ assert(value >= 0); });
+        try{
+          testQueue.getValue(testQueue.getSize() / 2);
+        }
+        catch (const std::out_of_range&){
+        }
+        catch (const ListIsEmpty_Exception&){
+        }
+      }
+    });
+    pusherBack.join();
+    pusherFront.join();
+    inserter.join();
+    popper.join();
+    reader.join();
+
+    assert(testQueue.getSize() + popped == 3*COUNT);
+    assert(testQueue.forEach([](const int&){}) == testQueue.getSize());
+  }
+}
@@ -0,0 +1,757 @@
+/**
+\file UnrolledQueue.h
+\brief Шаблон класса - потокобезопасный развёрнутый (unrolled) односвязный список
+с мелкогранулярными блокировками
+
+Методы:
+- добавить элемент в начало / конец / заданную позицию списка
+- сконструировать элемент на месте в начале / конце / заданной позиции списка
+- извлечь элемент из начала / конца списка без ожидания
+- получить количество элементов в списке
+- получить значение элемента в заданной позиции списка
+- прочитать элемент без копирования (посетителем)
+- обойти все элементы за один проход (посетителем)
+- получить признак - пуст ли список
+
+Элемент списка (блок) хранит до Capacity значений подряд и один mutex -
+по умолчанию значения занимают одну кэш-линию. Полный блок при вставке
+делится пополам, почти пустой первый блок при извлечении сливается
+со следующим. Пустых блоков в списке нет, кроме единственного блока
+пустого списка - поэтому начало и конец списка существуют всегда
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "NodePool/PoolAllocator.h"
+#include "Exceptions/ListIsEmpty_Exception.h"
+
+
+template<typename T = int,
+         size_t Capacity = (64 / sizeof(T) > 2 ? 64 / sizeof(T) : 2),
+         typename Allocator = PoolAllocator<T>>
+class UnrolledQueue{
+  static_assert(Capacity >= 2, "Block must hold at least two values");
+
+  public:
+    UnrolledQueue();
+    UnrolledQueue(std::initializer_list<T> values);
+
+    UnrolledQueue(const UnrolledQueue& other) = delete;
+    UnrolledQueue& operator=(const UnrolledQueue& other) = delete;
+
+    ~UnrolledQueue();
+
+    /**
+    Вставить элемент в начало списка
+    \param[in] value Значение элемента
+    */
+    void pushFront(const T& value);
+    void pushFront(T&& value);
+
+    /**
+    Вставить элемент в конец списка
+    \param[in] value Значение элемента
+    */
+    void pushBack(const T& value);
+    void pushBack(T&& value);
+
+    /**
+    Вставить элемент в заданную позицию
+    Если позиция больше длины списка - вставить в конец
+    \param[in] value Значение элемента
+    \param[in] pos Позиция в списке куда поместить
+    */
+    void insertIntoMiddle(const T& value, size_t pos);
+    void insertIntoMiddle(T&& value, size_t pos);
+
+    /**
+    Сконструировать элемент на месте в начале / конце списка
+    \param[in] args Аргументы конструктора T
+    */
+    template<typename... Args>
+    void emplaceFront(Args&&... args);
+
+    template<typename... Args>
+    void emplaceBack(Args&&... args);
+
+    /**
+    Сконструировать элемент в заданной позиции
+    Если позиция больше длины списка - вставить в конец
+    \param[in] pos Позиция в списке куда поместить
+    \param[in] args Аргументы конструктора T
+    */
+    template<typename... Args>
+    void emplaceAt(size_t pos, Args&&... args);
+
+    /**
+    Извлечь элемент из начала списка без ожидания
+    \return Значение элемента или std::nullopt, если список пуст
+    */
+    std::optional<T> tryPopFront();
+
+    /**
+    Извлечь элемент из конца списка без ожидания.
+    Если последний блок опустеет - предпоследний блок ищется проходом
+    от начала списка
+    \return Значение элемента или std::nullopt, если список пуст
+    */
+    std::optional<T> tryPopBack();
+
+    /**
+    \return Количество элементов списка
+    */
+    size_t getSize() const;
+
+    /**
+    \param[in] pos Позиция в списке
+    \return Копия значения элемента
+    */
+    T getValue(size_t pos) const;
+
+    /**
+    Прочитать элемент без копирования: visitor вызывается
+    под разделяемой блокировкой блока
+    \param[in] pos Позиция в списке
+    \param[in] visitor Функция, принимающая const T&
+    \return Результат visitor
+    */
+    template<typename Visitor>
+    std::invoke_result_t<Visitor, const T&> visitValue(size_t pos,
+                                                       Visitor&& visitor) const;
+
+    /**
+    Обойти все элементы от начала к концу за один проход, захватывая
+    mutex блоков на чтение по цепочке. visitor не должен изменять список.
+    Если visitor возвращает bool, false прекращает обход
+    \param[in] visitor Функция, принимающая const T&
+    \return Количество элементов, переданных visitor
+    */
+    template<typename Visitor>
+    size_t forEach(Visitor&& visitor) const;
+
+    /**
+    \return Признак пуст ли список
+    */
+    bool isEmpty() const;
+
+  private:
+    //Элемент списка - блок значений. Значения [0, count) сконструированы
+    struct Block{
+      Block(): count(0), next(nullptr){}
+      ~Block();
+
+      T* values(){ return std::launder(reinterpret_cast<T*>(storage)); }
+      const T* values() const{ return std::launder(reinterpret_cast<const T*>(storage)); }
+
+      /**
+      Вставить значение в позицию pos блока, блок не полон
+      \param[in] pos Позиция в блоке, не больше count
+      \param[in] value Значение
+      */
+      void insert(size_t pos, T&& value);
+
+      /**
+      Извлечь значение из начала / конца блока, блок не пуст
+      \return Значение
+      */
+      T takeFront();
+      T takeBack();
+
+      /**
+      Перенести верхнюю половину значений в пустой блок other
+      \param[in] other Новый блок
+      */
+      void splitTo(Block* other);
+
+      /**
+      Перенести все значения блока other в начало блока
+      \param[in] other Блок, предшествующий этому блоку
+      */
+      void prependFrom(Block* other);
+
+      alignas(T) unsigned char storage[Capacity * sizeof(T)];
+      size_t count;
+      Block* next;
+      std::shared_mutex mutex;
+    };
+
+    using BlockAllocator =
+      typename std::allocator_traits<Allocator>::template rebind_alloc<Block>;
+    using BlockTraits = std::allocator_traits<BlockAllocator>;
+
+    static Block* createBlock();
+    static void destroyBlock(Block* block) noexcept;
+
+    /**
+    Вставить значение в заданную позицию
+    \param[in] value Значение
+    \param[in] pos Позиция в списке
+    \param[in] lockEnds Захватить mutex начала и конца списка на всё время
+    вставки - нужно для деления последнего блока
+    \return Признак успеха; false - нужно делить последний блок, а lockEnds не задан
+    */
+    bool insertValue(T& value, size_t pos, bool lockEnds);
+
+    /**
+    Найти блок, содержащий элемент pos, захватывая mutex по цепочке
+    \param[in] pos Позиция в списке; на выходе - позиция в блоке
+    \return Блок, его mutex захвачен на чтение
+    */
+    Block* findShared(size_t& pos) const;
+
+    [[noreturn]] static void throwOutOfRange(size_t pos);
+
+    std::atomic<size_t> size_;  //Размер списка
+    Block* head_;               //Первый блок, существует всегда
+    Block* tail_;               //Последний блок, существует всегда
+    mutable std::shared_mutex mutexHead_;
+    mutable std::shared_mutex mutexTail_;
+};
+
+
+
+template<typename T, size_t Capacity, typename Allocator>
+UnrolledQueue<T, Capacity, Allocator>::UnrolledQueue():
+  size_(0), head_(createBlock()), tail_(head_)
+{
+}
+
+
+
+template<typename T, size_t Capacity, typename Allocator>
+UnrolledQueue<T, Capacity, Allocator>::UnrolledQueue(std::initializer_list<T> values):
+  UnrolledQueue()
+{
+  for (const auto& value : values){
+    pushBack(value);
+  }
+}
+
+
+
+template<typename T, size_t Capacity, typename Allocator>
+UnrolledQueue<T, Capacity, Allocator>::~UnrolledQueue()
+{
+  Block* block = head_;
+  while (block){
+    Block* next = block->next;
+    destroyBlock(block);
+    block = next;
+  }
+}
+
+
+
+template<typename T, size_t Capacity, typename Allocator>
+void UnrolledQueue<T, Capacity, Allocator>::pushFront(const T& value)
+{
+  emplaceFront(value);
+}
+
+
+
+template<typename T, size_t Capacity, typename Allocator>
+void UnrolledQueue<T, Capacity, Allocator>::pushFront(T&& value)
+{
+  emplaceFront(std::move(value));
+}
+
+
+
+template<typename T, size_t Capacity, typename Allocator>
+void UnrolledQueue<T, Capacity, Allocator>::pushBack(const T& value)
+{
+  emplaceBack(value);
+}
+
+
+
+template<typename T, size_t Capacity, typename Allocator>
+void UnrolledQueue<T, Capacity, Allocator>::pushBack(T&& value)
+{
+  emplaceBack(std::move(value));
+}
+
+
+
+template<typename T, size_t Capacity, typename Allocator>
+void UnrolledQueue<T, Capacity, Allocator>::insertIntoMiddle(const T& value, size_t pos)
+{
+  emplaceAt(pos, value);
+}
+
+
+
+template<typename T, size_t Capacity, typename Allocator>
+void UnrolledQueue<T, Capacity, Allocator>::insertIntoMiddle(T&& value, size_t pos)
+{
+  emplaceAt(pos, std::move(value));
+}
+
+
+
+template<typename T, size_t Capacity, typename Allocator>
+template<typename... Args>
+void UnrolledQueue<T, Capacity, Allocator>::emplaceFront(Args&&... args)
+{
+  T value(std::forward<Args>(args)...);
+  std::lock_guard<std::shared_mutex> headLock(mutexHead_);
+  Block* first = head_;
+  std::lock_guard<std::shared_mutex> blockLock(first->mutex);
+  ++size_;
+  if (first->count < Capacity){
+    first->insert(0, std::move(value));
+    return;
+  }
+  //Первый блок полон - новый блок становится первым, конец списка не меняется
+  Block* block = createBlock();
+  block->insert(0, std::move(value));
+  block->next = first;
+  head_ = block;
+}
+
+
+
+template<typename T, size_t Capacity, typename Allocator>
+template<typename... Args>
+void UnrolledQueue<T, Capacity, Allocator>::emplaceBack(Args&&... args)
+{
+  T value(std::forward<Args>(args)...);
+  std::lock_guard<std::shared_mutex> tailLock(mutexTail_);
+  Block* last = tail_;
+  std::lock_guard<std::shared_mutex> blockLock(last->mutex);
+  ++size_;
+  if (last->count < Capacity){
+    last->insert(last->count, std::move(value));
+    return;
+  }
+  //Последний блок полон - новый блок становится последним, начало списка не меняется
+  Block* block = createBlock();
+  block->insert(0, std::move(value));
+  last->next = block;
+  tail_ = block;
+}
+
+
+
+template<typename T, size_t Capacity, typename Allocator>
+template<typename... Args>
+void UnrolledQueue<T, Capacity, Allocator>::emplaceAt(size_t pos, Args&&... args)
+{
+  if (pos == 0){
+    emplaceFront(std::forward<Args>(args)...);
+    return;
+  }
+  if (pos >= size_){
+    emplaceBack(std::forward<Args>(args)...);
+    return;
+  }
+  T value(std::forward<Args>(args)...);
+  //Деление последнего блока меняет tail_ - тогда вставка повторяется
+  //с mutex начала и конца списка
+  if (!insertValue(value, pos, false)){
+    insertValue(value, pos, true);
+  }
+}
+
+
+
+template<typename T, size_t Capacity, typename Allocator>
+std::optional<T> UnrolledQueue<T, Capacity, Allocator>::tryPopFront()
+{
+  std::lock_guard<std::shared_mutex> headLock(mutexHead_);
+  Block* first = head_;
+  first->mutex.lock();
+  //Пустой блок может быть только единственным - список пуст
+  if (first->count == 0){
+    first->mutex.unlock();
+    return std::nullopt;
+  }
+  std::optional<T> value(first->takeFront());
+  --size_;
+
+  Block* next = first->next;
+  if (!next){
+    first->mutex.unlock();
+    return value;
+  }
+  //Опустевший блок исключается из списка. Почти пустой блок сливается
+  //со следующим, если значения помещаются в него. Следующий блок остаётся
+  //на месте - конец списка не меняется, даже если он последний
+  if (first->count != 0){
+    if (first->count > Capacity / 4){
+      first->mutex.unlock();
+      return value;
+    }
+    next->mutex.lock();
+    if (first->count + next->count > Capacity){
+      next->mutex.unlock();
+      first->mutex.unlock();
+      return value;
+    }
+    next->prependFrom(first);
+    next->mutex.unlock();
+  }
+  //Блок недостижим: новые проходы начинаются с head_ под mutexHead_,
+  //а начатые проходы уже захватили следующие блоки
+  head_ = next;
+  first->mutex.unlock();
+  destroyBlock(first);
+  return value;
+}
+
+
+
+template<typename T, size_t Capacity, typename Allocator>
+std::optional<T> UnrolledQueue<T, Capacity, Allocator>::tryPopBack()
+{
+  std::lock(mutexHead_, mutexTail_);
+  std::lock_guard<std::shared_mutex> tailLock(mutexTail_, std::adopt_lock);
+  Block* last = tail_;
+  last->mutex.lock();
+  //Единственный блок или значение не последнее в блоке -
+  //блоки не исключаются, начало списка не нужно
+  if (last == head_ || last->count > 1){
+    mutexHead_.unlock();
+    if (last->count == 0){
+      last->mutex.unlock();
+      return std::nullopt;
+    }
+    std::optional<T> value(last->takeBack());
+    --size_;
+    last->mutex.unlock();
+    return value;
+  }
+  last->mutex.unlock();
+
+  //Последний блок опустеет - найти предпоследний блок, захватывая mutex
+  //по цепочке. mutexTail_ удерживается - последний блок не изменится
+  Block* prev = head_;
+  prev->mutex.lock();
+  mutexHead_.unlock();
+  while (prev->next != last){
+    Block* next = prev->next;
+    next->mutex.lock();
+    prev->mutex.unlock();
+    prev = next;
+  }
+  last->mutex.lock();
+  std::optional<T> value(last->takeBack());
+  --size_;
+  //Пока mutex был свободен, в блок могли вставить значения
+  if (last->count != 0){
+    last->mutex.unlock();
+    prev->mutex.unlock();
+    return value;
+  }
+  prev->next = nullptr;
+  tail_ = prev;
+  last->mutex.unlock();
+  prev->mutex.unlock();
+  destroyBlock(last);
+  return value;
+}
+
+
+
+template<typename T, size_t Capacity, typename Allocator>
+size_t UnrolledQueue<T, Capacity, Allocator>::getSize() const
+{
+  return size_;
+}
+
+
+
+template<typename T, size_t Capacity, typename Allocator>
+T UnrolledQueue<T, Capacity, Allocator>::getValue(size_t pos) const
+{
+  return visitValue(pos, [](const T& value){ return value; });
+}
+
+
+
+template<typename T, size_t Capacity, typename Allocator>
+template<typename Visitor>
+std::invoke_result_t<Visitor, const T&>
+UnrolledQueue<T, Capacity, Allocator>::visitValue(size_t pos, Visitor&& visitor) const
+{
+  size_t posInBlock = pos;
+  Block* block = findShared(posInBlock);
+  //Снять блокировку блока и при исключении в visitor
+  std::shared_lock<std::shared_mutex> lock(block->mutex, std::adopt_lock);
+  return std::forward<Visitor>(visitor)(std::as_const(block->values()[posInBlock]));
+}
+
+
+
+template<typename T, size_t Capacity, typename Allocator>
+template<typename Visitor>
+size_t UnrolledQueue<T, Capacity, Allocator>::forEach(Visitor&& visitor) const
+{
+  mutexHead_.lock_shared();
+  Block* block = head_;
+  block->mutex.lock_shared();
+  mutexHead_.unlock_shared();
+
+  size_t visited = 0;
+  while (block){
+    Block* next = nullptr;
+    {
+      //Снять блокировку блока и при исключении в visitor
+      std::shared_lock<std::shared_mutex> lock(block->mutex, std::adopt_lock);
+      bool proceed = true;
+      for (size_t i=0; i<block->count && proceed; ++i){
+        ++visited;
+        if constexpr (std::is_same_v<std::invoke_result_t<Visitor&, const T&>, bool>){
+          proceed = visitor(std::as_const(block->values()[i]));
+        }
+        else{
+          visitor(std::as_const(block->values()[i]));
+        }
+      }
+      if (proceed){
+        next = block->next;
+        //Захватить следующий блок до освобождения текущего
+        if (next){
+          next->mutex.lock_shared();
+        }
+      }
+    }
+    block = next;
+  }
+  return visited;
+}
+
+
+
+template<typename T, size_t Capacity, typename Allocator>
+bool UnrolledQueue<T, Capacity, Allocator>::isEmpty() const
+{
+  return size_ == 0;
+}
+
+
+
+template<typename T, size_t Capacity, typename Allocator>
+bool UnrolledQueue<T, Capacity, Allocator>::insertValue(T& value, size_t pos,
+                                                         bool lockEnds)
+{
+  if (lockEnds){
+    std::lock(mutexHead_, mutexTail_);
+  }
+  else{
+    mutexHead_.lock_shared();
+  }
+  Block* block = head_;
+  block->mutex.lock();
+  if (!lockEnds){
+    mutexHead_.unlock_shared();
+  }
+  auto unlockEnds = [this, lockEnds](){
+    if (lockEnds){
+      mutexHead_.unlock();
+      mutexTail_.unlock();
+    }
+  };
+
+  //Найти блок, в который попадает позиция: вставка в конец блока
+  //равносильна вставке перед первым значением следующего блока
+  while (pos > block->count && block->next){
+    Block* next = block->next;
+    next->mutex.lock();
+    pos -= block->count;
+    block->mutex.unlock();
+    block = next;
+  }
+  //Список укоротился после проверки размера - вставка в конец
+  pos = std::min(pos, block->count);
+
+  if (block->count < Capacity){
+    ++size_;
+    block->insert(pos, std::move(value));
+    block->mutex.unlock();
+    unlockEnds();
+    return true;
+  }
+  //Деление последнего блока меняет tail_ - нужен mutexTail_, а захватывать
+  //его под mutex блока нельзя: pushBack держит mutexTail_ и ждёт mutex блока
+  if (!block->next && !lockEnds){
+    block->mutex.unlock();
+    return false;
+  }
+  //Новый блок не виден другим потокам, пока mutex делимого блока захвачен
+  Block* half = createBlock();
+  block->splitTo(half);
+  half->next = block->next;
+  block->next = half;
+  if (!half->next){
+    tail_ = half;
+  }
+  ++size_;
+  if (pos <= block->count){
+    block->insert(pos, std::move(value));
+  }
+  else{
+    half->insert(pos - block->count, std::move(value));
+  }
+  block->mutex.unlock();
+  unlockEnds();
+  return true;
+}
+
+
+
+template<typename T, size_t Capacity, typename Allocator>
+typename UnrolledQueue<T, Capacity, Allocator>::Block*
+UnrolledQueue<T, Capacity, Allocator>::findShared(size_t& pos) const
+{
+  //Обработка ошибок
+  if (isEmpty()){
+    throw ListIsEmpty_Exception();
+  }
+  const size_t posInList = pos;
+  mutexHead_.lock_shared();
+  Block* block = head_;
+  block->mutex.lock_shared();
+  mutexHead_.unlock_shared();
+  while (pos >= block->count){
+    Block* next = block->next;
+    //Список короче pos
+    if (!next){
+      block->mutex.unlock_shared();
+      throwOutOfRange(posInList);
+    }
+    next->mutex.lock_shared();
+    pos -= block->count;
+    block->mutex.unlock_shared();
+    block = next;
+  }
+  return block;
+}
+
+
+
+template<typename T, size_t Capacity, typename Allocator>
+typename UnrolledQueue<T, Capacity, Allocator>::Block*
+UnrolledQueue<T, Capacity, Allocator>::createBlock()
+{
+  BlockAllocator allocator;
+  Block* block = BlockTraits::allocate(allocator, 1);
+  return new (block) Block();
+}
+
+
+
+template<typename T, size_t Capacity, typename Allocator>
+void UnrolledQueue<T, Capacity, Allocator>::destroyBlock(Block* block) noexcept
+{
+  BlockAllocator allocator;
+  block->~Block();
+  BlockTraits::deallocate(allocator, block, 1);
+}
+
+
+
+template<typename T, size_t Capacity, typename Allocator>
+void UnrolledQueue<T, Capacity, Allocator>::throwOutOfRange(size_t pos)
+{
+  const std::string errorMessage = "Error: pos (" +
+    std::to_string(pos) + ") is out_of_range";
+  throw std::out_of_range(errorMessage.c_str());
+}
+
+
+
+template<typename T, size_t Capacity, typename Allocator>
+UnrolledQueue<T, Capacity, Allocator>::Block::~Block()
+{
+  std::destroy_n(values(), count);
+}
+
+
+
+template<typename T, size_t Capacity, typename Allocator>
+void UnrolledQueue<T, Capacity, Allocator>::Block::insert(size_t pos, T&& value)
+{
+  T* data = values();
+  new (data + count) T(std::move(value));
+  ++count;
+  //Новое значение сдвигается на место pos
+  std::rotate(data + pos, data + count - 1, data + count);
+}
+
+
+
+template<typename T, size_t Capacity, typename Allocator>
+T UnrolledQueue<T, Capacity, Allocator>::Block::takeFront()
+{
+  T* data = values();
+  T value(std::move(data[0]));
+  std::move(data + 1, data + count, data);
+  std::destroy_at(data + count - 1);
+  --count;
+  return value;
+}
+
+
+
+template<typename T, size_t Capacity, typename Allocator>
+T UnrolledQueue<T, Capacity, Allocator>::Block::takeBack()
+{
+  T* data = values();
+  T value(std::move(data[count - 1]));
+  std::destroy_at(data + count - 1);
+  --count;
+  return value;
+}
+
+
+
+template<typename T, size_t Capacity, typename Allocator>
+void UnrolledQueue<T, Capacity, Allocator>::Block::splitTo(Block* other)
+{
+  const size_t half = count / 2;
+  std::uninitialized_move(values() + half, values() + count, other->values());
+  std::destroy(values() + half, values() + count);
+  other->count = count - half;
+  count = half;
+}
+
+
+
+template<typename T, size_t Capacity, typename Allocator>
+void UnrolledQueue<T, Capacity, Allocator>::Block::prependFrom(Block* other)
+{
+  //Значения other дописываются в конец и сдвигаются в начало
+  T* data = values();
+  const size_t countBefore = count;
+  std::uninitialized_move(other->values(), other->values() + other->count,
+                          data + count);
+  count += other->count;
+  std::rotate(data, data + countBefore, data + count);
+  std::destroy(other->values(), other->values() + other->count);
+  other->count = 0;
+}
+
+
+
+namespace unrolled_queue{
+  /**
+  Протестировать развёрнутый список
+  */
+  void test();
+}
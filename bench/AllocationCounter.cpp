@@ -0,0 +1,66 @@
+#include "AllocationCounter.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+
+static std::atomic<size_t> allocations{0};
+static std::atomic<size_t> allocatedBytes{0};
+
+
+
+size_t allocation_counter::get()
+{
+  return allocations.load(std::memory_order_relaxed);
+}
+
+
+
+size_t allocation_counter::bytes()
+{
+  return allocatedBytes.load(std::memory_order_relaxed);
+}
+
+
+
+void* operator new(size_t size)
+{
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+  if (void* p = std::malloc(size ? size : 1)){
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new(size_t size, std::align_val_t align)
+{
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+  const size_t alignment = static_cast<size_t>(align);
+  if (void* p = std::aligned_alloc(alignment,
+                                   (size + alignment - 1) / alignment * alignment)){
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept
+{
+  std::free(p);
+}
@@ -0,0 +1,24 @@
+/**
+\file AllocationCounter.h
+\brief Подсчёт обращений к системному аллокатору в бенчмарке
+
+Глобальные operator new / operator delete бенчмарка заменены
+версиями, считающими вызовы operator new и запрошенные байты
+*/
+
+#pragma once
+
+#include <cstddef>
+
+
+namespace allocation_counter{
+  /**
+  \return Количество вызовов operator new с начала программы
+  */
+  size_t get();
+
+  /**
+  \return Количество байт, запрошенных у operator new с начала программы
+  */
+  size_t bytes();
+}
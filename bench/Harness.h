@@ -0,0 +1,180 @@
+/**
+\file Harness.h
+\brief Запуск сценария бенчмарка в нескольких потоках
+
+- Каждый поток в течение заданного времени выполняет операции сценария
+- Задержка каждой операции измеряется отдельно; выборка задержек
+  ограничена (reservoir sampling) и выделяется до начала измерений
+- Результат: операций в секунду, p50 / p99 / p999 задержки,
+  обращений к системному аллокатору на операцию
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AllocationCounter.h"
+
+
+//Быстрый генератор псевдослучайных чисел (xorshift64*) - по одному на поток
+class Random{
+  public:
+    explicit Random(uint64_t seed): state_(seed * 0x9E3779B97F4A7C15ull + 1){}
+
+    uint64_t next()
+    {
+      state_ ^= state_ >> 12;
+      state_ ^= state_ << 25;
+      state_ ^= state_ >> 27;
+      return state_ * 0x2545F4914F6CDD1Dull;
+    }
+
+    /**
+    \return Число в диапазоне [0, bound)
+    */
+    size_t below(size_t bound)
+    {
+      return bound ? static_cast<size_t>(next() % bound) : 0;
+    }
+
+    /**
+    \return Число в диапазоне [0, 1)
+    */
+    double unit()
+    {
+      return static_cast<double>(next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+  private:
+    uint64_t state_;
+};
+
+
+
+//Параметры сценария - попадают в отчёт
+struct ScenarioParams{
+  std::string name;
+  size_t threads = 1;
+  size_t length = 0;              //Длина списка до начала измерений
+  double readRatio = 0;           //Доля операций чтения
+  std::string distribution = "-"; //Распределение позиций: front / back / uniform
+};
+
+
+
+struct BenchResult{
+  ScenarioParams params;
+  size_t ops = 0;
+  double seconds = 0;
+  double opsPerSec = 0;
+  uint64_t p50 = 0;               //Задержки, нс
+  uint64_t p99 = 0;
+  uint64_t p999 = 0;
+  double allocsPerOp = 0;
+};
+
+
+
+/**
+Выполнять operation(threadIndex, random) в params.threads потоках
+в течение duration
+\param[in] params Параметры сценария
+\param[in] duration Длительность измерений
+\param[in] operation Одна операция сценария
+\return Результат измерений
+*/
+template<typename Operation>
+BenchResult runThreads(const ScenarioParams& params,
+                       std::chrono::milliseconds duration,
+                       Operation operation)
+{
+  static constexpr size_t MAX_SAMPLES = size_t(1) << 18;
+
+  struct ThreadState{
+    std::vector<uint64_t> samples;
+    size_t ops = 0;
+  };
+  std::vector<ThreadState> states(params.threads);
+  for (auto& state : states){
+    state.samples.reserve(MAX_SAMPLES);
+  }
+
+  std::atomic<size_t> ready(0);
+  std::atomic<bool> start(false);
+  std::atomic<bool> stop(false);
+  std::vector<std::thread> threads;
+  for (size_t t=0; t<params.threads; ++t){
+    threads.emplace_back([&, t](){
+      ThreadState& state = states[t];
+      Random random(t + 1);
+      ++ready;
+      while (!start.load(std::memory_order_acquire)){
+        std::this_thread::yield();
+      }
+      while (!stop.load(std::memory_order_relaxed)){
+        const auto begin = std::chrono::steady_clock::now();
+        operation(t, random);
+        const auto end = std::chrono::steady_clock::now();
+        const uint64_t ns = static_cast<uint64_t>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+        ++state.ops;
+        if (state.samples.size() < MAX_SAMPLES){
+          state.samples.push_back(ns);
+        }
+        else{
+          const size_t slot = random.below(state.ops);
+          if (slot < MAX_SAMPLES){
+            state.samples[slot] = ns;
+          }
+        }
+      }
+    });
+  }
+  while (ready.load() != params.threads){
+    std::this_thread::yield();
+  }
+
+  const size_t allocationsBefore = allocation_counter::get();
+  const auto begin = std::chrono::steady_clock::now();
+  start.store(true, std::memory_order_release);
+  std::this_thread::sleep_for(duration);
+  stop.store(true);
+  for (auto& thread : threads){
+    thread.join();
+  }
+  const auto end = std::chrono::steady_clock::now();
+  const size_t allocationsAfter = allocation_counter::get();
+
+  BenchResult result;
+  result.params = params;
+  std::vector<uint64_t> samples;
+  for (const auto& state : states){
+    result.ops += state.ops;
+    samples.insert(samples.end(), state.samples.begin(), state.samples.end());
+  }
+  result.seconds = std::chrono::duration<double>(end - begin).count();
+  result.opsPerSec = result.ops / result.seconds;
+  if (result.ops){
+    result.allocsPerOp = static_cast<double>(allocationsAfter - allocationsBefore) /
+                         result.ops;
+  }
+  std::sort(samples.begin(), samples.end());
+  auto percentile = [&samples](double q) -> uint64_t{
+    if (samples.empty()){
+      return 0;
+    }
+    const size_t index = static_cast<size_t>(q * (samples.size() - 1) + 0.5);
+    return samples[index];
+  };
+  result.p50 = percentile(0.50);
+  result.p99 = percentile(0.99);
+  result.p999 = percentile(0.999);
+  return result;
+}
@@ -0,0 +1,86 @@
+#include "Report.h"
+#include <cstdio>
+#include <fstream>
+
+
+
+void report::printHeader()
+{
+  std::printf("%-28s %7s %9s %5s %8s %13s %9s %9s %9s %10s\n",
+              "scenario", "threads", "length", "read", "dist",
+              "ops/sec", "p50,ns", "p99,ns", "p999,ns", "allocs/op");
+}
+
+
+
+void report::printResult(const BenchResult& result)
+{
+  const ScenarioParams& params = result.params;
+  std::printf("%-28s %7zu %9zu %5.2f %8s %13.0f %9llu %9llu %9llu %10.4f\n",
+              params.name.c_str(),
+              params.threads,
+              params.length,
+              params.readRatio,
+              params.distribution.c_str(),
+              result.opsPerSec,
+              static_cast<unsigned long long>(result.p50),
+              static_cast<unsigned long long>(result.p99),
+              static_cast<unsigned long long>(result.p999),
+              result.allocsPerOp);
+  std::fflush(stdout);
+}
+
+
+
+void report::printMemory(const std::string& name, double bytesPerElement)
+{
+  std::printf("memory: %-40s %8.1f bytes/element\n", name.c_str(), bytesPerElement);
+  std::fflush(stdout);
+}
+
+
+
+static std::string quoted(const std::string& text)
+{
+  std::string result = "\"";
+  for (const char c : text){
+    if (c == '"' || c == '\\'){
+      result += '\\';
+    }
+    result += c;
+  }
+  return result + "\"";
+}
+
+
+
+bool report::writeJson(const std::string& path,
+                       const std::string& label,
+                       const std::vector<BenchResult>& results)
+{
+  std::ofstream file(path);
+  if (!file){
+    return false;
+  }
+  file << "{\n  \"label\": " << quoted(label) << ",\n  \"results\": [\n";
+  for (size_t i=0; i<results.size(); ++i){
+    const BenchResult& result = results[i];
+    const ScenarioParams& params = result.params;
+    file << "    {"
+         << "\"scenario\": " << quoted(params.name)
+         << ", \"threads\": " << params.threads
+         << ", \"length\": " << params.length
+         << ", \"read_ratio\": " << params.readRatio
+         << ", \"distribution\": " << quoted(params.distribution)
+         << ", \"ops\": " << result.ops
+         << ", \"seconds\": " << result.seconds
+         << ", \"ops_per_sec\": " << result.opsPerSec
+         << ", \"p50_ns\": " << result.p50
+         << ", \"p99_ns\": " << result.p99
+         << ", \"p999_ns\": " << result.p999
+         << ", \"allocs_per_op\": " << result.allocsPerOp
+         << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+  file << "  ]\n}\n";
+  return static_cast<bool>(file);
+}
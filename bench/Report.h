@@ -0,0 +1,43 @@
+/**
+\file Report.h
+\brief Вывод результатов бенчмарка: таблица в stdout и файл JSON
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Harness.h"
+
+
+namespace report{
+  /**
+  Напечатать заголовок таблицы результатов
+  */
+  void printHeader();
+
+  /**
+  Напечатать строку таблицы результатов
+  \param[in] result Результат сценария
+  */
+  void printResult(const BenchResult& result);
+
+  /**
+  Напечатать расход памяти на элемент списка
+  \param[in] name Тип списка
+  \param[in] bytesPerElement Байт на элемент
+  */
+  void printMemory(const std::string& name, double bytesPerElement);
+
+  /**
+  Записать результаты в файл JSON
+  \param[in] path Путь к файлу
+  \param[in] label Метка запуска (например, вариант блокировок)
+  \param[in] results Результаты сценариев
+  \return Признак успешной записи
+  */
+  bool writeJson(const std::string& path,
+                 const std::string& label,
+                 const std::vector<BenchResult>& results);
+}
@@ -0,0 +1,1008 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FineGrainedQueue/FineGrainedQueue.h"
+#include "FineGrainedQueue/UnrolledQueue/UnrolledQueue.h"
+#include "FineGrainedQueue/ShardedQueue/ShardedQueue.h"
+#include "FineGrainedQueue/RingQueue/RingQueue.h"
+#include "FineGrainedQueue/FineGrainedSortedList/FineGrainedSortedList.h"
+#include "Harness.h"
+#include "Report.h"
+
+
+//Параметры запуска
+struct Options{
+  size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<size_t> lengths = {10, 1000, 100000};
+  std::vector<double> readRatios = {0, 0.5, 0.9, 1.0};
+  std::chrono::milliseconds duration{200};
+  std::string jsonPath;
+  std::string label = "shared_mutex lock coupling";
+  std::string filter;
+  FineGrainedQueue<int>::TraversalMode traversal =
+    FineGrainedQueue<int>::TraversalMode::LOCK_COUPLING;
+  FineGrainedQueue<int>::IndexMode index = FineGrainedQueue<int>::IndexMode::NONE;
+};
+
+//Распределение позиций вставки и чтения
+enum class Distribution{
+  FRONT,
+  BACK,
+  UNIFORM
+};
+
+static const char* toString(Distribution distribution);
+static size_t readPosition(Distribution distribution, size_t size, Random& random);
+static size_t insertPosition(Distribution distribution, size_t size, Random& random);
+
+static std::vector<size_t> threadCounts(const Options& options);
+static bool selected(const Options& options, const std::string& name);
+
+static void benchMemory(const Options& options);
+static void benchPush(const Options& options, std::vector<BenchResult>& results);
+static void benchMixed(const Options& options, std::vector<BenchResult>& results);
+static void benchPeek(const Options& options, std::vector<BenchResult>& results);
+static void benchRemove(const Options& options, std::vector<BenchResult>& results);
+static void benchRebalance(const Options& options, std::vector<BenchResult>& results);
+static void benchScan(const Options& options, std::vector<BenchResult>& results);
+static void benchSorted(const Options& options, std::vector<BenchResult>& results);
+static void benchUnrolled(const Options& options, std::vector<BenchResult>& results);
+static void benchProducerConsumer(const Options& options, std::vector<BenchResult>& results);
+static void benchLockPolicy(const Options& options, std::vector<BenchResult>& results);
+
+static bool parseOptions(int argc, char* argv[], Options& options);
+static void printUsage(const char* program);
+
+
+
+int main(int argc, char* argv[])
+{
+  Options options;
+  if (!parseOptions(argc, argv, options)){
+    printUsage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  std::vector<BenchResult> results;
+  benchMemory(options);
+  report::printHeader();
+  benchPush(options, results);
+  benchMixed(options, results);
+  benchPeek(options, results);
+  benchRemove(options, results);
+  benchRebalance(options, results);
+  benchScan(options, results);
+  benchSorted(options, results);
+  benchUnrolled(options, results);
+  benchProducerConsumer(options, results);
+  benchLockPolicy(options, results);
+
+  if (!options.jsonPath.empty()){
+    if (!report::writeJson(options.jsonPath, options.label, results)){
+      std::fprintf(stderr, "Error: can not write %s\n", options.jsonPath.c_str());
+      return EXIT_FAILURE;
+    }
+  }
+  return EXIT_SUCCESS;
+}
+
+
+
+static void benchMemory(const Options& options)
+{
+  //Память, запрошенная у системы при построении списка, - до остальных
+  //сценариев: пул элементов ещё пуст
+  static constexpr size_t ELEMENTS = size_t(1) << 20;
+  if (!selected(options, "memory")){
+    return;
+  }
+  auto measure = [](auto& queue){
+    const size_t bytesBefore = allocation_counter::bytes();
+    for (size_t i=0; i<ELEMENTS; ++i){
+      queue.pushBack(static_cast<int>(i));
+    }
+    return static_cast<double>(allocation_counter::bytes() - bytesBefore) / ELEMENTS;
+  };
+  {
+    FineGrainedQueue<int> queue;
+    report::printMemory("FineGrainedQueue<int>", measure(queue));
+  }
+  {
+    UnrolledQueue<int> queue;
+    report::printMemory("UnrolledQueue<int>", measure(queue));
+  }
+}
+
+
+
+static void benchPush(const Options& options, std::vector<BenchResult>& results)
+{
+  for (const size_t threads : threadCounts(options)){
+    for (const bool reserved : {false, true}){
+      ScenarioParams params;
+      params.threads = threads;
+
+      params.name = reserved ? "pushBack(reserved)" : "pushBack";
+      if (selected(options, params.name)){
+        FineGrainedQueue<int> queue;
+        if (reserved){
+          queue.reserve(1 << 20);
+        }
+        results.push_back(runThreads(params, options.duration,
+          [&queue](size_t, Random& random){
+            queue.pushBack(static_cast<int>(random.next()));
+          }));
+        report::printResult(results.back());
+      }
+
+      params.name = reserved ? "pushFront(reserved)" : "pushFront";
+      if (selected(options, params.name)){
+        FineGrainedQueue<int> queue;
+        if (reserved){
+          queue.reserve(1 << 20);
+        }
+        results.push_back(runThreads(params, options.duration,
+          [&queue](size_t, Random& random){
+            queue.pushFront(static_cast<int>(random.next()));
+          }));
+        report::printResult(results.back());
+      }
+    }
+
+    //Flat combining против захвата mutex конца списка каждым потоком (pushBack)
+    ScenarioParams params;
+    params.threads = threads;
+    params.name = "pushBack(combining)";
+    if (selected(options, params.name)){
+      FineGrainedQueue<int> queue;
+      queue.setPushMode(FineGrainedQueue<int>::PushMode::COMBINING);
+      results.push_back(runThreads(params, options.duration,
+        [&queue](size_t, Random& random){
+          queue.pushBack(static_cast<int>(random.next()));
+        }));
+      report::printResult(results.back());
+    }
+
+    //Затраты гистограмм задержек списка - сравнение с pushBack
+    params.name = "pushBack(latency stats)";
+    if (selected(options, params.name)){
+      FineGrainedQueue<int> queue;
+      queue.setLatencyStats(true);
+      results.push_back(runThreads(params, options.duration,
+        [&queue](size_t, Random& random){
+          queue.pushBack(static_cast<int>(random.next()));
+        }));
+      report::printResult(results.back());
+    }
+
+    //Одна операция - пакет из BULK_SIZE элементов
+    static constexpr size_t BULK_SIZE = 1024;
+    params.name = "pushBackBulk(" + std::to_string(BULK_SIZE) + ")";
+    if (selected(options, params.name)){
+      FineGrainedQueue<int> queue;
+      std::vector<std::vector<int>> batches(threads, std::vector<int>(BULK_SIZE));
+      results.push_back(runThreads(params, options.duration,
+        [&queue, &batches](size_t threadIndex, Random& random){
+          std::vector<int>& batch = batches[threadIndex];
+          for (auto& value : batch){
+            value = static_cast<int>(random.next());
+          }
+          queue.pushBackBulk(batch);
+        }));
+      report::printResult(results.back());
+    }
+  }
+}
+
+
+
+static void benchMixed(const Options& options, std::vector<BenchResult>& results)
+{
+  const Distribution distributions[] = {
+    Distribution::FRONT, Distribution::BACK, Distribution::UNIFORM
+  };
+  for (const size_t length : options.lengths){
+    for (const double readRatio : options.readRatios){
+      for (const Distribution distribution : distributions){
+        for (const size_t threads : threadCounts(options)){
+          ScenarioParams params;
+          params.name = "getValue/insertIntoMiddle";
+          params.threads = threads;
+          params.length = length;
+          params.readRatio = readRatio;
+          params.distribution = toString(distribution);
+          if (!selected(options, params.name)){
+            continue;
+          }
+
+          FineGrainedQueue<int> queue(options.index);
+          queue.setTraversalMode(options.traversal);
+          for (size_t i=0; i<length; ++i){
+            queue.pushBack(static_cast<int>(i));
+          }
+          results.push_back(runThreads(params, options.duration,
+            [&queue, readRatio, distribution](size_t, Random& random){
+              const size_t size = queue.getSize();
+              if (random.unit() < readRatio){
+                //Позиция могла выйти за конец списка, пока другой поток
+                //вставлял и извлекал элемент
+                try{
+                  queue.getValue(readPosition(distribution, size, random));
+                }
+                catch (const std::out_of_range&){
+                }
+              }
+              //Запись: вставка и извлечение из начала - длина списка
+              //остаётся равной исходной
+              else{
+                queue.insertIntoMiddle(static_cast<int>(random.next()),
+                                       insertPosition(distribution, size, random));
+                queue.tryPopFront();
+              }
+            }));
+          report::printResult(results.back());
+        }
+      }
+    }
+  }
+}
+
+
+
+static void benchPeek(const Options& options, std::vector<BenchResult>& results)
+{
+  //Чтение первого / последнего элемента без блокировок против getValue().
+  //При нескольких потоках первый добавляет в конец и извлекает из начала -
+  //длина списка не меньше исходной, остальные читают первый или последний элемент
+  for (const size_t length : options.lengths){
+    for (const size_t threads : threadCounts(options)){
+      for (const bool locked : {false, true}){
+        ScenarioParams params;
+        params.name = locked ? "peek(getValue):front/back" : "peekFront/peekBack";
+        params.threads = threads;
+        params.length = length;
+        params.readRatio = threads > 1 ? 1.0 - 1.0 / threads : 1.0;
+        if (!selected(options, params.name)){
+          continue;
+        }
+
+        FineGrainedQueue<int> queue(options.index);
+        queue.setTraversalMode(options.traversal);
+        for (size_t i=0; i<length; ++i){
+          queue.pushBack(static_cast<int>(i));
+        }
+        results.push_back(runThreads(params, options.duration,
+          [&queue, length, locked, threads](size_t threadIndex, Random& random){
+            if (threadIndex == 0 && threads > 1){
+              queue.pushBack(static_cast<int>(random.next()));
+              queue.tryPopFront();
+            }
+            else if (locked){
+              queue.getValue(random.next() % 2 == 0 ? 0 : length - 1);
+            }
+            else if (random.next() % 2 == 0){
+              queue.tryPeekFront();
+            }
+            else{
+              queue.tryPeekBack();
+            }
+          }));
+        report::printResult(results.back());
+      }
+    }
+  }
+}
+
+
+
+static void benchRemove(const Options& options, std::vector<BenchResult>& results)
+{
+  //Одна операция - вставка в случайную позицию и удаление из случайной
+  //позиции: длина списка остаётся равной исходной
+  for (const size_t length : options.lengths){
+    for (const size_t threads : threadCounts(options)){
+      ScenarioParams params;
+      params.name = "insertIntoMiddle/erase";
+      params.threads = threads;
+      params.length = length;
+      params.distribution = toString(Distribution::UNIFORM);
+      if (!selected(options, params.name)){
+        continue;
+      }
+
+      FineGrainedQueue<int> queue(options.index);
+      queue.setTraversalMode(options.traversal);
+      for (size_t i=0; i<length; ++i){
+        queue.pushBack(static_cast<int>(i));
+      }
+      results.push_back(runThreads(params, options.duration,
+        [&queue](size_t, Random& random){
+          const size_t size = queue.getSize();
+          queue.insertIntoMiddle(static_cast<int>(random.next()),
+                                 insertPosition(Distribution::UNIFORM, size, random));
+          //Позиция могла выйти за конец списка, пока другой поток удалял элемент
+          try{
+            queue.erase(readPosition(Distribution::UNIFORM, size, random));
+          }
+          catch (const std::out_of_range&){
+          }
+        }));
+      report::printResult(results.back());
+    }
+  }
+}
+
+
+
+static void benchRebalance(const Options& options, std::vector<BenchResult>& results)
+{
+  //Два списка заданной длины; одна операция переносит половину одного
+  //списка в другой (направление чередуется): splitAt и appendAll против
+  //переноса по одному элементу
+  for (const bool splice : {true, false}){
+    for (const size_t length : options.lengths){
+      for (const size_t threads : threadCounts(options)){
+        ScenarioParams params;
+        params.name = splice ? "rebalance:splitAt/appendAll" :
+                               "rebalance(manual):tryPopFront/pushBack";
+        params.threads = threads;
+        params.length = length;
+        if (!selected(options, params.name)){
+          continue;
+        }
+
+        FineGrainedQueue<int> queues[2] = {FineGrainedQueue<int>(options.index),
+                                           FineGrainedQueue<int>(options.index)};
+        for (auto& queue : queues){
+          for (size_t i=0; i<length; ++i){
+            queue.pushBack(static_cast<int>(i));
+          }
+        }
+        std::atomic<size_t> operation(0);
+        results.push_back(runThreads(params, options.duration,
+          [&queues, &operation, splice](size_t, Random&){
+            const size_t direction = operation.fetch_add(1, std::memory_order_relaxed) % 2;
+            FineGrainedQueue<int>& from = queues[direction];
+            FineGrainedQueue<int>& to = queues[1 - direction];
+            const size_t count = from.getSize() / 2;
+            if (splice){
+              //Переносится начало списка: хвост отделяется и возвращается
+              FineGrainedQueue<int> tail = from.splitAt(count);
+              to.appendAll(std::move(from));
+              from.appendAll(std::move(tail));
+              return;
+            }
+            for (size_t i=0; i<count; ++i){
+              if (std::optional<int> value = from.tryPopFront()){
+                to.pushBack(*value);
+              }
+            }
+          }));
+        report::printResult(results.back());
+      }
+    }
+  }
+}
+
+
+
+static void benchScan(const Options& options, std::vector<BenchResult>& results)
+{
+  using Queue = FineGrainedQueue<int>;
+  for (const size_t length : options.lengths){
+    for (const auto mode : {Queue::ScanMode::LOCK_COUPLING, Queue::ScanMode::WEAK}){
+      for (const size_t threads : threadCounts(options)){
+        //Одна операция - полный обход списка; первый поток одновременно
+        //добавляет элемент в конец и извлекает из начала
+        ScenarioParams params;
+        params.name = mode == Queue::ScanMode::WEAK ? "forEach(weak)" : "forEach";
+        params.threads = threads;
+        params.length = length;
+        params.readRatio = threads > 1 ? 1.0 - 1.0 / threads : 1.0;
+        if (!selected(options, params.name)){
+          continue;
+        }
+
+        Queue queue(options.index);
+        for (size_t i=0; i<length; ++i){
+          queue.pushBack(static_cast<int>(i));
+        }
+        results.push_back(runThreads(params, options.duration,
+          [&queue, mode, threads](size_t threadIndex, Random& random){
+            if (threadIndex == 0 && threads > 1){
+              queue.pushBack(static_cast<int>(random.next()));
+              queue.tryPopFront();
+              return;
+            }
+            long sum = 0;
+            queue.forEach([&sum](const int& value){ sum += value; }, mode);
+            asm volatile("" : : "r"(sum));
+          }));
+        report::printResult(results.back());
+      }
+    }
+  }
+
+  //Сумма в несколько потоков ThreadPool: один поток вызывает
+  //parallelReduce, второй (если есть) добавляет в конец и извлекает из начала
+  for (const size_t length : options.lengths){
+    for (const size_t threads : threadCounts(options)){
+      if (threads > 2){
+        break;
+      }
+      ScenarioParams params;
+      params.name = "parallelReduce(sum)";
+      params.threads = threads;
+      params.length = length;
+      params.readRatio = 1.0 / threads;
+      if (!selected(options, params.name)){
+        continue;
+      }
+
+      Queue queue(options.index);
+      for (size_t i=0; i<length; ++i){
+        queue.pushBack(static_cast<int>(i));
+      }
+      results.push_back(runThreads(params, options.duration,
+        [&queue](size_t threadIndex, Random& random){
+          if (threadIndex == 1){
+            queue.pushBack(static_cast<int>(random.next()));
+            queue.tryPopFront();
+            return;
+          }
+          const long sum = queue.parallelReduce(0L,
+            [](long result, const int& value){ return result + value; },
+            std::plus<long>());
+          asm volatile("" : : "r"(sum));
+        }));
+      report::printResult(results.back());
+    }
+  }
+}
+
+
+
+static void benchSorted(const Options& options, std::vector<BenchResult>& results)
+{
+  //Упорядоченная вставка: FineGrainedSortedList против поиска места
+  //через getValue и insertIntoMiddle в FineGrainedQueue. Значения -
+  //из диапазона [0, 2*length), запись - вставка или удаление поровну,
+  //длина остаётся около исходной
+  for (const size_t length : options.lengths){
+    const size_t range = 2 * length;
+    for (const double readRatio : options.readRatios){
+      for (const size_t threads : threadCounts(options)){
+        ScenarioParams params;
+        params.name = "sorted:contains/insert/remove";
+        params.threads = threads;
+        params.length = length;
+        params.readRatio = readRatio;
+        params.distribution = toString(Distribution::UNIFORM);
+        if (!selected(options, params.name)){
+          continue;
+        }
+
+        FineGrainedSortedList<int> list;
+        for (size_t i=0; i<length; ++i){
+          list.insert(static_cast<int>(2 * i));
+        }
+        results.push_back(runThreads(params, options.duration,
+          [&list, readRatio, range](size_t, Random& random){
+            const int value = static_cast<int>(random.next() % range);
+            if (random.unit() < readRatio){
+              list.contains(value);
+            }
+            else if (random.next() % 2){
+              list.insert(value);
+            }
+            else{
+              list.remove(value);
+            }
+          }));
+        report::printResult(results.back());
+      }
+    }
+  }
+
+  //Вставка по месту вручную: два прохода, место может измениться между ними
+  for (const size_t length : options.lengths){
+    for (const size_t threads : threadCounts(options)){
+      ScenarioParams params;
+      params.name = "sorted(manual):getValue+insertIntoMiddle";
+      params.threads = threads;
+      params.length = length;
+      params.distribution = toString(Distribution::UNIFORM);
+      if (!selected(options, params.name)){
+        continue;
+      }
+
+      FineGrainedQueue<int> queue;
+      for (size_t i=0; i<length; ++i){
+        queue.pushBack(static_cast<int>(2 * i));
+      }
+      results.push_back(runThreads(params, options.duration,
+        [&queue, length](size_t, Random& random){
+          //Место ищется двоичным поиском по getValue; одна операция -
+          //вставка и удаление, длина не меняется
+          const int value = static_cast<int>(random.next() % (2 * length));
+          size_t low = 0;
+          size_t high = queue.getSize();
+          try{
+            while (low < high){
+              const size_t middle = (low + high) / 2;
+              if (queue.getValue(middle) < value){
+                low = middle + 1;
+              }
+              else{
+                high = middle;
+              }
+            }
+          }
+          catch (const std::out_of_range&){
+          }
+          queue.insertIntoMiddle(value, low);
+          try{
+            queue.erase(static_cast<size_t>(random.next() % queue.getSize()));
+          }
+          catch (const std::out_of_range&){
+          }
+        }));
+      report::printResult(results.back());
+    }
+  }
+}
+
+
+
+static void benchUnrolled(const Options& options, std::vector<BenchResult>& results)
+{
+  //Те же сценарии для развёрнутого списка: блок - 16 значений int
+  for (const size_t threads : threadCounts(options)){
+    ScenarioParams params;
+    params.name = "unrolled:pushBack";
+    params.threads = threads;
+    if (selected(options, params.name)){
+      UnrolledQueue<int> queue;
+      results.push_back(runThreads(params, options.duration,
+        [&queue](size_t, Random& random){
+          queue.pushBack(static_cast<int>(random.next()));
+        }));
+      report::printResult(results.back());
+    }
+  }
+
+  for (const size_t length : options.lengths){
+    for (const double readRatio : options.readRatios){
+      for (const size_t threads : threadCounts(options)){
+        ScenarioParams params;
+        params.name = "unrolled:getValue/insertIntoMiddle";
+        params.threads = threads;
+        params.length = length;
+        params.readRatio = readRatio;
+        params.distribution = toString(Distribution::UNIFORM);
+        if (!selected(options, params.name)){
+          continue;
+        }
+        UnrolledQueue<int> queue;
+        for (size_t i=0; i<length; ++i){
+          queue.pushBack(static_cast<int>(i));
+        }
+        results.push_back(runThreads(params, options.duration,
+          [&queue, readRatio](size_t, Random& random){
+            const size_t size = queue.getSize();
+            if (random.unit() < readRatio){
+              try{
+                queue.getValue(readPosition(Distribution::UNIFORM, size, random));
+              }
+              catch (const std::out_of_range&){
+              }
+            }
+            else{
+              queue.insertIntoMiddle(static_cast<int>(random.next()),
+                                     insertPosition(Distribution::UNIFORM, size, random));
+              queue.tryPopFront();
+            }
+          }));
+        report::printResult(results.back());
+      }
+    }
+  }
+
+  for (const size_t length : options.lengths){
+    for (const size_t threads : threadCounts(options)){
+      ScenarioParams params;
+      params.name = "unrolled:forEach";
+      params.threads = threads;
+      params.length = length;
+      params.readRatio = threads > 1 ? 1.0 - 1.0 / threads : 1.0;
+      if (!selected(options, params.name)){
+        continue;
+      }
+      UnrolledQueue<int> queue;
+      for (size_t i=0; i<length; ++i){
+        queue.pushBack(static_cast<int>(i));
+      }
+      results.push_back(runThreads(params, options.duration,
+        [&queue, threads](size_t threadIndex, Random& random){
+          if (threadIndex == 0 && threads > 1){
+            queue.pushBack(static_cast<int>(random.next()));
+            queue.tryPopFront();
+            return;
+          }
+          long sum = 0;
+          queue.forEach([&sum](const int& value){ sum += value; });
+          asm volatile("" : : "r"(sum));
+        }));
+      report::printResult(results.back());
+    }
+  }
+}
+
+
+
+static void benchProducerConsumer(const Options& options, std::vector<BenchResult>& results)
+{
+  //Производители и потребители: один список, полоса на поток, кольцевой буфер.
+  //Чётные потоки добавляют, нечётные извлекают
+  for (const size_t threads : threadCounts(options)){
+    ScenarioParams params;
+    params.threads = threads;
+    params.readRatio = 0.5;
+
+    params.name = "pushBack/tryPopFront";
+    if (selected(options, params.name)){
+      FineGrainedQueue<int> queue;
+      results.push_back(runThreads(params, options.duration,
+        [&queue](size_t threadIndex, Random& random){
+          if (threadIndex % 2 == 0){
+            queue.pushBack(static_cast<int>(random.next()));
+          }
+          else{
+            queue.tryPopFront();
+          }
+        }));
+      report::printResult(results.back());
+    }
+
+    //Тот же список с добавлением через flat combining
+    params.name = "pushBack/tryPopFront(combining)";
+    if (selected(options, params.name)){
+      FineGrainedQueue<int> queue;
+      queue.setPushMode(FineGrainedQueue<int>::PushMode::COMBINING);
+      results.push_back(runThreads(params, options.duration,
+        [&queue](size_t threadIndex, Random& random){
+          if (threadIndex % 2 == 0){
+            queue.pushBack(static_cast<int>(random.next()));
+          }
+          else{
+            queue.tryPopFront();
+          }
+        }));
+      report::printResult(results.back());
+    }
+
+    //Тот же список с распределённым счётчиком размера
+    params.name = "pushBack/tryPopFront(sharded size)";
+    if (selected(options, params.name)){
+      FineGrainedQueue<int> queue(FineGrainedQueue<int>::SizeMode::SHARDED);
+      results.push_back(runThreads(params, options.duration,
+        [&queue](size_t threadIndex, Random& random){
+          if (threadIndex % 2 == 0){
+            queue.pushBack(static_cast<int>(random.next()));
+          }
+          else{
+            queue.tryPopFront();
+          }
+        }));
+      report::printResult(results.back());
+    }
+
+    params.name = "sharded:pushBack/tryPopFront";
+    if (selected(options, params.name)){
+      ShardedQueue<int> queue(threads);
+      results.push_back(runThreads(params, options.duration,
+        [&queue](size_t threadIndex, Random& random){
+          if (threadIndex % 2 == 0){
+            queue.pushBack(static_cast<int>(random.next()));
+          }
+          else{
+            queue.tryPopFront();
+          }
+        }));
+      report::printResult(results.back());
+    }
+
+    //Заполненный буфер не ждёт потребителей: неудачная вставка - тоже операция
+    params.name = "ring:tryPushBack/tryPopFront";
+    if (selected(options, params.name)){
+      RingQueue<int> queue(1 << 16);
+      results.push_back(runThreads(params, options.duration,
+        [&queue](size_t threadIndex, Random& random){
+          if (threadIndex % 2 == 0){
+            queue.tryPushBack(static_cast<int>(random.next()));
+          }
+          else{
+            queue.tryPopFront();
+          }
+        }));
+      report::printResult(results.back());
+    }
+
+    //Список с ёмкостью кольцевого буфера: неудачная вставка - тоже операция.
+    //Блокирующий pushBack не подходит - после остановки потребителей
+    //производители ждали бы места бесконечно
+    params.name = "bounded:tryPushBack/tryPopFront";
+    if (selected(options, params.name)){
+      FineGrainedQueue<int> queue;
+      queue.setCapacity(1 << 16);
+      results.push_back(runThreads(params, options.duration,
+        [&queue](size_t threadIndex, Random& random){
+          if (threadIndex % 2 == 0){
+            queue.tryPushBack(static_cast<int>(random.next()));
+          }
+          else{
+            queue.tryPopFront();
+          }
+        }));
+      report::printResult(results.back());
+    }
+
+    params.name = "sharded:pushBack";
+    params.readRatio = 0;
+    if (selected(options, params.name)){
+      ShardedQueue<int> queue(threads);
+      results.push_back(runThreads(params, options.duration,
+        [&queue](size_t, Random& random){
+          queue.pushBack(static_cast<int>(random.next()));
+        }));
+      report::printResult(results.back());
+    }
+  }
+}
+
+
+
+template<typename Queue>
+static void benchPolicy(const Options& options, std::vector<BenchResult>& results,
+                        const std::string& policy, bool concurrent)
+{
+  static constexpr size_t LENGTH = 1000;
+  for (const size_t threads : threadCounts(options)){
+    //Политика без блокировок - только в одном потоке
+    if (!concurrent && threads > 1){
+      break;
+    }
+    ScenarioParams params;
+    params.threads = threads;
+
+    params.name = policy + ":pushBack/tryPopFront";
+    params.readRatio = 0.5;
+    if (selected(options, params.name)){
+      Queue queue;
+      results.push_back(runThreads(params, options.duration,
+        [&queue, threads](size_t threadIndex, Random& random){
+          if (threadIndex % 2 == 0){
+            queue.pushBack(static_cast<int>(random.next()));
+          }
+          if (threadIndex % 2 == 1 || threads == 1){
+            queue.tryPopFront();
+          }
+        }));
+      report::printResult(results.back());
+    }
+
+    params.name = policy + ":getValue";
+    params.length = LENGTH;
+    params.readRatio = 1.0;
+    params.distribution = toString(Distribution::UNIFORM);
+    if (selected(options, params.name)){
+      Queue queue;
+      for (size_t i=0; i<LENGTH; ++i){
+        queue.pushBack(static_cast<int>(i));
+      }
+      results.push_back(runThreads(params, options.duration,
+        [&queue](size_t, Random& random){
+          const int value = queue.getValue(random.next() % LENGTH);
+          asm volatile("" : : "r"(value));
+        }));
+      report::printResult(results.back());
+    }
+  }
+}
+
+
+
+static void benchLockPolicy(const Options& options, std::vector<BenchResult>& results)
+{
+  //Политики блокировок списка: цена захватов без конкуренции (null - нижняя
+  //граница) и поведение под конкуренцией
+  using Allocator = PoolAllocator<int>;
+  benchPolicy<FineGrainedQueue<int>>(options, results, "compact", true);
+  benchPolicy<FineGrainedQueue<int, Allocator, NoLockStats, SharedMutexLocking>>(
+    options, results, "shared_mutex", true);
+  benchPolicy<FineGrainedQueue<int, Allocator, NoLockStats, SpinLocking>>(
+    options, results, "spin", true);
+  benchPolicy<FineGrainedQueue<int, Allocator, NoLockStats, NullLocking<>>>(
+    options, results, "null", false);
+}
+
+
+
+static const char* toString(Distribution distribution)
+{
+  switch (distribution){
+    case Distribution::FRONT:
+      return "front";
+    case Distribution::BACK:
+      return "back";
+    case Distribution::UNIFORM:
+      return "uniform";
+  }
+  return "-";
+}
+
+
+
+static size_t readPosition(Distribution distribution, size_t size, Random& random)
+{
+  switch (distribution){
+    case Distribution::FRONT:
+      return 0;
+    case Distribution::BACK:
+      return size - 1;
+    case Distribution::UNIFORM:
+      return random.below(size);
+  }
+  return 0;
+}
+
+
+
+static size_t insertPosition(Distribution distribution, size_t size, Random& random)
+{
+  switch (distribution){
+    case Distribution::FRONT:
+      return 0;
+    case Distribution::BACK:
+      return size;
+    case Distribution::UNIFORM:
+      return random.below(size + 1);
+  }
+  return 0;
+}
+
+
+
+static std::vector<size_t> threadCounts(const Options& options)
+{
+  std::vector<size_t> counts;
+  for (size_t threads=1; threads<options.maxThreads; threads*=2){
+    counts.push_back(threads);
+  }
+  counts.push_back(options.maxThreads);
+  return counts;
+}
+
+
+
+static bool selected(const Options& options, const std::string& name)
+{
+  return options.filter.empty() || name.find(options.filter) != std::string::npos;
+}
+
+
+
+static std::vector<std::string> split(const char* text)
+{
+  std::vector<std::string> parts;
+  std::string part;
+  for (const char* c=text; ; ++c){
+    if (*c == ',' || *c == '\0'){
+      if (!part.empty()){
+        parts.push_back(part);
+      }
+      part.clear();
+      if (*c == '\0'){
+        break;
+      }
+    }
+    else{
+      part += *c;
+    }
+  }
+  return parts;
+}
+
+
+
+static bool parseOptions(int argc, char* argv[], Options& options)
+{
+  for (int i=1; i<argc; ++i){
+    const char* option = argv[i];
+    if (i + 1 >= argc){
+      return false;
+    }
+    const char* value = argv[++i];
+    if (std::strcmp(option, "--threads") == 0){
+      options.maxThreads = std::strtoull(value, nullptr, 10);
+      if (options.maxThreads == 0){
+        return false;
+      }
+    }
+    else if (std::strcmp(option, "--sizes") == 0){
+      options.lengths.clear();
+      for (const auto& part : split(value)){
+        options.lengths.push_back(std::strtoull(part.c_str(), nullptr, 10));
+      }
+    }
+    else if (std::strcmp(option, "--reads") == 0){
+      options.readRatios.clear();
+      for (const auto& part : split(value)){
+        options.readRatios.push_back(std::strtod(part.c_str(), nullptr));
+      }
+    }
+    else if (std::strcmp(option, "--duration") == 0){
+      options.duration = std::chrono::milliseconds(std::strtoull(value, nullptr, 10));
+    }
+    else if (std::strcmp(option, "--json") == 0){
+      options.jsonPath = value;
+    }
+    else if (std::strcmp(option, "--label") == 0){
+      options.label = value;
+    }
+    else if (std::strcmp(option, "--filter") == 0){
+      options.filter = value;
+    }
+    else if (std::strcmp(option, "--traversal") == 0){
+      if (std::strcmp(value, "coupling") == 0){
+        options.traversal = FineGrainedQueue<int>::TraversalMode::LOCK_COUPLING;
+      }
+      else if (std::strcmp(value, "optimistic") == 0){
+        options.traversal = FineGrainedQueue<int>::TraversalMode::OPTIMISTIC;
+      }
+      else{
+        return false;
+      }
+    }
+    else if (std::strcmp(option, "--index") == 0){
+      if (std::strcmp(value, "none") == 0){
+        options.index = FineGrainedQueue<int>::IndexMode::NONE;
+      }
+      else if (std::strcmp(value, "skiplist") == 0){
+        options.index = FineGrainedQueue<int>::IndexMode::SKIP_LIST;
+      }
+      else{
+        return false;
+      }
+    }
+    else{
+      return false;
+    }
+  }
+  return true;
+}
+
+
+
+static void printUsage(const char* program)
+{
+  std::fprintf(stderr,
+    "Usage: %s [options]\n"
+    "  --threads N       maximum number of threads (1, 2, 4, ... N)\n"
+    "  --sizes a,b,...   list lengths for mixed scenarios (10 ... 10000000)\n"
+    "  --reads a,b,...   read ratios for mixed scenarios (0 ... 1)\n"
+    "  --duration MS     duration of every measurement\n"
+    "  --json PATH       write results to a JSON file\n"
+    "  --label TEXT      label of the run in the JSON file\n"
+    "  --filter TEXT     run only scenarios containing TEXT\n"
+    "  --traversal MODE  coupling | optimistic list traversal in mixed scenarios\n"
+    "  --index MODE      none | skiplist positional index in mixed scenarios\n",
+    program);
+}
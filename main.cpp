@@ -1,11 +1,41 @@
 #include <iostream>
 
 #include "FineGrainedQueue/FineGrainedQueue.h"
+#include "FineGrainedQueue/NodePool/NodePool.h"
+#include "FineGrainedQueue/EpochReclaimer/EpochReclaimer.h"
+#include "FineGrainedQueue/ThreadPool/ThreadPool.h"
+#include "FineGrainedQueue/ThreadNumber/ThreadNumber.h"
+#include "FineGrainedQueue/CompactSharedMutex/CompactSharedMutex.h"
+#include "FineGrainedQueue/LockPolicy/LockPolicy.h"
+#include "FineGrainedQueue/LockStats/LockStats.h"
+#include "FineGrainedQueue/SizeCounter/SizeCounter.h"
+#include "FineGrainedQueue/SkipListIndex/SkipListIndex.h"
+#include "FineGrainedQueue/FlatCombiner/FlatCombiner.h"
+#include "FineGrainedQueue/LatencyStats/LatencyStats.h"
+#include "FineGrainedQueue/UnrolledQueue/UnrolledQueue.h"
+#include "FineGrainedQueue/ShardedQueue/ShardedQueue.h"
+#include "FineGrainedQueue/RingQueue/RingQueue.h"
+#include "FineGrainedQueue/FineGrainedSortedList/FineGrainedSortedList.h"
 
 int main()
 {
   try{
+    node_pool::test();
+    epoch_reclaimer::test();
+    thread_pool::test();
+    thread_number::test();
+    compact_shared_mutex::test();
+    lock_policy::test();
+    lock_stats::test();
+    size_counter::test();
+    skip_list_index::test();
+    flat_combiner::test();
+    latency_stats::test();
     fine_grained_queue::test();
+    unrolled_queue::test();
+    sharded_queue::test();
+    ring_queue::test();
+    fine_grained_sorted_list::test();
   }
   catch (std::exception& error) {
     std::cerr << error.what() << std::endl;